@@ -0,0 +1,543 @@
+// Micro-benchmarks of the CPU hot paths of the framework and the demo. They do not need OpenGL, so they also run
+// on build machines without a GPU. Run the run_framework_benchmarks target (or framework_benchmarks with
+// --reporter xml::out=<file>) to get the results in a machine-readable form.
+#include "bezier.h"
+#include "ocean.h"
+#include "particles.h"
+#include "sph.h"
+#include "water.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/fft.h>
+#include <framework/image.h>
+#include <framework/job_system.h>
+#include <framework/json.h>
+#include <framework/mesh.h>
+#include <framework/radix_sort.h>
+#include <framework/spatial_hash.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const std::filesystem::path resourceRoot { RESOURCE_ROOT "resources/" };
+
+TEST_CASE("loadMesh", "[mesh]")
+{
+    BENCHMARK("Beach.obj")
+    {
+        return loadMesh(resourceRoot / "Beach.obj");
+    };
+    BENCHMARK("water_circle.obj")
+    {
+        return loadMesh(resourceRoot / "water_circle.obj");
+    };
+}
+
+TEST_CASE("meshComputeTangents", "[mesh]")
+{
+    const std::vector<Mesh> meshes = loadMesh(resourceRoot / "water_circle.obj");
+    REQUIRE(!meshes.empty());
+    BENCHMARK_ADVANCED("water_circle.obj")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<Mesh> copies(static_cast<size_t>(meter.runs()), meshes[0]);
+        meter.measure([&](int i) { meshComputeTangents(copies[static_cast<size_t>(i)]); });
+    };
+}
+
+TEST_CASE("mergeMeshes", "[mesh]")
+{
+    std::vector<Mesh> meshes = loadMesh(resourceRoot / "Beach.obj");
+    const std::vector<Mesh> water = loadMesh(resourceRoot / "water_circle.obj");
+    meshes.insert(std::end(meshes), std::begin(water), std::end(water));
+    BENCHMARK("Beach.obj + water_circle.obj")
+    {
+        return mergeMeshes(meshes);
+    };
+}
+
+TEST_CASE("writeJsonString", "[json]")
+{
+    std::ostringstream stream;
+    writeJsonString(stream, std::string_view("a\"b\\c\n\x01\x1f\xc3\xa9", 10));
+    CHECK(stream.str() == "\"a\\\"b\\\\c\\n\\u0001\\u001f\xc3\xa9\"");
+}
+
+TEST_CASE("Image", "[image]")
+{
+    BENCHMARK("load checkerboard.png")
+    {
+        return Image(resourceRoot / "checkerboard.png");
+    };
+    BENCHMARK("load ground.jpg")
+    {
+        return Image(resourceRoot / "ground/ground.jpg");
+    };
+
+    const Image image { resourceRoot / "ground/ground.jpg" };
+    REQUIRE(image.channels == 3);
+    BENCHMARK("get_pixel sweep ground.jpg")
+    {
+        glm::vec3 sum { 0.0f };
+        for (int i = 0; i < image.width * image.height; ++i)
+            sum += image.get_pixel<3>(i);
+        return sum;
+    };
+}
+
+TEST_CASE("CubicBezier", "[bezier]")
+{
+    const std::vector<CubicBezier> path {
+        { { -1, 0, 2 }, { 0, 1, 2 }, { 1, 1, 2 }, { 2, 0, 2 } },
+        { { 2, 0, 2 }, { 3, -1, 1 }, { 2, -1, 0 }, { -1, -1, -1 } },
+        { { -1, -1, -1 }, { -2, 0, 0 }, { -3, 1, 1 }, { -1, 0, 2 } }
+    };
+    BENCHMARK("evaluate + derivative x10000")
+    {
+        glm::vec3 sum { 0.0f };
+        for (int i = 0; i < 10000; ++i) {
+            const CubicBezier& curve = path[static_cast<size_t>(i) % path.size()];
+            const float t = static_cast<float>(i) / 10000.0f;
+            sum += curve.evaluate(t) + curve.derivative(t);
+        }
+        return sum;
+    };
+    BENCHMARK("sampleBezierPath 50 samples per curve")
+    {
+        return sampleBezierPath(path, 50);
+    };
+}
+
+// Query points of the water surface tests: a 64x64 grid over the water plane.
+static void makeWaterGrid(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z)
+{
+    for (int j = 0; j < 64; ++j) {
+        for (int i = 0; i < 64; ++i) {
+            x.push_back(float(i) * 0.25f - 8.0f);
+            y.push_back(0.0f);
+            z.push_back(float(j) * 0.25f - 8.0f);
+        }
+    }
+}
+
+TEST_CASE("WaterSurface accuracy", "[water]")
+{
+    const glm::mat4 waterModelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.2f, 0.0f)), glm::vec3(8.0f));
+    const WaveParameters waves {};
+    const WaterSurface water { waterModelMatrix, waves };
+    // At a late time, so that the sines are evaluated far from zero.
+    const float time = 1000.0f;
+
+    std::vector<float> x, y, z;
+    makeWaterGrid(x, y, z);
+    const size_t numPoints = x.size();
+    std::vector<float> height(numPoints), normalX(numPoints), normalY(numPoints), normalZ(numPoints), velocity(numPoints);
+    const WaterSurfaceSamples samples { height, normalX, normalY, normalZ, velocity };
+
+    // Compare with the sum of sines of water_vert.glsl in double precision; a central difference in time gives the
+    // velocity.
+    const auto referenceHeight = [&](size_t point, double t) {
+        const double modelX = double(x[point]) / 8.0, modelZ = double(z[point]) / 8.0;
+        double sum = 0.0, angle = 0.1, amplitude = double(waves.amplitude), omega = double(waves.omega);
+        for (int wave = 0; wave < waves.numWaves; ++wave) {
+            sum += amplitude * std::sin((std::cos(angle) * modelX + std::sin(angle) * modelZ) * omega + t * double(waves.phi));
+            angle += 0.73 * 3.14159;
+            amplitude *= 0.75;
+            omega *= 1.5;
+        }
+        return sum * 8.0 - 0.2;
+    };
+    water.evaluate(time, x, y, z, samples);
+    double maxHeightError = 0.0, maxVelocityError = 0.0;
+    for (size_t point = 0; point < numPoints; ++point) {
+        maxHeightError = std::max(maxHeightError, std::abs(double(height[point]) - referenceHeight(point, double(time))));
+        const double referenceVelocity = (referenceHeight(point, double(time) + 1e-4) - referenceHeight(point, double(time) - 1e-4)) / 2e-4;
+        maxVelocityError = std::max(maxVelocityError, std::abs(double(velocity[point]) - referenceVelocity));
+        CHECK(std::abs(normalX[point] * normalX[point] + normalY[point] * normalY[point] + normalZ[point] * normalZ[point] - 1.0f) < 1e-5f);
+        CHECK(water.height(glm::vec3(x[point], y[point], z[point]), time) == height[point]);
+    }
+    // Arguments around 1000 are only accurate to about 1e-4 in single precision.
+    CHECK(maxHeightError < 1e-4 * 8.0 * 0.032);
+    CHECK(maxVelocityError < 1e-3);
+}
+
+TEST_CASE("WaterSurface", "[water]")
+{
+    const glm::mat4 waterModelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.2f, 0.0f)), glm::vec3(8.0f));
+    const WaterSurface water { waterModelMatrix };
+    const float time = 1000.0f;
+
+    std::vector<float> x, y, z;
+    makeWaterGrid(x, y, z);
+    const size_t numPoints = x.size();
+    std::vector<float> height(numPoints), normalX(numPoints), normalY(numPoints), normalZ(numPoints), velocity(numPoints);
+    const WaterSurfaceSamples samples { height, normalX, normalY, normalZ, velocity };
+
+    BENCHMARK("64x64 grid, one point per call")
+    {
+        float sum = 0.0f;
+        for (size_t point = 0; point < numPoints; ++point)
+            sum += water.height(glm::vec3(x[point], y[point], z[point]), time);
+        return sum;
+    };
+    BENCHMARK("64x64 grid, height")
+    {
+        water.evaluate(time, x, y, z, { .height = height });
+        return height[0];
+    };
+    BENCHMARK("64x64 grid, height, normal and velocity")
+    {
+        water.evaluate(time, x, y, z, samples);
+        return height[0];
+    };
+}
+
+TEST_CASE("FFT ocean accuracy", "[ocean]")
+{
+    // Compare the FFT with a naive DFT in double precision.
+    {
+        const size_t n = 64;
+        const FFT fft { n };
+        std::vector<std::complex<float>> data(n);
+        Xoshiro128Plus random { 1 };
+        for (auto& value : data)
+            value = { random.nextFloat() - 0.5f, random.nextFloat() - 0.5f };
+        const std::vector<std::complex<float>> input = data;
+        fft.forward(data);
+        double maxError = 0.0;
+        for (size_t k = 0; k < n; ++k) {
+            std::complex<double> sum { 0.0 };
+            for (size_t j = 0; j < n; ++j)
+                sum += std::complex<double>(input[j]) * std::polar(1.0, -2.0 * 3.14159265358979323846 * double(j * k % n) / double(n));
+            maxError = std::max(maxError, std::abs(std::complex<double>(data[k]) - sum));
+        }
+        CHECK(maxError < 1e-4);
+        fft.inverse(data);
+        for (size_t j = 0; j < n; ++j)
+            CHECK(std::abs(data[j] / float(n) - input[j]) < 1e-5f);
+    }
+
+    // Without choppiness, sampling at texel positions returns the texels, and their root mean square is the wave
+    // height.
+    {
+        OceanSettings settings;
+        settings.resolution = 64;
+        settings.choppiness = 0.0f;
+        Ocean ocean { settings };
+        ocean.update(10.0f);
+        OceanTexels texels;
+        ocean.writeTexels(texels);
+        std::vector<float> x, z;
+        for (int row = 0; row < settings.resolution; ++row) {
+            for (int column = 0; column < settings.resolution; ++column) {
+                x.push_back(float(column) * settings.patchSize / float(settings.resolution));
+                z.push_back(float(row) * settings.patchSize / float(settings.resolution));
+            }
+        }
+        std::vector<float> height(x.size());
+        ocean.sample(x, z, { .height = height });
+        double sumSquares = 0.0;
+        for (size_t i = 0; i < height.size(); ++i) {
+            CHECK(std::abs(glm::unpackHalf4x16(texels.displacement[i]).y - height[i]) < 1e-3f * settings.waveHeight + 1e-5f);
+            sumSquares += double(height[i]) * double(height[i]);
+        }
+        const double rms = std::sqrt(sumSquares / double(height.size()));
+        CHECK(rms > 0.5 * double(settings.waveHeight));
+        CHECK(rms < 1.5 * double(settings.waveHeight));
+    }
+}
+
+TEST_CASE("FFT ocean", "[ocean]")
+{
+    JobSystem jobSystem;
+    for (const int resolution : { 128, 256, 512 }) {
+        std::string suffix = " ";
+        suffix += std::to_string(resolution);
+        const FFT fft { size_t(resolution) };
+        std::vector<std::complex<float>> grid(size_t(resolution) * size_t(resolution), std::complex<float>(1.0f, 0.0f));
+        BENCHMARK("FFT::inverse2D" + suffix)
+        {
+            fft.inverse2D(grid);
+            return grid[0];
+        };
+
+        OceanSettings settings;
+        settings.resolution = resolution;
+        Ocean ocean { settings };
+        float time = 0.0f;
+        BENCHMARK("Ocean::update" + suffix)
+        {
+            time += 0.016f;
+            ocean.update(time);
+            return time;
+        };
+        BENCHMARK("Ocean::update" + suffix + ", " + std::to_string(jobSystem.numThreads()) + " threads")
+        {
+            time += 0.016f;
+            ocean.update(time, &jobSystem);
+            return time;
+        };
+        OceanTexels texels;
+        BENCHMARK("Ocean::writeTexels" + suffix)
+        {
+            ocean.writeTexels(texels, &jobSystem);
+            return texels.displacement.size();
+        };
+    }
+}
+
+TEST_CASE("particles", "[particles]")
+{
+    for (const size_t numParticles : { size_t(500), size_t(100000), size_t(1) << 20 }) {
+        // Fill the pool with particles that live long enough to stay alive during the whole benchmark.
+        ParticleSystem particles { numParticles };
+        particles.emit(glm::vec3(0.0f), numParticles);
+        ParticleVertices vertices;
+
+        BENCHMARK("update " + std::to_string(numParticles))
+        {
+            particles.update(1e-9f);
+            return particles.size();
+        };
+        BENCHMARK("writeVertices " + std::to_string(numParticles))
+        {
+            particles.writeVertices(vertices);
+            return vertices.size();
+        };
+    }
+
+    // Half of the particles die every update, so this includes the swap-remove compaction.
+    BENCHMARK_ADVANCED("emit + update with removal 1M")(Catch::Benchmark::Chronometer meter)
+    {
+        ParticleSystem particles { size_t(1) << 20 };
+        meter.measure([&]() {
+            particles.emit(glm::vec3(0.0f), particles.capacity() - particles.size());
+            particles.update(0.6f);
+            return particles.size();
+        });
+    };
+}
+
+// Radix keys of 1M random floats.
+static std::vector<uint32_t> makeRandomRadixKeys()
+{
+    std::vector<uint32_t> randomKeys(size_t(1) << 20);
+    Xoshiro128Plus random { 1 };
+    for (uint32_t& key : randomKeys)
+        key = floatToRadixKey(random.nextFloat() * 200.0f - 100.0f);
+    return randomKeys;
+}
+
+// Particles in front of an orbiting camera (see sortViewMatrix()).
+static ParticleVertices makeSortParticles()
+{
+    ParticleSystem particles { 100000 };
+    for (int i = 0; i < 100; ++i) {
+        particles.emit(glm::vec3(0.0f), 1000);
+        particles.update(0.005f);
+    }
+    ParticleVertices vertices;
+    particles.writeVertices(vertices);
+    return vertices;
+}
+
+static glm::mat4 sortViewMatrix(float angle)
+{
+    return glm::lookAt(glm::vec3(3.0f * std::cos(angle), 1.0f, 3.0f * std::sin(angle)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+TEST_CASE("radix sort correctness", "[sort]")
+{
+    const std::vector<uint32_t> randomKeys = makeRandomRadixKeys();
+    std::vector<uint32_t> keys = randomKeys, values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = static_cast<uint32_t>(i);
+    RadixSorter sorter;
+    sorter.sort(keys, values);
+    REQUIRE(std::is_sorted(std::begin(keys), std::end(keys)));
+    REQUIRE(randomKeys[values[0]] == keys[0]);
+
+    // The first sort starts from scratch, the second one repairs the order of the first.
+    const ParticleVertices vertices = makeSortParticles();
+    ParticleDepthSorter depthSorter;
+    depthSorter.sort(vertices, sortViewMatrix(0.0f));
+    depthSorter.sort(vertices, sortViewMatrix(0.0f));
+    CHECK(depthSorter.lastSortWasIncremental());
+}
+
+TEST_CASE("radix sort", "[sort]")
+{
+    const std::vector<uint32_t> randomKeys = makeRandomRadixKeys();
+    std::vector<uint32_t> keys, values;
+    RadixSorter sorter;
+    const auto resetInput = [&]() {
+        keys = randomKeys;
+        values.resize(keys.size());
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = static_cast<uint32_t>(i);
+    };
+
+    BENCHMARK_ADVANCED("RadixSorter 1M")(Catch::Benchmark::Chronometer meter)
+    {
+        resetInput();
+        meter.measure([&]() { sorter.sort(keys, values); });
+    };
+    JobSystem jobSystem;
+    BENCHMARK_ADVANCED("RadixSorter 1M, " + std::to_string(jobSystem.numThreads()) + " threads")(Catch::Benchmark::Chronometer meter)
+    {
+        resetInput();
+        meter.measure([&]() { sorter.sort(keys, values, &jobSystem); });
+    };
+    BENCHMARK_ADVANCED("std::sort of (key, index) 1M")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<uint64_t> pairs(randomKeys.size());
+        for (size_t i = 0; i < pairs.size(); ++i)
+            pairs[i] = (uint64_t(randomKeys[i]) << 32) | i;
+        meter.measure([&]() { std::sort(std::begin(pairs), std::end(pairs)); });
+    };
+
+    // The first sort starts from scratch, the next ones repair the order of the previous frame.
+    const ParticleVertices vertices = makeSortParticles();
+    BENCHMARK_ADVANCED("ParticleDepthSorter 100k, new view")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<ParticleDepthSorter> sorters(size_t(meter.runs()));
+        meter.measure([&](int run) { return sorters[size_t(run)].sort(vertices, sortViewMatrix(0.0f)).size(); });
+    };
+    ParticleDepthSorter depthSorter;
+    depthSorter.sort(vertices, sortViewMatrix(0.0f));
+    BENCHMARK("ParticleDepthSorter 100k, same view")
+    {
+        return depthSorter.sort(vertices, sortViewMatrix(0.0f)).size();
+    };
+    // This cloud is so dense that a small rotation reorders most particles, so this usually falls back to radix sort.
+    float angle = 0.0f;
+    BENCHMARK("ParticleDepthSorter 100k, orbiting view")
+    {
+        angle += 0.001f;
+        return depthSorter.sort(vertices, sortViewMatrix(angle)).size();
+    };
+}
+
+// A block of water at rest density above the water surface: random positions with a mean spacing of half the
+// smoothing radius and no initial velocity.
+static void emitRestBlock(SPHFluid& fluid, size_t numParticles, const SPHSettings& settings)
+{
+    const float spread = 0.25f * settings.smoothingRadius * std::cbrt(static_cast<float>(numParticles));
+    fluid.emit(glm::vec3(0.0f, spread + 0.5f, 0.0f), numParticles, spread, 0.0f);
+}
+
+TEST_CASE("SPH neighbours", "[sph]")
+{
+    const glm::mat4 waterModelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.2f, 0.0f)), glm::vec3(8.0f));
+    const WaterSurface water { waterModelMatrix };
+    SPHSettings settings;
+    settings.lifetime = 1e6f;
+    for (const size_t numParticles : { size_t(10000), size_t(100000) }) {
+        SPHFluid fluid { numParticles, settings };
+        emitRestBlock(fluid, numParticles, settings);
+        fluid.update(settings.maxTimeStep, water, 0.0f);
+        // About 4/3 pi 2^3 = 33.5 particles are within the smoothing radius.
+        CHECK(fluid.averageNeighbours() > 25.0f);
+        CHECK(fluid.averageNeighbours() < 45.0f);
+    }
+}
+
+// The block of water falls onto the water surface, from 10k to 500k particles.
+TEST_CASE("SPH", "[sph]")
+{
+    const glm::mat4 waterModelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.2f, 0.0f)), glm::vec3(8.0f));
+    const WaterSurface water { waterModelMatrix };
+    SPHSettings settings;
+    settings.lifetime = 1e6f;
+    JobSystem jobSystem;
+
+    for (const size_t numParticles : { size_t(10000), size_t(50000), size_t(100000), size_t(500000) }) {
+        SPHFluid fluid { numParticles, settings };
+        emitRestBlock(fluid, numParticles, settings);
+        fluid.update(settings.maxTimeStep, water, 0.0f);
+
+        std::string suffix = " ";
+        suffix += std::to_string(numParticles / 1000);
+        suffix += 'k';
+        BENCHMARK("SPHFluid::update" + suffix)
+        {
+            fluid.update(settings.maxTimeStep, water, 0.0f);
+            return fluid.size();
+        };
+        BENCHMARK("SPHFluid::update" + suffix + ", " + std::to_string(jobSystem.numThreads()) + " threads")
+        {
+            fluid.update(settings.maxTimeStep, water, 0.0f, &jobSystem);
+            return fluid.size();
+        };
+    }
+
+    std::vector<float> x(500000), y(500000), z(500000);
+    Xoshiro128Plus random { 1 };
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = random.nextFloat() * 4.0f;
+        y[i] = random.nextFloat() * 4.0f;
+        z[i] = random.nextFloat() * 4.0f;
+    }
+    SpatialHash hash { 0.1f };
+    BENCHMARK("SpatialHash::build 500k")
+    {
+        hash.build(x, y, z);
+        return hash.order().size();
+    };
+}
+
+// Strong scaling of the job system from one thread to all hardware threads.
+TEST_CASE("JobSystem scaling", "[jobs]")
+{
+    const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threadCounts;
+    for (unsigned numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+        threadCounts.push_back(numThreads);
+    threadCounts.push_back(maxThreads);
+
+    ParticleSystem particles { size_t(1) << 20 };
+    particles.emit(glm::vec3(0.0f), particles.capacity());
+    const std::vector<Mesh> meshes = loadMesh(resourceRoot / "water_circle.obj");
+    REQUIRE(!meshes.empty());
+    std::vector<Mesh> meshCopies(64, meshes[0]);
+
+    for (const unsigned numThreads : threadCounts) {
+        JobSystem jobSystem { numThreads - 1 };
+        REQUIRE(jobSystem.numThreads() == numThreads);
+
+        BENCHMARK("ParticleSystem::update 1M, " + std::to_string(numThreads) + " threads")
+        {
+            particles.update(1e-9f, &jobSystem, 16384);
+            return particles.size();
+        };
+        BENCHMARK("meshComputeTangents x64, " + std::to_string(numThreads) + " threads")
+        {
+            jobSystem.parallelFor(0, meshCopies.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    meshComputeTangents(meshCopies[i]);
+            });
+            return meshCopies[0].vertices[0].tangent;
+        };
+        BENCHMARK("dependent jobs 1024, " + std::to_string(numThreads) + " threads")
+        {
+            // Two stages of 512 small jobs, the second stage only starts once the first is done.
+            std::atomic<int> sum { 0 };
+            JobCounter first, second;
+            for (int i = 0; i < 512; ++i)
+                jobSystem.submit([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); }, &first);
+            for (int i = 0; i < 512; ++i)
+                jobSystem.submit([&sum]() { sum.fetch_add(2, std::memory_order_relaxed); }, &second, &first);
+            jobSystem.wait(second);
+            return sum.load();
+        };
+    }
+}
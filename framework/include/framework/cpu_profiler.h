@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Low overhead CPU profiler. CPU_PROFILE_ZONE("name") records the time from that line to the end of the enclosing
+// scope. Every thread records into its own fixed-size ring buffer (single writer, no locks), which holds the most
+// recent zones of that thread; writeChromeTrace() writes them in the Chrome trace event format, which can be opened
+// in chrome://tracing or https://ui.perfetto.dev.
+//
+// The zones are compiled out unless the framework is built with FRAMEWORK_CPU_PROFILER enabled.
+// Zone names must be string literals (only the pointer is stored).
+
+// Name of the calling thread in the trace.
+void cpuProfilerSetThreadName(const char* name);
+void cpuProfilerRecordZone(const char* name, int64_t startNanoseconds, int64_t endNanoseconds);
+bool writeChromeTrace(const std::filesystem::path& filePath);
+
+inline int64_t cpuProfilerTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class CpuProfileScope {
+public:
+    explicit CpuProfileScope(const char* name)
+        : m_name(name)
+        , m_start(cpuProfilerTimestamp())
+    {
+    }
+    CpuProfileScope(const CpuProfileScope&) = delete;
+    ~CpuProfileScope()
+    {
+        cpuProfilerRecordZone(m_name, m_start, cpuProfilerTimestamp());
+    }
+
+    CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_start;
+};
+
+#if FRAMEWORK_CPU_PROFILER
+#define CPU_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_IMPL(a, b)
+#define CPU_PROFILE_ZONE(name) const CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__) { name }
+#else
+#define CPU_PROFILE_ZONE(name)
+#endif
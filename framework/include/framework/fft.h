@@ -0,0 +1,41 @@
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// Iterative radix-2 fast Fourier transform of complex sequences whose length is a power of two. The twiddle factors
+// and the bit reversal permutation are computed once in the constructor.
+//
+// The 2D transforms of a square row-major grid first transform all rows and then all columns. The column pass runs the
+// same butterflies on whole row segments instead of on single elements, so it reads contiguous memory and the grid is
+// never transposed; rows and column segments are split over the job system.
+class FFT {
+public:
+    explicit FFT(size_t size);
+
+    [[nodiscard]] size_t size() const;
+
+    // Forward transform X_k = sum_j x_j e^(-2 pi i jk/n) of size() elements.
+    void forward(std::span<std::complex<float>> data) const;
+    // Inverse transform x_j = sum_k X_k e^(2 pi i jk/n), without the 1/n normalization.
+    void inverse(std::span<std::complex<float>> data) const;
+
+    // Transform a grid of size() x size() elements in both dimensions.
+    void forward2D(std::span<std::complex<float>> grid, JobSystem* jobSystem = nullptr) const;
+    void inverse2D(std::span<std::complex<float>> grid, JobSystem* jobSystem = nullptr) const;
+
+private:
+    // Transform count interleaved sequences: element j of sequence s is data[j * stride + s].
+    void transform(std::complex<float>* data, size_t stride, size_t count, bool inverse) const;
+    void transform2D(std::span<std::complex<float>> grid, bool inverse, JobSystem* jobSystem) const;
+
+private:
+    size_t m_size;
+    // e^(-2 pi i k/n) for k < n/2.
+    std::vector<std::complex<float>> m_twiddles;
+    // Pairs (i, j) with i < j whose elements are swapped by the bit reversal.
+    std::vector<std::pair<size_t, size_t>> m_swaps;
+};
@@ -26,7 +26,7 @@ public:
         
         glm::vec<image_channels, float> pixel;
         for (int channel = 0; channel < image_channels; channel++) {
-            pixel[channel] = pixels[index * image_channels + channel] / 255.0f;
+            pixel[channel] = pixels[static_cast<size_t>(index * image_channels + channel)] / 255.0f;
         }
 
         return pixel;
@@ -37,13 +37,16 @@ public:
         assert(image_channels == channels);
         
         for (int channel = 0; channel < image_channels; channel++) {
-            pixels[index * image_channels + channel] = (uint8_t) (value[channel] * 255.0f);
+            pixels[static_cast<size_t>(index * image_channels + channel)] = (uint8_t) (value[channel] * 255.0f);
         }
     }
 
     uint8_t* get_data() {
         return pixels.data();
     }
+    const uint8_t* get_data() const {
+        return pixels.data();
+    }
 
 private:
     std::vector<uint8_t> pixels;
@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+// Number of unfinished jobs that were submitted with this counter. Other jobs can be made to depend on it (they are
+// only started once it reaches zero) and JobSystem::wait() blocks until it does. A counter must outlive its jobs;
+// it may be reused once it has reached zero.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    ~JobCounter() = default;
+
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    [[nodiscard]] bool done() const;
+
+private:
+    friend class JobSystem;
+
+    mutable std::mutex m_mutex;
+    int64_t m_count { 0 };
+    // Jobs that wait for this counter to reach zero.
+    std::vector<Job*> m_dependents;
+};
+
+// Work-stealing job system. Every worker thread (and the thread that created the job system) owns a Chase-Lev deque:
+// it pushes and pops jobs at the bottom of its own deque (LIFO, cache friendly), while idle threads steal from the top
+// of the other deques (FIFO, large chunks first). Jobs that are submitted from other threads go through a shared
+// queue. Threads that wait for a counter run other jobs in the meantime instead of blocking.
+//
+// Jobs must not throw; catch exceptions inside the job and pass them on (e.g. through std::exception_ptr).
+class JobSystem {
+public:
+    // Creates numWorkers worker threads; the thread that creates the job system is used as well while it waits.
+    explicit JobSystem(unsigned numWorkers = defaultNumWorkers());
+    JobSystem(const JobSystem&) = delete;
+    ~JobSystem();
+
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // One worker per hardware thread, except for the one that is used by the creating thread.
+    [[nodiscard]] static unsigned defaultNumWorkers();
+    // Number of threads that run jobs (the workers and the creating thread).
+    [[nodiscard]] unsigned numThreads() const;
+
+    // Run function on any thread. The counter (optional) is incremented now and decremented once the function has
+    // returned. If dependency is given the job only starts once the dependency counter reached zero.
+    void submit(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+    // Wait for the counter to reach zero, running jobs in the meantime.
+    void wait(const JobCounter& counter);
+    // Run one queued job on the calling thread; returns false if there was none.
+    bool runPendingJob();
+
+    // Call function(chunkBegin, chunkEnd) for consecutive chunks of at most grainSize indices of [begin, end) in
+    // parallel and wait for all of them. The grain size trades scheduling overhead against load balancing.
+    template <typename F>
+    void parallelFor(size_t begin, size_t end, size_t grainSize, F&& function)
+    {
+        if (begin >= end)
+            return;
+        grainSize = std::max<size_t>(grainSize, 1);
+        if (end - begin <= grainSize) {
+            function(begin, end);
+            return;
+        }
+        JobCounter counter;
+        for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize) {
+            const size_t chunkEnd = std::min(end, chunkBegin + grainSize);
+            submit([&function, chunkBegin, chunkEnd]() { function(chunkBegin, chunkEnd); }, &counter);
+        }
+        wait(counter);
+    }
+
+private:
+    struct Queue;
+
+    void workerMain(unsigned index);
+    void push(Job* job);
+    Job* findJob();
+    void run(Job* job);
+    void finish(JobCounter* counter);
+
+private:
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+
+    // Jobs submitted by threads that do not belong to the job system.
+    std::mutex m_sharedMutex;
+    std::deque<Job*> m_sharedJobs;
+
+    // Idle workers sleep until a job is pushed.
+    std::atomic<int64_t> m_numQueuedJobs { 0 };
+    std::atomic<int> m_numSleeping { 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    std::atomic<bool> m_stop { false };
+};
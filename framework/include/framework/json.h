@@ -0,0 +1,7 @@
+#pragma once
+#include <ostream>
+#include <string_view>
+
+// Write string as a quoted JSON string. Quotes and backslashes are escaped, and control characters are written as
+// short escapes (\n, \t, ...) or \uXXXX. Other bytes (including UTF-8 sequences) are copied as they are.
+void writeJsonString(std::ostream& stream, std::string_view string);
@@ -33,6 +33,8 @@ struct Material {
 	//   material.kdTexture->getTexel(...);
 	// }
 	std::shared_ptr<Image> kdTexture;
+	// File of kdTexture (empty if there is none).
+	std::filesystem::path kdTexturePath;
 };
 
 struct Mesh {
@@ -44,13 +46,22 @@ struct Mesh {
 	Material material;
 };
 
+class JobSystem;
+
 struct LoadMeshSettings {
 	bool normalizeVertexPositions { false };
 	bool cacheVertices { true };
+	// Compute the tangents of the sub-meshes in parallel.
+	JobSystem* jobSystem { nullptr };
+	// Load the material textures into Material::kdTexture; otherwise only kdTexturePath is set (so that the caller
+	// can load them itself, e.g. concurrently or shared between meshes).
+	bool loadTextures { true };
 };
 
 [[nodiscard]] std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings = {});
 [[nodiscard]] Mesh mergeMeshes(std::span<const Mesh> meshes);
+// Per-vertex tangents (xyz) and bitangent sign (w) from the texture coordinates (loadMesh() already computes them).
+void meshComputeTangents(Mesh& mesh);
 void meshFlipX(Mesh& mesh);
 void meshFlipY(Mesh& mesh);
 void meshFlipZ(Mesh& mesh);
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// Map a float to an unsigned integer with the same order, so that floats can be radix sorted: the sign bit is
+// flipped for positive values and all bits are flipped for negative ones.
+[[nodiscard]] inline uint32_t floatToRadixKey(float value)
+{
+    const auto bits = std::bit_cast<uint32_t>(value);
+    return bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+// Stable least significant digit radix sort of 32-bit keys with an attached value (typically an index into the data
+// that the keys belong to, so the data itself is never moved). It makes one counting and one scatter pass per 8-bit
+// digit and skips digits that are the same for all keys. The sorter keeps its scratch memory between calls.
+class RadixSorter {
+public:
+    // Sort keys in ascending order and apply the same permutation to values (which must be just as long). With a job
+    // system, large inputs are split into blocks that are counted and scattered in parallel.
+    void sort(std::span<uint32_t> keys, std::span<uint32_t> values, JobSystem* jobSystem = nullptr);
+
+private:
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_values;
+    // Per block and digit: the count, then the output position of the next key.
+    std::vector<size_t> m_histograms;
+};
@@ -10,12 +10,22 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 #include <exception>
 #include <filesystem>
+#include <string>
 #include <vector>
 
 struct ShaderLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+enum class ShaderCompileMode {
+    // Check compile and link status as soon as each stage is added / the program is built.
+    Immediate,
+    // Submit all stages without waiting for the driver. Status is only queried when the program is
+    // first needed, so multiple programs (and other work) can overlap with compilation.
+    // Uses GL_KHR_parallel_shader_compile when the driver supports it.
+    Deferred
+};
+
 class Shader {
 public:
     Shader();
@@ -37,27 +47,48 @@ public:
     // Query a uniform location by its name in the shader
     GLint getUniformLocation(const std::string& name) const;
 
+    // Non-blocking check whether a deferred program has finished compiling and linking.
+    // Always true for immediately built shaders and when GL_KHR_parallel_shader_compile is not available.
+    [[nodiscard]] bool isReady() const;
+    // Wait for a deferred program and check it for errors (throws ShaderLoadingException).
+    // Called automatically the first time the shader is used; does nothing if already resolved.
+    void resolve() const;
+
 private:
     friend class ShaderBuilder;
     Shader(GLuint program);
+    Shader(GLuint program, std::vector<GLuint> pendingShaders, std::vector<std::filesystem::path> pendingFiles);
+
+    void freePendingShaders() const;
 
 private:
     GLuint m_program;
+
+    // Stages of a deferred program whose compile status has not been checked yet.
+    mutable std::vector<GLuint> m_pendingShaders;
+    mutable std::vector<std::filesystem::path> m_pendingFiles;
+    mutable bool m_pending { false };
 };
 
 class ShaderBuilder {
 public:
     ShaderBuilder() = default;
+    explicit ShaderBuilder(ShaderCompileMode compileMode);
     ShaderBuilder(const ShaderBuilder&) = delete;
     ShaderBuilder(ShaderBuilder&&) = default;
     ~ShaderBuilder();
 
     ShaderBuilder& addStage(GLuint shaderStage, std::filesystem::path shaderFile);
+    // Capture these vertex shader outputs with transform feedback, interleaved into a single buffer.
+    ShaderBuilder& setTransformFeedbackVaryings(std::vector<std::string> varyings);
     Shader build();
 
 private:
     void freeShaders();
 
 private:
+    ShaderCompileMode m_compileMode { ShaderCompileMode::Immediate };
     std::vector<GLuint> m_shaders;
+    std::vector<std::filesystem::path> m_shaderFiles;
+    std::vector<std::string> m_transformFeedbackVaryings;
 };
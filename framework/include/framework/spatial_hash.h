@@ -0,0 +1,55 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// Uniform grid for neighbour queries over an unbounded space: the integer cell coordinates of a point are hashed into
+// a table of buckets. build() counting sorts the points by bucket, so the points of a cell form one contiguous range
+// of order(); if the caller reorders its point data in that order, neighbour queries read contiguous memory. Only the
+// y and z coordinates are hashed and x is added to the result, so a row of cells along x maps to consecutive buckets
+// and the 27 cells around a cell are mostly covered by 9 ranges of three cells. Different cells can share a bucket,
+// so queries must still check the distance. The hash keeps its memory between builds.
+class SpatialHash {
+public:
+    // Ranges [begin, end) of order() that hold the points of the 3x3x3 cells around a cell, without overlap.
+    struct NeighbourRanges {
+        std::array<uint32_t, 27> begins;
+        std::array<uint32_t, 27> ends;
+        size_t size;
+    };
+
+    explicit SpatialHash(float cellSize);
+
+    [[nodiscard]] float cellSize() const;
+    [[nodiscard]] glm::ivec3 cell(const glm::vec3& point) const;
+    [[nodiscard]] uint32_t bucket(const glm::ivec3& cell) const;
+    [[nodiscard]] NeighbourRanges neighbourRanges(const glm::ivec3& cell) const;
+
+    // Sort the points (given as one array per coordinate) into buckets. The table gets about two buckets per point.
+    // With a job system the buckets of the points are computed in parallel; the counting sort itself is serial.
+    void build(std::span<const float> x, std::span<const float> y, std::span<const float> z, JobSystem* jobSystem = nullptr);
+
+    // Indices of the points of the last build, grouped by bucket.
+    [[nodiscard]] std::span<const uint32_t> order() const;
+    // Range [begin, end) of a bucket in order().
+    [[nodiscard]] uint32_t bucketBegin(uint32_t bucket) const;
+    [[nodiscard]] uint32_t bucketEnd(uint32_t bucket) const;
+
+private:
+    float m_cellSize;
+    float m_inverseCellSize;
+    // Power of two.
+    uint32_t m_numBuckets { 1 };
+    std::vector<uint32_t> m_pointBuckets;
+    // Exclusive prefix sum of the bucket sizes, with numBuckets + 1 entries.
+    std::vector<uint32_t> m_bucketStarts;
+    std::vector<uint32_t> m_order;
+};
@@ -6,6 +6,7 @@ DISABLE_WARNINGS_PUSH()
 #include <GLFW/glfw3.h>
 #include <glm/vec2.hpp>
 DISABLE_WARNINGS_POP()
+#include <array>
 #include <functional>
 #include <optional>
 #include <string_view>
@@ -19,6 +20,11 @@ enum class OpenGLVersion {
 	GL45
 };
 
+// A window with an OpenGL context and Dear ImGui.
+// A window that is not presentable is headless: nothing is shown on screen and there is no ImGui nor input. It uses a
+// surfaceless EGL context (EGL_MESA_platform_surfaceless, works without a display server and on CPU-only machines
+// with llvmpipe) when EGL is available and a hidden GLFW window otherwise, and renders into an offscreen
+// framebuffer of windowSize (see getFramebuffer()).
 class Window {
 public:
 	Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion, bool presentable=true, bool visible=true);
@@ -29,6 +35,9 @@ public:
 
 	void updateInput();
 	void swapBuffers(); // Swap the front/back buffer
+	void setVSync(bool enabled); // Wait for the vertical blank in swapBuffers() (enabled by default).
+	// Framebuffer that represents the window: 0 if it is presentable, the offscreen framebuffer if it is headless.
+	[[nodiscard]] GLuint getFramebuffer() const;
 
 
 	void renderToImage(const std::filesystem::path& filePath, const bool flipY = false); // renders the output to an image
@@ -63,6 +72,10 @@ public:
 	[[nodiscard]] float getAspectRatio() const;
 	[[nodiscard]] float getDpiScalingFactor() const;
 
+	// Address of an OpenGL function (also of one that GLAD does not load), resolved through the same loader as GLAD:
+	// GLFW or, with a surfaceless context, EGL. Returns nullptr before a window was created.
+	static void* getProcAddress(const char* name);
+
 private:
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void charCallback(GLFWwindow* window, unsigned unicodeCodePoint);
@@ -71,13 +84,23 @@ private:
 	static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 	static void windowSizeCallback(GLFWwindow* window, int width, int height);
 
+	bool createSurfacelessContext();
+	void createOffscreenFramebuffer();
+
 private:
-	GLFWwindow* m_pWindow;
+	GLFWwindow* m_pWindow { nullptr };
 	glm::ivec2 m_windowSize;
 	float m_dpiScalingFactor = 1.0f;
 	const OpenGLVersion m_glVersion;
         bool m_presentable;
 
+	// Headless windows.
+	void* m_eglDisplay { nullptr };
+	void* m_eglContext { nullptr };
+	bool m_shouldClose { false };
+	GLuint m_offscreenFramebuffer { 0 };
+	std::array<GLuint, 2> m_offscreenRenderbuffers { 0, 0 }; // Color and depth/stencil.
+
 	std::vector<KeyCallback> m_keyCallbacks;
 	std::vector<CharCallback> m_charCallbacks;
 	std::vector<MouseButtonCallback> m_mouseButtonCallbacks;
@@ -0,0 +1,150 @@
+#include "cpu_profiler.h"
+#include "json.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct ZoneEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+// Ring buffer that is written by one thread only; the writer publishes every event by incrementing head.
+struct ThreadBuffer {
+    static constexpr uint64_t CAPACITY = 1 << 15;
+
+    std::unique_ptr<ZoneEvent[]> events { std::make_unique<ZoneEvent[]>(CAPACITY) };
+    std::atomic<uint64_t> head { 0 };
+    uint32_t threadId { 0 };
+    // Protected by the registry mutex.
+    std::string name;
+    bool inUse { false };
+};
+
+// Buffers of all threads that recorded a zone. They are never freed, so the events of threads that have exited can
+// still be written out; instead, the buffer of an exited thread is handed to the next new thread (short-lived worker
+// threads would otherwise allocate a new buffer every time).
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+// Releases the buffer of the thread when it exits.
+struct ThreadBufferOwner {
+    ThreadBuffer* buffer { nullptr };
+
+    ~ThreadBufferOwner()
+    {
+        if (buffer) {
+            std::lock_guard lock { registry().mutex };
+            buffer->inUse = false;
+        }
+    }
+};
+
+thread_local ThreadBufferOwner t_threadBuffer;
+
+ThreadBuffer& threadBuffer()
+{
+    if (!t_threadBuffer.buffer) {
+        Registry& reg = registry();
+        std::lock_guard lock { reg.mutex };
+        auto iter = std::find_if(std::begin(reg.buffers), std::end(reg.buffers), [](const auto& buffer) { return !buffer->inUse; });
+        if (iter == std::end(reg.buffers)) {
+            auto& buffer = reg.buffers.emplace_back(std::make_unique<ThreadBuffer>());
+            buffer->threadId = static_cast<uint32_t>(reg.buffers.size());
+            buffer->name = "Thread " + std::to_string(buffer->threadId);
+            iter = std::prev(std::end(reg.buffers));
+        }
+        (*iter)->inUse = true;
+        t_threadBuffer.buffer = iter->get();
+    }
+    return *t_threadBuffer.buffer;
+}
+
+}
+
+void cpuProfilerSetThreadName(const char* name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard lock { registry().mutex };
+    buffer.name = name;
+}
+
+void cpuProfilerRecordZone(const char* name, int64_t startNanoseconds, int64_t endNanoseconds)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % ThreadBuffer::CAPACITY] = { name, startNanoseconds, endNanoseconds };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const std::filesystem::path& filePath)
+{
+    struct ThreadEvents {
+        uint32_t threadId;
+        std::string name;
+        std::vector<ZoneEvent> events;
+    };
+    std::vector<ThreadEvents> threads;
+    {
+        Registry& reg = registry();
+        std::lock_guard lock { reg.mutex };
+        for (const auto& buffer : reg.buffers) {
+            // Copy the events without stopping the writer, then drop the ones it may have overwritten meanwhile.
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t first = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+            std::vector<ZoneEvent> events;
+            events.reserve(head - first);
+            for (uint64_t i = first; i < head; ++i)
+                events.push_back(buffer->events[i % ThreadBuffer::CAPACITY]);
+            const uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+            const uint64_t firstValid = newHead > ThreadBuffer::CAPACITY ? newHead - ThreadBuffer::CAPACITY : 0;
+            if (firstValid > first)
+                events.erase(std::begin(events), std::begin(events) + static_cast<ptrdiff_t>(std::min(firstValid - first, head - first)));
+            threads.push_back({ buffer->threadId, buffer->name, std::move(events) });
+        }
+    }
+
+    int64_t origin = std::numeric_limits<int64_t>::max();
+    for (const ThreadEvents& thread : threads) {
+        for (const ZoneEvent& event : thread.events)
+            origin = std::min(origin, event.start);
+    }
+
+    std::ofstream file { filePath };
+    if (!file)
+        return false;
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    file.setf(std::ios::fixed);
+    file.precision(3);
+    bool first = true;
+    for (const ThreadEvents& thread : threads) {
+        file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread.threadId << ",\"args\":{\"name\":";
+        writeJsonString(file, thread.name);
+        file << "}}";
+        first = false;
+        // Complete ("X") events with the time stamps in microseconds.
+        for (const ZoneEvent& event : thread.events) {
+            file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << thread.threadId << ",\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"ts\":" << double(event.start - origin) * 1e-3 << ",\"dur\":" << double(event.end - event.start) * 1e-3 << '}';
+        }
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
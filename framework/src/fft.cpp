@@ -0,0 +1,105 @@
+#include "fft.h"
+#include "job_system.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+// Rows and columns per job of the 2D transforms; 16 columns are two cache lines of every row.
+static constexpr size_t ROW_GRAIN_SIZE = 16;
+static constexpr size_t COLUMN_GRAIN_SIZE = 16;
+
+FFT::FFT(size_t size)
+    : m_size(size)
+{
+    assert(std::has_single_bit(size));
+    m_twiddles.resize(size / 2);
+    for (size_t k = 0; k < size / 2; ++k) {
+        const double angle = -2.0 * std::numbers::pi * double(k) / double(size);
+        m_twiddles[k] = { float(std::cos(angle)), float(std::sin(angle)) };
+    }
+
+    const int numBits = std::countr_zero(size);
+    for (size_t i = 0; i < size; ++i) {
+        size_t reversed = 0;
+        for (int bit = 0; bit < numBits; ++bit)
+            reversed |= ((i >> bit) & 1) << (numBits - 1 - bit);
+        if (i < reversed)
+            m_swaps.emplace_back(i, reversed);
+    }
+}
+
+size_t FFT::size() const
+{
+    return m_size;
+}
+
+void FFT::forward(std::span<std::complex<float>> data) const
+{
+    assert(data.size() == m_size);
+    transform(data.data(), 1, 1, false);
+}
+
+void FFT::inverse(std::span<std::complex<float>> data) const
+{
+    assert(data.size() == m_size);
+    transform(data.data(), 1, 1, true);
+}
+
+void FFT::forward2D(std::span<std::complex<float>> grid, JobSystem* jobSystem) const
+{
+    transform2D(grid, false, jobSystem);
+}
+
+void FFT::inverse2D(std::span<std::complex<float>> grid, JobSystem* jobSystem) const
+{
+    transform2D(grid, true, jobSystem);
+}
+
+void FFT::transform(std::complex<float>* data, size_t stride, size_t count, bool inverse) const
+{
+    for (const auto& [i, j] : m_swaps)
+        std::swap_ranges(data + i * stride, data + i * stride + count, data + j * stride);
+
+    // The butterflies are written out on the real and imaginary parts, because the complex multiplication operator
+    // handles infinities and NaNs with a library call.
+    const float sign = inverse ? -1.0f : 1.0f;
+    for (size_t half = 1; half < m_size; half *= 2) {
+        const size_t twiddleStep = m_size / (2 * half);
+        for (size_t start = 0; start < m_size; start += 2 * half) {
+            for (size_t k = 0; k < half; ++k) {
+                const float twiddleReal = m_twiddles[k * twiddleStep].real();
+                const float twiddleImaginary = sign * m_twiddles[k * twiddleStep].imag();
+                std::complex<float>* a = data + (start + k) * stride;
+                std::complex<float>* b = a + half * stride;
+                for (size_t s = 0; s < count; ++s) {
+                    const float br = b[s].real() * twiddleReal - b[s].imag() * twiddleImaginary;
+                    const float bi = b[s].real() * twiddleImaginary + b[s].imag() * twiddleReal;
+                    const float ar = a[s].real(), ai = a[s].imag();
+                    a[s] = { ar + br, ai + bi };
+                    b[s] = { ar - br, ai - bi };
+                }
+            }
+        }
+    }
+}
+
+void FFT::transform2D(std::span<std::complex<float>> grid, bool inverse, JobSystem* jobSystem) const
+{
+    assert(grid.size() == m_size * m_size);
+    const auto transformRows = [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row)
+            transform(grid.data() + row * m_size, 1, 1, inverse);
+    };
+    const auto transformColumns = [&](size_t begin, size_t end) {
+        transform(grid.data() + begin, m_size, end - begin, inverse);
+    };
+    if (jobSystem) {
+        jobSystem->parallelFor(0, m_size, ROW_GRAIN_SIZE, transformRows);
+        jobSystem->parallelFor(0, m_size, COLUMN_GRAIN_SIZE, transformColumns);
+    } else {
+        transformRows(0, m_size);
+        transformColumns(0, m_size);
+    }
+}
@@ -35,7 +35,7 @@ Image::Image(const std::filesystem::path& filePath)
 		throw std::exception();
 	}
 
-	for (size_t i = 0UL; i < width * height * channels; i++) { pixels.emplace_back(stbPixels[i]); }
+	pixels.assign(stbPixels, stbPixels + size_t(width) * size_t(height) * size_t(channels));
 
 	stbi_image_free(stbPixels);
 }
@@ -0,0 +1,280 @@
+#include "job_system.h"
+#include <cassert>
+#include <random>
+
+struct Job {
+    std::function<void()> function;
+    JobCounter* counter;
+};
+
+namespace {
+
+// Chase-Lev work-stealing deque ("Dynamic Circular Work-Stealing Deque", with the memory orderings of "Correct and
+// Efficient Work-Stealing for Weak Memory Models"). Only the owner calls push() and pop(); any thread may steal().
+class WorkStealingDeque {
+public:
+    WorkStealingDeque()
+        : m_array(new Array(256))
+    {
+        m_arrays.emplace_back(m_array.load(std::memory_order_relaxed));
+    }
+
+    void push(Job* job)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        Array* array = m_array.load(std::memory_order_relaxed);
+        if (bottom - top > array->capacity - 1)
+            array = grow(array, top, bottom);
+        array->put(bottom, job);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    Job* pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* array = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            // Empty.
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = array->get(bottom);
+        if (top == bottom) {
+            // Last job: race against the thieves for it.
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+        Array* array = m_array.load(std::memory_order_acquire);
+        Job* job = array->get(top);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // Lost the race against the owner or another thief.
+        return job;
+    }
+
+private:
+    struct Array {
+        explicit Array(int64_t capacity)
+            : capacity(capacity)
+            , jobs(new std::atomic<Job*>[size_t(capacity)])
+        {
+        }
+
+        Job* get(int64_t i) const { return jobs[size_t(i & (capacity - 1))].load(std::memory_order_relaxed); }
+        void put(int64_t i, Job* job) { jobs[size_t(i & (capacity - 1))].store(job, std::memory_order_relaxed); }
+
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Job*>[]> jobs;
+    };
+
+    Array* grow(Array* array, int64_t top, int64_t bottom)
+    {
+        // Thieves may still read from the old array, so it is kept alive until the deque is destroyed.
+        Array* newArray = m_arrays.emplace_back(std::make_unique<Array>(2 * array->capacity)).get();
+        for (int64_t i = top; i < bottom; ++i)
+            newArray->put(i, array->get(i));
+        m_array.store(newArray, std::memory_order_release);
+        return newArray;
+    }
+
+private:
+    std::atomic<int64_t> m_top { 0 };
+    std::atomic<int64_t> m_bottom { 0 };
+    std::atomic<Array*> m_array;
+    std::vector<std::unique_ptr<Array>> m_arrays;
+};
+
+// The job system and queue that the current thread belongs to (if any).
+thread_local JobSystem* t_jobSystem = nullptr;
+thread_local size_t t_queueIndex = 0;
+
+}
+
+struct JobSystem::Queue {
+    WorkStealingDeque deque;
+    std::minstd_rand random;
+};
+
+bool JobCounter::done() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_count == 0;
+}
+
+JobSystem::JobSystem(unsigned numWorkers)
+{
+    // Queue 0 belongs to the creating thread.
+    for (unsigned i = 0; i < numWorkers + 1; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+        m_queues.back()->random.seed(i + 1);
+    }
+    t_jobSystem = this;
+    t_queueIndex = 0;
+    for (unsigned i = 1; i <= numWorkers; ++i)
+        m_workers.emplace_back(&JobSystem::workerMain, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard lock { m_sleepMutex };
+        m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+    if (t_jobSystem == this)
+        t_jobSystem = nullptr;
+    assert(m_numQueuedJobs == 0);
+}
+
+unsigned JobSystem::defaultNumWorkers()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+}
+
+unsigned JobSystem::numThreads() const
+{
+    return static_cast<unsigned>(m_queues.size());
+}
+
+void JobSystem::submit(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+    Job* job = new Job { std::move(function), counter };
+    if (counter) {
+        std::lock_guard lock { counter->m_mutex };
+        counter->m_count++;
+    }
+    if (dependency) {
+        std::lock_guard lock { dependency->m_mutex };
+        if (dependency->m_count > 0) {
+            // Pushed by finish() when the last job of the dependency is done.
+            dependency->m_dependents.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+void JobSystem::wait(const JobCounter& counter)
+{
+    int numIdleRounds = 0;
+    while (!counter.done()) {
+        if (Job* job = findJob()) {
+            run(job);
+            numIdleRounds = 0;
+        } else if (++numIdleRounds > 64) {
+            // The remaining jobs are running on other threads.
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool JobSystem::runPendingJob()
+{
+    Job* job = findJob();
+    if (job)
+        run(job);
+    return job != nullptr;
+}
+
+void JobSystem::workerMain(unsigned index)
+{
+    t_jobSystem = this;
+    t_queueIndex = index;
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        if (Job* job = findJob()) {
+            run(job);
+            continue;
+        }
+
+        // Sleep until a job is pushed; pushers only notify when someone sleeps (see push()).
+        std::unique_lock lock { m_sleepMutex };
+        m_numSleeping++;
+        m_wakeUp.wait(lock, [this]() { return m_stop.load() || m_numQueuedJobs.load() > 0; });
+        m_numSleeping--;
+    }
+}
+
+void JobSystem::push(Job* job)
+{
+    if (t_jobSystem == this) {
+        m_queues[t_queueIndex]->deque.push(job);
+    } else {
+        std::lock_guard lock { m_sharedMutex };
+        m_sharedJobs.push_back(job);
+    }
+    m_numQueuedJobs++;
+    if (m_numSleeping.load() > 0) {
+        // Taking the lock guarantees that a worker that is about to sleep either sees the job or gets the notification.
+        { std::lock_guard lock { m_sleepMutex }; }
+        m_wakeUp.notify_one();
+    }
+}
+
+Job* JobSystem::findJob()
+{
+    Job* job = nullptr;
+    const bool ownsQueue = t_jobSystem == this;
+    if (ownsQueue)
+        job = m_queues[t_queueIndex]->deque.pop();
+
+    if (!job && m_numQueuedJobs.load(std::memory_order_relaxed) > 0) {
+        // Steal from a random victim first so that thieves spread out over the queues.
+        const size_t numQueues = m_queues.size();
+        const size_t start = ownsQueue ? m_queues[t_queueIndex]->random() % numQueues : 0;
+        for (size_t i = 0; i < numQueues && !job; ++i) {
+            const size_t victim = (start + i) % numQueues;
+            if (!ownsQueue || victim != t_queueIndex)
+                job = m_queues[victim]->deque.steal();
+        }
+        if (!job) {
+            std::lock_guard lock { m_sharedMutex };
+            if (!m_sharedJobs.empty()) {
+                job = m_sharedJobs.front();
+                m_sharedJobs.pop_front();
+            }
+        }
+    }
+
+    if (job)
+        m_numQueuedJobs--;
+    return job;
+}
+
+void JobSystem::run(Job* job)
+{
+    job->function();
+    JobCounter* counter = job->counter;
+    delete job;
+    if (counter)
+        finish(counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    std::vector<Job*> ready;
+    {
+        std::lock_guard lock { counter->m_mutex };
+        if (--counter->m_count == 0)
+            ready.swap(counter->m_dependents);
+    }
+    // The counter may be destroyed by a waiting thread from here on.
+    for (Job* job : ready)
+        push(job);
+}
@@ -0,0 +1,38 @@
+#include "json.h"
+
+void writeJsonString(std::ostream& stream, std::string_view string)
+{
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    stream << '"';
+    for (const char c : string) {
+        switch (c) {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        case '\b':
+            stream << "\\b";
+            break;
+        case '\f':
+            stream << "\\f";
+            break;
+        case '\n':
+            stream << "\\n";
+            break;
+        case '\r':
+            stream << "\\r";
+            break;
+        case '\t':
+            stream << "\\t";
+            break;
+        default:
+            if (const auto byte = static_cast<unsigned char>(c); byte < 0x20)
+                stream << "\\u00" << HEX_DIGITS[byte >> 4] << HEX_DIGITS[byte & 0xF];
+            else
+                stream << c;
+        }
+    }
+    stream << '"';
+}
@@ -0,0 +1,82 @@
+#include "radix_sort.h"
+#include "job_system.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+static constexpr int RADIX_BITS = 8;
+static constexpr size_t RADIX_SIZE = size_t(1) << RADIX_BITS;
+// Inputs are only split when every block has at least this many keys; below that the passes are memory bound anyway.
+static constexpr size_t MIN_KEYS_PER_BLOCK = 16384;
+
+void RadixSorter::sort(std::span<uint32_t> keys, std::span<uint32_t> values, JobSystem* jobSystem)
+{
+    assert(keys.size() == values.size());
+    const size_t numKeys = keys.size();
+    if (numKeys < 2)
+        return;
+
+    m_keys.resize(numKeys);
+    m_values.resize(numKeys);
+    const size_t numBlocks = jobSystem ? std::clamp<size_t>(numKeys / MIN_KEYS_PER_BLOCK, 1, jobSystem->numThreads()) : 1;
+    const size_t blockSize = (numKeys + numBlocks - 1) / numBlocks;
+    m_histograms.resize(numBlocks * RADIX_SIZE);
+    const auto forEachBlock = [&](auto&& function) {
+        if (numBlocks == 1) {
+            function(size_t(0));
+            return;
+        }
+        jobSystem->parallelFor(0, numBlocks, 1, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; ++block)
+                function(block);
+        });
+    };
+
+    uint32_t* sourceKeys = keys.data();
+    uint32_t* sourceValues = values.data();
+    uint32_t* targetKeys = m_keys.data();
+    uint32_t* targetValues = m_values.data();
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        forEachBlock([&](size_t block) {
+            size_t* histogram = &m_histograms[block * RADIX_SIZE];
+            std::fill_n(histogram, RADIX_SIZE, size_t(0));
+            const size_t end = std::min(numKeys, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; ++i)
+                histogram[(sourceKeys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        });
+
+        // Exclusive prefix sum in (digit, block) order: the blocks of a digit are written after each other, which
+        // keeps the sort stable.
+        size_t offset = 0;
+        bool sameDigit = false;
+        for (size_t digit = 0; digit < RADIX_SIZE; ++digit) {
+            const size_t digitBegin = offset;
+            for (size_t block = 0; block < numBlocks; ++block) {
+                const size_t count = m_histograms[block * RADIX_SIZE + digit];
+                m_histograms[block * RADIX_SIZE + digit] = offset;
+                offset += count;
+            }
+            if (offset - digitBegin == numKeys)
+                sameDigit = true;
+        }
+        if (sameDigit)
+            continue; // The pass would not change the order.
+
+        forEachBlock([&](size_t block) {
+            size_t* positions = &m_histograms[block * RADIX_SIZE];
+            const size_t end = std::min(numKeys, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; ++i) {
+                const size_t position = positions[(sourceKeys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                targetKeys[position] = sourceKeys[i];
+                targetValues[position] = sourceValues[i];
+            }
+        });
+        std::swap(sourceKeys, targetKeys);
+        std::swap(sourceValues, targetValues);
+    }
+
+    if (sourceKeys != keys.data()) {
+        std::copy_n(sourceKeys, numKeys, keys.data());
+        std::copy_n(sourceValues, numKeys, values.data());
+    }
+}
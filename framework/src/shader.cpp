@@ -1,4 +1,5 @@
 #include "shader.h"
+#include "window.h"
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
@@ -8,18 +9,34 @@ DISABLE_WARNINGS_POP()
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+
+// GL_KHR_parallel_shader_compile is not part of the generated GLAD loader.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+using PFNGLMAXSHADERCOMPILERTHREADSKHRPROC = void(APIENTRYP)(GLuint count);
 
 static constexpr GLuint invalid = 0xFFFFFFFF;
 
 static bool checkShaderErrors(GLuint shader);
 static bool checkProgramErrors(GLuint program);
 static std::string readFile(std::filesystem::path filePath);
+static bool enableParallelShaderCompile();
 
 Shader::Shader(GLuint program)
     : m_program(program)
 {
 }
 
+Shader::Shader(GLuint program, std::vector<GLuint> pendingShaders, std::vector<std::filesystem::path> pendingFiles)
+    : m_program(program)
+    , m_pendingShaders(std::move(pendingShaders))
+    , m_pendingFiles(std::move(pendingFiles))
+    , m_pending(true)
+{
+}
+
 Shader::Shader()
     : m_program(invalid)
 {
@@ -28,33 +45,88 @@ Shader::Shader()
 Shader::Shader(Shader&& other)
 {
     m_program = other.m_program;
+    m_pendingShaders = std::move(other.m_pendingShaders);
+    m_pendingFiles = std::move(other.m_pendingFiles);
+    m_pending = other.m_pending;
     other.m_program = invalid;
+    other.m_pendingShaders.clear();
+    other.m_pending = false;
 }
 
 Shader::~Shader()
 {
+    freePendingShaders();
     if (m_program != invalid)
         glDeleteProgram(m_program);
 }
 
 Shader& Shader::operator=(Shader&& other)
 {
+    freePendingShaders();
     if (m_program != invalid)
         glDeleteProgram(m_program);
 
     m_program = other.m_program;
+    m_pendingShaders = std::move(other.m_pendingShaders);
+    m_pendingFiles = std::move(other.m_pendingFiles);
+    m_pending = other.m_pending;
     other.m_program = invalid;
+    other.m_pendingShaders.clear();
+    other.m_pending = false;
     return *this;
 }
 
 void Shader::bind() const
 {
     assert(m_program != invalid);
+    resolve();
     glUseProgram(m_program);
 }
 
+bool Shader::isReady() const
+{
+    if (!m_pending || !enableParallelShaderCompile())
+        return true;
+
+    GLint completed = GL_FALSE;
+    glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+void Shader::resolve() const
+{
+    if (!m_pending)
+        return;
+    m_pending = false;
+
+    // Querying the status blocks until the driver has finished, so check the stages only now.
+    for (size_t i = 0; i < m_pendingShaders.size(); ++i) {
+        if (!checkShaderErrors(m_pendingShaders[i])) {
+            freePendingShaders();
+            throw ShaderLoadingException(fmt::format("Failed to compile shader {}", m_pendingFiles[i].string().c_str()));
+        }
+    }
+    freePendingShaders();
+
+    if (!checkProgramErrors(m_program)) {
+        throw ShaderLoadingException("Shader program failed to link");
+    }
+}
+
+void Shader::freePendingShaders() const
+{
+    for (GLuint shader : m_pendingShaders) {
+        if (m_program != invalid)
+            glDetachShader(m_program, shader);
+        glDeleteShader(shader);
+    }
+    m_pendingShaders.clear();
+    m_pendingFiles.clear();
+}
+
 void Shader::bindUniformBlock(const std::string& blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const
 {
+    resolve();
     GLuint blockIdx = glGetUniformBlockIndex(m_program, blockName.data());
     if (blockIdx != GL_INVALID_INDEX) {
         glUniformBlockBinding(m_program, blockIdx, bindingLocation);
@@ -66,6 +138,7 @@ void Shader::bindUniformBlock(const std::string& blockName, GLuint bindingLocati
 
 GLuint Shader::getAttributeLocation(const std::string& name) const
 {
+    resolve();
     GLuint loc = glGetAttribLocation(m_program, name.c_str());
     if (loc == invalid) {
         std::cerr << "Warning : Could not find attribute " << name << std::endl;
@@ -75,6 +148,7 @@ GLuint Shader::getAttributeLocation(const std::string& name) const
 
 GLint Shader::getUniformLocation(const std::string& name) const
 {
+    resolve();
     GLint loc = glGetUniformLocation(m_program, name.c_str());
     if (loc == GL_INVALID_INDEX) {
         std::cerr << "Warning : Could not find uniform " << name << std::endl;
@@ -82,6 +156,13 @@ GLint Shader::getUniformLocation(const std::string& name) const
     return loc;
 }
 
+ShaderBuilder::ShaderBuilder(ShaderCompileMode compileMode)
+    : m_compileMode(compileMode)
+{
+    if (m_compileMode == ShaderCompileMode::Deferred)
+        enableParallelShaderCompile();
+}
+
 ShaderBuilder::~ShaderBuilder()
 {
     freeShaders();
@@ -98,12 +179,19 @@ ShaderBuilder& ShaderBuilder::addStage(GLuint shaderStage, std::filesystem::path
     const char* shaderSourcePtr = shaderSource.c_str();
     glShaderSource(shader, 1, &shaderSourcePtr, nullptr);
     glCompileShader(shader);
-    if (!checkShaderErrors(shader)) {
+    if (m_compileMode == ShaderCompileMode::Immediate && !checkShaderErrors(shader)) {
         glDeleteShader(shader);
         throw ShaderLoadingException(fmt::format("Failed to compile shader {}", shaderFile.string().c_str()));
     }
 
     m_shaders.push_back(shader);
+    m_shaderFiles.push_back(std::move(shaderFile));
+    return *this;
+}
+
+ShaderBuilder& ShaderBuilder::setTransformFeedbackVaryings(std::vector<std::string> varyings)
+{
+    m_transformFeedbackVaryings = std::move(varyings);
     return *this;
 }
 
@@ -113,8 +201,23 @@ Shader ShaderBuilder::build()
     GLuint program = glCreateProgram();
     for (GLuint shader : m_shaders)
         glAttachShader(program, shader);
+    if (!m_transformFeedbackVaryings.empty()) {
+        // Only takes effect when the program is linked.
+        std::vector<const char*> varyings;
+        for (const std::string& varying : m_transformFeedbackVaryings)
+            varyings.push_back(varying.c_str());
+        glTransformFeedbackVaryings(program, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
     glLinkProgram(program);
 
+    if (m_compileMode == ShaderCompileMode::Deferred) {
+        // The program takes ownership of the stages so it can report compile errors once it is resolved.
+        Shader shader { program, std::move(m_shaders), std::move(m_shaderFiles) };
+        m_shaders.clear();
+        m_shaderFiles.clear();
+        return shader;
+    }
+
     if (!checkProgramErrors(program)) {
         throw ShaderLoadingException("Shader program failed to link");
     }
@@ -128,6 +231,27 @@ void ShaderBuilder::freeShaders()
         glDeleteShader(shader);
 }
 
+// Ask the driver to compile on background threads if it supports GL_KHR_parallel_shader_compile.
+// Returns whether GL_COMPLETION_STATUS_KHR can be queried.
+static bool enableParallelShaderCompile()
+{
+    static const bool supported = []() {
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (GLint i = 0; i < numExtensions; ++i) {
+            const auto* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (extension && std::string_view(extension) == "GL_KHR_parallel_shader_compile") {
+                auto maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(Window::getProcAddress("glMaxShaderCompilerThreadsKHR"));
+                if (maxShaderCompilerThreads)
+                    maxShaderCompilerThreads(0xFFFFFFFF); // Let the implementation pick the number of threads.
+                return true;
+            }
+        }
+        return false;
+    }();
+    return supported;
+}
+
 static std::string readFile(std::filesystem::path filePath)
 {
     std::ifstream file(filePath, std::ios::binary);
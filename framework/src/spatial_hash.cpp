@@ -0,0 +1,114 @@
+#include "spatial_hash.h"
+#include "job_system.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+// Points per job when computing their buckets.
+static constexpr size_t GRAIN_SIZE = 16384;
+
+SpatialHash::SpatialHash(float cellSize)
+    : m_cellSize(cellSize)
+    , m_inverseCellSize(1.0f / cellSize)
+    , m_bucketStarts(2, 0)
+{
+    assert(cellSize > 0.0f);
+}
+
+float SpatialHash::cellSize() const
+{
+    return m_cellSize;
+}
+
+glm::ivec3 SpatialHash::cell(const glm::vec3& point) const
+{
+    return glm::ivec3(glm::floor(point * m_inverseCellSize));
+}
+
+uint32_t SpatialHash::bucket(const glm::ivec3& cell) const
+{
+    // Hash of the row, with the low bits mixed like the finalizer of MurmurHash3 so that they can be masked.
+    uint32_t hash = static_cast<uint32_t>(cell.y) * 0x8DA6B343u + static_cast<uint32_t>(cell.z) * 0xCB1AB31Fu;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return (hash + static_cast<uint32_t>(cell.x)) & (m_numBuckets - 1);
+}
+
+SpatialHash::NeighbourRanges SpatialHash::neighbourRanges(const glm::ivec3& cell) const
+{
+    // Sorted distinct buckets; cells that share a bucket must only be visited once, or their points would be counted
+    // twice.
+    std::array<uint32_t, 27> buckets;
+    size_t numBuckets = 0;
+    for (int z = -1; z <= 1; ++z) {
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x)
+                buckets[numBuckets++] = bucket(cell + glm::ivec3(x, y, z));
+        }
+    }
+    std::sort(std::begin(buckets), std::end(buckets));
+    numBuckets = static_cast<size_t>(std::unique(std::begin(buckets), std::end(buckets)) - std::begin(buckets));
+
+    // Consecutive buckets are stored after each other, so they merge into one range.
+    NeighbourRanges result { {}, {}, 0 };
+    for (size_t i = 0; i < numBuckets; ++i) {
+        if (result.size > 0 && buckets[i] == buckets[i - 1] + 1) {
+            result.ends[result.size - 1] = m_bucketStarts[buckets[i] + 1];
+        } else {
+            result.begins[result.size] = m_bucketStarts[buckets[i]];
+            result.ends[result.size] = m_bucketStarts[buckets[i] + 1];
+            result.size++;
+        }
+    }
+    return result;
+}
+
+void SpatialHash::build(std::span<const float> x, std::span<const float> y, std::span<const float> z, JobSystem* jobSystem)
+{
+    assert(x.size() == y.size() && x.size() == z.size());
+    const size_t numPoints = x.size();
+    m_numBuckets = std::bit_ceil(static_cast<uint32_t>(std::max<size_t>(numPoints * 2, 1)));
+
+    m_pointBuckets.resize(numPoints);
+    const auto computeBuckets = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            m_pointBuckets[i] = bucket(cell(glm::vec3(x[i], y[i], z[i])));
+    };
+    if (jobSystem)
+        jobSystem->parallelFor(0, numPoints, GRAIN_SIZE, computeBuckets);
+    else
+        computeBuckets(0, numPoints);
+
+    // Counting sort: count the points per bucket, turn the counts into start positions and scatter the indices.
+    m_bucketStarts.assign(size_t(m_numBuckets) + 1, 0);
+    for (uint32_t pointBucket : m_pointBuckets)
+        m_bucketStarts[pointBucket + 1]++;
+    for (size_t i = 1; i < m_bucketStarts.size(); ++i)
+        m_bucketStarts[i] += m_bucketStarts[i - 1];
+    m_order.resize(numPoints);
+    for (size_t i = 0; i < numPoints; ++i)
+        m_order[m_bucketStarts[m_pointBuckets[i]]++] = static_cast<uint32_t>(i);
+    // The scatter advanced every start to the start of the next bucket.
+    std::copy_backward(std::begin(m_bucketStarts), std::end(m_bucketStarts) - 1, std::end(m_bucketStarts));
+    m_bucketStarts[0] = 0;
+}
+
+std::span<const uint32_t> SpatialHash::order() const
+{
+    return m_order;
+}
+
+uint32_t SpatialHash::bucketBegin(uint32_t bucket) const
+{
+    return m_bucketStarts[bucket];
+}
+
+uint32_t SpatialHash::bucketEnd(uint32_t bucket) const
+{
+    return m_bucketStarts[bucket + 1];
+}
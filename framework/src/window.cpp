@@ -5,8 +5,14 @@
 #undef IMGUI_IMPL_OPENGL_LOADER_GLEW
 #define IMGUI_IMPL_OPENGL_LOADER_GLAD 1
 #include <imgui/imgui_impl_opengl3.h>
+#include <cstring>
 #include <iostream>
 #include <stb/stb_image_write.h>
+#if FRAMEWORK_HEADLESS_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 static void glfwErrorCallback(int error, const char* description)
 {
@@ -15,6 +21,9 @@ static void glfwErrorCallback(int error, const char* description)
     exit(1);
 }
 
+// The loader that GLAD was initialized with.
+static GLADloadproc s_getProcAddress = nullptr;
+
 #ifdef GL_DEBUG_SEVERITY_NOTIFICATION
 // OpenGL debug callback
 void APIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
@@ -28,18 +37,17 @@ void APIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id, GLenum seve
 Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion, bool presentable, bool visible)
     : m_presentable(presentable), m_glVersion(glVersion)
 {
-    glfwSetErrorCallback(glfwErrorCallback);
-    if (!glfwInit()) {
-        std::cerr << "Could not initialize GLFW" << std::endl;
-        exit(1);
-    }
-
-    if (m_presentable) {
-        if (visible) {
-            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
-        }
-        else {
-            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLADloadproc getProcAddress = (GLADloadproc)glfwGetProcAddress;
+    if (!m_presentable && createSurfacelessContext()) {
+        m_windowSize = windowSize;
+#if FRAMEWORK_HEADLESS_EGL
+        getProcAddress = (GLADloadproc)eglGetProcAddress;
+#endif
+    } else {
+        glfwSetErrorCallback(glfwErrorCallback);
+        if (!glfwInit()) {
+            std::cerr << "Could not initialize GLFW" << std::endl;
+            exit(1);
         }
 
         if (glVersion == OpenGLVersion::GL3) {
@@ -60,63 +68,74 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
 
-        // HighDPI awareness
-        // https://decovar.dev/blog/2019/08/04/glfw-dear-imgui/#high-dpi
+        if (m_presentable) {
+            if (visible) {
+                glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+            }
+            else {
+                glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            }
+
+            // HighDPI awareness
+            // https://decovar.dev/blog/2019/08/04/glfw-dear-imgui/#high-dpi
 #ifdef _WIN32
-        // if it's a HighDPI monitor, try to scale everything
-        GLFWmonitor* monitor = glfwGetPrimaryMonitor();
-        float xscale, yscale;
-        glfwGetMonitorContentScale(monitor, &xscale, &yscale);
-        if (xscale > 1 || yscale > 1) {
-            m_dpiScalingFactor = xscale;
-            glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
-        }
+            // if it's a HighDPI monitor, try to scale everything
+            GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+            float xscale, yscale;
+            glfwGetMonitorContentScale(monitor, &xscale, &yscale);
+            if (xscale > 1 || yscale > 1) {
+                m_dpiScalingFactor = xscale;
+                glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
+            }
 #elif __APPLE__
-        // to prevent 1200x800 from becoming 2400x1600
-        glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GLFW_FALSE);
+            // to prevent 1200x800 from becoming 2400x1600
+            glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GLFW_FALSE);
 #endif
-    } else {
-        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-    }
-
-    // std::string_view does not guarantee that the string contains a terminator character.
-    const std::string titleString { title };
-    m_pWindow = glfwCreateWindow(windowSize.x, windowSize.y, titleString.c_str(), nullptr, nullptr);
-    if (m_pWindow == nullptr) {
-        glfwTerminate();
-        std::cerr << "Could not create GLFW window" << std::endl;
-        exit(1);
-    }
-    glfwMakeContextCurrent(m_pWindow);
-    glfwSwapInterval(1); // Enable vsync. To disable vsync set this to 0.
-
-    float xScale, yScale;
-    glfwGetWindowContentScale(m_pWindow, &xScale, &yScale);
-    //std::cout << "Window content scale: " << xScale << ", " << yScale << std::endl;
-
-    glfwGetWindowSize(m_pWindow, &m_windowSize.x, &m_windowSize.y);
+        } else {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
 
-    if (m_presentable) {
-        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        // std::string_view does not guarantee that the string contains a terminator character.
+        const std::string titleString { title };
+        m_pWindow = glfwCreateWindow(windowSize.x, windowSize.y, titleString.c_str(), nullptr, nullptr);
+        if (m_pWindow == nullptr) {
             glfwTerminate();
-            std::cerr << "Could not initialize GLEW" << std::endl;
+            std::cerr << "Could not create GLFW window" << std::endl;
             exit(1);
         }
-        int glVersionMajor, glVersionMinor;
-        glGetIntegerv(GL_MAJOR_VERSION, &glVersionMajor);
-        glGetIntegerv(GL_MINOR_VERSION, &glVersionMinor);
-        std::cout << "Initialized OpenGL version " << glVersionMajor << "." << glVersionMinor << std::endl;
+        glfwMakeContextCurrent(m_pWindow);
+        glfwSwapInterval(1); // Enable vsync. To disable vsync set this to 0.
+
+        float xScale, yScale;
+        glfwGetWindowContentScale(m_pWindow, &xScale, &yScale);
+        //std::cout << "Window content scale: " << xScale << ", " << yScale << std::endl;
+
+        glfwGetWindowSize(m_pWindow, &m_windowSize.x, &m_windowSize.y);
+        if (!m_presentable)
+            m_windowSize = windowSize;
+    }
 
-        // NOTE(Mathijs): this is not supported on macOS since Apple can't be bothered to update
-        //  their OpenGL version past 4.1 which released in 2010!
+    if (!gladLoadGLLoader(getProcAddress)) {
+        std::cerr << "Could not initialize GLAD" << std::endl;
+        exit(1);
+    }
+    s_getProcAddress = getProcAddress;
+    int glVersionMajor, glVersionMinor;
+    glGetIntegerv(GL_MAJOR_VERSION, &glVersionMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &glVersionMinor);
+    std::cout << "Initialized OpenGL version " << glVersionMajor << "." << glVersionMinor << std::endl;
+
+    // NOTE(Mathijs): this is not supported on macOS since Apple can't be bothered to update
+    //  their OpenGL version past 4.1 which released in 2010!
 #if !defined(__APPLE__) && defined(GL_DEBUG_SEVERITY_NOTIFICATION) && !defined(NDEBUG)
-        // Custom debug message with breakpoints at the exact error. Only supported on OpenGL 4.3 and higher.
-        if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 3)) {
-            glDebugMessageCallback(glDebugCallback, nullptr);
-            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-        }
+    // Custom debug message with breakpoints at the exact error. Only supported on OpenGL 4.3 and higher.
+    if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 3)) {
+        glDebugMessageCallback(glDebugCallback, nullptr);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
 #endif
 
+    if (m_presentable) {
         // Setup Dear ImGui context.
         ImGui::CreateContext();
         ImGuiIO& io = ImGui::GetIO();
@@ -163,6 +182,8 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         glfwSetCursorPosCallback(m_pWindow, mouseMoveCallback);
         glfwSetScrollCallback(m_pWindow, scrollCallback);
         glfwSetWindowSizeCallback(m_pWindow, windowSizeCallback);
+    } else {
+        createOffscreenFramebuffer();
     }
 }
 
@@ -184,25 +205,118 @@ Window::~Window()
         };
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
+    } else {
+        glDeleteFramebuffers(1, &m_offscreenFramebuffer);
+        glDeleteRenderbuffers(static_cast<GLsizei>(m_offscreenRenderbuffers.size()), m_offscreenRenderbuffers.data());
+    }
+
+    if (m_pWindow) {
+        glfwDestroyWindow(m_pWindow);
+        glfwTerminate();
+    }
+#if FRAMEWORK_HEADLESS_EGL
+    if (m_eglDisplay) {
+        eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_eglDisplay, m_eglContext);
+        eglTerminate(m_eglDisplay);
+    }
+#endif
+}
+
+bool Window::createSurfacelessContext()
+{
+#if FRAMEWORK_HEADLESS_EGL
+    // Mesa's surfaceless platform needs neither a display server nor a GPU (it falls back to llvmpipe).
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    const auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!clientExtensions || !std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless") || !getPlatformDisplay)
+        return false;
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        return false;
+    const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!displayExtensions || !std::strstr(displayExtensions, "EGL_KHR_surfaceless_context") || !std::strstr(displayExtensions, "EGL_KHR_no_config_context") || !eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(display);
+        return false;
+    }
+
+    std::vector<EGLint> attributes;
+    switch (m_glVersion) {
+    case OpenGLVersion::GL2: {
+        attributes = { EGL_CONTEXT_MAJOR_VERSION, 2, EGL_CONTEXT_MINOR_VERSION, 1 };
+    } break;
+    case OpenGLVersion::GL3: {
+        attributes = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT };
+    } break;
+    case OpenGLVersion::GL41: {
+        attributes = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 1, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE };
+    } break;
+    case OpenGLVersion::GL45: {
+        attributes = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT };
+    } break;
+    };
+#ifndef NDEBUG
+    attributes.insert(std::end(attributes), { EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE });
+#endif
+    attributes.push_back(EGL_NONE);
+
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes.data());
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        return false;
     }
+    m_eglDisplay = display;
+    m_eglContext = context;
+    return true;
+#else
+    return false;
+#endif
+}
 
-    glfwDestroyWindow(m_pWindow);
-    glfwTerminate();
+void Window::createOffscreenFramebuffer()
+{
+    glGenRenderbuffers(static_cast<GLsizei>(m_offscreenRenderbuffers.size()), m_offscreenRenderbuffers.data());
+    glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenRenderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_windowSize.x, m_windowSize.y);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenRenderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_windowSize.x, m_windowSize.y);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_offscreenFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_offscreenFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_offscreenRenderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_offscreenRenderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Could not create the offscreen framebuffer" << std::endl;
+        exit(1);
+    }
+    glViewport(0, 0, m_windowSize.x, m_windowSize.y);
 }
 
 void Window::close()
 {
-    glfwSetWindowShouldClose(m_pWindow, 1);
+    if (m_pWindow)
+        glfwSetWindowShouldClose(m_pWindow, 1);
+    else
+        m_shouldClose = true;
 }
 
 bool Window::shouldClose()
 {
+    if (!m_pWindow)
+        return m_shouldClose;
     return glfwWindowShouldClose(m_pWindow) != 0;
 }
 
 void Window::updateInput()
 {
-    glfwPollEvents();
+    if (m_pWindow)
+        glfwPollEvents();
 
     if (m_presentable) {
         // Start the Dear ImGui frame.
@@ -245,14 +359,30 @@ void Window::swapBuffers()
         };
     }
 
-    glfwSwapBuffers(m_pWindow);
+    if (m_presentable)
+        glfwSwapBuffers(m_pWindow);
+    else
+        glFlush(); // Nothing to present; make sure the frame is submitted.
+}
+
+void Window::setVSync(bool enabled)
+{
+    if (m_presentable)
+        glfwSwapInterval(enabled ? 1 : 0);
+}
+
+GLuint Window::getFramebuffer() const
+{
+    return m_offscreenFramebuffer;
 }
 
 
 void Window::renderToImage (const std::filesystem::path& filePath, const bool flipY) {
         std::vector <GLubyte> pixels;
-        pixels.reserve (4 * m_windowSize.x * m_windowSize.y);
+        pixels.resize (4 * m_windowSize.x * m_windowSize.y);
 
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_offscreenFramebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
         glReadPixels(0, 0, m_windowSize.x, m_windowSize.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
 
         std::string filePathString = filePath.string();
@@ -377,16 +507,18 @@ void Window::windowSizeCallback(GLFWwindow* window, int width, int height)
 
 bool Window::isKeyPressed(int key) const
 {
-    return glfwGetKey(m_pWindow, key) == GLFW_PRESS;
+    return m_presentable && glfwGetKey(m_pWindow, key) == GLFW_PRESS;
 }
 
 bool Window::isMouseButtonPressed(int button) const
 {
-    return glfwGetMouseButton(m_pWindow, button) == GLFW_PRESS;
+    return m_presentable && glfwGetMouseButton(m_pWindow, button) == GLFW_PRESS;
 }
 
 glm::vec2 Window::getCursorPos() const
 {
+    if (!m_presentable)
+        return glm::vec2(0.0f);
     double x, y;
     glfwGetCursorPos(m_pWindow, &x, &y);
     return glm::vec2(x, m_windowSize.y - 1 - y);
@@ -402,6 +534,8 @@ glm::vec2 Window::getCursorPixel() const
     // https://stackoverflow.com/questions/45796287/screen-coordinates-to-world-coordinates
     // Coordinates returned by glfwGetCursorPos are in screen coordinates which may not map 1:1 to
     // pixel coordinates on some machines (e.g. with resolution scaling).
+    if (!m_presentable)
+        return glm::vec2(0.5f);
     glm::ivec2 screenSize;
     glfwGetWindowSize(m_pWindow, &screenSize.x, &screenSize.y);
     glm::ivec2 framebufferSize;
@@ -418,6 +552,8 @@ glm::vec2 Window::getCursorPixel() const
 
 void Window::setMouseCapture(bool capture)
 {
+    if (!m_presentable)
+        return;
     if (capture) {
         glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     } else {
@@ -434,6 +570,8 @@ glm::ivec2 Window::getWindowSize() const
 
 glm::ivec2 Window::getFrameBufferSize() const
 {
+    if (!m_presentable)
+        return m_windowSize;
     glm::ivec2 out {};
     glfwGetFramebufferSize(m_pWindow, &out.x, &out.y);
     return out;
@@ -450,3 +588,8 @@ float Window::getDpiScalingFactor() const
 {
     return m_dpiScalingFactor;
 }
+
+void* Window::getProcAddress(const char* name)
+{
+    return s_getProcAddress ? s_getProcAddress(name) : nullptr;
+}
@@ -31,6 +31,26 @@ in vec4 fragTangent;
 
 layout(location = 0) out vec4 fragColor;
 
+// Defined in clustered_lights_frag.glsl
+uvec2 findClusterLights(vec3 worldPosition);
+vec3 clusterLightRadiance(uint i, vec3 worldPosition, out vec3 L);
+// Defined in shadows_frag.glsl
+float sunShadow(vec3 worldPosition, vec3 N, vec3 L);
+
+// Diffuse + specular intensity of a light in direction L
+vec3 phong(vec3 N, vec3 V, vec3 L, vec3 kdColor)
+{
+    // Reflect expects the incident vector; reflect(-L, N) reflects the light direction around the normal
+    vec3 R = reflect(-L, N);
+    float diff = max(dot(N, L), 0.0);
+    float spec = 0.0;
+    if (diff > 0.0)
+    {
+        spec = pow(max(dot(R, V), 0.0), shininess);
+    }
+    return kdColor * diff + ks * spec;
+}
+
 void main()
 {
     // Base normal (transformed by normalModelMatrix in vertex shader already)
@@ -58,20 +78,19 @@ void main()
             // Optionally flip green channel depending on normal map convention
             Nsample = normalize(TBN * mapN);
         }
-        // Reflect expects the incident vector; reflect(-L, Nsample) reflects the light direction around the normal
-        vec3 R = reflect(-L, Nsample);
         vec3 V = normalize(cameraPosition - fragPosition);
 
-        float diff = max(dot(Nsample, L), 0.0);
-        float spec = 0.0;
-        if (diff > 0.0)
-        {
-            spec = pow(max(dot(R, V), 0.0), shininess);
-        }
-
         vec3 ambient = ka * lightColor;
 
-        vec3 color = ambient + (kdColor * diff + ks * spec) * lightColor;
+        vec3 color = ambient + phong(Nsample, V, L, kdColor) * lightColor * sunShadow(fragPosition, N, L);
+
+        // Point lights of the cluster that contains this fragment
+        uvec2 clusterLights = findClusterLights(fragPosition);
+        for (uint i = clusterLights.x; i < clusterLights.x + clusterLights.y; ++i) {
+            vec3 pointL;
+            vec3 radiance = clusterLightRadiance(i, fragPosition, pointL);
+            color += phong(Nsample, V, pointL, kdColor) * radiance;
+        }
 
         if (useEnvironmentMap) {
             vec3 I = normalize(fragPosition - cameraPosition);
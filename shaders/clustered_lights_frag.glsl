@@ -0,0 +1,77 @@
+#version 410
+
+// Clustered point lights (see src/light_clusters.h). This file has no main(); it is linked into the fragment
+// shaders that loop over the lights of their cluster.
+uniform samplerBuffer clusterLightData;      // Two texels per light: (position, radius) and (color, shadow index).
+uniform usamplerBuffer clusterData;          // One texel per cluster: (offset into clusterLightIndices, number of lights).
+uniform usamplerBuffer clusterLightIndices;
+uniform mat4 clusterViewMatrix;
+uniform ivec3 clusterGridSize;
+uniform vec2 clusterTileScale;               // Clusters per pixel in x and y.
+uniform vec2 clusterDepthScaleBias;          // slice = log(viewDepth) * scale - bias
+
+// Cube map faces of the shadowed lights, packed into one atlas (see src/point_shadow_atlas.h).
+uniform sampler2DShadow pointShadowAtlas;
+uniform samplerBuffer pointShadowData;       // Seven texels per shadowed light: (tile offset, tile size) per face, (near, far).
+
+// Orientation of the cube map faces (+X, -X, +Y, -Y, +Z, -Z), must match src/point_shadow_atlas.cpp.
+const vec3 faceForward[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 faceUp[6] = vec3[6](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+// Fraction of the light that reaches the fragment; toFragment is the vector from the light to the fragment.
+float pointShadow(int shadowIndex, vec3 toFragment)
+{
+    // The face is picked by the major axis, exactly like a cube map lookup.
+    vec3 absolute = abs(toFragment);
+    int face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+        face = toFragment.x > 0.0 ? 0 : 1;
+    else if (absolute.y >= absolute.z)
+        face = toFragment.y > 0.0 ? 2 : 3;
+    else
+        face = toFragment.z > 0.0 ? 4 : 5;
+
+    vec4 tile = texelFetch(pointShadowData, shadowIndex * 7 + face);
+    vec2 nearFar = texelFetch(pointShadowData, shadowIndex * 7 + 6).xy;
+
+    // Project with the same view (lookAt) and 90 degree perspective matrix that rendered the face.
+    vec3 right = normalize(cross(faceForward[face], faceUp[face]));
+    vec3 up = cross(right, faceForward[face]);
+    float distance = dot(toFragment, faceForward[face]);
+    vec2 ndc = vec2(dot(toFragment, right), dot(toFragment, up)) / distance;
+    float depthNdc = (nearFar.y + nearFar.x) / (nearFar.y - nearFar.x) - 2.0 * nearFar.y * nearFar.x / ((nearFar.y - nearFar.x) * distance);
+
+    // Stay half a texel inside the tile so bilinear filtering does not read neighbouring tiles.
+    float halfTexel = 0.5 / (tile.z * float(textureSize(pointShadowAtlas, 0).x));
+    vec2 uv = tile.xy + clamp(ndc * 0.5 + 0.5, halfTexel, 1.0 - halfTexel) * tile.z;
+    return texture(pointShadowAtlas, vec3(uv, depthNdc * 0.5 + 0.5 - 0.0005));
+}
+
+// Offset and number of lights of the cluster that contains the current fragment.
+uvec2 findClusterLights(vec3 worldPosition)
+{
+    float viewDepth = -(clusterViewMatrix * vec4(worldPosition, 1.0)).z;
+    int slice = int(log(max(viewDepth, 1e-4)) * clusterDepthScaleBias.x - clusterDepthScaleBias.y);
+    ivec3 cluster = clamp(ivec3(ivec2(gl_FragCoord.xy * clusterTileScale), slice), ivec3(0), clusterGridSize - 1);
+    int index = (cluster.z * clusterGridSize.y + cluster.y) * clusterGridSize.x + cluster.x;
+    return texelFetch(clusterData, index).xy;
+}
+
+// Color of the i'th light of the index list arriving at worldPosition, and the direction towards it.
+vec3 clusterLightRadiance(uint i, vec3 worldPosition, out vec3 L)
+{
+    int light = int(texelFetch(clusterLightIndices, int(i)).r);
+    vec4 positionRadius = texelFetch(clusterLightData, 2 * light);
+    vec4 colorShadow = texelFetch(clusterLightData, 2 * light + 1);
+    vec3 color = colorShadow.rgb;
+
+    vec3 toLight = positionRadius.xyz - worldPosition;
+    float distance2 = dot(toLight, toLight);
+    L = toLight * inversesqrt(max(distance2, 1e-8));
+
+    // Inverse square falloff, windowed so that it reaches zero at the light radius.
+    float ratio2 = distance2 / (positionRadius.w * positionRadius.w);
+    float window = clamp(1.0 - ratio2 * ratio2, 0.0, 1.0);
+    float shadow = colorShadow.w >= 0.0 ? pointShadow(int(colorShadow.w), -toLight) : 1.0;
+    return color * (window * window * shadow) / (distance2 + 1.0);
+}
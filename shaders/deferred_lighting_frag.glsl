@@ -0,0 +1,60 @@
+#version 410
+
+// Lighting pass of the deferred renderer. G-buffer layout (written by gbuffer_frag.glsl):
+//  gbufferAlbedo   RGBA8: sqrt(albedo), 1 if the surface is lit (else the albedo is the final color).
+//  gbufferNormal   RG16:  octahedral encoded shading normal.
+//  gbufferMaterial RGBA8: roughness, metallic, ambient occlusion, environment reflection on/off.
+//  gbufferDepth:          depth buffer; the world position is reconstructed from it.
+// The depth is written to the window framebuffer too, so forward passes that follow are depth tested against it.
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferMaterial;
+uniform sampler2D gbufferDepth;
+uniform mat4 inverseViewProjection;
+
+layout(location = 0) out vec4 fragColor;
+
+// Defined in pbr_lighting_frag.glsl
+vec3 shadeSurface(vec3 position, vec3 N, vec3 Nsample, vec3 albedo, float rough, float metallic, float ao, bool reflective);
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 octahedralDecode(vec2 e)
+{
+    vec2 p = e * 2.0 - 1.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferDepth, texel, 0).r;
+    // Nothing was drawn here; leave the pixel to the skybox.
+    if (depth == 1.0)
+        discard;
+    gl_FragDepth = depth;
+
+    vec4 albedoLit = texelFetch(gbufferAlbedo, texel, 0);
+    vec3 albedo = albedoLit.rgb * albedoLit.rgb;
+    if (albedoLit.a < 0.5) {
+        fragColor = vec4(albedo, 1.0);
+        return;
+    }
+
+    vec4 ndc = vec4(gl_FragCoord.xy / vec2(textureSize(gbufferDepth, 0)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 worldPosition = inverseViewProjection * ndc;
+    vec3 position = worldPosition.xyz / worldPosition.w;
+
+    // Only the shading normal is stored, so it also offsets the shadow lookup.
+    vec3 N = octahedralDecode(texelFetch(gbufferNormal, texel, 0).xy);
+    vec4 material = texelFetch(gbufferMaterial, texel, 0);
+    vec3 color = shadeSurface(position, N, N, albedo, material.r, material.g, material.b, material.a > 0.5);
+    // Linear back to sRGB
+    fragColor = vec4(pow(color, vec3(1.0/2.2)), 1.0);
+}
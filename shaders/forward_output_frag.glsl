@@ -0,0 +1,9 @@
+#version 410
+// writeFragment() of transparent surfaces that are alpha blended in back to front order (see oit_output_frag.glsl).
+
+layout(location = 0) out vec4 fragColor;
+
+void writeFragment(vec4 color)
+{
+    fragColor = color;
+}
@@ -0,0 +1,40 @@
+#version 410
+
+// G-buffer of the deferred renderer (see deferred_lighting_frag.glsl for the layout).
+uniform bool useEnvironmentMap;
+
+layout(location = 0) out vec4 gbufferAlbedo;
+layout(location = 1) out vec2 gbufferNormal;
+layout(location = 2) out vec4 gbufferMaterial;
+
+// Defined in surface_frag.glsl
+bool evaluateSurface(out vec3 N, out vec3 Nsample, out vec3 albedo, out float rough, out float metallic, out float ao);
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014), mapped to [0, 1].
+vec2 octahedralEncode(vec3 n)
+{
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0)
+        p = (1.0 - abs(p.yx)) * signNotZero(p);
+    return p * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec3 N, Nsample, albedo;
+    float rough, metallic, ao;
+    bool lit = evaluateSurface(N, Nsample, albedo, rough, metallic, ao);
+    // Unlit fragments show their normal; store it in the albedo so the lighting pass can output it directly.
+    if (!lit)
+        albedo = N;
+
+    // The square root spends the 8 bits more evenly over the perceived brightness (cheap gamma 2 encoding).
+    gbufferAlbedo = vec4(sqrt(clamp(albedo, 0.0, 1.0)), lit ? 1.0 : 0.0);
+    gbufferNormal = octahedralEncode(Nsample);
+    gbufferMaterial = vec4(rough, metallic, ao, useEnvironmentMap ? 1.0 : 0.0);
+}
@@ -0,0 +1,63 @@
+#version 410
+// Transform feedback update of one particle slot of GPUParticleSystem: respawn it if an emitter claimed the slot,
+// otherwise integrate it like ParticleSystem::simulate().
+const int MAX_EMITTERS = 8;
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aVelocity;
+layout(location = 2) in float aLife;
+
+out vec3 outPosition;
+out vec3 outVelocity;
+out float outLife;
+
+uniform int numEmitters;
+uniform vec3 emitterPositions[MAX_EMITTERS];
+// Every emitter respawns the slots [first, first + count) of the ring of capacity slots.
+uniform int emitterFirstSlots[MAX_EMITTERS];
+uniform int emitterCounts[MAX_EMITTERS];
+uniform int capacity;
+uniform uint seed;
+uniform float deltaTime;
+uniform float gravity;
+uniform float lifetime;
+
+// PCG hash (Jarzynski and Olano, "Hash Functions for GPU Rendering").
+uint pcgHash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Uniformly distributed in [0, 1).
+float nextRandom(inout uint state)
+{
+    state = pcgHash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+void main()
+{
+    int slot = gl_VertexID;
+    for (int i = 0; i < numEmitters; ++i) {
+        if ((slot - emitterFirstSlots[i] + capacity) % capacity < emitterCounts[i]) {
+            uint state = pcgHash(uint(slot) ^ pcgHash(seed));
+            outPosition = emitterPositions[i];
+            outVelocity = vec3((nextRandom(state) * 2.0 - 1.0) * 0.5, nextRandom(state), (nextRandom(state) * 2.0 - 1.0) * 0.5);
+            outLife = lifetime;
+            return;
+        }
+    }
+
+    if (aLife <= 0.0) {
+        // Dead slots stay dead until an emitter claims them.
+        outPosition = aPosition;
+        outVelocity = aVelocity;
+        outLife = aLife;
+        return;
+    }
+    outLife = aLife - deltaTime;
+    outPosition = aPosition + aVelocity * deltaTime;
+    outVelocity = vec3(aVelocity.x, aVelocity.y - gravity * deltaTime, aVelocity.z);
+}
@@ -0,0 +1,29 @@
+#version 410
+
+// Same outputs as shader_vert.glsl, but the model and normal matrices come from per-instance attributes.
+uniform mat4 viewProjectionMatrix;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in vec4 tangent;
+layout(location = 4) in mat4 instanceModelMatrix; // Locations 4-7
+layout(location = 8) in mat3 instanceNormalModelMatrix; // Locations 8-10
+
+out vec3 fragPosition;
+out vec3 fragNormal;
+out vec2 fragTexCoord;
+out vec4 fragTangent;
+
+void main()
+{
+    vec4 worldPosition = instanceModelMatrix * vec4(position, 1);
+    gl_Position = viewProjectionMatrix * worldPosition;
+
+    fragPosition    = worldPosition.xyz;
+    fragNormal      = instanceNormalModelMatrix * normal;
+    fragTexCoord    = texCoord;
+    // Transform tangent to stay in the same space as the normal
+    vec3 t_transformed = normalize(instanceNormalModelMatrix * tangent.xyz);
+    fragTangent     = vec4(t_transformed, tangent.w);
+}
@@ -0,0 +1,23 @@
+#version 410
+// Resolve the weighted blended transparency targets (see oit_output_frag.glsl) over the opaque image, which is
+// blended with SRC_ALPHA, ONE_MINUS_SRC_ALPHA.
+
+uniform sampler2D accumulationTexture;
+uniform sampler2D revealageTexture;
+
+layout(location = 0) out vec4 fragColor;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(revealageTexture, pixel, 0).r;
+    if (revealage >= 1.0)
+        discard; // No transparent surface covers this pixel.
+
+    vec4 accumulation = texelFetch(accumulationTexture, pixel, 0);
+    // Guard against overflow of the half float sums.
+    if (isinf(max(max(abs(accumulation.r), abs(accumulation.g)), abs(accumulation.b))))
+        accumulation.rgb = vec3(accumulation.a);
+    vec3 averageColor = accumulation.rgb / max(accumulation.a, 1e-5);
+    fragColor = vec4(averageColor, 1.0 - revealage);
+}
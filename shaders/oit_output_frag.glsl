@@ -0,0 +1,16 @@
+#version 410
+// writeFragment() of transparent surfaces for weighted blended order-independent transparency (McGuire and Bavoil,
+// "Weighted Blended Order-Independent Transparency"). The accumulation target sums the weighted premultiplied colors
+// (blended with ONE, ONE) and the revealage target multiplies the transmittances (ZERO, ONE_MINUS_SRC_COLOR), so
+// the surfaces can be drawn in any order; oit_composite_frag.glsl resolves them.
+
+layout(location = 0) out vec4 accumulation;
+layout(location = 1) out float revealage;
+
+void writeFragment(vec4 color)
+{
+    // Nearby and more opaque surfaces get a larger weight, so they dominate the average color.
+    float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+    accumulation = vec4(color.rgb * color.a, color.a) * weight;
+    revealage = color.a;
+}
@@ -0,0 +1,19 @@
+#version 410
+// Downsample the opaque depth for the reduced resolution particle pass: every texel covers scale x scale
+// full resolution pixels and keeps the farthest of them, so particles are only hidden where the whole block is
+// occluded. particle_upsample_frag.glsl takes care of the edges.
+
+uniform sampler2D depthTexture;
+uniform int scale;
+
+void main()
+{
+    ivec2 maxPixel = textureSize(depthTexture, 0) - 1;
+    ivec2 firstPixel = ivec2(gl_FragCoord.xy) * scale;
+    float depth = 0.0;
+    for (int y = 0; y < scale; y++) {
+        for (int x = 0; x < scale; x++)
+            depth = max(depth, texelFetch(depthTexture, min(firstPixel + ivec2(x, y), maxPixel), 0).r);
+    }
+    gl_FragDepth = depth;
+}
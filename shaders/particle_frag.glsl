@@ -1,9 +1,11 @@
 #version 410
 in vec4 vertexColor;
-out vec4 FragColor;
+
+// Implemented by forward_output_frag.glsl or oit_output_frag.glsl.
+void writeFragment(vec4 color);
 
 void main() {
 	vec2 coord = gl_PointCoord - vec2(0.5);
 	if (length(coord) > 0.5) discard;
-	FragColor = vec4(vertexColor.rgb, vertexColor.a);
+	writeFragment(vertexColor);
 }
@@ -0,0 +1,68 @@
+#version 410
+// Depth-aware (bilateral) upsample of the reduced resolution particle accumulation and revealage into the full
+// resolution order-independent transparency targets, which blend with the same functions as oit_output_frag.glsl.
+// Each pixel mixes the four nearest low resolution texels with bilinear weights that are scaled down by how much
+// the opaque depth behind them differs from the pixel's own, so particles do not bleed across depth edges. When
+// none of the four texels saw the pixel's surface (a foreground silhouette thinner than a texel), the particles
+// are faded out instead of renormalizing weights that are all near zero.
+
+uniform sampler2D accumulationTexture;
+uniform sampler2D revealageTexture;
+uniform sampler2D lowResolutionDepthTexture;
+uniform sampler2D depthTexture;
+uniform mat4 projection;
+uniform int scale;
+
+layout(location = 0) out vec4 accumulation;
+layout(location = 1) out float revealage;
+
+// Range of the smallest relative depth difference over which a pixel fades out.
+const float REJECT_DEPTH_START = 0.05;
+const float REJECT_DEPTH_END = 0.1;
+
+// Distance from the camera along the view direction.
+float linearDepth(float depth)
+{
+    return projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+}
+
+void main()
+{
+    ivec2 maxTexel = textureSize(revealageTexture, 0) - 1;
+    vec2 position = gl_FragCoord.xy / float(scale) - 0.5;
+    ivec2 firstTexel = ivec2(floor(position));
+    vec2 fraction = position - vec2(firstTexel);
+
+    ivec2 texels[4];
+    float texelRevealages[4];
+    bool covered = false;
+    for (int i = 0; i < 4; i++) {
+        texels[i] = clamp(firstTexel + ivec2(i & 1, i >> 1), ivec2(0), maxTexel);
+        texelRevealages[i] = texelFetch(revealageTexture, texels[i], 0).r;
+        covered = covered || texelRevealages[i] < 1.0;
+    }
+    if (!covered)
+        discard; // No particle near this pixel.
+
+    float pixelDepth = linearDepth(texelFetch(depthTexture, ivec2(gl_FragCoord.xy), 0).r);
+    vec4 accumulationSum = vec4(0.0);
+    float revealageSum = 0.0;
+    float weightSum = 0.0;
+    float minDepthDifference = 1e30;
+    for (int i = 0; i < 4; i++) {
+        vec2 bilinear = mix(1.0 - fraction, fraction, vec2(i & 1, i >> 1));
+        float depthDifference = abs(linearDepth(texelFetch(lowResolutionDepthTexture, texels[i], 0).r) - pixelDepth) / pixelDepth;
+        float weight = bilinear.x * bilinear.y / (1e-3 + depthDifference);
+        minDepthDifference = min(minDepthDifference, depthDifference);
+        accumulationSum += texelFetch(accumulationTexture, texels[i], 0) * weight;
+        revealageSum += texelRevealages[i] * weight;
+        weightSum += weight;
+    }
+
+    float fade = 1.0 - smoothstep(REJECT_DEPTH_START, REJECT_DEPTH_END, minDepthDifference);
+    if (fade == 0.0)
+        discard;
+    accumulation = accumulationSum / weightSum * fade;
+    // The targets multiply by one minus this.
+    revealage = (1.0 - revealageSum / weightSum) * fade;
+}
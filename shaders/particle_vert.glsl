@@ -1,6 +1,9 @@
 #version 410
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec4 aColor;
+// One attribute array per component, see ParticleVertices.
+layout(location = 0) in float aPositionX;
+layout(location = 1) in float aPositionY;
+layout(location = 2) in float aPositionZ;
+layout(location = 3) in float aLife;
 
 out vec4 vertexColor;
 
@@ -9,7 +12,8 @@ uniform mat4 projection;
 uniform float pointSize; 
 
 void main() {
-    gl_Position = projection * view * vec4(aPos, 1.0);
-    vertexColor = aColor;
+    // Dead slots of the GPU particles are moved outside of the clip volume.
+    gl_Position = aLife > 0.0 ? projection * view * vec4(aPositionX, aPositionY, aPositionZ, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+    vertexColor = vec4(0.5, 0.7, 1.0, max(aLife, 0.0)); // light blue, fading out
     gl_PointSize = pointSize; // make it bigger
 }
@@ -0,0 +1,92 @@
+#version 410
+
+// PBR lighting by the active light, the clustered point lights and the environment map. This file has no main();
+// it is linked into the forward PBR shader and into the lighting pass of the deferred renderer.
+uniform samplerCube environmentMap;
+uniform float daylight;
+
+uniform vec3 cameraPosition;
+uniform vec3 lightPosition;
+uniform vec3 lightColor;
+uniform float ka;
+
+// Defined in clustered_lights_frag.glsl
+uvec2 findClusterLights(vec3 worldPosition);
+vec3 clusterLightRadiance(uint i, vec3 worldPosition, out vec3 L);
+// Defined in shadows_frag.glsl
+float sunShadow(vec3 worldPosition, vec3 N, vec3 L);
+
+const float PI = 3.14159265359;
+
+// Schlick-GGX
+float G1(float Ndot, float k) {
+    return Ndot / (Ndot * (1.0 - k) + k + 1e-7);
+}
+
+// GGX specular + Burley diffuse for a single light direction L, multiplied by N.L (excluding the light color).
+vec3 brdfTimesCosine(vec3 N, vec3 V, vec3 L, vec3 albedo, float rough, float metallic, float ao)
+{
+    vec3 H = normalize(V + L);
+
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotH = max(dot(N, H), 0.0);
+    float VdotH = max(dot(V, H), 0.0);
+
+    float alpha = rough * rough;
+
+    // GGX NDF
+    float alpha2 = alpha * alpha;
+    float denom = (NdotH * NdotH) * (alpha2 - 1.0) + 1.0;
+    float D = alpha2 / (PI * denom * denom + 1e-7);
+
+    // Smith Visibility
+    float k = alpha/2.0;
+    float G = G1(NdotV, k) * G1(NdotL, k);
+
+    // Schlick Fresnel
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+    vec3 F = F0 + (1 - F0) * pow(1.0 - VdotH, 5.0);
+
+    // Specular term
+    vec3 numerator = D * G * F;
+    float denominator = 4.0 * NdotV * NdotL + 1e-7;
+    vec3 specular = numerator / denominator;
+
+    // Burley Diffuse
+    float F90 = 0.5 + 2.0*rough*VdotH*VdotH;
+    vec3 diffuse = (1.0 - F) * (1.0 - metallic) * (albedo / PI) * (1.0 + (F90 - 1.0)*pow(1-NdotL,5.0)) * (1.0 + (F90 - 1.0)*pow(1-NdotV,5.0));
+
+    // AO only darkens the diffuse part
+    return (diffuse * ao + specular) * NdotL;
+}
+
+// Linear color of a surface point. N is the geometric normal (for the shadow lookup), Nsample the shading normal.
+vec3 shadeSurface(vec3 position, vec3 N, vec3 Nsample, vec3 albedo, float rough, float metallic, float ao, bool reflective)
+{
+    // Light vector from fragment to light
+    vec3 L = normalize(lightPosition - position);
+    vec3 V = normalize(cameraPosition - position);
+
+    vec3 ambient = ka * lightColor * ao * albedo * 0.1;
+    vec3 Lo = brdfTimesCosine(Nsample, V, L, albedo, rough, metallic, ao) * lightColor * sunShadow(position, N, L);
+
+    // Point lights of the cluster that contains this fragment
+    uvec2 clusterLights = findClusterLights(position);
+    for (uint i = clusterLights.x; i < clusterLights.x + clusterLights.y; ++i) {
+        vec3 pointL;
+        vec3 radiance = clusterLightRadiance(i, position, pointL);
+        Lo += brdfTimesCosine(Nsample, V, pointL, albedo, rough, metallic, ao) * radiance;
+    }
+    vec3 color = ambient + Lo;
+
+    if (reflective) {
+        vec3 I = normalize(position - cameraPosition);
+        vec3 R = reflect(I, Nsample);
+        vec3 envColor = texture(environmentMap, R).rgb;
+        envColor *= daylight;
+        float reflectionStrength = 0.2;
+        color = mix(color, envColor, reflectionStrength);
+    }
+    return color;
+}
@@ -11,6 +11,9 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 layout(location = 3) in vec4 tangent;
 
+// Depth-only and shading passes must produce bit-identical depth for the GL_EQUAL depth test.
+invariant gl_Position;
+
 out vec3 fragPosition;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
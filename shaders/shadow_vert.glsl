@@ -4,6 +4,9 @@ uniform mat4 mvpMatrix;
 
 layout(location = 0) in vec3 position;
 
+// Depth-only and shading passes must produce bit-identical depth for the GL_EQUAL depth test.
+invariant gl_Position;
+
 void main()
 {
     gl_Position = mvpMatrix * vec4(position, 1);
@@ -0,0 +1,43 @@
+#version 410
+
+// Cascaded sun shadows (see src/cascaded_shadow_maps.h). This file has no main(); it is linked into the fragment
+// shaders that are lit by the sun.
+const int NUM_CASCADES = 4;
+
+uniform sampler2DArrayShadow shadowMap;
+uniform bool useShadows;
+uniform mat4 shadowMatrices[NUM_CASCADES];
+uniform vec4 cascadeSplits;                  // Far view depth of every cascade.
+uniform mat4 shadowViewMatrix;
+
+// Fraction of the light from direction L that reaches worldPosition (1 = fully lit). N is the geometric normal.
+float sunShadow(vec3 worldPosition, vec3 N, vec3 L)
+{
+    if (!useShadows)
+        return 1.0;
+
+    float viewDepth = -(shadowViewMatrix * vec4(worldPosition, 1.0)).z;
+    int cascade = 0;
+    while (cascade < NUM_CASCADES && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == NUM_CASCADES)
+        return 1.0;
+
+    // Offset along the normal by about a texel of the cascade (more at grazing angles) against shadow acne.
+    mat4 shadowMatrix = shadowMatrices[cascade];
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float worldTexelSize = 2.0 * texelSize.x / length(vec3(shadowMatrix[0][0], shadowMatrix[1][0], shadowMatrix[2][0]));
+    float NdotL = clamp(dot(N, L), 0.0, 1.0);
+    vec3 offsetPosition = worldPosition + N * worldTexelSize * (2.0 - NdotL);
+
+    // Orthographic projection, so no perspective divide.
+    vec3 coord = (shadowMatrix * vec4(offsetPosition, 1.0)).xyz * 0.5 + 0.5;
+
+    // 3x3 percentage closer filtering on top of the bilinear filtering of the comparison sampler.
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texelSize, float(cascade), coord.z));
+    }
+    return lit / 9.0;
+}
@@ -0,0 +1,116 @@
+#version 410
+
+// Material of the current fragment (parallax occlusion mapping, color, normal and PBR maps). This file has no main();
+// it is linked into the forward PBR shader and into the G-buffer shader of the deferred renderer.
+layout(std140) uniform Material // Must match the GPUMaterial defined in src/mesh.h
+{
+    vec3 kd;
+	vec3 ks;
+	float shininess;
+	float transparency;
+};
+
+uniform sampler2D colorMap;
+uniform bool hasTexCoords;
+uniform bool useTexture;
+uniform bool useMaterial;
+uniform sampler2D normalMap;
+uniform bool hasNormalMap;
+uniform sampler2D roughnessMap;
+uniform bool hasRoughnessMap;
+uniform sampler2D metallicMap;
+uniform bool hasMetallicMap;
+uniform sampler2D aoMap;
+uniform bool hasAOMap;
+uniform sampler2D heightMap;
+uniform bool hasHeightMap;
+uniform float heightScale;
+
+uniform vec3 cameraPosition;
+uniform float metallicValue;
+uniform float roughnessValue;
+
+in vec3 fragPosition;
+in vec3 fragNormal;
+in vec2 fragTexCoord;
+in vec4 fragTangent;
+
+// Returns false if the fragment has no material; it is then drawn with its normal as color.
+// N is the interpolated geometric normal, Nsample the normal after normal mapping.
+bool evaluateSurface(out vec3 N, out vec3 Nsample, out vec3 albedo, out float rough, out float metallic, out float ao)
+{
+    // Base normal (transformed by normalModelMatrix in vertex shader already)
+    N = normalize(fragNormal);
+    Nsample = N;
+    albedo = kd;
+    rough = roughnessValue;
+    metallic = metallicValue;
+    ao = 1.0;
+    if (!(useMaterial || hasTexCoords))
+        return false;
+
+    // Build TBN from interpolated tangent (w = handedness)
+    vec3 T = normalize(fragTangent.xyz);
+    // Renormalize tangent against the normal to correct after interpolation
+    T = normalize(T - N * dot(N, T));
+    vec3 B = normalize(cross(N, T)) * fragTangent.w;
+    mat3 TBN = mat3(T, B, N);
+
+    // Parallax occlusion mapping
+    vec3 viewDir = normalize(cameraPosition - fragPosition);
+    vec3 viewDirTangent = TBN * viewDir;
+    vec2 uv = fragTexCoord * vec2(40.0, 40.0);
+    if (hasHeightMap) {
+        float numLayers = mix(8, 64, max(dot(vec3(0.0, 0.0, 1.0), viewDir), 0.0));
+        float layerDepth = 1.0 / numLayers;
+        float currentLayerDepth = 0.0;
+        vec2 P = viewDir.xy * heightScale;
+        vec2 deltaUV = P / numLayers;
+
+        float currentUV = texture(heightMap, uv).r;
+
+        while(currentLayerDepth < currentUV)
+        {
+            // shift texture coordinates along P
+            uv -= deltaUV;
+            currentUV = texture(heightMap, uv).r;
+            // get depth of next layer
+            currentLayerDepth += layerDepth;
+        }
+
+        // get texture coordinates before collision (reverse operations)
+        vec2 prevUV = uv + deltaUV;
+
+        // get depth after and before collision for linear interpolation
+        float afterDepth  = currentUV - currentLayerDepth;
+        float beforeDepth = texture(heightMap, prevUV).r - currentLayerDepth + layerDepth;
+
+        // interpolation of texture coordinates
+        float weight = afterDepth / (afterDepth - beforeDepth);
+        uv = mix(prevUV, uv, weight);
+    }
+
+    // Determine diffuse color, either kd or sampled texture
+    if (hasTexCoords && useTexture) {
+        // Sampled color textures are usually sRGB, convert to linear before use
+        vec3 sampled = texture(colorMap, uv).rgb;
+        albedo = pow(sampled, vec3(2.2));
+    }
+    // Use normal mapping if available
+    if (hasNormalMap) {
+        vec3 mapN = texture(normalMap, uv).rgb;
+        mapN = mapN * 2.0 - 1.0; // expand to [-1,1]
+        Nsample = normalize(TBN * mapN); // transform to world space
+    }
+    if (hasRoughnessMap) {
+        rough = texture(roughnessMap, uv).r;
+    }
+    if (hasMetallicMap) {
+        metallic = texture(metallicMap, uv).r;
+    }
+    // Apply AO to diffuse and ambient
+    if (hasAOMap) {
+        ao = texture(aoMap, uv).r;
+    }
+    return true;
+}
@@ -19,16 +19,29 @@ uniform int numWaves;
 uniform float time;
 uniform samplerCube environmentMap;
 
+// FFT ocean: slopes of the height along x and z and the Jacobian determinant of the horizontal displacement.
+uniform bool fftOcean;
+uniform sampler2D oceanSlopes;
+
 in vec3 fragPosition;
 in vec3 fragNormal;
 in vec2 fragTexCoord;
 in vec4 fragTangent;
+in vec2 fragOceanTexCoord;
 
-layout(location = 0) out vec4 fragColor;
+// Implemented by forward_output_frag.glsl or oit_output_frag.glsl.
+void writeFragment(vec4 color);
 
 void main()
 {
     vec3 N = normalize(fragNormal);
+    float foam = 0.0;
+    if (fftOcean) {
+        vec3 slopes = texture(oceanSlopes, fragOceanTexCoord).xyz;
+        N = normalize(vec3(-slopes.x, 1.0, -slopes.y));
+        // Foam where the displacement squeezes the surface together (or even folds it over, below 0).
+        foam = smoothstep(0.9, 0.4, slopes.z);
+    }
 	vec3 V = normalize(cameraPosition - fragPosition);
 	vec3 L = normalize(lightPosition - fragPosition);
 	vec3 H = normalize(L + V);
@@ -56,5 +69,8 @@ void main()
 	// Mix base shading with environment reflection using Fresnel
 	vec3 final = mix(color, envColor, F);
 
-	fragColor = vec4(final, 1.0);
+	final = mix(final, vec3(0.9) * (ka + NdotL) * lightColor, foam);
+
+	// The water is more opaque at grazing angles, where it reflects more, and where it foams.
+	writeFragment(vec4(final, mix(transparency, 1.0, max(F, foam))));
 }
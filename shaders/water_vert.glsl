@@ -13,6 +13,14 @@ uniform float time;
 uniform float phi;
 uniform float alpha;
 
+// FFT ocean (see src/ocean.h): a world space displacement that repeats every oceanPatchSize along x and z. The level
+// of detail matches the texel size to the vertex spacing, so that waves between the vertices do not alias.
+uniform bool fftOcean;
+uniform sampler2D oceanDisplacement;
+uniform float oceanPatchSize;
+uniform float oceanDisplacementLod;
+uniform mat4 viewProjectionMatrix;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
@@ -22,8 +30,26 @@ out vec3 fragPosition;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
 out vec4 fragTangent;
+out vec2 fragOceanTexCoord;
 void main()
 {
+    fragTexCoord    = texCoord;
+    // Transform tangent to stay in the same space as the normal
+    vec3 t_transformed = normalize(normalModelMatrix * tangent.xyz);
+    fragTangent     = vec4(t_transformed, tangent.w);
+
+    if (fftOcean) {
+        // The normal comes from the slope texture in the fragment shader.
+        vec3 worldPosition = (modelMatrix * vec4(position, 1)).xyz;
+        fragOceanTexCoord = worldPosition.xz / oceanPatchSize;
+        worldPosition += textureLod(oceanDisplacement, fragOceanTexCoord, oceanDisplacementLod).xyz;
+        gl_Position = viewProjectionMatrix * vec4(worldPosition, 1);
+        fragPosition = worldPosition;
+        fragNormal = normalize(normalModelMatrix * normal);
+        return;
+    }
+    fragOceanTexCoord = vec2(0.0);
+
     // Wave displacement in model space
     vec3 pos = position;
     float height = 0.0;
@@ -49,8 +75,4 @@ void main()
 
     fragPosition = (modelMatrix * vec4(pos, 1)).xyz;
     fragNormal = normalModelMatrix * normalize(normal - vec3(dpdx.x, 0.0, dpdx.y));
-    fragTexCoord    = texCoord;
-    // Transform tangent to stay in the same space as the normal
-    vec3 t_transformed = normalize(normalModelMatrix * tangent.xyz);
-    fragTangent     = vec4(t_transformed, tangent.w);
 }
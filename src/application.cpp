@@ -1,6 +1,20 @@
 //#include "Image.h"
+#include "asset_loader.h"
+#include "benchmark.h"
+#include "bezier.h"
+#include "cascaded_shadow_maps.h"
+#include "draw_stats.h"
+#include "frame_graph.h"
+#include "gpu_particles.h"
+#include "gpu_profiler.h"
+#include "light_clusters.h"
 #include "mesh.h"
+#include "ocean_textures.h"
+#include "particles.h"
+#include "point_shadow_atlas.h"
+#include "simulation_thread.h"
 #include "texture.h"
+#include "water.h"
 // Always include window first (because it includes glfw, which includes GL which needs to be included AFTER glew).
 // Can't wait for modules to fix this stuff...
 #include <framework/disable_all_warnings.h>
@@ -18,27 +32,201 @@ DISABLE_WARNINGS_POP()
 #include <framework/shader.h>
 #include <framework/window.h>
 #include <framework/camera.h>
+#include <framework/cpu_profiler.h>
 #include <framework/file_picker.h>
+#include <framework/image.h>
+#include <framework/job_system.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <optional>
 #include <vector>
-#include <stb/stb_image.h>
 
 
 class Application {
 public:
-    Application()
-        : m_window("Final Project", glm::ivec2(1024, 1024), OpenGLVersion::GL41), m_texture(nullptr)
+    // In benchmark mode the window is headless (see Window) and has the resolution of the benchmark.
+    explicit Application(std::optional<BenchmarkOptions> benchmark = {})
+        : m_window("Final Project", benchmark ? benchmark->resolution : glm::ivec2(1024, 1024), OpenGLVersion::GL41, !benchmark)
+        , m_texture(nullptr)
+        , m_benchmark(std::move(benchmark))
     {
+        // Submit all shader programs first. The driver compiles them in the background (deferred mode) while
+        // the textures and meshes below are decoded; their status is only checked in resolveShaders().
+        try {
+            m_defaultShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shader_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/surface_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/pbr_lighting_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/clustered_lights_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadows_frag.glsl")
+                .build();
+
+            m_shadowShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shadow_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadow_frag.glsl")
+                .build();
+
+            // Position-only shader for the depth pre-pass (uses the same invariant gl_Position as shader_vert.glsl).
+            m_depthShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shadow_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadow_frag.glsl")
+                .build();
+
+            m_skyboxShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/skybox_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/skybox_frag.glsl")
+                .build();
+
+            m_lineShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/line_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/line_frag.glsl")
+                .build();
+
+            m_particleShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/particle_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/particle_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/forward_output_frag.glsl")
+                .build();
+            m_particleOITShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/particle_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/particle_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/oit_output_frag.glsl")
+                .build();
+            // Transform feedback only, see GPUParticleSystem.
+            m_particleUpdateShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/gpu_particles_update_vert.glsl")
+                .setTransformFeedbackVaryings({ "outPosition", "outVelocity", "outLife" })
+                .build();
+
+            // Instanced variants of the PBR and Blinn-Phong shaders (snake segments, light markers).
+            m_defaultInstancedShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/instanced_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shader_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/surface_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/pbr_lighting_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/clustered_lights_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadows_frag.glsl")
+                .build();
+            m_basicInstancedShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/instanced_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/blinnphong_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/clustered_lights_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadows_frag.glsl")
+                .build();
+
+            // Deferred renderer: G-buffer variants of the PBR shader and the full screen lighting pass.
+            m_gbufferShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/gbuffer_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/surface_frag.glsl")
+                .build();
+            m_gbufferInstancedShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/instanced_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/gbuffer_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/surface_frag.glsl")
+                .build();
+            m_deferredLightingShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/fullscreen_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/deferred_lighting_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/pbr_lighting_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/clustered_lights_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadows_frag.glsl")
+                .build();
+            // Resolves the weighted blended transparency targets over the opaque image.
+            m_oitCompositeShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/fullscreen_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/oit_composite_frag.glsl")
+                .build();
+            // Reduced resolution particles (see drawFrame()).
+            m_particleDepthDownsampleShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/fullscreen_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/particle_depth_downsample_frag.glsl")
+                .build();
+            m_particleUpsampleShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/fullscreen_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/particle_upsample_frag.glsl")
+                .build();
+
+            // Any new shaders can be added below in similar fashion.
+            // ==> Don't forget to reconfigure CMake when you do!
+            //     Visual Studio: PROJECT => Generate Cache for ComputerGraphics
+            //     VS Code: ctrl + shift + p => CMake: Configure => enter
+            // ....
+        } catch (ShaderLoadingException e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        // Blinn-phong shader for comparison
+        try
+        {
+            m_basicShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/blinnphong_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/clustered_lights_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadows_frag.glsl")
+                .build();
+        }
+        catch (ShaderLoadingException &e)
+        {
+            // It's fine if this shader fails to load; we'll just keep using the default shader
+            std::cerr << "Warning: failed to load basic shader: " << e.what() << std::endl;
+        }
+
+        // Water shader
+        try
+        {
+            m_waterShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/water_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/water_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/forward_output_frag.glsl")
+                .build();
+            m_waterOITShader = ShaderBuilder(ShaderCompileMode::Deferred)
+                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/water_vert.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/water_frag.glsl")
+                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/oit_output_frag.glsl")
+                .build();
+        }
+        catch (ShaderLoadingException &e)
+        {
+            std::cerr << "Warning: failed to load water shader: " << e.what() << std::endl;
+        }
+
+        // Start loading all assets. They load concurrently on the job system and are waited for where they are
+        // needed below; the uploads run on this (the OpenGL) thread while it waits. The dragon is needed first.
+        AssetLoader assets { m_jobSystem };
+        AssetTask<std::vector<GPUMesh>> dragonMesh = assets.loadMesh(RESOURCE_ROOT "resources/dragon.obj", 2);
+        AssetTask<std::vector<GPUMesh>> planeMesh = assets.loadMesh(RESOURCE_ROOT "resources/water_circle.obj", 1);
+        AssetTask<std::vector<GPUMesh>> groundMesh = assets.loadMesh(RESOURCE_ROOT "resources/Beach.obj", 1);
+        std::array<AssetTask<std::shared_ptr<const Image>>, 6> cubemapFaces;
+        const std::array<const char*, 6> cubemapFaceNames { "px", "nx", "py", "ny", "pz", "nz" };
+        for (size_t i = 0; i < cubemapFaces.size(); ++i)
+            cubemapFaces[i] = assets.loadImage(std::string(RESOURCE_ROOT) + "resources/cubemap/" + cubemapFaceNames[i] + ".png");
+
         // Create default texture here so we can change it later
         // Load default ground PBR maps from resources/ground
+        std::array<AssetTask<Texture>, 5> groundMaps {
+            assets.loadTexture(RESOURCE_ROOT "resources/ground/ground.jpg"),
+            assets.loadTexture(RESOURCE_ROOT "resources/ground/ground_normals.png"),
+            assets.loadTexture(RESOURCE_ROOT "resources/ground/ground_roughness.jpg"),
+            assets.loadTexture(RESOURCE_ROOT "resources/ground/ground_ao.jpg"),
+            assets.loadTexture(RESOURCE_ROOT "resources/ground/ground_height.png")
+        };
         try
         {
-            m_texture = std::make_unique<Texture>(RESOURCE_ROOT "resources/ground/ground.jpg");
-            m_normalMap = std::make_unique<Texture>(RESOURCE_ROOT "resources/ground/ground_normals.png");
-            m_roughnessMap = std::make_unique<Texture>(RESOURCE_ROOT "resources/ground/ground_roughness.jpg");
-            m_aoMap = std::make_unique<Texture>(RESOURCE_ROOT "resources/ground/ground_ao.jpg");
-            m_heightMap = std::make_unique<Texture>(RESOURCE_ROOT "resources/ground/ground_height.png");
+            for (const AssetTask<Texture>& groundMap : groundMaps) {
+                assets.wait(groundMap);
+                groundMap.get();
+            }
+            m_texture = std::make_unique<Texture>(std::move(groundMaps[0].get()));
+            m_normalMap = std::make_unique<Texture>(std::move(groundMaps[1].get()));
+            m_roughnessMap = std::make_unique<Texture>(std::move(groundMaps[2].get()));
+            m_aoMap = std::make_unique<Texture>(std::move(groundMaps[3].get()));
+            m_heightMap = std::make_unique<Texture>(std::move(groundMaps[4].get()));
             m_useTexture = true;
             m_useNormalMap = false;
             m_useRoughnessMap = false;
@@ -48,7 +236,9 @@ public:
         }
         catch (...)
         {
-            // Fall back to checkerboard if any default asset fails to load
+            // Fall back to checkerboard if any default asset fails to load; the other maps are not needed then.
+            for (const AssetTask<Texture>& groundMap : groundMaps)
+                groundMap.cancel();
             m_texture = std::make_unique<Texture>(RESOURCE_ROOT "resources/checkerboard.png");
         }
         // Default camera to point at origin
@@ -59,6 +249,8 @@ public:
         const float pitch = glm::degrees(glm::asin(dir.y));
         const float yaw = glm::degrees(glm::atan(dir.z, dir.x));
         m_camera = Camera(camPos, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
+        m_frameGraph.setProfiler(&m_gpuProfiler);
+        cpuProfilerSetThreadName("Main");
         m_window.registerKeyCallback([this](int key, int scancode, int action, int mods) {
             if (action == GLFW_PRESS)
                 onKeyPressed(key, mods);
@@ -83,7 +275,8 @@ public:
                 m_lastMousePos = m_window.getCursorPos();
             } });
 
-        m_meshes = GPUMesh::loadMeshGPU(RESOURCE_ROOT "resources/dragon.obj");
+        assets.wait(dragonMesh);
+        m_meshes = std::move(dragonMesh.get());
 
         initSnakePath();
 
@@ -101,104 +294,56 @@ public:
         glBindVertexArray(0);
 
 
+        // The full screen triangle of the deferred lighting pass has no vertex attributes, but core profile needs a VAO.
+        glGenVertexArrays(1, &m_fullscreenVAO);
+
         // particle vao and vbo initialisation
+        // The buffer holds one array per attribute (x, y, z and life) of m_maxParticles floats each, like ParticleVertices.
         glGenVertexArrays(1, &m_particleVAO);
         glGenBuffers(1, &m_particleVBO);
         glBindVertexArray(m_particleVAO);
         glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(4 * m_maxParticles * sizeof(GLfloat)), nullptr, GL_STREAM_DRAW);
+        for (GLuint attribute = 0; attribute < 4; ++attribute) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribPointer(attribute, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void*)(attribute * m_maxParticles * sizeof(GLfloat)));
+        }
+        // Back-to-front draw order (see ParticleDepthSorter).
+        glGenBuffers(1, &m_particleEBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_particleEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_maxParticles * sizeof(GLuint)), nullptr, GL_STREAM_DRAW);
+        glBindVertexArray(0);
+        m_gpuParticles.emplace(m_maxParticles);
+        m_gpuParticlesEnabled = m_benchmark && m_benchmark->gpuParticles;
+        m_sphParticles = m_benchmark && m_benchmark->sphParticles;
+        m_fftOcean = !m_benchmark || m_benchmark->fftOcean;
 
-        // position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(GLfloat), (void*)0);
-
-        // color
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 7 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
-        m_particles.resize(m_maxParticles);
-
-
-        std::vector<std::string> faces = {
-            std::string(RESOURCE_ROOT) + "resources/cubemap/px.png",
-            std::string(RESOURCE_ROOT) + "resources/cubemap/nx.png",
-            std::string(RESOURCE_ROOT) + "resources/cubemap/py.png",
-            std::string(RESOURCE_ROOT) + "resources/cubemap/ny.png",
-            std::string(RESOURCE_ROOT) + "resources/cubemap/pz.png",
-            std::string(RESOURCE_ROOT) + "resources/cubemap/nz.png",
-        };
-        m_cubemapTexture = loadCubemap(faces);
-
-        try {
-            ShaderBuilder defaultBuilder;
-            defaultBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl");
-            defaultBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shader_frag.glsl");
-            m_defaultShader = defaultBuilder.build();
-
-            ShaderBuilder shadowBuilder;
-            shadowBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shadow_vert.glsl");
-            shadowBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadow_frag.glsl");
-            m_shadowShader = shadowBuilder.build();
-
-            m_skyboxShader = ShaderBuilder()
-                .addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/skybox_vert.glsl")
-                .addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/skybox_frag.glsl")
-                .build();
-
-            ShaderBuilder lineBuilder;
-            lineBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/line_vert.glsl");
-            lineBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/line_frag.glsl");
-            m_lineShader = lineBuilder.build();
-
-
-            ShaderBuilder particleBuilder;
-            particleBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/particle_vert.glsl");
-            particleBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/particle_frag.glsl");
-            m_particleShader = particleBuilder.build();
 
-            // Any new shaders can be added below in similar fashion.
-            // ==> Don't forget to reconfigure CMake when you do!
-            //     Visual Studio: PROJECT => Generate Cache for ComputerGraphics
-            //     VS Code: ctrl + shift + p => CMake: Configure => enter
-            // ....
-        } catch (ShaderLoadingException e) {
-            std::cerr << e.what() << std::endl;
+        std::array<std::shared_ptr<const Image>, 6> faces;
+        for (size_t i = 0; i < faces.size(); ++i)
+        {
+            assets.wait(cubemapFaces[i]);
+            try
+            {
+                faces[i] = cubemapFaces[i].get();
+            }
+            catch (...)
+            {
+                // Leave the face empty (still valid).
+                std::cerr << "Cubemap failed to load face " << cubemapFaceNames[i] << std::endl;
+            }
         }
+        m_cubemapTexture = loadCubemap(faces);
 
 		// setup skybox VAO/VBO
         setupSkybox();
 
 
-        // Blinn-phong shader for comparison
-        try
-        {
-            ShaderBuilder basicBuilder;
-            basicBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl");
-            basicBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/blinnphong_frag.glsl");
-            m_basicShader = basicBuilder.build();
-        }
-        catch (ShaderLoadingException &e)
-        {
-            // It's fine if this shader fails to load; we'll just keep using the default shader
-            std::cerr << "Warning: failed to load basic shader: " << e.what() << std::endl;
-        }
-
-        // Water shader
-        try
-        {
-            ShaderBuilder waterBuilder;
-            // Use the existing vertex shader for simplicity; if you have a custom vertex shader for water, replace the path
-            waterBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/water_vert.glsl");
-            waterBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/water_frag.glsl");
-            m_waterShader = waterBuilder.build();
-        }
-        catch (ShaderLoadingException &e)
-        {
-            std::cerr << "Warning: failed to load water shader: " << e.what() << std::endl;
-        }
-
         // Load mesh for water surface
         try
         {
-            auto planeMeshes = GPUMesh::loadMeshGPU(RESOURCE_ROOT "resources/water_circle.obj");
+            assets.wait(planeMesh);
+            auto planeMeshes = std::move(planeMesh.get());
             if (!planeMeshes.empty())
             {
                 std::cout << "Loaded water plane mesh." << std::endl;
@@ -213,7 +358,8 @@ public:
         // Load mesh for the ground
         try
         {
-            auto groundMeshes = GPUMesh::loadMeshGPU(RESOURCE_ROOT "resources/Beach.obj");
+            assets.wait(groundMesh);
+            auto groundMeshes = std::move(groundMesh.get());
             if (!groundMeshes.empty())
             {
                 std::cout << "Loaded ground plane mesh." << std::endl;
@@ -242,40 +388,64 @@ public:
         m_amplitude = 0.008f;
 
         // Initialize a default light
-        m_lights.push_back({glm::vec3(2.0f, 4.0f, 2.0f), glm::vec3(1.0f, 1.0f, 1.0f)});
+        m_lights.push_back({glm::vec3(2.0f, 4.0f, 2.0f), glm::vec3(1.0f, 1.0f, 1.0f), SUN_RADIUS});
 
 
-        // Initialise Snake
-        const int segmentCount = 6;        
-        const float segmentLength = 0.3f;  
-        auto head = std::make_unique<SnakeSegment>();
-        head->localPosition = glm::vec3(0.0f);
-        SnakeSegment* prev = head.get();
-        m_snakeSegments.push_back(prev);
-
-        for (int i = 1; i < segmentCount; ++i) {
-            auto seg = std::make_unique<SnakeSegment>();
-            seg->localPosition = glm::vec3(0.0f, 0.0f, segmentLength);
-            prev->child = std::move(seg);
-            prev = prev->child.get();
-            m_snakeSegments.push_back(prev);
-        }
-
-        m_snakeRoot = std::move(head);
-
+        // All assets are loaded; wait for the shader programs that were compiling in the meantime.
+        resolveShaders();
 
+        // The benchmark takes exactly one simulation step per frame, independent of how long the frames take.
+        m_simulationThread.emplace(Simulation(m_snakePath, m_maxParticles, &m_jobSystem), simulationSettings(),
+            benchmark ? double(benchmark->timeStep) : 1.0 / 60.0,
+            benchmark ? SimulationThread::Mode::LockStep : SimulationThread::Mode::RealTime);
     }
 
-    GLuint loadCubemap(const std::vector<std::string>& faces)
+    void resolveShaders()
     {
-        if (faces.size() != 6) {
-            std::cerr << "loadCubemap: expected 6 faces, got " << faces.size() << std::endl;
-            return 0;
+        try {
+            m_defaultShader.resolve();
+            m_shadowShader.resolve();
+            m_depthShader.resolve();
+            m_skyboxShader.resolve();
+            m_lineShader.resolve();
+            m_particleShader.resolve();
+            m_particleOITShader.resolve();
+            m_particleUpdateShader.resolve();
+            m_defaultInstancedShader.resolve();
+            m_basicInstancedShader.resolve();
+            m_gbufferShader.resolve();
+            m_gbufferInstancedShader.resolve();
+            m_deferredLightingShader.resolve();
+            m_oitCompositeShader.resolve();
+            m_particleDepthDownsampleShader.resolve();
+            m_particleUpsampleShader.resolve();
+        } catch (const ShaderLoadingException& e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        try
+        {
+            m_basicShader.resolve();
+        }
+        catch (ShaderLoadingException &e)
+        {
+            std::cerr << "Warning: failed to load basic shader: " << e.what() << std::endl;
         }
 
-        // Important: ensure stb doesn't flip cubemap faces unexpectedly
-        stbi_set_flip_vertically_on_load(false);
+        try
+        {
+            m_waterShader.resolve();
+            m_waterOITShader.resolve();
+        }
+        catch (ShaderLoadingException &e)
+        {
+            std::cerr << "Warning: failed to load water shader: " << e.what() << std::endl;
+        }
+    }
 
+    // Faces in the order +X, -X, +Y, -Y, +Z, -Z; missing faces are left empty.
+    GLuint loadCubemap(const std::array<std::shared_ptr<const Image>, 6>& faces)
+    {
         GLuint textureID = 0;
         glGenTextures(1, &textureID);
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
@@ -284,37 +454,27 @@ public:
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
         for (unsigned int i = 0; i < faces.size(); ++i) {
-            int width = 0, height = 0, nrChannels = 0;
-            // Force 0 to get number of channels; we will handle both 3 and 4 channels
-            stbi_uc* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-
-            if (!data) {
-                std::cerr << "Cubemap failed to load at path: " << faces[i] << "\n";
-                std::cerr << " stbi failure: " << stbi_failure_reason() << std::endl;
-                // leave the face empty (still valid) or bail out:
-                // return 0;
+            if (!faces[i])
                 continue;
-            }
+            const Image& face = *faces[i];
 
-            if (width != height) {
-                std::cerr << "Warning: cubemap face not square: " << faces[i] << " (" << width << "x" << height << ")\n";
+            if (face.width != face.height) {
+                std::cerr << "Warning: cubemap face " << i << " not square (" << face.width << "x" << face.height << ")\n";
             }
 
             GLenum format = GL_RGB;
-            if (nrChannels == 1) format = GL_RED;
-            else if (nrChannels == 3) format = GL_RGB;
-            else if (nrChannels == 4) format = GL_RGBA;
+            if (face.channels == 1) format = GL_RED;
+            else if (face.channels == 3) format = GL_RGB;
+            else if (face.channels == 4) format = GL_RGBA;
             else {
-                std::cerr << "Unexpected channel count (" << nrChannels << ") for " << faces[i] << std::endl;
+                std::cerr << "Unexpected channel count (" << face.channels << ") for cubemap face " << i << std::endl;
             }
 
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+                0, format, face.width, face.height, 0, format, GL_UNSIGNED_BYTE, face.get_data());
 
-            stbi_image_free(data);
-
-            std::cout << "Loaded cubemap face " << i << ": " << faces[i]
-                << " (" << width << "x" << height << ", ch=" << nrChannels << ")\n";
+            std::cout << "Loaded cubemap face " << i
+                << " (" << face.width << "x" << face.height << ", ch=" << face.channels << ")\n";
         }
 
         // Filters + wrapping
@@ -390,438 +550,932 @@ public:
     }
 
 
-    void update()
+    // Camera movement (WASD) and mouse look.
+    void processInput(float deltaTime)
     {
-        int dummyInteger = 0; // Initialized to 0
-        double lastTime = glfwGetTime();
-        while (!m_window.shouldClose()) {
-            // This is your game loop
-            // Put your real-time logic and rendering in here
-            m_window.updateInput();
+        CPU_PROFILE_ZONE("input");
+        // Handle continuous key presses (WASD)
+        if (m_window.isKeyPressed(GLFW_KEY_W))
+            m_camera.processKeyboard(CameraMovement::Forward, deltaTime);
+        if (m_window.isKeyPressed(GLFW_KEY_S))
+            m_camera.processKeyboard(CameraMovement::Backward, deltaTime);
+        if (m_window.isKeyPressed(GLFW_KEY_A))
+            m_camera.processKeyboard(CameraMovement::Left, deltaTime);
+        if (m_window.isKeyPressed(GLFW_KEY_D))
+            m_camera.processKeyboard(CameraMovement::Right, deltaTime);
+        if (m_window.isKeyPressed(GLFW_KEY_SPACE))
+            m_camera.processKeyboard(CameraMovement::Up, deltaTime);
+        if (m_window.isKeyPressed(GLFW_KEY_LEFT_CONTROL) || m_window.isKeyPressed(GLFW_KEY_LEFT_ALT))
+            m_camera.processKeyboard(CameraMovement::Down, deltaTime);
+
+        // Mouse look when captured
+        if (m_mouseCaptured)
+        {
+            glm::vec2 cursor = m_window.getCursorPos();
+            glm::vec2 delta = cursor - m_lastMousePos;
+            m_lastMousePos = cursor;
+            m_camera.processMouseMovement(delta.x, delta.y);
+        }
+    }
 
-            // Time step
-            double currentTime = glfwGetTime();
-            float deltaTime = static_cast<float>(currentTime - lastTime);
-            lastTime = currentTime;
+    // Build the ImGui window with all the settings and statistics.
+    void drawUserInterface()
+    {
+        CPU_PROFILE_ZONE("imgui");
+        // Use ImGui for easy input/output of ints, floats, strings, etc...
+        ImGui::Begin("Window");
+        // Material parameters
+        ImGui::Text("Material parameters");
+        ImGui::SliderFloat("Shininess", &m_shininess, 0.0f, 80.0f);
+        ImGui::ColorEdit3("Kd", &m_kd[0]);
+        ImGui::ColorEdit3("Ks", &m_ks[0]);
+        ImGui::SliderFloat("Ambient ka", &m_ka, 0.0f, 1.0f);
+        ImGui::SliderFloat("Metallic", &m_metallic, 0.0f, 1.0f);
+        ImGui::SliderFloat("Roughness", &m_roughness, 0.04f, 1.0f);
+        ImGui::Separator();
+
+        // Lights
+        ImGui::Text("Lights");
+        ImGui::Text("Active Light: %zu/%zu", m_selectedLight + 1, m_lights.size() > 0 ? m_lights.size() : 1);
+
+        // Build listbox strings
+        std::vector<std::string> itemStrings;
+        for (size_t i = 0; i < m_lights.size(); ++i)
+        {
+            std::string active = (i == m_selectedLight) ? " [ACTIVE]" : "";
+            itemStrings.push_back("Light " + std::to_string(i) + active);
+        }
+        std::vector<const char *> itemCStrings;
+        for (const auto &s : itemStrings)
+            itemCStrings.push_back(s.c_str());
 
-            // Handle continuous key presses (WASD)
-            if (m_window.isKeyPressed(GLFW_KEY_W))
-                m_camera.processKeyboard(CameraMovement::Forward, deltaTime);
-            if (m_window.isKeyPressed(GLFW_KEY_S))
-                m_camera.processKeyboard(CameraMovement::Backward, deltaTime);
-            if (m_window.isKeyPressed(GLFW_KEY_A))
-                m_camera.processKeyboard(CameraMovement::Left, deltaTime);
-            if (m_window.isKeyPressed(GLFW_KEY_D))
-                m_camera.processKeyboard(CameraMovement::Right, deltaTime);
-            if (m_window.isKeyPressed(GLFW_KEY_SPACE))
-                m_camera.processKeyboard(CameraMovement::Up, deltaTime);
-            if (m_window.isKeyPressed(GLFW_KEY_LEFT_CONTROL) || m_window.isKeyPressed(GLFW_KEY_LEFT_ALT))
-                m_camera.processKeyboard(CameraMovement::Down, deltaTime);
-
-            // Mouse look when captured
-            if (m_mouseCaptured)
+        int tempSelected = static_cast<int>(m_selectedLight);
+        if (!itemCStrings.empty())
+        {
+            if (ImGui::ListBox("Lights", &tempSelected, itemCStrings.data(), (int)itemCStrings.size(), 4))
             {
-                glm::vec2 cursor = m_window.getCursorPos();
-                glm::vec2 delta = cursor - m_lastMousePos;
-                m_lastMousePos = cursor;
-                m_camera.processMouseMovement(delta.x, delta.y);
+                m_selectedLight = static_cast<size_t>(tempSelected);
             }
+        }
 
-
-            // Use ImGui for easy input/output of ints, floats, strings, etc...
-            ImGui::Begin("Window");
-            // Material parameters
-            ImGui::Text("Material parameters");
-            ImGui::SliderFloat("Shininess", &m_shininess, 0.0f, 80.0f);
-            ImGui::ColorEdit3("Kd", &m_kd[0]);
-            ImGui::ColorEdit3("Ks", &m_ks[0]);
-            ImGui::SliderFloat("Ambient ka", &m_ka, 0.0f, 1.0f);
-            ImGui::SliderFloat("Metallic", &m_metallic, 0.0f, 1.0f);
-            ImGui::SliderFloat("Roughness", &m_roughness, 0.04f, 1.0f);
-            ImGui::Separator();
-
-            // Lights
-            ImGui::Text("Lights");
-            ImGui::Text("Active Light: %zu/%zu", m_selectedLight + 1, m_lights.size() > 0 ? m_lights.size() : 1);
-
-            // Build listbox strings
-            std::vector<std::string> itemStrings;
-            for (size_t i = 0; i < m_lights.size(); ++i)
+        if (ImGui::Button("Reset Lights"))
+        {
+            m_lights.clear();
+            m_lights.push_back({glm::vec3(2.0f, 4.0f, 2.0f), glm::vec3(1.0f), SUN_RADIUS});
+            m_selectedLight = 0;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Add Light"))
+        {
+            // Place new light at camera position
+            m_lights.push_back({m_camera.getPosition(), glm::vec3(1.0f, 1.0f, 1.0f)});
+            m_selectedLight = m_lights.size() - 1;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Add 1000 Lights"))
+        {
+            // Small colored point lights scattered just above the ground (the active light stays selected)
+            for (int i = 0; i < 1000; ++i)
             {
-                std::string active = (i == m_selectedLight) ? " [ACTIVE]" : "";
-                itemStrings.push_back("Light " + std::to_string(i) + active);
+                const glm::vec3 position(randomFloat(-8.0f, 8.0f), randomFloat(0.05f, 1.0f), randomFloat(-8.0f, 8.0f));
+                const glm::vec3 color = glm::normalize(glm::vec3(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f)));
+                m_lights.push_back({position, color, randomFloat(0.3f, 1.0f)});
             }
-            std::vector<const char *> itemCStrings;
-            for (const auto &s : itemStrings)
-                itemCStrings.push_back(s.c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Remove Light") && !m_lights.empty())
+        {
+            m_lights.erase(m_lights.begin() + m_selectedLight);
+            if (m_selectedLight >= m_lights.size() && !m_lights.empty())
+                m_selectedLight = m_lights.size() - 1;
+        }
 
-            int tempSelected = static_cast<int>(m_selectedLight);
-            if (!itemCStrings.empty())
-            {
-                if (ImGui::ListBox("Lights", &tempSelected, itemCStrings.data(), (int)itemCStrings.size(), 4))
-                {
-                    m_selectedLight = static_cast<size_t>(tempSelected);
-                }
-            }
+        if (!m_lights.empty() && m_selectedLight < m_lights.size())
+        {
+            ImGui::Separator();
+            ImGui::Text("Edit Current Light:");
+            ImGui::ColorEdit3("Light Color", &m_lights[m_selectedLight].color[0]);
+            ImGui::SliderFloat("Light Radius", &m_lights[m_selectedLight].radius, 0.1f, 10.0f);
+        }
+        // The active light lights the whole scene; all other lights are clustered point lights.
+        ImGui::Text("Clustered lights: %zu, light/cluster pairs: %zu, max per cluster: %zu, assignment: %.3f ms",
+            m_lightClusters.numLights(), m_lightClusters.numLightIndices(), m_lightClusters.maxLightsPerCluster(), double(m_lightClusters.assignMilliseconds()));
 
-            if (ImGui::Button("Reset Lights"))
-            {
-                m_lights.clear();
-                m_lights.push_back({glm::vec3(2.0f, 4.0f, 2.0f), glm::vec3(1.0f)});
-                m_selectedLight = 0;
-            }
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("PBR"))
+        {
+            ImGui::Checkbox("Use Texture", &m_useTexture);
             ImGui::SameLine();
-            if (ImGui::Button("Add Light"))
-            {
-                // Place new light at camera position
-                m_lights.push_back({m_camera.getPosition(), glm::vec3(1.0f, 1.0f, 1.0f)});
-                m_selectedLight = m_lights.size() - 1;
-            }
+            ImGui::Checkbox("Use PBR shader", &m_usePBR);
             ImGui::SameLine();
-            if (ImGui::Button("Remove Light") && !m_lights.empty())
-            {
-                m_lights.erase(m_lights.begin() + m_selectedLight);
-                if (m_selectedLight >= m_lights.size() && !m_lights.empty())
-                    m_selectedLight = m_lights.size() - 1;
-            }
-
-            if (!m_lights.empty() && m_selectedLight < m_lights.size())
+            ImGui::Checkbox("Depth pre-pass", &m_useDepthPrepass);
+            ImGui::SameLine();
+            ImGui::Checkbox("Deferred shading", &m_useDeferred);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose Texture..."))
             {
-                ImGui::Separator();
-                ImGui::Text("Edit Current Light:");
-                ImGui::ColorEdit3("Light Color", &m_lights[m_selectedLight].color[0]);
+                if (auto path = pickOpenFile("png,jpg"))
+                {
+                    try
+                    {
+                        m_texture = std::make_unique<Texture>(path->string());
+                        m_useTexture = true;
+                    }
+                    catch (...)
+                    {
+                        std::cerr << "Failed to load normal map" << std::endl;
+                    }
+                }
             }
 
             ImGui::Separator();
-            if (ImGui::CollapsingHeader("PBR"))
+            ImGui::Checkbox("Use Normal Map", &m_useNormalMap);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose Normal Map..."))
             {
-                ImGui::Checkbox("Use Texture", &m_useTexture);
-                ImGui::SameLine();
-                ImGui::Checkbox("Use PBR shader", &m_usePBR);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose Texture..."))
+                if (auto path = pickOpenFile("png,jpg"))
                 {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    try
                     {
-                        try
-                        {
-                            m_texture = std::make_unique<Texture>(path->string());
-                            m_useTexture = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load normal map" << std::endl;
-                        }
+                        m_normalMap = std::make_unique<Texture>(path->string());
+                        m_useNormalMap = true;
                     }
-                }
-
-                ImGui::Separator();
-                ImGui::Checkbox("Use Normal Map", &m_useNormalMap);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose Normal Map..."))
-                {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    catch (...)
                     {
-                        try
-                        {
-                            m_normalMap = std::make_unique<Texture>(path->string());
-                            m_useNormalMap = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load normal map" << std::endl;
-                        }
+                        std::cerr << "Failed to load normal map" << std::endl;
                     }
                 }
+            }
 
-                ImGui::Separator();
-                ImGui::Checkbox("Use Roughness Map", &m_useRoughnessMap);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose Roughness Map..."))
+            ImGui::Separator();
+            ImGui::Checkbox("Use Roughness Map", &m_useRoughnessMap);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose Roughness Map..."))
+            {
+                if (auto path = pickOpenFile("png,jpg"))
                 {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    try
                     {
-                        try
-                        {
-                            m_roughnessMap = std::make_unique<Texture>(path->string());
-                            m_useRoughnessMap = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load roughness map" << std::endl;
-                        }
+                        m_roughnessMap = std::make_unique<Texture>(path->string());
+                        m_useRoughnessMap = true;
                     }
-                }
-
-                ImGui::Separator();
-                ImGui::Checkbox("Use Metallic Map", &m_useMetallicMap);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose Metallic Map..."))
-                {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    catch (...)
                     {
-                        try
-                        {
-                            m_metallicMap = std::make_unique<Texture>(path->string());
-                            m_useMetallicMap = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load metallic map" << std::endl;
-                        }
+                        std::cerr << "Failed to load roughness map" << std::endl;
                     }
                 }
+            }
 
-                ImGui::Separator();
-                ImGui::Checkbox("Use AO Map", &m_useAOMap);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose AO Map..."))
+            ImGui::Separator();
+            ImGui::Checkbox("Use Metallic Map", &m_useMetallicMap);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose Metallic Map..."))
+            {
+                if (auto path = pickOpenFile("png,jpg"))
                 {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    try
                     {
-                        try
-                        {
-                            m_aoMap = std::make_unique<Texture>(path->string());
-                            m_useAOMap = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load AO map" << std::endl;
-                        }
+                        m_metallicMap = std::make_unique<Texture>(path->string());
+                        m_useMetallicMap = true;
                     }
-                }
-
-                ImGui::Separator();
-                ImGui::Checkbox("Use Height Map", &m_useHeightMap);
-                ImGui::SameLine();
-                if (ImGui::Button("Choose Height Map..."))
-                {
-                    if (auto path = pickOpenFile("png,jpg"))
+                    catch (...)
                     {
-                        try
-                        {
-                            m_heightMap = std::make_unique<Texture>(path->string());
-                            m_useHeightMap = true;
-                        }
-                        catch (...)
-                        {
-                            std::cerr << "Failed to load height map" << std::endl;
-                        }
+                        std::cerr << "Failed to load metallic map" << std::endl;
                     }
                 }
+            }
 
-                if (m_useHeightMap)
+            ImGui::Separator();
+            ImGui::Checkbox("Use AO Map", &m_useAOMap);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose AO Map..."))
+            {
+                if (auto path = pickOpenFile("png,jpg"))
                 {
-                    ImGui::SliderFloat("Height scale", &m_heightScale, 0.0f, 0.2f);
+                    try
+                    {
+                        m_aoMap = std::make_unique<Texture>(path->string());
+                        m_useAOMap = true;
+                    }
+                    catch (...)
+                    {
+                        std::cerr << "Failed to load AO map" << std::endl;
+                    }
                 }
             }
 
             ImGui::Separator();
-            ImGui::Checkbox("Use Environment Map", &m_useEnvironmentMapping);
-            ImGui::Checkbox("Use Snake Camera", &m_useSnakeCamera);
-
-            if (ImGui::CollapsingHeader("Snake"))
+            ImGui::Checkbox("Use Height Map", &m_useHeightMap);
+            ImGui::SameLine();
+            if (ImGui::Button("Choose Height Map..."))
             {
-                ImGui::Separator();
-                ImGui::Checkbox("Render the Bezier curves", &m_showPath);
-
-                ImGui::Separator();
-                ImGui::Checkbox("Use material if no texture", &m_useMaterial);
-
-                ImGui::Separator();
-                ImGui::Text("Snake animation controls:");
-                ImGui::SliderFloat("Wave Speed", &m_snakeWaveSpeed, 0.0f, 10.0f);
-                ImGui::SliderFloat("Wave Amplitude (deg)", &m_snakeWaveAmplitude, 0.0f, glm::radians(90.0f));
-                ImGui::SliderFloat("Wavelength", &m_snakeWavelength, 0.1f, 2.0f);
-                ImGui::Checkbox("Pause Snake", &m_snakePaused);
-                ImGui::Checkbox("Move at constant speed", &m_moveAtConstantSpeed);
-                if (m_moveAtConstantSpeed)
+                if (auto path = pickOpenFile("png,jpg"))
                 {
-                    ImGui::SliderFloat("Snake constant movement speed", &m_snakeSpeed, 0.0f, 10.0f);
-                    m_snakeClampedToWaterheight = false;
-                }
-                else {
-                    ImGui::Checkbox("Clamp snake y to waterheight", &m_snakeClampedToWaterheight);
+                    try
+                    {
+                        m_heightMap = std::make_unique<Texture>(path->string());
+                        m_useHeightMap = true;
+                    }
+                    catch (...)
+                    {
+                        std::cerr << "Failed to load height map" << std::endl;
+                    }
                 }
-                 
-
             }
 
-            ImGui::Separator();
-            if (ImGui::CollapsingHeader("Water"))
+            if (m_useHeightMap)
             {
-                ImGui::SliderInt("Num Waves", &m_numWaves, 1, MAX_WAVES);
-                ImGui::SliderFloat("Omega", &m_omega, 0.1f, 5.0f);
-                ImGui::SliderFloat("Phi", &m_phi, 0.0f, 10.0f);
-                ImGui::SliderFloat("Amplitude", &m_amplitude, 0.001f, 0.01f);
+                ImGui::SliderFloat("Height scale", &m_heightScale, 0.0f, 0.2f);
             }
+        }
 
-            ImGui::Separator();
-            ImGui::Checkbox("Draw mesh at light positions", &m_drawMeshAtLights);
-            ImGui::SliderFloat("Day/Night cycle speed", &m_dayNightSpeed, 0.0f, 0.5f);
-
-            ImGui::End();
+        ImGui::Separator();
+        ImGui::Checkbox("Use Environment Map", &m_useEnvironmentMapping);
+        ImGui::Checkbox("Use Snake Camera", &m_useSnakeCamera);
 
-            // Clear the screen
-            glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (ImGui::CollapsingHeader("Snake"))
+        {
+            ImGui::Separator();
+            ImGui::Checkbox("Render the Bezier curves", &m_showPath);
 
-            // ...
-            glEnable(GL_DEPTH_TEST);
+            ImGui::Separator();
+            ImGui::Checkbox("Use material if no texture", &m_useMaterial);
 
-            // Compute active view matrix
-            glm::mat4 activeView = m_camera.getViewMatrix();
-            glm::vec3 activeCameraPos = m_camera.getPosition();
-            if (m_useSnakeCamera)
+            ImGui::Separator();
+            ImGui::Text("Snake animation controls:");
+            ImGui::SliderFloat("Wave Speed", &m_snakeWaveSpeed, 0.0f, 10.0f);
+            ImGui::SliderFloat("Wave Amplitude (deg)", &m_snakeWaveAmplitude, 0.0f, glm::radians(90.0f));
+            ImGui::SliderFloat("Wavelength", &m_snakeWavelength, 0.1f, 2.0f);
+            ImGui::Checkbox("Pause Snake", &m_snakePaused);
+            ImGui::Checkbox("Move at constant speed", &m_moveAtConstantSpeed);
+            if (m_moveAtConstantSpeed)
             {
-                glm::vec3 forward = glm::normalize(glm::vec3(-1.0f) * glm::vec3(m_snakeRotation[2]));
-                glm::vec3 up = glm::normalize(glm::vec3(m_snakeRotation[1]));
-                // Position the camera slightly above and at the front of the snake
-                glm::vec3 eye = m_snakePosition + forward * 0.5f + up * 0.15f;
-                activeView = glm::lookAt(eye, eye + forward, up);
-                activeCameraPos = eye;
+                ImGui::SliderFloat("Snake constant movement speed", &m_snakeSpeed, 0.0f, 10.0f);
+                m_snakeClampedToWaterheight = false;
             }
+            else {
+                ImGui::Checkbox("Clamp snake y to waterheight", &m_snakeClampedToWaterheight);
+            }
+             
 
-            float daylight = updateDayAndNightCycle(deltaTime);
-
-            // Draw Skybox
-            glDepthFunc(GL_LEQUAL);
-            m_skyboxShader.bind();
+        }
 
-            // Remove translation from view matrix
-            glm::mat4 viewNoTranslate = glm::mat4(glm::mat3(activeView));
-            glUniformMatrix4fv(m_skyboxShader.getUniformLocation("view"), 1, GL_FALSE, glm::value_ptr(viewNoTranslate));
-            glUniformMatrix4fv(m_skyboxShader.getUniformLocation("projection"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
-            glUniform1f(m_skyboxShader.getUniformLocation("daylight"), daylight); // for making the skybox dark at night as well
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Water"))
+        {
+            ImGui::SliderInt("Num Waves", &m_numWaves, 1, MAX_WAVES);
+            ImGui::SliderFloat("Omega", &m_omega, 0.1f, 5.0f);
+            ImGui::SliderFloat("Phi", &m_phi, 0.0f, 10.0f);
+            ImGui::SliderFloat("Amplitude", &m_amplitude, 0.001f, 0.01f);
+            ImGui::Checkbox("FFT ocean (instead of the sum of sines)", &m_fftOcean);
+            if (m_fftOcean) {
+                int oceanResolution = m_oceanSettings.resolution == 128 ? 0 : (m_oceanSettings.resolution == 256 ? 1 : 2);
+                if (ImGui::Combo("Ocean resolution", &oceanResolution, "128\0" "256\0" "512\0"))
+                    m_oceanSettings.resolution = 128 << oceanResolution;
+                ImGui::SliderFloat("Ocean patch size (m)", &m_oceanSettings.patchSize, 2.0f, 32.0f);
+                ImGui::SliderFloat("Wave height (m)", &m_oceanSettings.waveHeight, 0.0f, 0.2f);
+                ImGui::SliderFloat("Wind speed (m/s)", &m_oceanSettings.windSpeed, 0.5f, 10.0f);
+                ImGui::SliderFloat("Wind direction", &m_oceanSettings.windDirection, 0.0f, 360.0f);
+                ImGui::SliderFloat("Choppiness", &m_oceanSettings.choppiness, 0.0f, 2.0f);
+            }
+            ImGui::SliderFloat("Opacity", &m_waterOpacity, 0.0f, 1.0f);
+            ImGui::Checkbox("Order-independent transparency (water and particles)", &m_useOIT);
+        }
 
-            glBindVertexArray(m_skyboxVAO);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            glBindVertexArray(0);
-            glDepthFunc(GL_LESS); // reset to default
+        ImGui::Separator();
+        ImGui::Checkbox("Draw mesh at light positions", &m_drawMeshAtLights);
+        ImGui::SliderFloat("Day/Night cycle speed", &m_dayNightSpeed, 0.0f, 0.5f);
 
-            // Update view matrix from the active view we computed earlier
-            m_viewMatrix = activeView;
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Simulation"))
+        {
+            int stepsPerSecond = static_cast<int>(std::round(1.0 / m_simulationThread->stepSeconds()));
+            if (ImGui::SliderInt("Steps per second", &stepsPerSecond, 5, 240))
+                m_simulationThread->setStepSeconds(1.0 / stepsPerSecond);
+            int maxStepsPerFrame = m_simulationThread->maxStepsPerFrame();
+            if (ImGui::SliderInt("Max steps per wake-up", &maxStepsPerFrame, 1, 16))
+                m_simulationThread->setMaxStepsPerFrame(maxStepsPerFrame);
+            ImGui::Checkbox("Interpolate", &m_interpolateSimulation);
+            if (ImGui::Checkbox("Simulate particles on the GPU", &m_gpuParticlesEnabled) && m_gpuParticlesEnabled)
+                m_gpuParticles->reset();
+            ImGui::Checkbox("SPH splash (CPU particles)", &m_sphParticles);
+            ImGui::Checkbox("Sort particles back to front (CPU, without order-independent transparency)", &m_sortParticles);
+            int particleResolution = m_particleResolutionScale == 1 ? 0 : (m_particleResolutionScale == 2 ? 1 : 2);
+            if (ImGui::Combo("Particle resolution (with order-independent transparency)", &particleResolution, "Full\0Half\0Quarter\0"))
+                m_particleResolutionScale = 1 << particleResolution;
+            ImGui::Text("Step %llu", static_cast<unsigned long long>(m_renderedStep));
+            ImGui::Text("Simulation time: %.2f s (%.2f s dropped)", double(m_time), m_simulationThread->droppedSeconds());
+        }
 
-            if (m_showPath) {
-                renderBezierPath();
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Shadows"))
+        {
+            CascadedShadowMaps::Settings& shadowSettings = m_shadowMaps.settings;
+            ImGui::Checkbox("Sun shadows", &m_useShadows);
+            ImGui::SliderFloat("Shadow distance", &shadowSettings.shadowDistance, 2.0f, FAR_PLANE);
+            ImGui::SliderFloat("Split lambda", &shadowSettings.splitLambda, 0.0f, 1.0f);
+            ImGui::SliderInt("First static cascade", &shadowSettings.firstStaticCascade, 0, CascadedShadowMaps::NUM_CASCADES);
+            ImGui::SliderFloat("Static re-render angle", &shadowSettings.staticAngleThresholdDegrees, 0.0f, 10.0f, "%.2f deg");
+            for (int i = 0; i < CascadedShadowMaps::NUM_CASCADES; ++i)
+            {
+                ImGui::Text("Cascade %d: up to %.2f, %s, rendered %u times", i, double(m_shadowMaps.splitDistance(i)),
+                    m_shadowMaps.isStatic(i) ? "static" : "dynamic", m_shadowMaps.renderCount(i));
             }
 
-            updateSnakeMotion(deltaTime);
-            updateSnake(deltaTime);
-            drawSnake();
-
-            updateParticles(deltaTime);
+            PointShadowAtlas::Settings& pointShadowSettings = m_pointShadows.settings;
+            ImGui::Checkbox("Point light shadows", &pointShadowSettings.enabled);
+            ImGui::SliderInt("Faces per frame", &pointShadowSettings.faceBudget, 1, 96);
+            ImGui::SliderInt("Max shadowed lights", &pointShadowSettings.maxShadowedLights, 0, 128);
+            ImGui::Text("Shadowed lights: %d, dirty faces: %d", m_pointShadows.numShadowedLights(), m_pointShadows.numDirtyFaces());
+        }
 
-            // Draw ground plane
-            if (m_groundMesh.has_value())
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Frame graph"))
+        {
+            ImGui::Text("Transient targets: %zu, pooled textures: %zu", m_frameGraph.numTransientTargets(), m_frameGraph.numPooledTextures());
+            uint64_t shadedFragments = 0;
+            for (const FrameGraphPassTiming& timing : m_frameGraph.timings())
             {
-                Shader &activeShader = m_usePBR ? m_defaultShader : m_basicShader;
-                activeShader.bind();
-
-                glm::mat4 mvpGround = m_projectionMatrix * m_viewMatrix * m_groundModelMatrix;
-                glUniformMatrix4fv(activeShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpGround));
-                glUniformMatrix4fv(activeShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(m_groundModelMatrix));
-                glm::mat3 normalGround = glm::inverseTranspose(glm::mat3(m_groundModelMatrix));
-                glUniformMatrix3fv(activeShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalGround));
-                glUniform1f(activeShader.getUniformLocation("daylight"), daylight);
+                if (timing.culled) {
+                    ImGui::TextDisabled("%-14s culled", timing.name.c_str());
+                    continue;
+                }
+                ImGui::Text("%-14s CPU %.3f ms  GPU %.3f ms  %llu fragments", timing.name.c_str(), double(timing.cpuMilliseconds), double(timing.gpuMilliseconds),
+                    static_cast<unsigned long long>(timing.samplesPassed));
+                // The pre-pass and shadow maps only write depth, so they do not count as shading.
+                if (timing.name != "depthPrepass" && timing.name != "pointShadows" && !timing.name.starts_with("shadowCascade"))
+                    shadedFragments += timing.samplesPassed;
+            }
+            // Remember the last count of either mode so toggling the pre-pass shows the difference.
+            if (!deferredActive())
+                m_shadedFragments[m_useDepthPrepass ? 1 : 0] = shadedFragments;
+            ImGui::Text("Shaded fragments: %llu without pre-pass, %llu with pre-pass",
+                static_cast<unsigned long long>(m_shadedFragments[0]), static_cast<unsigned long long>(m_shadedFragments[1]));
+        }
 
-                if (m_groundMesh->hasTextureCoords())
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("GPU profiler"))
+        {
+            ImGui::Checkbox("Enabled", &m_gpuProfiler.enabled);
+            ImGui::SameLine();
+            if (ImGui::Button("Export CSV..."))
+            {
+                if (auto path = pickSaveFile("csv"))
                 {
-                    if (m_useTexture)
-                    {
-                        if (m_texture)
-                            m_texture->bind(GL_TEXTURE0);
-                        glUniform1i(activeShader.getUniformLocation("colorMap"), 0);
-                        glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_TRUE);
-                        glUniform1i(activeShader.getUniformLocation("useTexture"), GL_TRUE);
-                        glUniform1i(activeShader.getUniformLocation("useMaterial"), GL_FALSE);
-                    }
-                    else
-                    {
-                        glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
-                        glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
-                        glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
-                    }
-                }
-                else
-                {
-                    glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
-                    glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
-                    glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
+                    if (!m_gpuProfiler.writeCsv(*path))
+                        std::cerr << "Warning: failed to write " << path->string() << std::endl;
                 }
+            }
+            ImGui::SameLine();
+            ImGui::Text("Dropped frames: %llu", static_cast<unsigned long long>(m_gpuProfiler.numDroppedFrames()));
 
-                // Upload camera and material uniforms
-                glUniform3fv(activeShader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(activeCameraPos));
-
-                GPUMaterial gmat;
-                gmat.kd = m_kd;
-                gmat.ks = m_ks;
-                gmat.shininess = m_shininess;
-                gmat.transparency = m_transparency;
-                m_groundMesh->updateMaterialBuffer(gmat);
-
-                glm::vec3 lightPos = m_lights.empty() ? glm::vec3(2.0f, 4.0f, 2.0f) : m_lights[m_selectedLight].position;
-                glm::vec3 lightCol = m_lights.empty() ? glm::vec3(1.0f) : m_lights[m_selectedLight].color;
-                glUniform3fv(activeShader.getUniformLocation("lightPosition"), 1, glm::value_ptr(lightPos));
-                int locColor = activeShader.getUniformLocation("lightColor");
-                if (locColor >= 0)
-                    glUniform3fv(locColor, 1, glm::value_ptr(lightCol));
-                int locKa = activeShader.getUniformLocation("ka");
-                if (locKa >= 0)
-                    glUniform1f(locKa, m_ka);
-
-                // Normal map handling (if supported)
-                int locHasNM = activeShader.getUniformLocation("hasNormalMap");
-                if (locHasNM >= 0)
-                    glUniform1i(locHasNM, (m_useNormalMap && m_normalMap) ? GL_TRUE : GL_FALSE);
-                if (m_useNormalMap && m_normalMap)
-                {
-                    m_normalMap->bind(GL_TEXTURE1);
-                    int locNM = activeShader.getUniformLocation("normalMap");
-                    if (locNM >= 0)
-                        glUniform1i(locNM, 1);
-                }
+            m_gpuProfiler.drawFlameBar();
+            ImGui::Text("%-28s %8s %8s %8s %8s", "Zone", "last", "min", "avg", "p99");
+            for (const GpuProfiler::ZoneTiming& zone : m_gpuProfiler.zones())
+            {
+                ImGui::Text("%*s%-*s %8.3f %8.3f %8.3f %8.3f", 2 * zone.depth, "", 28 - 2 * zone.depth, zone.name.c_str(),
+                    double(zone.milliseconds), double(zone.minMilliseconds), double(zone.avgMilliseconds), double(zone.p99Milliseconds));
+            }
+        }
+
+        ImGui::End();
+    }
 
-                m_groundMesh->draw(activeShader);
+    void update()
+    {
+        int dummyInteger = 0; // Initialized to 0
+        double lastTime = glfwGetTime();
+        while (!m_window.shouldClose()) {
+            CPU_PROFILE_ZONE("frame");
+            // This is your game loop
+            // Put your real-time logic and rendering in here
+            m_window.updateInput();
+
+            // Time step
+            double currentTime = glfwGetTime();
+            float deltaTime = static_cast<float>(currentTime - lastTime);
+            lastTime = currentTime;
+
+            processInput(deltaTime);
+
+            drawUserInterface();
+
+            consumeSimulation();
+            drawFrame();
+
+            // Processes input and swaps the window buffer
+            {
+                CPU_PROFILE_ZONE("swapBuffers");
+                m_window.swapBuffers();
             }
+        }
+    }
 
-            // Easiest way to dissapear the dragon
-            m_modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -100.0f, 0.0f));
-            const glm::mat4 mvpMatrix = m_projectionMatrix * m_viewMatrix * m_modelMatrix;
-
-            // Normals should be transformed differently than positions (ignoring translations + dealing with scaling):
-            // https://paroj.github.io/gltut/Illumination/Tut09%20Normal%20Transformation.html
-            const glm::mat3 normalModelMatrix = glm::inverseTranspose(glm::mat3(m_modelMatrix));
-
-
-            for (GPUMesh& mesh : m_meshes) {
-                // Choose active shader based on UI toggle
-                Shader &activeShader = m_usePBR ? m_defaultShader : m_basicShader;
-                activeShader.bind();
-                glUniformMatrix4fv(activeShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-                // Upload model/normal matrices
-                glUniformMatrix4fv(activeShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(m_modelMatrix));
-                glUniformMatrix3fv(activeShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalModelMatrix));
-                if (mesh.hasTextureCoords()) {
-                    // If user wants to use textures, bind and tell shader to sample; otherwise treat as no texcoords for shading
-                    if (m_useTexture)
-                    {
-                        if (m_texture)
-                            m_texture->bind(GL_TEXTURE0);
-                        glUniform1i(activeShader.getUniformLocation("colorMap"), 0);
-                        glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_TRUE);
-                        glUniform1i(activeShader.getUniformLocation("useTexture"), GL_TRUE);
-                        glUniform1i(activeShader.getUniformLocation("useMaterial"), GL_FALSE);
-                    }
-                    else
-                    {
-                        // Mesh has texcoords, but user disabled texture usage: tell shader it has texcoords=false
-                        glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
-                        glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
-                        glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
-                    }
+    // Headless benchmark: render the scripted scene into the window's offscreen framebuffer with a fixed time step,
+    // then write the frame time statistics to the output file. Returns the exit status of the program.
+    int runBenchmark(float startupMilliseconds)
+    {
+        const BenchmarkOptions& options = *m_benchmark;
+        BenchmarkResults results;
+        results.renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        results.startupMilliseconds = startupMilliseconds;
+        std::srand(1);
+
+        for (int frame = 0; frame < options.numWarmupFrames + options.numFrames; ++frame) {
+            if (frame == options.numWarmupFrames) {
+                // Only log the GPU time of the measured frames.
+                m_gpuProfiler.finish();
+                m_gpuProfiler.clearHistory();
+                m_gpuProfiler.setFrameTimeLog(&results.gpuFrameMilliseconds);
+            }
+
+            drawStats() = {};
+            const int64_t frameStart = cpuProfilerTimestamp();
+            {
+                CPU_PROFILE_ZONE("frame");
+                // Orbit around the scene (one revolution every 20 seconds) while the snake follows its path.
+                const float angle = m_time * glm::two_pi<float>() / 20.0f;
+                const glm::vec3 position { 3.5f * std::cos(angle), 1.5f, 3.5f * std::sin(angle) };
+                const glm::vec3 direction = glm::normalize(-position);
+                m_camera = Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), glm::degrees(std::atan2(direction.z, direction.x)), glm::degrees(std::asin(direction.y)));
+                consumeSimulation();
+                drawFrame();
+                glFlush();
+            }
+            const float frameMilliseconds = float(cpuProfilerTimestamp() - frameStart) * 1e-6f;
+
+            if (frame == 0)
+                results.firstFrameMilliseconds = frameMilliseconds;
+            if (frame >= options.numWarmupFrames) {
+                results.cpuFrameMilliseconds.push_back(frameMilliseconds);
+                results.drawStats.push_back(drawStats());
+            }
+        }
+        m_gpuProfiler.finish();
+        m_gpuProfiler.setFrameTimeLog(nullptr);
+        results.gpuZones.assign(std::begin(m_gpuProfiler.zones()), std::end(m_gpuProfiler.zones()));
+        results.numDroppedGpuFrames = m_gpuProfiler.numDroppedFrames();
+        while (glGetError() != GL_NO_ERROR)
+            results.numGLErrors++;
+
+        if (!writeBenchmarkJson(options.outputPath, options, results)) {
+            std::cerr << "Could not write benchmark results to " << options.outputPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote benchmark results to " << options.outputPath << std::endl;
+        return results.numGLErrors == 0 ? 0 : 1;
+    }
+
+    // Pick up the latest state of the simulation thread and interpolate between its last two steps for rendering.
+    void consumeSimulation()
+    {
+        CPU_PROFILE_ZONE("consumeSimulation");
+        m_simulationThread->setSettings(simulationSettings());
+        const SimulationSnapshot& snapshot = m_simulationThread->acquire();
+        m_snapshot = &snapshot;
+        if (snapshot.step != m_renderedStep) {
+            if (m_gpuParticlesEnabled)
+                updateGPUParticles(snapshot);
+            else
+                uploadParticles(snapshot);
+            uploadOcean(snapshot);
+        }
+        m_renderedStep = snapshot.step;
+
+        // The snapshot was published right after its step, so it becomes fully current one step after that.
+        float alpha = 1.0f;
+        if (m_interpolateSimulation && !m_benchmark && snapshot.stepSeconds > 0.0f)
+            alpha = glm::clamp(float(cpuProfilerTimestamp() - snapshot.publishTimestamp) * 1e-9f / snapshot.stepSeconds, 0.0f, 1.0f);
+        m_snakeRenderTransforms.resize(snapshot.snakeTransforms.size());
+        for (size_t i = 0; i < snapshot.snakeTransforms.size(); ++i)
+            m_snakeRenderTransforms[i] = interpolateTransform(snapshot.previousSnakeTransforms[i], snapshot.snakeTransforms[i], alpha);
+        m_time = float(snapshot.time);
+        m_renderTime = float(snapshot.time) - (1.0f - alpha) * snapshot.stepSeconds;
+        m_daylight = applyDayAndNightCycle(glm::mix(snapshot.previousTimeOfDay, snapshot.timeOfDay, alpha));
+    }
+
+    SimulationSettings simulationSettings() const
+    {
+        SimulationSettings settings;
+        settings.snakeSpeed = m_snakeSpeed;
+        settings.snakeWaveSpeed = m_snakeWaveSpeed;
+        settings.snakeWaveAmplitude = m_snakeWaveAmplitude;
+        settings.snakeWavelength = m_snakeWavelength;
+        settings.snakePaused = m_snakePaused;
+        settings.snakeClampedToWaterheight = m_snakeClampedToWaterheight;
+        settings.moveAtConstantSpeed = m_moveAtConstantSpeed;
+        settings.simulateParticles = !m_gpuParticlesEnabled;
+        settings.sphParticles = m_sphParticles;
+        settings.dayNightSpeed = m_dayNightSpeed;
+        settings.waves = { m_numWaves, m_omega, m_phi, m_amplitude };
+        settings.waterModelMatrix = m_waterModelMatrix;
+        settings.fftOcean = m_fftOcean;
+        settings.ocean = m_oceanSettings;
+        return settings;
+    }
+
+    // Render the interpolated simulation state.
+    void drawFrame()
+    {
+        glEnable(GL_DEPTH_TEST);
+
+        // Compute active view matrix
+        glm::mat4 activeView = m_camera.getViewMatrix();
+        glm::vec3 activeCameraPos = m_camera.getPosition();
+        if (m_useSnakeCamera && !m_snakeRenderTransforms.empty())
+        {
+            const glm::mat4& snakeHead = m_snakeRenderTransforms.front();
+            glm::vec3 forward = glm::normalize(glm::vec3(-1.0f) * glm::vec3(snakeHead[2]));
+            glm::vec3 up = glm::normalize(glm::vec3(snakeHead[1]));
+            // Position the camera slightly above and at the front of the snake
+            glm::vec3 eye = glm::vec3(snakeHead[3]) + forward * 0.5f + up * 0.15f;
+            activeView = glm::lookAt(eye, eye + forward, up);
+            activeCameraPos = eye;
+        }
+
+        const float daylight = m_daylight;
+
+        // Update view matrix from the active view we computed earlier
+        m_viewMatrix = activeView;
+        m_cameraPosition = activeCameraPos;
+
+        updateLightClusters();
+        if (shadowsActive())
+            m_shadowMaps.update(m_viewMatrix, m_projectionMatrix, NEAR_PLANE, glm::normalize(m_lights[0].position));
+
+        // Easiest way to dissapear the dragon
+        m_modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -100.0f, 0.0f));
+
+        // Build this frame's render passes. Most of them draw into the window framebuffer, so the frame graph
+        // keeps them in the order in which they are added below; the first pass clears the screen.
+        // Opaque geometry goes first, the skybox only fills the pixels that are still uncovered and the
+        // blended water and particles come last (particles write depth, which would break the GL_EQUAL test).
+        m_frameGraph.reset();
+        const FrameGraphResource backbuffer = m_frameGraph.importFramebuffer(
+            "backbuffer", m_window.getFramebuffer(), m_window.getFrameBufferSize(), GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+        const auto writeBackbuffer = [backbuffer](FrameGraph::PassBuilder& builder) { builder.write(backbuffer); };
+
+        // One pass per shadow cascade so that their cost shows up separately; cached cascades do nothing.
+        std::vector<FrameGraphResource> shadowCascades;
+        if (shadowsActive())
+        {
+            for (int i = 0; i < CascadedShadowMaps::NUM_CASCADES; ++i)
+            {
+                const std::string name = "shadowCascade" + std::to_string(i);
+                const FrameGraphResource cascade = m_frameGraph.importFramebuffer(name, m_shadowMaps.framebuffer(i), glm::ivec2(m_shadowMaps.settings.resolution));
+                m_frameGraph.addPass(name, [=](FrameGraph::PassBuilder& builder) { builder.write(cascade); },
+                    [this, i](const FrameGraph::PassContext&) { renderShadowCascade(i); });
+                shadowCascades.push_back(cascade);
+            }
+        }
+        // The point shadow atlas is cached, so the pass only exists when faces have to be (re-)rendered.
+        const FrameGraphResource pointShadowAtlas = m_frameGraph.importFramebuffer(
+            "pointShadowAtlas", m_pointShadows.framebuffer(), glm::ivec2(PointShadowAtlas::ATLAS_SIZE));
+        if (!m_pointShadows.facesToRender().empty())
+        {
+            m_frameGraph.addPass("pointShadows", [=](FrameGraph::PassBuilder& builder) { builder.write(pointShadowAtlas); },
+                [this](const FrameGraph::PassContext&) { renderPointShadows(); });
+        }
+        // Lit passes sample the sun and point light shadow maps.
+        const auto writeBackbufferLit = [backbuffer, shadowCascades, pointShadowAtlas](FrameGraph::PassBuilder& builder) {
+            for (FrameGraphResource cascade : shadowCascades)
+                builder.read(cascade);
+            builder.read(pointShadowAtlas);
+            builder.write(backbuffer);
+        };
+
+        if (prepassActive())
+            m_frameGraph.addPass("depthPrepass", writeBackbuffer, [this](const FrameGraph::PassContext&) { drawDepthPrepass(); });
+        if (m_showPath)
+            m_frameGraph.addPass("path", writeBackbuffer, [this](const FrameGraph::PassContext&) { renderBezierPath(); });
+        if (deferredActive())
+        {
+            // Deferred: the snake, ground and dragon fill the G-buffer, which is then lit in one full screen pass.
+            const glm::ivec2 screenSize = m_window.getFrameBufferSize();
+            const std::array<FrameGraphResource, 4> gbuffer {
+                m_frameGraph.createRenderTarget("gbufferAlbedo", { screenSize, GL_RGBA8 }),
+                m_frameGraph.createRenderTarget("gbufferNormal", { screenSize, GL_RG16 }),
+                m_frameGraph.createRenderTarget("gbufferMaterial", { screenSize, GL_RGBA8 }),
+                m_frameGraph.createRenderTarget("gbufferDepth", { screenSize, GL_DEPTH_COMPONENT32F }, glm::vec4(1.0f))
+            };
+            const auto writeGBuffer = [gbuffer](FrameGraph::PassBuilder& builder) {
+                for (FrameGraphResource target : gbuffer)
+                    builder.write(target);
+            };
+            m_frameGraph.addPass("snake", writeGBuffer, [this](const FrameGraph::PassContext&) { drawSnake(); });
+            m_frameGraph.addPass("ground", writeGBuffer, [=, this](const FrameGraph::PassContext&) { drawGround(daylight); });
+            m_frameGraph.addPass("dragon", writeGBuffer, [this](const FrameGraph::PassContext&) { drawDragon(); });
+            m_frameGraph.addPass("deferredLighting",
+                [=](FrameGraph::PassBuilder& builder) {
+                    for (FrameGraphResource target : gbuffer)
+                        builder.read(target);
+                    writeBackbufferLit(builder);
+                },
+                [=, this](const FrameGraph::PassContext& context) { drawDeferredLighting(context, gbuffer, daylight); });
+        }
+        else
+        {
+            m_frameGraph.addPass("snake", writeBackbufferLit, [this](const FrameGraph::PassContext&) { drawSnake(); });
+            m_frameGraph.addPass("ground", writeBackbufferLit, [=, this](const FrameGraph::PassContext&) { drawGround(daylight); });
+            m_frameGraph.addPass("dragon", writeBackbufferLit, [this](const FrameGraph::PassContext&) { drawDragon(); });
+        }
+        if (m_drawMeshAtLights)
+            m_frameGraph.addPass("lightMarkers", writeBackbufferLit, [this](const FrameGraph::PassContext&) { drawMeshAtLights(); });
+        m_frameGraph.addPass("skybox", writeBackbuffer, [=, this](const FrameGraph::PassContext&) { drawSkybox(daylight); });
+        if (m_useOIT)
+        {
+            // Weighted blended order-independent transparency: the water and particles are accumulated in any
+            // order (so the particles are not sorted) and composited over the opaque image in one full screen pass.
+            // They are depth tested against a copy of the opaque depth, which has the format of the window's
+            // depth buffer so that it can be blitted.
+            const glm::ivec2 screenSize = m_window.getFrameBufferSize();
+            const FrameGraphResource accumulation = m_frameGraph.createRenderTarget("oitAccumulation", { screenSize, GL_RGBA16F });
+            const FrameGraphResource revealage = m_frameGraph.createRenderTarget("oitRevealage", { screenSize, GL_R8 }, glm::vec4(1.0f));
+            const FrameGraphResource depth = m_frameGraph.createRenderTarget("oitDepth", { screenSize, GL_DEPTH24_STENCIL8 }, glm::vec4(1.0f));
+            m_frameGraph.addPass("oitCopyDepth",
+                [=](FrameGraph::PassBuilder& builder) {
+                    builder.read(backbuffer);
+                    builder.write(depth);
+                    // The transparent passes render on top of the copy, which the culling does not see as a read.
+                    builder.setSideEffect();
+                },
+                [this, screenSize](const FrameGraph::PassContext&) {
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_window.getFramebuffer());
+                    glBlitFramebuffer(0, 0, screenSize.x, screenSize.y, 0, 0, screenSize.x, screenSize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                });
+            const auto writeTransparent = [=](FrameGraph::PassBuilder& builder) {
+                builder.write(accumulation);
+                builder.write(revealage);
+                builder.write(depth);
+            };
+            m_frameGraph.addPass("water", writeTransparent, [this](const FrameGraph::PassContext&) { drawWater(true); });
+            if (m_particleResolutionScale > 1)
+            {
+                // The large, overlapping particle sprites are fill rate bound, so they are drawn at a fraction of
+                // the resolution against a downsampled depth buffer and upsampled into the transparency targets.
+                const int scale = m_particleResolutionScale;
+                const glm::ivec2 lowResolution = (screenSize + scale - 1) / scale;
+                const std::array<FrameGraphResource, 3> particleTargets {
+                    m_frameGraph.createRenderTarget("particleAccumulation", { lowResolution, GL_RGBA16F }),
+                    m_frameGraph.createRenderTarget("particleRevealage", { lowResolution, GL_R8 }, glm::vec4(1.0f)),
+                    m_frameGraph.createRenderTarget("particleDepth", { lowResolution, GL_DEPTH_COMPONENT32F }, glm::vec4(1.0f))
+                };
+                m_frameGraph.addPass("particleDepthDownsample",
+                    [=](FrameGraph::PassBuilder& builder) {
+                        builder.read(depth);
+                        builder.write(particleTargets[2]);
+                    },
+                    [=, this](const FrameGraph::PassContext& context) { drawParticleDepthDownsample(context, depth, scale); });
+                m_frameGraph.addPass("particles",
+                    [=](FrameGraph::PassBuilder& builder) {
+                        for (FrameGraphResource target : particleTargets)
+                            builder.write(target);
+                    },
+                    [=, this](const FrameGraph::PassContext&) { drawParticles(true, scale); });
+                m_frameGraph.addPass("particleUpsample",
+                    [=](FrameGraph::PassBuilder& builder) {
+                        for (FrameGraphResource target : particleTargets)
+                            builder.read(target);
+                        builder.read(depth);
+                        builder.write(accumulation);
+                        builder.write(revealage);
+                    },
+                    [=, this](const FrameGraph::PassContext& context) { drawParticleUpsample(context, particleTargets, depth, scale); });
+            }
+            else
+            {
+                m_frameGraph.addPass("particles", writeTransparent, [this](const FrameGraph::PassContext&) { drawParticles(true); });
+            }
+            m_frameGraph.addPass("oitComposite",
+                [=](FrameGraph::PassBuilder& builder) {
+                    builder.read(accumulation);
+                    builder.read(revealage);
+                    builder.write(backbuffer);
+                },
+                [=, this](const FrameGraph::PassContext& context) { drawOITComposite(context, accumulation, revealage); });
+        }
+        else
+        {
+            m_frameGraph.addPass("water", writeBackbuffer, [this](const FrameGraph::PassContext&) { drawWater(false); });
+            m_frameGraph.addPass("particles", writeBackbuffer, [this](const FrameGraph::PassContext&) { drawParticles(false); });
+        }
+
+        m_frameGraph.compile();
+        // Every frame graph pass gets its own zone under the frame zone (see FrameGraph::setProfiler).
+        m_gpuProfiler.beginFrame();
+        m_gpuProfiler.pushZone("frame");
+        m_frameGraph.execute();
+        m_gpuProfiler.popZone();
+        m_gpuProfiler.endFrame();
+    }
+
+    
+
+    // Lay down the depth of the ground and dragon, whose (parallax mapped) fragment shader is expensive, with a
+    // position-only vertex stream. Their shading passes then test with GL_EQUAL so every pixel is shaded once.
+    void drawDepthPrepass()
+    {
+        CPU_PROFILE_ZONE("drawDepthPrepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        m_depthShader.bind();
+
+        if (m_groundMesh.has_value())
+        {
+            const glm::mat4 mvpGround = m_projectionMatrix * m_viewMatrix * m_groundModelMatrix;
+            glUniformMatrix4fv(m_depthShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpGround));
+            m_groundMesh->drawPositionsOnly();
+        }
+
+        const glm::mat4 mvpMatrix = m_projectionMatrix * m_viewMatrix * m_modelMatrix;
+        glUniformMatrix4fv(m_depthShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+        for (GPUMesh& mesh : m_meshes)
+            mesh.drawPositionsOnly();
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    // Depth state for geometry that was drawn in the depth pre-pass.
+    void beginPrepassedGeometry()
+    {
+        if (prepassActive())
+        {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+    }
+
+    void endPrepassedGeometry()
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    // The deferred renderer only has a PBR lighting pass; with the Blinn-Phong shader everything is drawn forward.
+    bool deferredActive() const
+    {
+        return m_useDeferred && m_usePBR;
+    }
+
+    // The G-buffer pass is cheap per fragment, so the depth pre-pass is only used by the forward renderer.
+    bool prepassActive() const
+    {
+        return m_useDepthPrepass && !deferredActive();
+    }
+
+    // Shadows are cast by the sun (light 0), and only while it is the active light and above the horizon.
+    bool shadowsActive() const
+    {
+        return m_useShadows && !m_lights.empty() && m_selectedLight == 0 && m_lights[0].position.y > 0.0f;
+    }
+
+    void drawShadowCaster(GPUMesh& mesh, const glm::mat4& lightViewProjection, const glm::mat4& modelMatrix)
+    {
+        const glm::mat4 mvpMatrix = lightViewProjection * modelMatrix;
+        glUniformMatrix4fv(m_shadowShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+        mesh.drawPositionsOnly();
+    }
+
+    // Static geometry (ground, water) goes into every cascade; dynamic geometry (snake, dragon) only into the
+    // cascades that are re-rendered every frame.
+    void renderShadowCascade(int cascade)
+    {
+        CPU_PROFILE_ZONE("renderShadowCascade");
+        if (!m_shadowMaps.needsRender(cascade))
+            return;
+
+        m_shadowMaps.beginRender(cascade);
+        m_shadowShader.bind();
+        const glm::mat4& lightViewProjection = m_shadowMaps.lightViewProjection(cascade);
+        {
+            GpuProfiler::Scope zone(m_gpuProfiler, "static");
+            if (m_groundMesh.has_value())
+                drawShadowCaster(*m_groundMesh, lightViewProjection, m_groundModelMatrix);
+            if (m_planeMesh.has_value())
+                drawShadowCaster(*m_planeMesh, lightViewProjection, m_waterModelMatrix);
+        }
+
+        if (!m_shadowMaps.isStatic(cascade))
+        {
+            GpuProfiler::Scope zone(m_gpuProfiler, "dynamic");
+            for (GPUMesh& mesh : m_meshes)
+                drawShadowCaster(mesh, lightViewProjection, m_modelMatrix);
+            if (!m_meshes.empty())
+            {
+                for (const glm::mat4& segmentTransform : m_snakeRenderTransforms)
+                    drawShadowCaster(m_meshes[0], lightViewProjection, segmentTransform);
+            }
+        }
+        m_shadowMaps.endRender(cascade);
+    }
+
+    // Render the point shadow faces that were scheduled by PointShadowAtlas::update().
+    void renderPointShadows()
+    {
+        CPU_PROFILE_ZONE("renderPointShadows");
+        m_pointShadows.beginRender();
+        m_shadowShader.bind();
+        for (const PointShadowAtlas::FaceRender& face : m_pointShadows.facesToRender())
+        {
+            m_pointShadows.beginFace(face);
+            if (m_groundMesh.has_value())
+                drawShadowCaster(*m_groundMesh, face.viewProjection, m_groundModelMatrix);
+            if (m_planeMesh.has_value())
+                drawShadowCaster(*m_planeMesh, face.viewProjection, m_waterModelMatrix);
+            for (GPUMesh& mesh : m_meshes)
+                drawShadowCaster(mesh, face.viewProjection, m_modelMatrix);
+            if (!m_meshes.empty())
+            {
+                for (const glm::mat4& segmentTransform : m_snakeRenderTransforms)
+                    drawShadowCaster(m_meshes[0], face.viewProjection, segmentTransform);
+            }
+        }
+        m_pointShadows.endRender();
+    }
+
+    static float randomFloat(float min, float max)
+    {
+        return min + (max - min) * (static_cast<float>(rand()) / static_cast<float>(RAND_MAX));
+    }
+
+    // Every light except the active one is a point light that is shaded through the light clusters.
+    void updateLightClusters()
+    {
+        CPU_PROFILE_ZONE("updateLightClusters");
+        m_clusteredLights.clear();
+        for (size_t i = 0; i < m_lights.size(); ++i)
+        {
+            if (i != m_selectedLight)
+                m_clusteredLights.push_back({m_lights[i].position, m_lights[i].radius, m_lights[i].color, m_lights[i].id});
+        }
+
+        // The snake segments and the dragon move, so point shadow faces that they enter or leave are re-rendered.
+        m_dynamicCasters.clear();
+        if (!m_meshes.empty())
+        {
+            const glm::vec3 center = m_meshes[0].boundingSphereCenter();
+            const float radius = m_meshes[0].boundingSphereRadius();
+            for (const glm::mat4& segmentTransform : m_snakeRenderTransforms)
+            {
+                const float scale = std::max({ glm::length(glm::vec3(segmentTransform[0])), glm::length(glm::vec3(segmentTransform[1])), glm::length(glm::vec3(segmentTransform[2])) });
+                m_dynamicCasters.push_back({ glm::vec3(segmentTransform * glm::vec4(center, 1.0f)), radius * scale });
+            }
+            for (const GPUMesh& mesh : m_meshes)
+            {
+                const float scale = std::max({ glm::length(glm::vec3(m_modelMatrix[0])), glm::length(glm::vec3(m_modelMatrix[1])), glm::length(glm::vec3(m_modelMatrix[2])) });
+                m_dynamicCasters.push_back({ glm::vec3(m_modelMatrix * glm::vec4(mesh.boundingSphereCenter(), 1.0f)), mesh.boundingSphereRadius() * scale });
+            }
+        }
+        m_pointShadows.update(m_clusteredLights, m_projectionMatrix * m_viewMatrix, m_cameraPosition, m_dynamicCasters);
+        m_lightClusters.update(m_clusteredLights, m_viewMatrix, m_projectionMatrix, NEAR_PLANE, FAR_PLANE, &m_jobSystem);
+    }
+
+    void drawSkybox(float daylightFactor)
+    {
+        CPU_PROFILE_ZONE("drawSkybox");
+        glDepthFunc(GL_LEQUAL);
+        m_skyboxShader.bind();
+
+        // Remove translation from view matrix
+        glm::mat4 viewNoTranslate = glm::mat4(glm::mat3(m_viewMatrix));
+        glUniformMatrix4fv(m_skyboxShader.getUniformLocation("view"), 1, GL_FALSE, glm::value_ptr(viewNoTranslate));
+        glUniformMatrix4fv(m_skyboxShader.getUniformLocation("projection"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
+        glUniform1f(m_skyboxShader.getUniformLocation("daylight"), daylightFactor); // for making the skybox dark at night as well
+
+        glBindVertexArray(m_skyboxVAO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        countDrawCall(12);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS); // reset to default
+    }
+
+    void drawGround(float daylightFactor)
+    {
+        CPU_PROFILE_ZONE("drawGround");
+        if (m_groundMesh.has_value())
+        {
+            Shader &activeShader = deferredActive() ? m_gbufferShader : (m_usePBR ? m_defaultShader : m_basicShader);
+            activeShader.bind();
+
+            glm::mat4 mvpGround = m_projectionMatrix * m_viewMatrix * m_groundModelMatrix;
+            glUniformMatrix4fv(activeShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpGround));
+            glUniformMatrix4fv(activeShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(m_groundModelMatrix));
+            glm::mat3 normalGround = glm::inverseTranspose(glm::mat3(m_groundModelMatrix));
+            glUniformMatrix3fv(activeShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalGround));
+            if (!deferredActive())
+                glUniform1f(activeShader.getUniformLocation("daylight"), daylightFactor);
+
+            if (m_groundMesh->hasTextureCoords())
+            {
+                if (m_useTexture)
+                {
+                    if (m_texture)
+                        m_texture->bind(GL_TEXTURE0);
+                    glUniform1i(activeShader.getUniformLocation("colorMap"), 0);
+                    glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_TRUE);
+                    glUniform1i(activeShader.getUniformLocation("useTexture"), GL_TRUE);
+                    glUniform1i(activeShader.getUniformLocation("useMaterial"), GL_FALSE);
                 }
                 else
                 {
@@ -829,165 +1483,271 @@ public:
                     glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
                     glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
                 }
-                // Upload camera and material uniforms
-                glUniform3fv(activeShader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(activeCameraPos));
-
-                // Update material UBO for this mesh (std140 block 'Material')
-                GPUMaterial mat;
-                mat.kd = m_kd;
-                mat.ks = m_ks;
-                mat.shininess = m_shininess;
-                mat.transparency = m_transparency;
-                // Update the mesh's material UBO
-                mesh.updateMaterialBuffer(mat);
-
-                // Active light (place at camera position if requested by add action)
-                glm::vec3 lightPos = m_lights.empty() ? glm::vec3(2.0f, 4.0f, 2.0f) : m_lights[m_selectedLight].position;
-                glm::vec3 lightCol = m_lights.empty() ? glm::vec3(1.0f) : m_lights[m_selectedLight].color;
-                glUniform3fv(activeShader.getUniformLocation("lightPosition"), 1, glm::value_ptr(lightPos));
-                // If shader supports a light color uniform, upload it (optional)
-                int locColor = activeShader.getUniformLocation("lightColor");
-                if (locColor >= 0)
-                    glUniform3fv(locColor, 1, glm::value_ptr(lightCol));
-                int locKa = activeShader.getUniformLocation("ka");
-                if (locKa >= 0)
-                    glUniform1f(locKa, m_ka);
-
-                int locHasNM = activeShader.getUniformLocation("hasNormalMap");
-                if (locHasNM >= 0)
-                    glUniform1i(locHasNM, (m_useNormalMap && m_normalMap) ? GL_TRUE : GL_FALSE);
-
-                if (m_useNormalMap && m_normalMap)
-                {
-                    m_normalMap->bind(GL_TEXTURE1);
-                    int locNM = activeShader.getUniformLocation("normalMap");
-                    if (locNM >= 0)
-                        glUniform1i(locNM, 1);
-                }
-                // Roughness map in texture 2
-                int locHasRough = activeShader.getUniformLocation("hasRoughnessMap");
-                if (locHasRough >= 0)
-                    glUniform1i(locHasRough, (m_useRoughnessMap && m_roughnessMap) ? GL_TRUE : GL_FALSE);
-                if (m_useRoughnessMap && m_roughnessMap)
-                {
-                    m_roughnessMap->bind(GL_TEXTURE2);
-                    int locR = activeShader.getUniformLocation("roughnessMap");
-                    if (locR >= 0)
-                        glUniform1i(locR, 2);
-                }
+            }
+            else
+            {
+                glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
+                glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
+                glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
+            }
 
-                // AO map in texture 3
-                int locHasAO = activeShader.getUniformLocation("hasAOMap");
-                if (locHasAO >= 0)
-                    glUniform1i(locHasAO, (m_useAOMap && m_aoMap) ? GL_TRUE : GL_FALSE);
-                if (m_useAOMap && m_aoMap)
-                {
-                    m_aoMap->bind(GL_TEXTURE3);
-                    int locAO = activeShader.getUniformLocation("aoMap");
-                    if (locAO >= 0)
-                        glUniform1i(locAO, 3);
-                }
+            // Upload camera and material uniforms
+            glUniform3fv(activeShader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(m_cameraPosition));
+
+            GPUMaterial gmat;
+            gmat.kd = m_kd;
+            gmat.ks = m_ks;
+            gmat.shininess = m_shininess;
+            gmat.transparency = m_transparency;
+            m_groundMesh->updateMaterialBuffer(gmat);
+
+            // The G-buffer shader does not light; the deferred lighting pass does.
+            if (!deferredActive())
+                setLightingUniforms(activeShader);
+
+            // Normal map handling (if supported)
+            int locHasNM = activeShader.getUniformLocation("hasNormalMap");
+            if (locHasNM >= 0)
+                glUniform1i(locHasNM, (m_useNormalMap && m_normalMap) ? GL_TRUE : GL_FALSE);
+            if (m_useNormalMap && m_normalMap)
+            {
+                m_normalMap->bind(GL_TEXTURE1);
+                int locNM = activeShader.getUniformLocation("normalMap");
+                if (locNM >= 0)
+                    glUniform1i(locNM, 1);
+            }
+
+            beginPrepassedGeometry();
+            m_groundMesh->draw(activeShader);
+            endPrepassedGeometry();
+        }
+    }
 
-                // Height map in texture 4
-                int locHasHeight = activeShader.getUniformLocation("hasHeightMap");
-                if (locHasHeight >= 0)
-                    glUniform1i(locHasHeight, (m_useHeightMap && m_heightMap) ? GL_TRUE : GL_FALSE);
-                if (m_useHeightMap && m_heightMap)
+    void drawDragon()
+    {
+        CPU_PROFILE_ZONE("drawDragon");
+        const glm::mat4 mvpMatrix = m_projectionMatrix * m_viewMatrix * m_modelMatrix;
+
+        // Normals should be transformed differently than positions (ignoring translations + dealing with scaling):
+        // https://paroj.github.io/gltut/Illumination/Tut09%20Normal%20Transformation.html
+        const glm::mat3 normalModelMatrix = glm::inverseTranspose(glm::mat3(m_modelMatrix));
+
+
+        for (GPUMesh& mesh : m_meshes) {
+            // Choose active shader based on UI toggle
+            Shader &activeShader = deferredActive() ? m_gbufferShader : (m_usePBR ? m_defaultShader : m_basicShader);
+            activeShader.bind();
+            glUniformMatrix4fv(activeShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+            // Upload model/normal matrices
+            glUniformMatrix4fv(activeShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(m_modelMatrix));
+            glUniformMatrix3fv(activeShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalModelMatrix));
+            if (mesh.hasTextureCoords()) {
+                // If user wants to use textures, bind and tell shader to sample; otherwise treat as no texcoords for shading
+                if (m_useTexture)
                 {
-                    m_heightMap->bind(GL_TEXTURE4);
-                    int locH = activeShader.getUniformLocation("heightMap");
-                    if (locH >= 0)
-                        glUniform1i(locH, 4);
+                    if (m_texture)
+                        m_texture->bind(GL_TEXTURE0);
+                    glUniform1i(activeShader.getUniformLocation("colorMap"), 0);
+                    glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_TRUE);
+                    glUniform1i(activeShader.getUniformLocation("useTexture"), GL_TRUE);
+                    glUniform1i(activeShader.getUniformLocation("useMaterial"), GL_FALSE);
                 }
-
-                int locHeightScale = activeShader.getUniformLocation("heightScale");
-                if (locHeightScale >= 0)
-                    glUniform1f(locHeightScale, m_heightScale);
-
-                // Upload PBR parameters
-                int locMetallic = activeShader.getUniformLocation("metallicValue");
-                if (locMetallic >= 0)
-                    glUniform1f(locMetallic, m_metallic);
-                int locRoughVal = activeShader.getUniformLocation("roughnessValue");
-                if (locRoughVal >= 0)
-                    glUniform1f(locRoughVal, m_roughness);
-
-                // Metallic map in texture 6
-                int locHasMetal = activeShader.getUniformLocation("hasMetallicMap");
-                if (locHasMetal >= 0)
-                    glUniform1i(locHasMetal, (m_useMetallicMap && m_metallicMap) ? GL_TRUE : GL_FALSE);
-                if (m_useMetallicMap && m_metallicMap)
+                else
                 {
-                    m_metallicMap->bind(GL_TEXTURE6);
-                    int locM = activeShader.getUniformLocation("metallicMap");
-                    if (locM >= 0)
-                        glUniform1i(locM, 6);
+                    // Mesh has texcoords, but user disabled texture usage: tell shader it has texcoords=false
+                    glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
+                    glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
+                    glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
                 }
+            }
+            else
+            {
+                glUniform1i(activeShader.getUniformLocation("hasTexCoords"), GL_FALSE);
+                glUniform1i(activeShader.getUniformLocation("useTexture"), GL_FALSE);
+                glUniform1i(activeShader.getUniformLocation("useMaterial"), m_useMaterial);
+            }
+            // Upload camera and material uniforms
+            glUniform3fv(activeShader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(m_cameraPosition));
+
+            // Update material UBO for this mesh (std140 block 'Material')
+            GPUMaterial mat;
+            mat.kd = m_kd;
+            mat.ks = m_ks;
+            mat.shininess = m_shininess;
+            mat.transparency = m_transparency;
+            // Update the mesh's material UBO
+            mesh.updateMaterialBuffer(mat);
+
+            if (!deferredActive())
+                setLightingUniforms(activeShader);
+
+            int locHasNM = activeShader.getUniformLocation("hasNormalMap");
+            if (locHasNM >= 0)
+                glUniform1i(locHasNM, (m_useNormalMap && m_normalMap) ? GL_TRUE : GL_FALSE);
+
+            if (m_useNormalMap && m_normalMap)
+            {
+                m_normalMap->bind(GL_TEXTURE1);
+                int locNM = activeShader.getUniformLocation("normalMap");
+                if (locNM >= 0)
+                    glUniform1i(locNM, 1);
+            }
+            // Roughness map in texture 2
+            int locHasRough = activeShader.getUniformLocation("hasRoughnessMap");
+            if (locHasRough >= 0)
+                glUniform1i(locHasRough, (m_useRoughnessMap && m_roughnessMap) ? GL_TRUE : GL_FALSE);
+            if (m_useRoughnessMap && m_roughnessMap)
+            {
+                m_roughnessMap->bind(GL_TEXTURE2);
+                int locR = activeShader.getUniformLocation("roughnessMap");
+                if (locR >= 0)
+                    glUniform1i(locR, 2);
+            }
 
-                // Environment mapping on texture 5
-                glUniform1i(activeShader.getUniformLocation("useEnvironmentMap"), m_useEnvironmentMapping ? GL_TRUE : GL_FALSE);
-                glActiveTexture(GL_TEXTURE5);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
-                glUniform1i(activeShader.getUniformLocation("environmentMap"), 5);
-                glActiveTexture(GL_TEXTURE0);
-
-                mesh.draw(activeShader);
+            // AO map in texture 3
+            int locHasAO = activeShader.getUniformLocation("hasAOMap");
+            if (locHasAO >= 0)
+                glUniform1i(locHasAO, (m_useAOMap && m_aoMap) ? GL_TRUE : GL_FALSE);
+            if (m_useAOMap && m_aoMap)
+            {
+                m_aoMap->bind(GL_TEXTURE3);
+                int locAO = activeShader.getUniformLocation("aoMap");
+                if (locAO >= 0)
+                    glUniform1i(locAO, 3);
             }
 
-            // Draw water plane with water shader
-            if (m_planeMesh.has_value())
+            // Height map in texture 4
+            int locHasHeight = activeShader.getUniformLocation("hasHeightMap");
+            if (locHasHeight >= 0)
+                glUniform1i(locHasHeight, (m_useHeightMap && m_heightMap) ? GL_TRUE : GL_FALSE);
+            if (m_useHeightMap && m_heightMap)
             {
-                m_waterShader.bind();
-                const glm::mat4 &waterModel = m_waterModelMatrix;
-                glm::mat4 mvpWater = m_projectionMatrix * m_viewMatrix * waterModel;
-                glm::mat3 normalWater = glm::inverseTranspose(glm::mat3(waterModel));
-
-                // Set common uniforms expected by shaders
-                glUniformMatrix4fv(m_waterShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpWater));
-                glUniformMatrix3fv(m_waterShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalWater));
-                // Provide model matrix so vertex shader can compute world-space fragPosition
-                glUniformMatrix4fv(m_waterShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(waterModel));
-                glUniform3fv(m_waterShader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(activeCameraPos));
-                glUniform1f(m_waterShader.getUniformLocation("time"), (float)glfwGetTime());
-
-                // Upload light uniforms
-                glm::vec3 lightPos = m_lights.empty() ? glm::vec3(2.0f, 4.0f, 2.0f) : m_lights[m_selectedLight].position;
-                glm::vec3 lightCol = m_lights.empty() ? glm::vec3(1.0f) : m_lights[m_selectedLight].color;
-                glUniform3fv(m_waterShader.getUniformLocation("lightPosition"), 1, glm::value_ptr(lightPos));
-                glUniform3fv(m_waterShader.getUniformLocation("lightColor"), 1, glm::value_ptr(lightCol));
-                glUniform1f(m_waterShader.getUniformLocation("ka"), m_ka);
-
-                // Upload sum-of-sines parameters
-                glUniform1i(m_waterShader.getUniformLocation("numWaves"), m_numWaves);
-                glUniform1f(m_waterShader.getUniformLocation("omega"), m_omega);
-                glUniform1f(m_waterShader.getUniformLocation("phi"), m_phi);
-                glUniform1f(m_waterShader.getUniformLocation("alpha"), m_amplitude);
-
-                // Bind environment cubemap for water reflections (skybox)
-                glActiveTexture(GL_TEXTURE6);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
-                glActiveTexture(GL_TEXTURE0);
-
-                // Update material UBO and draw
-                GPUMaterial mat;
-                mat.kd = m_kd;
-                mat.ks = m_ks;
-                mat.shininess = m_shininess;
-                mat.transparency = m_transparency;
-                m_planeMesh->updateMaterialBuffer(mat);
-                m_planeMesh->draw(m_waterShader);
+                m_heightMap->bind(GL_TEXTURE4);
+                int locH = activeShader.getUniformLocation("heightMap");
+                if (locH >= 0)
+                    glUniform1i(locH, 4);
             }
 
-            if (m_drawMeshAtLights) {
-                drawMeshAtLights();
+            int locHeightScale = activeShader.getUniformLocation("heightScale");
+            if (locHeightScale >= 0)
+                glUniform1f(locHeightScale, m_heightScale);
+
+            // Upload PBR parameters
+            int locMetallic = activeShader.getUniformLocation("metallicValue");
+            if (locMetallic >= 0)
+                glUniform1f(locMetallic, m_metallic);
+            int locRoughVal = activeShader.getUniformLocation("roughnessValue");
+            if (locRoughVal >= 0)
+                glUniform1f(locRoughVal, m_roughness);
+
+            // Metallic map in texture 6
+            int locHasMetal = activeShader.getUniformLocation("hasMetallicMap");
+            if (locHasMetal >= 0)
+                glUniform1i(locHasMetal, (m_useMetallicMap && m_metallicMap) ? GL_TRUE : GL_FALSE);
+            if (m_useMetallicMap && m_metallicMap)
+            {
+                m_metallicMap->bind(GL_TEXTURE6);
+                int locM = activeShader.getUniformLocation("metallicMap");
+                if (locM >= 0)
+                    glUniform1i(locM, 6);
             }
 
-            // Processes input and swaps the window buffer
-            m_window.swapBuffers();
+            // Environment mapping (the G-buffer only stores whether it is used)
+            glUniform1i(activeShader.getUniformLocation("useEnvironmentMap"), m_useEnvironmentMapping ? GL_TRUE : GL_FALSE);
+
+            beginPrepassedGeometry();
+            mesh.draw(activeShader);
+            endPrepassedGeometry();
         }
     }
 
-    
+    // The water and particles are transparent. With weighted blended transparency they are accumulated into the
+    // targets of the OIT passes (see oit_output_frag.glsl) without writing depth; otherwise they are alpha blended
+    // onto the backbuffer, in back to front order.
+    void beginTransparentGeometry(bool orderIndependent)
+    {
+        glEnable(GL_BLEND);
+        if (orderIndependent)
+        {
+            glBlendFunci(0, GL_ONE, GL_ONE);
+            glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+            glDepthMask(GL_FALSE);
+        }
+        else
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+    }
+    void endTransparentGeometry()
+    {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+    }
+
+    void drawWater(bool orderIndependent)
+    {
+        CPU_PROFILE_ZONE("drawWater");
+        if (m_planeMesh.has_value())
+        {
+            const Shader& shader = orderIndependent ? m_waterOITShader : m_waterShader;
+            shader.bind();
+            const glm::mat4 &waterModel = m_waterModelMatrix;
+            glm::mat4 mvpWater = m_projectionMatrix * m_viewMatrix * waterModel;
+            glm::mat3 normalWater = glm::inverseTranspose(glm::mat3(waterModel));
+
+            // Set common uniforms expected by shaders
+            glUniformMatrix4fv(shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpWater));
+            glUniformMatrix3fv(shader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalWater));
+            // Provide model matrix so vertex shader can compute world-space fragPosition
+            glUniformMatrix4fv(shader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(waterModel));
+            glUniform3fv(shader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(m_cameraPosition));
+            glUniform1f(shader.getUniformLocation("time"), m_renderTime);
+
+            // Upload light uniforms
+            glm::vec3 lightPos = m_lights.empty() ? glm::vec3(2.0f, 4.0f, 2.0f) : m_lights[m_selectedLight].position;
+            glm::vec3 lightCol = m_lights.empty() ? glm::vec3(1.0f) : m_lights[m_selectedLight].color;
+            glUniform3fv(shader.getUniformLocation("lightPosition"), 1, glm::value_ptr(lightPos));
+            glUniform3fv(shader.getUniformLocation("lightColor"), 1, glm::value_ptr(lightCol));
+            glUniform1f(shader.getUniformLocation("ka"), m_ka);
+
+            // Upload sum-of-sines parameters
+            glUniform1i(shader.getUniformLocation("numWaves"), m_numWaves);
+            glUniform1f(shader.getUniformLocation("omega"), m_omega);
+            glUniform1f(shader.getUniformLocation("phi"), m_phi);
+            glUniform1f(shader.getUniformLocation("alpha"), m_amplitude);
+
+            // FFT ocean heightfield; the samplers always get their own units, even when the sum of sines is drawn.
+            const bool fftOcean = m_oceanTextures.has_value() && m_oceanTextures->hasData();
+            glUniform1i(shader.getUniformLocation("fftOcean"), fftOcean);
+            glUniform1i(shader.getUniformLocation("oceanDisplacement"), OceanTextures::DISPLACEMENT_TEXTURE_UNIT);
+            glUniform1i(shader.getUniformLocation("oceanSlopes"), OceanTextures::SLOPE_TEXTURE_UNIT);
+            if (fftOcean) {
+                m_oceanTextures->bind(shader);
+                const glm::mat4 viewProjection = m_projectionMatrix * m_viewMatrix;
+                glUniformMatrix4fv(shader.getUniformLocation("viewProjectionMatrix"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+                // Mip level whose texels are as large as the distance between the water vertices.
+                const float vertexSpacing = WATER_VERTEX_SPACING * glm::length(glm::vec3(waterModel[0]));
+                const float texelSize = m_oceanTextures->patchSize() / float(m_oceanTextures->resolution());
+                glUniform1f(shader.getUniformLocation("oceanDisplacementLod"), std::max(std::log2(vertexSpacing / texelSize), 0.0f));
+            }
+
+            // Bind environment cubemap for water reflections (skybox)
+            glActiveTexture(GL_TEXTURE6);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
+            glActiveTexture(GL_TEXTURE0);
+
+            // Update material UBO and draw
+            GPUMaterial mat;
+            mat.kd = m_kd;
+            mat.ks = m_ks;
+            mat.shininess = m_shininess;
+            mat.transparency = m_waterOpacity;
+            m_planeMesh->updateMaterialBuffer(mat);
+            beginTransparentGeometry(orderIndependent);
+            m_planeMesh->draw(shader);
+            endTransparentGeometry();
+        }
+    }
 
     // In here you can handle key presses
     // key - Integer that corresponds to numbers in https://www.glfw.org/docs/latest/group__keys.html
@@ -995,6 +1755,14 @@ public:
     void onKeyPressed(int key, int mods)
     {
         std::cout << "Key pressed: " << key << std::endl;
+        // Dump the recent CPU profiler zones of all threads.
+        if (key == GLFW_KEY_F9)
+        {
+            if (writeChromeTrace("cpu_trace.json"))
+                std::cout << "Wrote CPU trace to " << std::filesystem::absolute("cpu_trace.json") << std::endl;
+            else
+                std::cerr << "Warning: failed to write cpu_trace.json" << std::endl;
+        }
     }
 
     // In here you can handle key releases
@@ -1027,128 +1795,114 @@ public:
         std::cout << "Released mouse button: " << button << std::endl;
     }
 
-    void updateParticles(float deltaTime)
+    void uploadParticles(const SimulationSnapshot& snapshot)
     {
-        auto emitParticle = [&](const glm::vec3& pos) {
-            // find particles which are dead so we can reuse them 
-            size_t i = m_lastUsedParticle;
-            for (size_t j = 0; j < m_maxParticles; ++j) {
-                i = (i + j) % m_maxParticles;
-                if (m_particles[i].life <= 0.0f) {
-                    m_lastUsedParticle = i;
-                    break;
-                }
-            }
+        // Copy the attribute arrays straight into the mapped vbo; invalidating it lets the driver orphan the storage
+        // that the previous frame may still be drawing from instead of stalling.
+        CPU_PROFILE_ZONE("uploadParticles");
+        const ParticleVertices& particles = snapshot.particles;
+        const size_t numParticles = std::min(particles.size(), m_maxParticles);
+        m_numParticleVertices = static_cast<GLsizei>(numParticles);
+        if (numParticles == 0)
+            return;
 
-            Particle& p = m_particles[i];
-            p.position = pos;
-            p.velocity = glm::vec3(
-                ((rand() % 100) / 50.0f - 1.0f) * 0.5f,
-                ((rand() % 100) / 100.0f) * 1.0f,
-                ((rand() % 100) / 50.0f - 1.0f) * 0.5f
-            );
-            p.color = glm::vec4(0.5f, 0.7f, 1.0f, 0.8f); // light blue, semi-transparent
-            p.life = 1.0f;
-        };
-
-        emitParticle(m_snakePosition);
-
-        for (auto& p : m_particles) {
-            if (p.life > 0.0f) {
-                p.life -= deltaTime;
-                p.position += p.velocity * deltaTime;
-                p.velocity.y -= 9.81f * 0.1f * deltaTime; // gravity
-                p.color.a = glm::max(0.0f, p.life);
-            }
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
+        auto* vertices = static_cast<GLfloat*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(4 * m_maxParticles * sizeof(GLfloat)),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!vertices) {
+            m_numParticleVertices = 0;
+            return;
         }
+        const std::array<const std::vector<float>*, 4> attributes { &particles.positionX, &particles.positionY, &particles.positionZ, &particles.life };
+        for (size_t attribute = 0; attribute < attributes.size(); ++attribute)
+            std::copy_n(attributes[attribute]->data(), numParticles, vertices + attribute * m_maxParticles);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
 
-        // data for the vbo
-        std::vector<GLfloat> particleData;
-        for (const auto& p : m_particles) {
-            if (p.life > 0.0f) {
-                particleData.push_back(p.position.x);
-                particleData.push_back(p.position.y);
-                particleData.push_back(p.position.z);
-                particleData.push_back(p.color.r);
-                particleData.push_back(p.color.g);
-                particleData.push_back(p.color.b);
-                particleData.push_back(p.color.a);
-            }
+    // Stream the ocean heightfield of a new step to the textures (recreated when the resolution changes).
+    void uploadOcean(const SimulationSnapshot& snapshot)
+    {
+        CPU_PROFILE_ZONE("uploadOcean");
+        if (snapshot.ocean.displacement.empty()) {
+            m_oceanTextures.reset();
+            return;
         }
+        if (!m_oceanTextures || m_oceanTextures->resolution() != snapshot.ocean.resolution)
+            m_oceanTextures.emplace(snapshot.ocean.resolution);
+        m_oceanTextures->upload(snapshot.ocean);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
-        glBufferData(GL_ARRAY_BUFFER, particleData.size() * sizeof(GLfloat), particleData.data(), GL_DYNAMIC_DRAW);
+    // Emit from the snake head and simulate the steps that the simulation thread took since the last update.
+    void updateGPUParticles(const SimulationSnapshot& snapshot)
+    {
+        CPU_PROFILE_ZONE("updateGPUParticles");
+        if (snapshot.snakeTransforms.empty())
+            return;
+        const uint64_t numSteps = std::min<uint64_t>(snapshot.step - m_renderedStep, 16);
+        const GPUParticleSystem::Emitter emitter { glm::vec3(snapshot.snakeTransforms[0][3]), static_cast<int>(numSteps) };
+        // Draws need a complete framebuffer even though the update does not rasterize (0 is incomplete when headless).
+        glBindFramebuffer(GL_FRAMEBUFFER, m_window.getFramebuffer());
+        m_gpuParticles->update(m_particleUpdateShader, std::span(&emitter, 1), float(numSteps) * snapshot.stepSeconds);
+    }
 
+    // Draw the particles; resolutionScale is the divisor of the resolution of the target they are drawn into.
+    void drawParticles(bool orderIndependent, int resolutionScale = 1)
+    {
+        CPU_PROFILE_ZONE("drawParticles");
         glEnable(GL_PROGRAM_POINT_SIZE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        beginTransparentGeometry(orderIndependent);
 
-        m_particleShader.bind();
-        glUniformMatrix4fv(m_particleShader.getUniformLocation("view"), 1, GL_FALSE, glm::value_ptr(m_viewMatrix));
-        glUniformMatrix4fv(m_particleShader.getUniformLocation("projection"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
-        glUniform1f(m_particleShader.getUniformLocation("pointSize"), 15.0f);
-
-        glBindVertexArray(m_particleVAO);
-        glDrawArrays(GL_POINTS, 0, (GLsizei)(particleData.size() / 7));
+        const Shader& shader = orderIndependent ? m_particleOITShader : m_particleShader;
+        shader.bind();
+        glUniformMatrix4fv(shader.getUniformLocation("view"), 1, GL_FALSE, glm::value_ptr(m_viewMatrix));
+        glUniformMatrix4fv(shader.getUniformLocation("projection"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
+        glUniform1f(shader.getUniformLocation("pointSize"), 15.0f / static_cast<float>(resolutionScale));
+
+        // The GPU particles are drawn straight from the last transform feedback output, including the dead slots.
+        const GLsizei numVertices = m_gpuParticlesEnabled ? static_cast<GLsizei>(m_gpuParticles->capacity()) : m_numParticleVertices;
+        glBindVertexArray(m_gpuParticlesEnabled ? m_gpuParticles->renderVertexArray() : m_particleVAO);
+        if (!orderIndependent && !m_gpuParticlesEnabled && m_sortParticles && numVertices > 1) {
+            // Blending needs back to front order, which changes with the camera, so the CPU particles are sorted every frame.
+            std::span<const uint32_t> order;
+            {
+                CPU_PROFILE_ZONE("sortParticles");
+                order = m_particleSorter.sort(m_snapshot->particles, m_viewMatrix, &m_jobSystem);
+            }
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(size_t(numVertices) * sizeof(GLuint)), order.data());
+            glDrawElements(GL_POINTS, numVertices, GL_UNSIGNED_INT, nullptr);
+        } else {
+            glDrawArrays(GL_POINTS, 0, numVertices);
+        }
+        countDrawCall(static_cast<uint64_t>(numVertices));
         glBindVertexArray(0);
-
+        endTransparentGeometry();
     }
     void drawMeshAtLights() {
+        CPU_PROFILE_ZONE("drawMeshAtLights");
         // draw a mesh at the position of lights, nice for visualisng the day night cycle
-        for (auto& light : m_lights)
-        {
-            m_basicShader.bind();
-            glm::mat4 model = glm::translate(glm::mat4(1.0f), light.position) * glm::scale(glm::mat4(1.0f), glm::vec3(0.2f));
+        if (m_meshes.empty()) return;
 
-            glm::mat4 mvp = m_projectionMatrix * m_viewMatrix * model;
-            glUniformMatrix4fv(m_basicShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvp));
-            glUniformMatrix4fv(m_basicShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(model));
+        m_instanceTransforms.clear();
+        for (auto& light : m_lights)
+            m_instanceTransforms.push_back(glm::translate(glm::mat4(1.0f), light.position) * glm::scale(glm::mat4(1.0f), glm::vec3(0.2f)));
 
-            m_meshes[0].draw(m_basicShader); // use dragon mesh for now
-        }
+        m_basicInstancedShader.bind();
+        setInstancedShaderUniforms(m_basicInstancedShader);
+        m_meshes[0].drawInstanced(m_basicInstancedShader, m_instanceTransforms); // use dragon mesh for now
     }
 
-    float updateDayAndNightCycle(float deltaTime) {
-        static float timeOfDay = 0.0f;
-        timeOfDay += deltaTime * m_dayNightSpeed;  // speed of day/night cycle
-        float sunAngle = timeOfDay * glm::two_pi<float>(); 
+    float applyDayAndNightCycle(float timeOfDay) {
+        float sunAngle = timeOfDay * glm::two_pi<float>();
 
         // Light 0 will be the sun which moves in a circle.
         m_lights[0].position = glm::vec3(cos(sunAngle) * 10.0f, sin(sunAngle) * 10.0f, 0.0f);
 
         // Light gets dimmer at night
-        float daylight = glm::clamp(sin(sunAngle) * 0.5f + 0.5f, 0.05f, 1.0f);
+        float daylight = glm::clamp(glm::sin(sunAngle) * 0.5f + 0.5f, 0.05f, 1.0f);
         m_lights[0].color = glm::vec3(daylight);
         return daylight;
     }
 
-    struct Particle {
-        glm::vec3 position;
-        glm::vec3 velocity;
-        glm::vec4 color; 
-        float life;     
-    };
-
-
-    struct CubicBezier {
-        glm::vec3 p0, p1, p2, p3;
-
-        glm::vec3 evaluate(float t) const {
-            float u = 1.0f - t;
-            return u * u * u * p0 + 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t * p3;
-        }
-
-        glm::vec3 derivative(float t) const {
-            float u = 1.0f - t;
-            return
-                -3.0f * u * u * p0 +
-                3.0f * u * u * p1 - 6.0f * u * t * p1 +
-                6.0f * u * t * p2 - 3.0f * t * t * p2 +
-                3.0f * t * t * p3;
-        }
-
-    };
-
     void initSnakePath() {
         m_snakePath = {
             { {-1,0,2}, {0,1,2}, {1,1,2}, {2,0,2} }, // curve 1
@@ -1168,189 +1922,225 @@ public:
 
         glBindVertexArray(m_pathVAO);
         glDrawArrays(GL_LINE_STRIP, 0, static_cast<GLsizei>(m_pathPoints.size()));
+        countDrawCall(m_pathPoints.size() - 1);
         glBindVertexArray(0);
     }
 
 
-    std::vector<glm::vec3> sampleBezierPath(const std::vector<Application::CubicBezier>& curves, int samplesPerCurve = 20) {
-        std::vector<glm::vec3> points;
-        for (const auto& curve : curves) {
-            for (int i = 0; i <= samplesPerCurve; ++i) {
-                float t = static_cast<float>(i) / samplesPerCurve;
-                points.push_back(curve.evaluate(t));
-            }
+    // Upload the camera, light and material uniforms used by the instanced snake and light marker draws.
+    void setInstancedShaderUniforms(const Shader& shader)
+    {
+        CPU_PROFILE_ZONE("setInstancedShaderUniforms");
+        glm::mat4 viewProjection = m_projectionMatrix * m_viewMatrix;
+        glUniformMatrix4fv(shader.getUniformLocation("viewProjectionMatrix"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        glUniform3fv(shader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(m_cameraPosition));
+        if (&shader != &m_gbufferInstancedShader)
+            setLightingUniforms(shader);
+
+        glUniform1i(shader.getUniformLocation("hasTexCoords"), GL_FALSE);
+        glUniform1i(shader.getUniformLocation("useTexture"), GL_FALSE);
+        glUniform1i(shader.getUniformLocation("useMaterial"), m_useMaterial);
+        // Only the programs that link surface_frag.glsl have the metallic and roughness values.
+        if (&shader != &m_basicInstancedShader) {
+            glUniform1f(shader.getUniformLocation("metallicValue"), m_metallic);
+            glUniform1f(shader.getUniformLocation("roughnessValue"), m_roughness);
         }
-        return points;
     }
 
-    // Sample the water surface height at a world-space position, as in the water shader
-    float sampleWaterHeightWorld(const glm::vec3 &worldPos) const
+    // Upload the active light and bind the environment map, light clusters and shadow maps (used by every lit shader).
+    // The environment map is bound even when it is not used: otherwise its samplerCube would default to texture
+    // unit 0 together with the sampler2D material maps, which makes every draw fail with GL_INVALID_OPERATION.
+    void setLightingUniforms(const Shader& shader)
     {
-        // Transform world position into water model space
-        glm::vec4 inv = glm::inverse(m_waterModelMatrix) * glm::vec4(worldPos, 1.0f);
-        glm::vec3 modelPos = glm::vec3(inv);
-
-        // Same sines logic as in the water shader
-        float height = 0.0f;
-        float angle = 0.1f;
-        float alpha_current = m_amplitude;
-        float omega_current = m_omega;
-        const float PI = 3.14159265359f;
-        float time = (float)glfwGetTime();
-
-        for (int i = 0; i < glm::min(m_numWaves, 10); ++i)
-        {
-            glm::vec2 dir = glm::vec2(cos(angle), sin(angle));
-            height += alpha_current * sin(glm::dot(dir, glm::vec2(modelPos.x, modelPos.z)) * omega_current + time * m_phi);
-
-            angle += 0.73f * PI;
-            alpha_current *= 0.75f;
-            omega_current *= 1.5f;
-        }
-
-        // Add height to model y. Normally the y-coordinate should be the y of the plane + height, but our plane is at y=0
-        glm::vec4 displacedModelPos = glm::vec4(modelPos.x, height, modelPos.z, 1.0f);
-        glm::vec4 displacedWorld = m_waterModelMatrix * displacedModelPos;
-        return displacedWorld.y;
+        CPU_PROFILE_ZONE("setLightingUniforms");
+        glm::vec3 lightPos = m_lights.empty() ? glm::vec3(2.0f, 4.0f, 2.0f) : m_lights[m_selectedLight].position;
+        glm::vec3 lightCol = m_lights.empty() ? glm::vec3(1.0f) : m_lights[m_selectedLight].color;
+        glUniform3fv(shader.getUniformLocation("lightPosition"), 1, glm::value_ptr(lightPos));
+        glUniform3fv(shader.getUniformLocation("lightColor"), 1, glm::value_ptr(lightCol));
+        glUniform1f(shader.getUniformLocation("ka"), m_ka);
+        bindEnvironmentMap(shader);
+        m_lightClusters.bind(shader, m_window.getFrameBufferSize());
+        m_shadowMaps.bind(shader, shadowsActive());
+        m_pointShadows.bind(shader);
     }
 
-    struct SnakeSegment
+    void bindEnvironmentMap(const Shader& shader)
     {
-        glm::vec3 localPosition;
-        glm::mat4 localRotation = glm::mat4(1.0f);
-        std::unique_ptr<SnakeSegment> child = nullptr;
-    };
-
-    void updateSnake(float dt) { // For updating the slithering motion of the snake
-        if (m_snakeSegments.empty() || m_snakePaused) return;
-
-        m_snakeTime += dt;
-
-        for (size_t i = 0; i < m_snakeSegments.size(); ++i) {
-            float phase = m_snakeTime * m_snakeWaveSpeed - static_cast<float>(i) * m_snakeWavelength;
-            float angle = sin(phase) * m_snakeWaveAmplitude;
-
-            m_snakeSegments[i]->localRotation = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0, 1, 0));
-        }
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture);
+        glUniform1i(shader.getUniformLocation("environmentMap"), 5);
+        glActiveTexture(GL_TEXTURE0);
     }
 
-
-    void drawMeshWithShader(GPUMesh& mesh, const glm::mat4& modelMatrix)
+    // Light the G-buffer in a single full screen pass. The per-pixel light lists come from the light clusters
+    // (clustered deferred shading), so every pixel only loops over the lights that can reach it.
+    void drawDeferredLighting(const FrameGraph::PassContext& context, const std::array<FrameGraphResource, 4>& gbuffer, float daylightFactor)
     {
-
-        Shader& shader = m_usePBR ? m_defaultShader : m_basicShader;
+        CPU_PROFILE_ZONE("drawDeferredLighting");
+        const Shader& shader = m_deferredLightingShader;
         shader.bind();
-
-        glm::mat4 mvp = m_projectionMatrix * m_viewMatrix * modelMatrix;
-        glUniformMatrix4fv(shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniformMatrix4fv(shader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-
-        glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(modelMatrix));
-        glUniformMatrix3fv(shader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-        mesh.draw(shader);
+        const char* samplerNames[] = { "gbufferAlbedo", "gbufferNormal", "gbufferMaterial", "gbufferDepth" };
+        for (size_t i = 0; i < gbuffer.size(); ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+            glBindTexture(GL_TEXTURE_2D, context.texture(gbuffer[i]));
+            glUniform1i(shader.getUniformLocation(samplerNames[i]), static_cast<GLint>(i));
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        const glm::mat4 inverseViewProjection = glm::inverse(m_projectionMatrix * m_viewMatrix);
+        glUniformMatrix4fv(shader.getUniformLocation("inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+        glUniform3fv(shader.getUniformLocation("cameraPosition"), 1, glm::value_ptr(m_cameraPosition));
+        glUniform1f(shader.getUniformLocation("daylight"), daylightFactor);
+        setLightingUniforms(shader);
+
+        // The lighting pass writes the G-buffer depth, so it is depth tested against what is already on screen
+        // (the path) and the forward passes that follow are depth tested against it.
+        glBindVertexArray(m_fullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        countDrawCall(1);
+        glBindVertexArray(0);
     }
 
-
-    void drawSnakeSegment(SnakeSegment* segment, const glm::mat4& parentTransform) {
-        if (!segment) return;
-
-        glm::mat4 model =
-            parentTransform *
-            glm::translate(glm::mat4(1.0f), segment->localPosition) *
-            segment->localRotation;
-
-        
-        if (!m_meshes.empty())
-            drawMeshWithShader(m_meshes[0], model); 
-
-        drawSnakeSegment(segment->child.get(), model);
+    // Blend the average color of the transparent surfaces over the opaque image, weighted by their total coverage.
+    void drawOITComposite(const FrameGraph::PassContext& context, FrameGraphResource accumulation, FrameGraphResource revealage)
+    {
+        CPU_PROFILE_ZONE("drawOITComposite");
+        const Shader& shader = m_oitCompositeShader;
+        shader.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, context.texture(accumulation));
+        glUniform1i(shader.getUniformLocation("accumulationTexture"), 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, context.texture(revealage));
+        glUniform1i(shader.getUniformLocation("revealageTexture"), 1);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBindVertexArray(m_fullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        countDrawCall(1);
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
     }
 
-    void drawSnake() {
-        if (!m_snakeRoot) return;
-
-        glm::mat4 base =
-            glm::translate(glm::mat4(1.0f), m_snakePosition) *
-            m_snakeRotation;
-
-        drawSnakeSegment(m_snakeRoot.get(), base);
+    // Fill the reduced resolution particle depth target with the farthest opaque depth of every block of
+    // scale x scale pixels.
+    void drawParticleDepthDownsample(const FrameGraph::PassContext& context, FrameGraphResource depth, int scale)
+    {
+        CPU_PROFILE_ZONE("drawParticleDepthDownsample");
+        const Shader& shader = m_particleDepthDownsampleShader;
+        shader.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, context.texture(depth));
+        glUniform1i(shader.getUniformLocation("depthTexture"), 0);
+        glUniform1i(shader.getUniformLocation("scale"), scale);
+
+        // Depth writes need the depth test.
+        glDepthFunc(GL_ALWAYS);
+        glBindVertexArray(m_fullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        countDrawCall(1);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS);
     }
 
-    void updateSnakeMotion(float deltaTime) {
-        if (m_snakePath.empty()) return;
-
-        if (m_moveAtConstantSpeed) {
-            auto& curve = m_snakePath[m_snakeCurve];
-            float dLenDt = glm::length(curve.derivative(m_snakeT));
-            m_snakeT += (m_snakeSpeed / dLenDt) * deltaTime;
-
-        }
-        else { // else move at constant t
-            m_snakeT += 0.2f * deltaTime;
-        }
-
-        if (m_snakeT > 1.0f) {
-            m_snakeT = 0.0f;
-            m_snakeCurve = (m_snakeCurve + 1) % m_snakePath.size();
-        }
-
-        // evaluate next position on the bezier curve
-        glm::vec3 newPos = m_snakePath[m_snakeCurve].evaluate(m_snakeT);
-
-        if (m_snakeClampedToWaterheight) {
-            // Clamp the snake's y to the water surface
-            float sampledY = sampleWaterHeightWorld(newPos);
-            newPos.y = sampledY;
-        }
-
-        // This block is for the direction of the snake
-        float nextT = m_snakeT + 0.01f;
-        if (nextT > 1.0f) nextT = 1.0f;
-        glm::vec3 nextPos = m_snakePath[m_snakeCurve].evaluate(nextT);
-
-        if (m_snakeClampedToWaterheight) {
-            // Also clamp next position to the water surface
-            float sampledNextY = sampleWaterHeightWorld(nextPos);
-            nextPos.y = sampledNextY;
+    // Add the reduced resolution particles to the full resolution transparency targets with a depth-aware upsample.
+    void drawParticleUpsample(const FrameGraph::PassContext& context, const std::array<FrameGraphResource, 3>& particleTargets, FrameGraphResource depth, int scale)
+    {
+        CPU_PROFILE_ZONE("drawParticleUpsample");
+        const Shader& shader = m_particleUpsampleShader;
+        shader.bind();
+        const char* samplerNames[] = { "accumulationTexture", "revealageTexture", "lowResolutionDepthTexture" };
+        for (size_t i = 0; i < particleTargets.size(); ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+            glBindTexture(GL_TEXTURE_2D, context.texture(particleTargets[i]));
+            glUniform1i(shader.getUniformLocation(samplerNames[i]), static_cast<GLint>(i));
         }
-        glm::vec3 direction = glm::normalize(newPos - nextPos);
-
-        // Build rotation so the snake faces along the path
-        glm::vec3 up(0.0f, 1.0f, 0.0f);
-        glm::vec3 right = glm::normalize(glm::cross(up, direction));
-        glm::vec3 correctedUp = glm::normalize(glm::cross(direction, right));
-
-        m_snakeRotation = glm::mat4(1.0f);
-        m_snakeRotation[0] = glm::vec4(right, 0.0f);
-        m_snakeRotation[1] = glm::vec4(correctedUp, 0.0f);
-        m_snakeRotation[2] = glm::vec4(direction, 0.0f);
-
-        m_snakePosition = newPos;
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, context.texture(depth));
+        glUniform1i(shader.getUniformLocation("depthTexture"), 3);
+        glActiveTexture(GL_TEXTURE0);
+        glUniformMatrix4fv(shader.getUniformLocation("projection"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
+        glUniform1i(shader.getUniformLocation("scale"), scale);
+
+        glDisable(GL_DEPTH_TEST);
+        beginTransparentGeometry(true);
+        glBindVertexArray(m_fullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        countDrawCall(1);
+        glBindVertexArray(0);
+        endTransparentGeometry();
+        glEnable(GL_DEPTH_TEST);
     }
 
+    void drawSnake() {
+        CPU_PROFILE_ZONE("drawSnake");
+        if (m_meshes.empty()) return;
 
+        // All segments share the same mesh, so they are drawn with a single instanced draw call.
+        Shader& shader = deferredActive() ? m_gbufferInstancedShader : (m_usePBR ? m_defaultInstancedShader : m_basicInstancedShader);
+        shader.bind();
+        setInstancedShaderUniforms(shader);
+        m_meshes[0].drawInstanced(shader, m_snakeRenderTransforms);
+    }
 
 private:
     Window m_window;
+    // Loaders and the simulation run their parallel work on this.
+    JobSystem m_jobSystem;
 
     // Shader for default rendering and for depth rendering
     Shader m_defaultShader;
     Shader m_shadowShader;
+    Shader m_depthShader;
     // Basic blinn phong shader to compare against PBR
     Shader m_basicShader;
     Shader m_skyboxShader;
     Shader m_lineShader;
     Shader m_particleShader;
+    Shader m_particleOITShader;
+    Shader m_particleUpdateShader;
+    // Instanced variants of the default and basic shader
+    Shader m_defaultInstancedShader;
+    Shader m_basicInstancedShader;
+    // Deferred renderer (G-buffer pass and full screen lighting pass)
+    Shader m_gbufferShader;
+    Shader m_gbufferInstancedShader;
+    Shader m_deferredLightingShader;
+    Shader m_oitCompositeShader;
+    Shader m_particleDepthDownsampleShader;
+    Shader m_particleUpsampleShader;
+    GLuint m_fullscreenVAO = 0;
+    // Scratch buffer with the model matrices of an instanced draw
+    std::vector<glm::mat4> m_instanceTransforms;
 
-    std::vector<Particle> m_particles;
     size_t m_maxParticles = 500;
-    size_t m_lastUsedParticle = 0;
     GLuint m_particleVAO = 0;
     GLuint m_particleVBO = 0;
+    GLuint m_particleEBO = 0;
+    ParticleDepthSorter m_particleSorter;
+    bool m_sortParticles = true;
+    // Divisor of the particle render resolution (1, 2 or 4), only with order-independent transparency.
+    int m_particleResolutionScale = 2;
+    GLsizei m_numParticleVertices = 0;
+    // Alternative to the particles of the simulation thread, switched at runtime.
+    std::optional<GPUParticleSystem> m_gpuParticles;
+    bool m_gpuParticlesEnabled = false;
+    // Simulate the CPU particles as an SPH fluid.
+    bool m_sphParticles = false;
 
     // Water shader and single plane mesh
     Shader m_waterShader;
+    Shader m_waterOITShader;
+    // Opacity of the water when looking straight down; it becomes opaque at grazing angles (Fresnel).
+    float m_waterOpacity{0.75f};
+    // Draw the water and particles with weighted blended order-independent transparency instead of sorted alpha blending.
+    bool m_useOIT{true};
     std::optional<GPUMesh> m_planeMesh;
     // Ground mesh (large plane) to form the scene floor
     std::optional<GPUMesh> m_groundMesh;
@@ -1362,10 +2152,20 @@ private:
     float m_omega{3.0f};
     float m_phi{1.0f};
     float m_amplitude{0.008f};
+    bool m_fftOcean{true};
+    OceanSettings m_oceanSettings;
+    std::optional<OceanTextures> m_oceanTextures;
+    // Mean edge length of water_circle.obj in model space.
+    static constexpr float WATER_VERTEX_SPACING = 0.018f;
     // Water reflection tunables (exposed to ImGui)
     float m_reflectionStrength{0.9f};
     glm::vec3 m_F0{0.02f};
     bool m_usePBR{true};
+    // Depth-only pre-pass for the ground and dragon; m_shadedFragments holds the last count without [0] / with [1] it.
+    bool m_useDepthPrepass{true};
+    // Shade the snake, ground and dragon in a full screen pass over a G-buffer instead of while drawing them.
+    bool m_useDeferred{false};
+    uint64_t m_shadedFragments[2]{0, 0};
 
 	bool m_useEnvironmentMapping { false };
     GLuint m_cubemapTexture;
@@ -1383,14 +2183,7 @@ private:
     std::vector<glm::vec3> m_pathPoints;
 
     std::vector<CubicBezier> m_snakePath;
-    std::unique_ptr<SnakeSegment> m_snakeRoot;
-    std::vector<SnakeSegment*> m_snakeSegments;
-    float m_snakeTime = 0.0f;
-    glm::vec3 m_snakePosition = glm::vec3(0.0f);
-    glm::mat4 m_snakeRotation = glm::mat4(1.0f);
-    float m_snakeT = 0.0f;
     float m_snakeSpeed = 1.0f; 
-    size_t m_snakeCurve = 2;
 
     float m_snakeWaveSpeed = 3.0f;
     float m_snakeWaveAmplitude = glm::radians(20.0f); // in radians
@@ -1420,7 +2213,21 @@ private:
     {
         glm::vec3 position;
         glm::vec3 color;
+        // Range of the light when it is not the active light (see updateLightClusters).
+        float radius{2.0f};
+        // Unique for every light that is created, so the point shadow atlas can tell lights apart.
+        uint32_t id{nextId++};
+
+        static inline uint32_t nextId{0};
     };
+    // The sun is far away, so give it a range that covers the whole scene.
+    static constexpr float SUN_RADIUS = 30.0f;
+    LightClusters m_lightClusters;
+    CascadedShadowMaps m_shadowMaps;
+    bool m_useShadows{true};
+    PointShadowAtlas m_pointShadows;
+    std::vector<ClusteredPointLight> m_clusteredLights;
+    std::vector<PointShadowAtlas::DynamicCaster> m_dynamicCasters;
 
     std::vector<LightSimple> m_lights;
     size_t m_selectedLight{0};
@@ -1438,19 +2245,51 @@ private:
     float m_heightScale{0.03f};
     bool m_useTexture{true};
 
+    FrameGraph m_frameGraph;
+    GpuProfiler m_gpuProfiler;
+    // The snake, particles and day/night cycle advance in fixed steps on the simulation thread; see consumeSimulation().
+    std::optional<SimulationThread> m_simulationThread;
+    bool m_interpolateSimulation { true };
+    uint64_t m_renderedStep { 0 };
+    // Latest state of the simulation thread; valid until the next acquire().
+    const SimulationSnapshot* m_snapshot { nullptr };
+    // Simulation time in seconds of the latest state (drives the waves) and of the rendered, interpolated state.
+    float m_time { 0.0f };
+    float m_renderTime { 0.0f };
+    float m_daylight { 1.0f };
+    // World transforms of the snake segments, interpolated between the last two steps.
+    std::vector<glm::mat4> m_snakeRenderTransforms;
+
+    // Benchmark mode (--benchmark).
+    std::optional<BenchmarkOptions> m_benchmark;
+
     // Projection and view matrices for you to fill in and use
-    glm::mat4 m_projectionMatrix = glm::perspective(glm::radians(80.0f), 1.0f, 0.1f, 30.0f);
+    static constexpr float NEAR_PLANE = 0.1f;
+    static constexpr float FAR_PLANE = 30.0f;
+    glm::mat4 m_projectionMatrix = glm::perspective(glm::radians(80.0f), 1.0f, NEAR_PLANE, FAR_PLANE);
     glm::mat4 m_viewMatrix = glm::lookAt(glm::vec3(-1, 1, -1), glm::vec3(0), glm::vec3(0, 1, 0));
     glm::mat4 m_modelMatrix { 1.0f };
+    glm::vec3 m_cameraPosition { 0.0f };
     Camera m_camera;
     bool m_mouseCaptured{false};
     glm::vec2 m_lastMousePos{0.0f};
     bool m_useSnakeCamera{false};
 };
 
-int main()
+int main(int argc, char** argv)
 {
-    Application app;
+    const int64_t startTime = cpuProfilerTimestamp();
+    std::optional<BenchmarkOptions> benchmark;
+    try {
+        benchmark = parseBenchmarkOptions(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    Application app { benchmark };
+    if (benchmark)
+        return app.runBenchmark(float(cpuProfilerTimestamp() - startTime) * 1e-6f);
     app.update();
 
     return 0;
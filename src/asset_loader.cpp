@@ -0,0 +1,155 @@
+#include "asset_loader.h"
+#include <framework/cpu_profiler.h>
+#include <framework/job_system.h>
+#include <algorithm>
+#include <thread>
+
+AssetLoader::AssetLoader(JobSystem& jobSystem)
+    : m_jobSystem(jobSystem)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    // Coroutines that are still queued reference this loader.
+    for (;;) {
+        {
+            std::lock_guard lock { m_queueMutex };
+            if (m_workerQueue.empty() && m_glQueue.empty() && m_numWorkerJobs == 0)
+                break;
+        }
+        helpOnce();
+    }
+}
+
+AssetTask<std::shared_ptr<const Image>> AssetLoader::loadImage(std::filesystem::path filePath, int priority)
+{
+    std::lock_guard lock { m_imagesMutex };
+    auto iter = m_images.find(filePath);
+    if (iter == std::end(m_images))
+        iter = m_images.emplace(filePath, decodeImage(filePath)).first;
+    // A shared image is needed as urgently as its most urgent user.
+    iter->second.setPriority(std::max(iter->second.priority(), priority));
+    return iter->second;
+}
+
+AssetTask<Texture> AssetLoader::loadTexture(std::filesystem::path filePath, int priority)
+{
+    AssetTask<Texture> task = uploadTexture(std::move(filePath));
+    task.setPriority(priority);
+    return task;
+}
+
+AssetTask<std::vector<GPUMesh>> AssetLoader::loadMesh(std::filesystem::path filePath, int priority)
+{
+    AssetTask<std::vector<GPUMesh>> task = parseAndUploadMesh(std::move(filePath));
+    task.setPriority(priority);
+    return task;
+}
+
+AssetTask<std::shared_ptr<const Image>> AssetLoader::decodeImage(std::filesystem::path filePath)
+{
+    co_await onWorker();
+    CPU_PROFILE_ZONE("decodeImage");
+    co_return std::make_shared<const Image>(filePath);
+}
+
+AssetTask<Texture> AssetLoader::uploadTexture(std::filesystem::path filePath)
+{
+    AssetTask<std::shared_ptr<const Image>> imageTask = loadImage(filePath);
+    const std::shared_ptr<const Image> image = co_await imageTask;
+    co_await onGLThread();
+    CPU_PROFILE_ZONE("uploadTexture");
+    co_return Texture(*image);
+}
+
+AssetTask<std::vector<GPUMesh>> AssetLoader::parseAndUploadMesh(std::filesystem::path filePath)
+{
+    co_await onWorker();
+    std::vector<Mesh> meshes;
+    {
+        CPU_PROFILE_ZONE("parseMesh");
+        if (!std::filesystem::exists(filePath))
+            throw MeshLoadingException("File " + filePath.string() + " does not exist");
+        meshes = ::loadMesh(filePath, { .jobSystem = &m_jobSystem, .loadTextures = false });
+    }
+
+    // Start all material textures before waiting for any of them.
+    std::vector<AssetTask<std::shared_ptr<const Image>>> textures;
+    for (const Mesh& mesh : meshes) {
+        if (!mesh.material.kdTexturePath.empty())
+            textures.push_back(loadImage(mesh.material.kdTexturePath));
+    }
+    size_t textureIndex = 0;
+    for (Mesh& mesh : meshes) {
+        if (mesh.material.kdTexturePath.empty())
+            continue;
+        std::shared_ptr<const Image> image = co_await textures[textureIndex];
+        mesh.material.kdTexture = std::const_pointer_cast<Image>(image);
+        ++textureIndex;
+    }
+
+    co_await onGLThread();
+    CPU_PROFILE_ZONE("uploadMesh");
+    co_return GPUMesh::upload(meshes);
+}
+
+void AssetLoader::enqueue(Queue queue, QueuedCoroutine coroutine)
+{
+    {
+        std::lock_guard lock { m_queueMutex };
+        (queue == Queue::Worker ? m_workerQueue : m_glQueue).push_back(coroutine);
+    }
+    if (queue == Queue::Worker) {
+        // Every job resumes whichever queued coroutine has the highest priority at the time it runs.
+        m_numWorkerJobs++;
+        m_jobSystem.submit([this]() {
+            resumeWorkerCoroutine();
+            m_numWorkerJobs--;
+        });
+    }
+}
+
+bool AssetLoader::popHighestPriority(std::vector<QueuedCoroutine>& queue, QueuedCoroutine& coroutine)
+{
+    if (queue.empty())
+        return false;
+    // Linear scan, so that priority changes of queued tasks take effect without re-sorting; queues are short.
+    auto iter = std::max_element(std::begin(queue), std::end(queue),
+        [](const QueuedCoroutine& lhs, const QueuedCoroutine& rhs) { return lhs.task->priority < rhs.task->priority; });
+    coroutine = *iter;
+    queue.erase(iter);
+    return true;
+}
+
+void AssetLoader::resumeWorkerCoroutine()
+{
+    QueuedCoroutine coroutine;
+    {
+        std::lock_guard lock { m_queueMutex };
+        if (!popHighestPriority(m_workerQueue, coroutine))
+            return;
+    }
+    coroutine.handle.resume();
+}
+
+bool AssetLoader::pumpGLThread()
+{
+    bool resumedAny = false;
+    for (;;) {
+        QueuedCoroutine coroutine;
+        {
+            std::lock_guard lock { m_queueMutex };
+            if (!popHighestPriority(m_glQueue, coroutine))
+                return resumedAny;
+        }
+        coroutine.handle.resume();
+        resumedAny = true;
+    }
+}
+
+void AssetLoader::helpOnce()
+{
+    if (!pumpGLThread() && !m_jobSystem.runPendingJob())
+        std::this_thread::yield();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "asset_task.h"
+#include "mesh.h"
+#include "texture.h"
+#include <framework/image.h>
+#include <atomic>
+#include <coroutine>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class JobSystem;
+
+// Loads assets as a graph of coroutines (AssetTask). A task moves between threads by awaiting onWorker() (decoding
+// and parsing, on the job system) and onGLThread() (uploads, run by pumpGLThread() on the OpenGL thread); a mesh task
+// awaits the tasks of its material textures. Independent assets therefore load concurrently, and only the uploads
+// are serialized on the OpenGL thread.
+//
+// Queued coroutines are resumed in order of the priority of their task (see AssetTask::setPriority()); cancelled
+// tasks throw AssetCancelledException when they would be resumed.
+class AssetLoader {
+public:
+    explicit AssetLoader(JobSystem& jobSystem);
+    AssetLoader(const AssetLoader&) = delete;
+    // Finishes the queued work.
+    ~AssetLoader();
+
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // Decoded image; the same file is only decoded once.
+    AssetTask<std::shared_ptr<const Image>> loadImage(std::filesystem::path filePath, int priority = 0);
+    AssetTask<Texture> loadTexture(std::filesystem::path filePath, int priority = 0);
+    // Sub-meshes of an OBJ file, with their material textures loaded concurrently.
+    AssetTask<std::vector<GPUMesh>> loadMesh(std::filesystem::path filePath, int priority = 0);
+
+    // Run the coroutines that are waiting for the OpenGL thread; returns false if there were none.
+    bool pumpGLThread();
+    // Block the (OpenGL) thread until the task finished, running uploads and jobs in the meantime.
+    template <typename T>
+    void wait(const AssetTask<T>& task)
+    {
+        while (!task.done())
+            helpOnce();
+    }
+
+    // Awaitables that resume the coroutine on a job system thread or on the OpenGL thread.
+    auto onWorker() { return ScheduleAwaiter { *this, Queue::Worker }; }
+    auto onGLThread() { return ScheduleAwaiter { *this, Queue::GLThread }; }
+
+private:
+    enum class Queue {
+        Worker,
+        GLThread
+    };
+    struct QueuedCoroutine {
+        std::coroutine_handle<> handle;
+        AssetTaskStateBase* task;
+    };
+    struct ScheduleAwaiter {
+        AssetLoader& loader;
+        Queue queue;
+        AssetTaskStateBase* task { nullptr };
+
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        void await_suspend(std::coroutine_handle<Promise> handle)
+        {
+            task = handle.promise().state.get();
+            loader.enqueue(queue, { handle, task });
+        }
+        void await_resume() const
+        {
+            if (task->cancelled)
+                throw AssetCancelledException("Asset loading was cancelled");
+        }
+    };
+
+    AssetTask<std::shared_ptr<const Image>> decodeImage(std::filesystem::path filePath);
+    AssetTask<Texture> uploadTexture(std::filesystem::path filePath);
+    AssetTask<std::vector<GPUMesh>> parseAndUploadMesh(std::filesystem::path filePath);
+
+    void enqueue(Queue queue, QueuedCoroutine coroutine);
+    // Remove the queued coroutine with the highest priority.
+    static bool popHighestPriority(std::vector<QueuedCoroutine>& queue, QueuedCoroutine& coroutine);
+    void resumeWorkerCoroutine();
+    void helpOnce();
+
+private:
+    JobSystem& m_jobSystem;
+
+    // Protects the queues. Tasks start eagerly and enqueue themselves, so this is never held while creating one.
+    std::mutex m_queueMutex;
+    std::vector<QueuedCoroutine> m_workerQueue;
+    std::vector<QueuedCoroutine> m_glQueue;
+    std::mutex m_imagesMutex;
+    std::map<std::filesystem::path, AssetTask<std::shared_ptr<const Image>>> m_images;
+    // Worker jobs that were submitted but did not finish yet.
+    std::atomic<int> m_numWorkerJobs { 0 };
+};
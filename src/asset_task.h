@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Thrown at the next scheduling point of a task that was cancelled.
+struct AssetCancelledException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// State shared by a running asset coroutine and the AssetTask handles to it.
+struct AssetTaskStateBase {
+    std::mutex mutex;
+    bool done { false };
+    std::exception_ptr exception;
+    // Coroutines that await this task; resumed on the thread that completes it.
+    std::vector<std::coroutine_handle<>> continuations;
+
+    // Read by the AssetLoader whenever it picks the next coroutine to resume.
+    std::atomic<int> priority { 0 };
+    std::atomic<bool> cancelled { false };
+
+    void complete()
+    {
+        std::vector<std::coroutine_handle<>> waiting;
+        {
+            std::lock_guard lock { mutex };
+            done = true;
+            waiting.swap(continuations);
+        }
+        for (std::coroutine_handle<> continuation : waiting)
+            continuation.resume();
+    }
+};
+
+template <typename T>
+struct AssetTaskState : public AssetTaskStateBase {
+    std::optional<T> value;
+};
+
+// Handle to an asset coroutine. The coroutine starts running eagerly when it is called (up to its first co_await,
+// typically AssetLoader::onWorker()) and frees itself when it finishes; its result lives in the shared state, so any
+// number of handles may await it, from any thread. Awaiting a failed task rethrows its exception.
+template <typename T>
+class AssetTask {
+public:
+    struct promise_type {
+        std::shared_ptr<AssetTaskState<T>> state { std::make_shared<AssetTaskState<T>>() };
+
+        AssetTask get_return_object() { return AssetTask(state); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept
+        {
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    // Destroy the frame before the continuations run, they may destroy the last handle.
+                    std::shared_ptr<AssetTaskState<T>> state = std::move(handle.promise().state);
+                    handle.destroy();
+                    state->complete();
+                }
+                void await_resume() noexcept { }
+            };
+            return FinalAwaiter {};
+        }
+        template <typename U>
+        void return_value(U&& value) { state->value.emplace(std::forward<U>(value)); }
+        void unhandled_exception() { state->exception = std::current_exception(); }
+    };
+
+    AssetTask() = default;
+
+    [[nodiscard]] bool valid() const { return m_state != nullptr; }
+    [[nodiscard]] bool done() const
+    {
+        std::lock_guard lock { m_state->mutex };
+        return m_state->done;
+    }
+    // Result of a finished task; rethrows the exception of a failed one.
+    T& get() const
+    {
+        if (m_state->exception)
+            std::rethrow_exception(m_state->exception);
+        return *m_state->value;
+    }
+
+    // Stop the task at its next scheduling point (it then fails with AssetCancelledException).
+    void cancel() const { m_state->cancelled = true; }
+    // Tasks with a higher priority are resumed first by the AssetLoader; this also affects work that is already queued.
+    void setPriority(int priority) const { m_state->priority = priority; }
+    [[nodiscard]] int priority() const { return m_state->priority; }
+
+    auto operator co_await() const
+    {
+        struct Awaiter {
+            std::shared_ptr<AssetTaskState<T>> state;
+
+            bool await_ready() const
+            {
+                std::lock_guard lock { state->mutex };
+                return state->done;
+            }
+            bool await_suspend(std::coroutine_handle<> continuation) const
+            {
+                std::lock_guard lock { state->mutex };
+                if (state->done)
+                    return false; // Finished in the meantime; continue right away.
+                state->continuations.push_back(continuation);
+                return true;
+            }
+            T& await_resume() const
+            {
+                if (state->exception)
+                    std::rethrow_exception(state->exception);
+                return *state->value;
+            }
+        };
+        return Awaiter { m_state };
+    }
+
+private:
+    explicit AssetTask(std::shared_ptr<AssetTaskState<T>> state)
+        : m_state(std::move(state))
+    {
+    }
+
+private:
+    std::shared_ptr<AssetTaskState<T>> m_state;
+};
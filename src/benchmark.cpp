@@ -0,0 +1,124 @@
+#include "benchmark.h"
+#include <framework/json.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+int parseInt(std::string_view option, const char* value, int min)
+{
+    int result = 0;
+    const std::string_view string { value };
+    const auto [end, error] = std::from_chars(string.data(), string.data() + string.size(), result);
+    if (error != std::errc() || end != string.data() + string.size() || result < min)
+        throw std::invalid_argument("Invalid value for " + std::string(option) + ": " + std::string(string));
+    return result;
+}
+
+// Nearest-rank percentile of sorted values.
+double percentile(const std::vector<double>& sorted, double fraction)
+{
+    const size_t rank = size_t(std::ceil(fraction * double(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+template <typename T>
+void writeSummary(std::ostream& stream, const std::vector<T>& values)
+{
+    if (values.empty()) {
+        stream << "null";
+        return;
+    }
+    std::vector<double> sorted(std::begin(values), std::end(values));
+    std::sort(std::begin(sorted), std::end(sorted));
+    const double mean = std::accumulate(std::begin(sorted), std::end(sorted), 0.0) / double(sorted.size());
+    stream << "{\"count\":" << sorted.size() << ",\"min\":" << sorted.front() << ",\"mean\":" << mean
+           << ",\"p50\":" << percentile(sorted, 0.5) << ",\"p90\":" << percentile(sorted, 0.9)
+           << ",\"p95\":" << percentile(sorted, 0.95) << ",\"p99\":" << percentile(sorted, 0.99)
+           << ",\"max\":" << sorted.back() << '}';
+}
+
+}
+
+std::optional<BenchmarkOptions> parseBenchmarkOptions(int argc, const char* const* argv)
+{
+    bool benchmark = false;
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view option { argv[i] };
+        if (option == "--benchmark") {
+            benchmark = true;
+            continue;
+        }
+        if (i + 1 == argc)
+            throw std::invalid_argument("Unknown option or missing value: " + std::string(option));
+        const char* value = argv[++i];
+        if (option == "--frames")
+            options.numFrames = parseInt(option, value, 1);
+        else if (option == "--warmup")
+            options.numWarmupFrames = parseInt(option, value, 0);
+        else if (option == "--width")
+            options.resolution.x = parseInt(option, value, 1);
+        else if (option == "--height")
+            options.resolution.y = parseInt(option, value, 1);
+        else if (option == "--output")
+            options.outputPath = value;
+        else if (option == "--particles" && (std::string_view(value) == "cpu" || std::string_view(value) == "gpu" || std::string_view(value) == "sph")) {
+            options.gpuParticles = std::string_view(value) == "gpu";
+            options.sphParticles = std::string_view(value) == "sph";
+        }
+        else if (option == "--water" && (std::string_view(value) == "fft" || std::string_view(value) == "sines"))
+            options.fftOcean = std::string_view(value) == "fft";
+        else
+            throw std::invalid_argument("Unknown option: " + std::string(option));
+    }
+    if (!benchmark)
+        return {};
+    return options;
+}
+
+bool writeBenchmarkJson(const std::filesystem::path& filePath, const BenchmarkOptions& options, const BenchmarkResults& results)
+{
+    std::ofstream file { filePath };
+    if (!file)
+        return false;
+
+    std::vector<uint64_t> drawCalls, primitives;
+    for (const DrawStats& stats : results.drawStats) {
+        drawCalls.push_back(stats.drawCalls);
+        primitives.push_back(stats.primitives);
+    }
+
+    file << "{\n\"renderer\":";
+    writeJsonString(file, results.renderer);
+    file << ",\n\"resolution\":[" << options.resolution.x << ',' << options.resolution.y << ']'
+         << ",\n\"frames\":" << options.numFrames << ",\n\"warmup_frames\":" << options.numWarmupFrames
+         << ",\n\"time_step_ms\":" << options.timeStep * 1000.0f
+         << ",\n\"particles\":\"" << (options.gpuParticles ? "gpu" : (options.sphParticles ? "sph" : "cpu")) << '"'
+         << ",\n\"water\":\"" << (options.fftOcean ? "fft" : "sines") << '"'
+         << ",\n\"startup_ms\":" << results.startupMilliseconds
+         << ",\n\"first_frame_ms\":" << results.firstFrameMilliseconds
+         << ",\n\"cpu_frame_ms\":";
+    writeSummary(file, results.cpuFrameMilliseconds);
+    file << ",\n\"gpu_frame_ms\":";
+    writeSummary(file, results.gpuFrameMilliseconds);
+    file << ",\n\"draw_calls\":";
+    writeSummary(file, drawCalls);
+    file << ",\n\"primitives\":";
+    writeSummary(file, primitives);
+    file << ",\n\"gpu_passes\":[";
+    for (size_t i = 0; i < results.gpuZones.size(); ++i) {
+        const GpuProfiler::ZoneTiming& zone = results.gpuZones[i];
+        file << (i ? ",\n" : "\n") << "{\"zone\":";
+        writeJsonString(file, zone.path);
+        file << ",\"min_ms\":" << zone.minMilliseconds << ",\"avg_ms\":" << zone.avgMilliseconds << ",\"p99_ms\":" << zone.p99Milliseconds << '}';
+    }
+    file << "],\n\"dropped_gpu_frames\":" << results.numDroppedGpuFrames
+         << ",\n\"gl_errors\":" << results.numGLErrors << "\n}\n";
+    return bool(file);
+}
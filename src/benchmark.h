@@ -0,0 +1,49 @@
+#pragma once
+#include "draw_stats.h"
+#include "gpu_profiler.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Options of the headless benchmark mode:
+//   Master_TechDemo --benchmark [--frames N] [--warmup N] [--width W] [--height H] [--output results.json]
+struct BenchmarkOptions {
+    int numFrames { 600 };
+    // Frames that are rendered before measuring, so that the shadow caches are filled and shaders are compiled.
+    int numWarmupFrames { 60 };
+    // Fixed simulation time step; the result is the same on every machine regardless of how fast it renders.
+    float timeStep { 1.0f / 60.0f };
+    glm::ivec2 resolution { 1024, 1024 };
+    // Simulate the particles with transform feedback instead of on the simulation thread (--particles gpu).
+    bool gpuParticles { false };
+    // Simulate the particles on the simulation thread as an SPH fluid (--particles sph).
+    bool sphParticles { false };
+    // Draw the FFT ocean (--water fft) or the sum of sines (--water sines).
+    bool fftOcean { true };
+    std::filesystem::path outputPath { "benchmark.json" };
+};
+
+// Returns std::nullopt when --benchmark is not given. Throws std::invalid_argument for unknown or invalid options.
+std::optional<BenchmarkOptions> parseBenchmarkOptions(int argc, const char* const* argv);
+
+// Measurements of the frames after the warm-up.
+struct BenchmarkResults {
+    std::string renderer;
+    float startupMilliseconds { 0.0f };
+    float firstFrameMilliseconds { 0.0f };
+    std::vector<float> cpuFrameMilliseconds;
+    std::vector<float> gpuFrameMilliseconds;
+    std::vector<DrawStats> drawStats;
+    // Per pass statistics of the GPU profiler (over its history of the last frames).
+    std::vector<GpuProfiler::ZoneTiming> gpuZones;
+    uint64_t numDroppedGpuFrames { 0 };
+    uint32_t numGLErrors { 0 };
+};
+
+// Write the options and the min/mean/percentiles of the per frame measurements as JSON.
+bool writeBenchmarkJson(const std::filesystem::path& filePath, const BenchmarkOptions& options, const BenchmarkResults& results);
@@ -0,0 +1,38 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <span>
+#include <vector>
+
+struct CubicBezier {
+    glm::vec3 p0, p1, p2, p3;
+
+    glm::vec3 evaluate(float t) const {
+        float u = 1.0f - t;
+        return u * u * u * p0 + 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t * p3;
+    }
+
+    glm::vec3 derivative(float t) const {
+        float u = 1.0f - t;
+        return
+            -3.0f * u * u * p0 +
+            3.0f * u * u * p1 - 6.0f * u * t * p1 +
+            6.0f * u * t * p2 - 3.0f * t * t * p2 +
+            3.0f * t * t * p3;
+    }
+};
+
+// Points at samplesPerCurve + 1 evenly spaced parameters of every curve.
+inline std::vector<glm::vec3> sampleBezierPath(std::span<const CubicBezier> curves, int samplesPerCurve = 20)
+{
+    std::vector<glm::vec3> points;
+    for (const auto& curve : curves) {
+        for (int i = 0; i <= samplesPerCurve; ++i) {
+            float t = static_cast<float>(i) / static_cast<float>(samplesPerCurve);
+            points.push_back(curve.evaluate(t));
+        }
+    }
+    return points;
+}
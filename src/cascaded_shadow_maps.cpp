@@ -0,0 +1,214 @@
+#include "cascaded_shadow_maps.h"
+#include <framework/cpu_profiler.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/matrix.hpp>
+#include <glm/trigonometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+
+// Distance behind the cascade at which casters are still captured (e.g. the snake between the sun and the ground).
+static constexpr float CASTER_DISTANCE = 20.0f;
+
+CascadedShadowMaps::CascadedShadowMaps()
+{
+    allocate();
+}
+
+CascadedShadowMaps::~CascadedShadowMaps()
+{
+    glDeleteFramebuffers(NUM_CASCADES, m_framebuffers.data());
+    glDeleteTextures(1, &m_texture);
+}
+
+void CascadedShadowMaps::allocate()
+{
+    if (m_texture) {
+        glDeleteFramebuffers(NUM_CASCADES, m_framebuffers.data());
+        glDeleteTextures(1, &m_texture);
+    }
+    m_allocatedResolution = settings.resolution;
+
+    // Depth comparison in the sampler gives bilinear percentage closer filtering for free.
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, m_allocatedResolution, m_allocatedResolution, NUM_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(NUM_CASCADES, m_framebuffers.data());
+    for (int cascade = 0; cascade < NUM_CASCADES; ++cascade) {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffers[size_t(cascade)]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texture, 0, cascade);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    invalidate();
+}
+
+void CascadedShadowMaps::invalidate()
+{
+    for (Cascade& cascade : m_cascades)
+        cascade.valid = false;
+}
+
+void CascadedShadowMaps::update(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float zNear, const glm::vec3& lightDirection)
+{
+    CPU_PROFILE_ZONE("CascadedShadowMaps::update");
+    if (settings.resolution != m_allocatedResolution)
+        allocate();
+    m_viewMatrix = viewMatrix;
+
+    // World space directions of the view rays through the corners of the screen, scaled to a view depth of 1.
+    const glm::mat4 inverseProjection = glm::inverse(projectionMatrix);
+    const glm::mat4 inverseView = glm::inverse(viewMatrix);
+    const glm::vec3 cameraPosition = inverseView[3];
+    std::array<glm::vec3, 4> rays;
+    const glm::vec2 corners[] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+    for (size_t i = 0; i < rays.size(); ++i) {
+        const glm::vec4 nearPoint = inverseProjection * glm::vec4(corners[i], -1.0f, 1.0f);
+        const glm::vec3 viewRay = glm::vec3(nearPoint) / -nearPoint.z;
+        rays[i] = glm::mat3(inverseView) * viewRay;
+    }
+
+    const float shadowDistance = settings.shadowDistance;
+    const float cosThreshold = std::cos(glm::radians(settings.staticAngleThresholdDegrees));
+    float splitNear = zNear;
+    for (int i = 0; i < NUM_CASCADES; ++i) {
+        Cascade& cascade = m_cascades[size_t(i)];
+
+        // Practical split scheme (Zhang et al.).
+        const float fraction = float(i + 1) / NUM_CASCADES;
+        const float logSplit = zNear * std::pow(shadowDistance / zNear, fraction);
+        const float uniformSplit = zNear + (shadowDistance - zNear) * fraction;
+        cascade.splitNear = splitNear;
+        cascade.splitFar = glm::mix(uniformSplit, logSplit, settings.splitLambda);
+        splitNear = cascade.splitFar;
+
+        // Bounding sphere of the frustum slice; its radius does not change when the camera rotates, which keeps
+        // the shadow map resolution stable. Rounding it up avoids flicker from floating point noise.
+        glm::vec3 center { 0.0f };
+        for (const glm::vec3& ray : rays)
+            center += cameraPosition + ray * (0.5f * (cascade.splitNear + cascade.splitFar));
+        center /= float(rays.size());
+        float radius = 0.0f;
+        for (const glm::vec3& ray : rays) {
+            radius = std::max(radius, glm::distance(center, cameraPosition + ray * cascade.splitNear));
+            radius = std::max(radius, glm::distance(center, cameraPosition + ray * cascade.splitFar));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        if (!isStatic(i)) {
+            cascade.valid = false;
+            cascade.lightViewProjection = fitLightProjection(center, radius, lightDirection);
+            cascade.needsRender = true;
+            continue;
+        }
+
+        const bool lightRotated = glm::dot(lightDirection, cascade.cachedLightDirection) < cosThreshold;
+        const bool outsideMargin = glm::distance(center, cascade.cachedCenter) + radius > cascade.cachedRadius;
+        if (!cascade.valid || lightRotated || outsideMargin) {
+            cascade.valid = true;
+            cascade.cachedCenter = center;
+            cascade.cachedRadius = radius * settings.staticMargin;
+            cascade.cachedLightDirection = lightDirection;
+            cascade.lightViewProjection = fitLightProjection(center, cascade.cachedRadius, lightDirection);
+            cascade.needsRender = true;
+        }
+    }
+}
+
+glm::mat4 CascadedShadowMaps::fitLightProjection(const glm::vec3& center, float radius, const glm::vec3& lightDirection) const
+{
+    const glm::vec3 up = std::abs(lightDirection.z) < 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const float eyeDistance = radius + CASTER_DISTANCE;
+    const glm::mat4 lightView = glm::lookAt(center + lightDirection * eyeDistance, center, up);
+    glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, eyeDistance + radius);
+
+    // Snap the projection to whole texels so shadow edges do not shimmer when the camera moves.
+    const float halfResolution = 0.5f * float(m_allocatedResolution);
+    const glm::vec4 origin = lightProjection * lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    const glm::vec2 originTexels = glm::vec2(origin) * halfResolution;
+    const glm::vec2 offset = (glm::round(originTexels) - originTexels) / halfResolution;
+    lightProjection[3][0] += offset.x;
+    lightProjection[3][1] += offset.y;
+    return lightProjection * lightView;
+}
+
+bool CascadedShadowMaps::needsRender(int cascade) const
+{
+    return m_cascades[size_t(cascade)].needsRender;
+}
+
+bool CascadedShadowMaps::isStatic(int cascade) const
+{
+    return cascade >= settings.firstStaticCascade;
+}
+
+void CascadedShadowMaps::beginRender(int cascade)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffers[size_t(cascade)]);
+    glViewport(0, 0, m_allocatedResolution, m_allocatedResolution);
+    glDepthMask(GL_TRUE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // Slope scaled bias against shadow acne on surfaces at grazing angles to the light.
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+}
+
+void CascadedShadowMaps::endRender(int cascade)
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    m_cascades[size_t(cascade)].needsRender = false;
+    m_cascades[size_t(cascade)].renderCount++;
+}
+
+GLuint CascadedShadowMaps::framebuffer(int cascade) const
+{
+    return m_framebuffers[size_t(cascade)];
+}
+
+const glm::mat4& CascadedShadowMaps::lightViewProjection(int cascade) const
+{
+    return m_cascades[size_t(cascade)].lightViewProjection;
+}
+
+float CascadedShadowMaps::splitDistance(int cascade) const
+{
+    return m_cascades[size_t(cascade)].splitFar;
+}
+
+uint32_t CascadedShadowMaps::renderCount(int cascade) const
+{
+    return m_cascades[size_t(cascade)].renderCount;
+}
+
+void CascadedShadowMaps::bind(const Shader& shader, bool enabled) const
+{
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    std::array<glm::mat4, NUM_CASCADES> matrices;
+    glm::vec4 splits;
+    for (int i = 0; i < NUM_CASCADES; ++i) {
+        matrices[size_t(i)] = m_cascades[size_t(i)].lightViewProjection;
+        splits[i] = m_cascades[size_t(i)].splitFar;
+    }
+    glUniform1i(shader.getUniformLocation("shadowMap"), 10);
+    glUniform1i(shader.getUniformLocation("useShadows"), enabled ? GL_TRUE : GL_FALSE);
+    glUniformMatrix4fv(shader.getUniformLocation("shadowMatrices"), NUM_CASCADES, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform4fv(shader.getUniformLocation("cascadeSplits"), 1, glm::value_ptr(splits));
+    glUniformMatrix4fv(shader.getUniformLocation("shadowViewMatrix"), 1, GL_FALSE, glm::value_ptr(m_viewMatrix));
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <framework/shader.h>
+#include <array>
+#include <cstdint>
+
+// Cascaded shadow maps for a directional light. The camera frustum (up to the shadow distance) is split into
+// NUM_CASCADES slices with the "practical" split scheme (a blend of logarithmic and uniform splits); every slice
+// gets an orthographic shadow map (one layer of a depth texture array) that covers its bounding sphere.
+//
+// Cascades from firstStaticCascade onwards only contain static geometry. They are rendered with some margin around
+// the slice and are kept until the light direction has rotated by more than the threshold or the slice has moved
+// out of the margin, so they are usually not re-rendered at all.
+class CascadedShadowMaps {
+public:
+    static constexpr int NUM_CASCADES = 4;
+
+    struct Settings {
+        int resolution { 2048 };
+        float shadowDistance { 20.0f };
+        float splitLambda { 0.8f }; // 0 = uniform splits, 1 = logarithmic splits.
+        int firstStaticCascade { 2 };
+        float staticAngleThresholdDegrees { 1.0f };
+        float staticMargin { 1.3f }; // Static cascades cover this times the radius of their slice.
+    };
+
+    CascadedShadowMaps();
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    ~CascadedShadowMaps();
+
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    // Fit the cascades to the camera and decide which cascades have to be rendered this frame.
+    // lightDirection points towards the light.
+    void update(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float zNear, const glm::vec3& lightDirection);
+    // Force all cascades to be rendered again (e.g. when static geometry changed).
+    void invalidate();
+
+    [[nodiscard]] bool needsRender(int cascade) const;
+    [[nodiscard]] bool isStatic(int cascade) const;
+    // Binds the framebuffer of the cascade, sets the viewport and clears the depth.
+    void beginRender(int cascade);
+    void endRender(int cascade);
+    [[nodiscard]] GLuint framebuffer(int cascade) const;
+    [[nodiscard]] const glm::mat4& lightViewProjection(int cascade) const;
+    [[nodiscard]] float splitDistance(int cascade) const;
+    [[nodiscard]] uint32_t renderCount(int cascade) const;
+
+    // Bind the shadow map to texture unit 10 and set the uniforms of shadows_frag.glsl.
+    void bind(const Shader& shader, bool enabled) const;
+
+    Settings settings;
+
+private:
+    struct Cascade {
+        float splitNear { 0.0f }, splitFar { 0.0f };
+        glm::mat4 lightViewProjection { 1.0f };
+        bool needsRender { true };
+        uint32_t renderCount { 0 };
+
+        // State at the time a static cascade was rendered.
+        bool valid { false };
+        glm::vec3 cachedCenter { 0.0f };
+        float cachedRadius { 0.0f };
+        glm::vec3 cachedLightDirection { 0.0f };
+    };
+
+    void allocate();
+    glm::mat4 fitLightProjection(const glm::vec3& center, float radius, const glm::vec3& lightDirection) const;
+
+private:
+    std::array<Cascade, NUM_CASCADES> m_cascades;
+    glm::mat4 m_viewMatrix { 1.0f };
+    int m_allocatedResolution { 0 };
+    GLuint m_texture { 0 };
+    std::array<GLuint, NUM_CASCADES> m_framebuffers {};
+};
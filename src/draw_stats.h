@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+
+// Draw calls and primitives submitted by the application, counted next to every glDraw* call. Whoever measures
+// them (the benchmark) resets the counters at the start of every frame.
+struct DrawStats {
+    uint64_t drawCalls { 0 };
+    uint64_t primitives { 0 };
+};
+
+inline DrawStats& drawStats()
+{
+    static DrawStats stats;
+    return stats;
+}
+
+inline void countDrawCall(uint64_t primitives, uint64_t instances = 1)
+{
+    DrawStats& stats = drawStats();
+    stats.drawCalls++;
+    stats.primitives += primitives * instances;
+}
@@ -0,0 +1,84 @@
+#include "fixed_timestep.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/quaternion.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(double stepSeconds, int maxSteps)
+    : maxStepsPerFrame(maxSteps)
+    , m_stepSeconds(stepSeconds)
+{
+}
+
+int FixedTimestep::advance(double frameSeconds)
+{
+    m_accumulator += std::max(frameSeconds, 0.0);
+    int numSteps = 0;
+    while (m_accumulator >= m_stepSeconds && numSteps < maxStepsPerFrame) {
+        m_accumulator -= m_stepSeconds;
+        numSteps++;
+    }
+    if (m_accumulator >= m_stepSeconds) {
+        // Keep the fraction so that alpha() stays continuous.
+        const double remainder = std::fmod(m_accumulator, m_stepSeconds);
+        m_droppedSeconds += m_accumulator - remainder;
+        m_accumulator = remainder;
+    }
+    m_numSteps += uint64_t(numSteps);
+    return numSteps;
+}
+
+void FixedTimestep::setStepSeconds(double stepSeconds)
+{
+    // Keep the same fraction of a step in the accumulator.
+    m_accumulator *= stepSeconds / m_stepSeconds;
+    m_stepSeconds = stepSeconds;
+}
+
+float FixedTimestep::stepSeconds() const
+{
+    return float(m_stepSeconds);
+}
+
+float FixedTimestep::alpha() const
+{
+    return float(m_accumulator / m_stepSeconds);
+}
+
+double FixedTimestep::simulationTime() const
+{
+    return double(m_numSteps) * m_stepSeconds;
+}
+
+double FixedTimestep::renderTime() const
+{
+    return simulationTime() - m_stepSeconds + m_accumulator;
+}
+
+uint64_t FixedTimestep::numSteps() const
+{
+    return m_numSteps;
+}
+
+double FixedTimestep::droppedSeconds() const
+{
+    return m_droppedSeconds;
+}
+
+glm::mat4 interpolateTransform(const glm::mat4& previous, const glm::mat4& current, float alpha)
+{
+    const glm::vec3 previousScale { glm::length(glm::vec3(previous[0])), glm::length(glm::vec3(previous[1])), glm::length(glm::vec3(previous[2])) };
+    const glm::vec3 currentScale { glm::length(glm::vec3(current[0])), glm::length(glm::vec3(current[1])), glm::length(glm::vec3(current[2])) };
+    const glm::quat previousRotation = glm::quat_cast(glm::mat3(glm::vec3(previous[0]) / previousScale.x, glm::vec3(previous[1]) / previousScale.y, glm::vec3(previous[2]) / previousScale.z));
+    const glm::quat currentRotation = glm::quat_cast(glm::mat3(glm::vec3(current[0]) / currentScale.x, glm::vec3(current[1]) / currentScale.y, glm::vec3(current[2]) / currentScale.z));
+
+    const glm::vec3 scale = glm::mix(previousScale, currentScale, alpha);
+    const glm::mat3 rotation = glm::mat3_cast(glm::slerp(previousRotation, currentRotation, alpha));
+    glm::mat4 result { 1.0f };
+    for (int i = 0; i < 3; ++i)
+        result[i] = glm::vec4(rotation[i] * scale[i], 0.0f);
+    result[3] = glm::mix(previous[3], current[3], alpha);
+    return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+
+// Fixed time step simulation clock. The measured frame time is added to an accumulator, from which the simulation
+// consumes steps of exactly stepSeconds(); the remainder is carried over to the next frame. Rendering interpolates
+// between the state before and after the last step using alpha(), so motion stays smooth when the frame rate and the
+// simulation rate differ (at the cost of showing the state up to one step late).
+//
+// Slow frames would otherwise require more steps, which make the next frame even slower (the "spiral of death"), so
+// at most maxStepsPerFrame steps are taken per frame. Time beyond that is dropped and the simulation slows down.
+class FixedTimestep {
+public:
+    explicit FixedTimestep(double stepSeconds = 1.0 / 60.0, int maxSteps = 5);
+
+    // Add the time that passed since the last frame and return the number of steps to simulate.
+    int advance(double frameSeconds);
+
+    void setStepSeconds(double stepSeconds);
+    [[nodiscard]] float stepSeconds() const;
+    // Fraction of a step that is left in the accumulator, in [0, 1).
+    [[nodiscard]] float alpha() const;
+    // Time of the current simulation state (after the last step).
+    [[nodiscard]] double simulationTime() const;
+    // Simulation time at which the interpolated state is rendered.
+    [[nodiscard]] double renderTime() const;
+    [[nodiscard]] uint64_t numSteps() const;
+    // Total time that was dropped by the step limit.
+    [[nodiscard]] double droppedSeconds() const;
+
+    int maxStepsPerFrame;
+
+private:
+    double m_stepSeconds;
+    double m_accumulator { 0.0 };
+    uint64_t m_numSteps { 0 };
+    double m_droppedSeconds { 0.0 };
+};
+
+// Interpolate a rigid transform (with scale): the translation and scale are interpolated linearly and the rotation
+// spherically, so that rotating objects do not shrink halfway between two steps.
+glm::mat4 interpolateTransform(const glm::mat4& previous, const glm::mat4& current, float alpha);
@@ -0,0 +1,530 @@
+#include "frame_graph.h"
+#include "gpu_profiler.h"
+#include <framework/cpu_profiler.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <queue>
+
+// Pooled textures that were not used for this many frames are released.
+static constexpr uint32_t MAX_UNUSED_FRAMES = 60;
+// Weight of the newest sample in the exponential moving average of the pass timings.
+static constexpr float TIMING_SMOOTHING = 0.1f;
+
+bool RenderTargetDesc::isDepth() const
+{
+    switch (internalFormat) {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH32F_STENCIL8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+FrameGraph::PassBuilder::PassBuilder(FrameGraph& graph, uint32_t pass)
+    : m_graph(graph)
+    , m_pass(pass)
+{
+}
+
+FrameGraphResource FrameGraph::PassBuilder::read(FrameGraphResource resource)
+{
+    assert(resource < m_graph.m_resources.size());
+    m_graph.m_passes[m_pass].reads.push_back(resource);
+    return resource;
+}
+
+FrameGraphResource FrameGraph::PassBuilder::write(FrameGraphResource resource)
+{
+    assert(resource < m_graph.m_resources.size());
+    m_graph.m_passes[m_pass].writes.push_back(resource);
+    return resource;
+}
+
+void FrameGraph::PassBuilder::setSideEffect()
+{
+    m_graph.m_passes[m_pass].sideEffect = true;
+}
+
+FrameGraph::PassContext::PassContext(const FrameGraph& graph)
+    : m_graph(graph)
+{
+}
+
+GLuint FrameGraph::PassContext::texture(FrameGraphResource resource) const
+{
+    const Resource& r = m_graph.m_resources[resource];
+    assert(!r.imported && r.pooledTexture >= 0);
+    return m_graph.m_texturePool[static_cast<size_t>(r.pooledTexture)].texture;
+}
+
+glm::ivec2 FrameGraph::PassContext::size(FrameGraphResource resource) const
+{
+    return m_graph.m_resources[resource].desc.size;
+}
+
+FrameGraph::~FrameGraph()
+{
+    for (const PooledTexture& pooled : m_texturePool)
+        glDeleteTextures(1, &pooled.texture);
+    for (const CachedFramebuffer& cached : m_framebufferCache)
+        glDeleteFramebuffers(1, &cached.framebuffer);
+    for (const QueryFrame& queryFrame : m_queryFrames) {
+        if (!queryFrame.queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(queryFrame.queries.size()), queryFrame.queries.data());
+        if (!queryFrame.sampleQueries.empty())
+            glDeleteQueries(static_cast<GLsizei>(queryFrame.sampleQueries.size()), queryFrame.sampleQueries.data());
+    }
+}
+
+void FrameGraph::reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_executionOrder.clear();
+}
+
+FrameGraphResource FrameGraph::createRenderTarget(std::string_view name, const RenderTargetDesc& desc, const glm::vec4& clearValue)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.clearValue = clearValue;
+    m_resources.push_back(std::move(resource));
+    return static_cast<FrameGraphResource>(m_resources.size() - 1);
+}
+
+FrameGraphResource FrameGraph::importFramebuffer(std::string_view name, GLuint framebuffer, const glm::ivec2& size, GLbitfield clearMask, const glm::vec4& clearColor)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc.size = size;
+    resource.clearValue = clearColor;
+    resource.imported = true;
+    resource.importedFramebuffer = framebuffer;
+    resource.importedClearMask = clearMask;
+    m_resources.push_back(std::move(resource));
+    return static_cast<FrameGraphResource>(m_resources.size() - 1);
+}
+
+void FrameGraph::addPass(std::string_view name, const SetupFunction& setup, ExecuteFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    m_passes.push_back(std::move(pass));
+
+    PassBuilder builder { *this, static_cast<uint32_t>(m_passes.size() - 1) };
+    setup(builder);
+}
+
+void FrameGraph::compile()
+{
+    CPU_PROFILE_ZONE("FrameGraph::compile");
+    cullPasses();
+    orderPasses();
+    allocateTextures();
+
+    m_timings.clear();
+    for (const Pass& pass : m_passes) {
+        FrameGraphPassTiming timing = m_smoothedTimings[pass.name];
+        timing.name = pass.name;
+        timing.culled = pass.culled;
+        m_timings.push_back(timing);
+    }
+}
+
+// Cull passes by reference counting: a transient target that nobody reads lets its writers drop a
+// reference; a writer without references is culled, which in turn releases the targets it reads.
+void FrameGraph::cullPasses()
+{
+    for (Resource& resource : m_resources)
+        resource.refCount = 0;
+    for (Pass& pass : m_passes) {
+        pass.culled = false;
+        pass.refCount = static_cast<uint32_t>(pass.writes.size());
+        for (FrameGraphResource read : pass.reads)
+            m_resources[read].refCount++;
+    }
+
+    const auto isRoot = [&](const Pass& pass) {
+        return pass.sideEffect || std::any_of(std::begin(pass.writes), std::end(pass.writes), [&](FrameGraphResource write) { return m_resources[write].imported; });
+    };
+
+    std::vector<FrameGraphResource> unreferenced;
+    for (FrameGraphResource i = 0; i < m_resources.size(); ++i) {
+        if (m_resources[i].refCount == 0 && !m_resources[i].imported)
+            unreferenced.push_back(i);
+    }
+
+    while (!unreferenced.empty()) {
+        const FrameGraphResource resource = unreferenced.back();
+        unreferenced.pop_back();
+
+        for (Pass& pass : m_passes) {
+            if (pass.culled || isRoot(pass) || std::find(std::begin(pass.writes), std::end(pass.writes), resource) == std::end(pass.writes))
+                continue;
+            if (--pass.refCount > 0)
+                continue;
+
+            pass.culled = true;
+            for (FrameGraphResource read : pass.reads) {
+                if (--m_resources[read].refCount == 0 && !m_resources[read].imported)
+                    unreferenced.push_back(read);
+            }
+        }
+    }
+}
+
+// Topological sort of the remaining passes: the accesses of a target keep the order in which the passes
+// were added, so a reader runs after the writers before it and a writer runs after the earlier writers and
+// readers (a pass may read the backbuffer before a later pass draws over it). Ties are broken by the order
+// of addition.
+void FrameGraph::orderPasses()
+{
+    const size_t numPasses = m_passes.size();
+    std::vector<std::vector<uint32_t>> successors(numPasses);
+    std::vector<uint32_t> numPredecessors(numPasses, 0);
+    const auto addEdge = [&](uint32_t from, uint32_t to) {
+        if (from == to)
+            return;
+        successors[from].push_back(to);
+        numPredecessors[to]++;
+    };
+
+    for (FrameGraphResource resource = 0; resource < m_resources.size(); ++resource) {
+        std::optional<uint32_t> lastWriter;
+        std::vector<uint32_t> readersSinceWrite;
+        for (uint32_t i = 0; i < numPasses; ++i) {
+            const Pass& pass = m_passes[i];
+            if (pass.culled)
+                continue;
+            if (std::find(std::begin(pass.writes), std::end(pass.writes), resource) != std::end(pass.writes)) {
+                if (lastWriter)
+                    addEdge(*lastWriter, i);
+                for (uint32_t reader : readersSinceWrite)
+                    addEdge(reader, i);
+                readersSinceWrite.clear();
+                lastWriter = i;
+            } else if (std::find(std::begin(pass.reads), std::end(pass.reads), resource) != std::end(pass.reads)) {
+                if (lastWriter)
+                    addEdge(*lastWriter, i);
+                readersSinceWrite.push_back(i);
+            }
+        }
+    }
+
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t i = 0; i < numPasses; ++i) {
+        if (!m_passes[i].culled && numPredecessors[i] == 0)
+            ready.push(i);
+    }
+
+    m_executionOrder.clear();
+    while (!ready.empty()) {
+        const uint32_t pass = ready.top();
+        ready.pop();
+        m_executionOrder.push_back(pass);
+        for (uint32_t successor : successors[pass]) {
+            if (--numPredecessors[successor] == 0)
+                ready.push(successor);
+        }
+    }
+
+    // A cycle means a pass (indirectly) reads its own output; fall back to the order of addition.
+    const size_t numActive = static_cast<size_t>(std::count_if(std::begin(m_passes), std::end(m_passes), [](const Pass& pass) { return !pass.culled; }));
+    assert(m_executionOrder.size() == numActive);
+    if (m_executionOrder.size() != numActive) {
+        m_executionOrder.clear();
+        for (uint32_t i = 0; i < numPasses; ++i) {
+            if (!m_passes[i].culled)
+                m_executionOrder.push_back(i);
+        }
+    }
+}
+
+// Compute the lifetime of every transient target in the execution order and assign targets whose
+// lifetimes do not overlap to the same pooled texture.
+void FrameGraph::allocateTextures()
+{
+    for (Resource& resource : m_resources) {
+        resource.firstUse = std::numeric_limits<uint32_t>::max();
+        resource.lastUse = 0;
+        resource.pooledTexture = -1;
+    }
+    for (Pass& pass : m_passes)
+        pass.clears.clear();
+
+    for (uint32_t order = 0; order < m_executionOrder.size(); ++order) {
+        Pass& pass = m_passes[m_executionOrder[order]];
+        const auto use = [&](FrameGraphResource r) {
+            Resource& resource = m_resources[r];
+            resource.firstUse = std::min(resource.firstUse, order);
+            resource.lastUse = std::max(resource.lastUse, order);
+        };
+        for (FrameGraphResource r : pass.reads)
+            use(r);
+        for (FrameGraphResource r : pass.writes) {
+            // The first pass that touches a target writes it, so that is where it has to be cleared.
+            if (m_resources[r].firstUse == std::numeric_limits<uint32_t>::max())
+                pass.clears.push_back(r);
+            use(r);
+        }
+    }
+
+    std::vector<FrameGraphResource> transients;
+    for (FrameGraphResource r = 0; r < m_resources.size(); ++r) {
+        if (!m_resources[r].imported && m_resources[r].firstUse != std::numeric_limits<uint32_t>::max())
+            transients.push_back(r);
+    }
+    std::sort(std::begin(transients), std::end(transients), [&](FrameGraphResource lhs, FrameGraphResource rhs) { return m_resources[lhs].firstUse < m_resources[rhs].firstUse; });
+
+    for (PooledTexture& pooled : m_texturePool)
+        pooled.busyUntil = -1;
+    for (FrameGraphResource r : transients) {
+        Resource& resource = m_resources[r];
+        auto iter = std::find_if(std::begin(m_texturePool), std::end(m_texturePool), [&](const PooledTexture& pooled) {
+            return pooled.desc == resource.desc && pooled.busyUntil < static_cast<int64_t>(resource.firstUse);
+        });
+        if (iter == std::end(m_texturePool)) {
+            PooledTexture pooled;
+            pooled.desc = resource.desc;
+            glGenTextures(1, &pooled.texture);
+            glBindTexture(GL_TEXTURE_2D, pooled.texture);
+            if (resource.desc.internalFormat == GL_DEPTH24_STENCIL8 || resource.desc.internalFormat == GL_DEPTH32F_STENCIL8)
+                glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(resource.desc.internalFormat), resource.desc.size.x, resource.desc.size.y, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+            else if (resource.desc.isDepth())
+                glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(resource.desc.internalFormat), resource.desc.size.x, resource.desc.size.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(resource.desc.internalFormat), resource.desc.size.x, resource.desc.size.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+            const GLint filter = resource.desc.isDepth() ? GL_NEAREST : GL_LINEAR;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            m_texturePool.push_back(pooled);
+            iter = std::prev(std::end(m_texturePool));
+        }
+        iter->busyUntil = resource.lastUse;
+        iter->unusedFrames = 0;
+        resource.pooledTexture = static_cast<int32_t>(std::distance(std::begin(m_texturePool), iter));
+    }
+
+    // Release textures (and the framebuffers that reference them) that have not been needed for a while, e.g. those
+    // of the old size after a resize. Textures of this frame are never released, so the pool is compacted and the
+    // resources are pointed at the new indices of their textures.
+    std::vector<int32_t> newIndices(m_texturePool.size(), -1);
+    size_t numKept = 0;
+    for (size_t i = 0; i < m_texturePool.size(); ++i) {
+        PooledTexture& pooled = m_texturePool[i];
+        if (pooled.busyUntil < 0 && ++pooled.unusedFrames > MAX_UNUSED_FRAMES) {
+            const GLuint texture = pooled.texture;
+            std::erase_if(m_framebufferCache, [&](const CachedFramebuffer& cached) {
+                if (std::find(std::begin(cached.attachments), std::end(cached.attachments), texture) == std::end(cached.attachments))
+                    return false;
+                glDeleteFramebuffers(1, &cached.framebuffer);
+                return true;
+            });
+            glDeleteTextures(1, &texture);
+            continue;
+        }
+        newIndices[i] = static_cast<int32_t>(numKept);
+        m_texturePool[numKept++] = pooled;
+    }
+    m_texturePool.resize(numKept);
+    for (Resource& resource : m_resources) {
+        if (resource.pooledTexture >= 0)
+            resource.pooledTexture = newIndices[static_cast<size_t>(resource.pooledTexture)];
+    }
+}
+
+GLuint FrameGraph::getFramebuffer(const Pass& pass)
+{
+    for (FrameGraphResource write : pass.writes) {
+        if (m_resources[write].imported) {
+            // Imported framebuffers cannot be combined with transient attachments.
+            assert(pass.writes.size() == 1);
+            return m_resources[write].importedFramebuffer;
+        }
+    }
+
+    // Color attachments in the order they were written, followed by the (optional) depth attachment.
+    std::vector<GLuint> attachments;
+    GLuint depthAttachment = 0;
+    const Resource* depthResource = nullptr;
+    for (FrameGraphResource write : pass.writes) {
+        const Resource& resource = m_resources[write];
+        const GLuint texture = m_texturePool[static_cast<size_t>(resource.pooledTexture)].texture;
+        if (resource.desc.isDepth()) {
+            depthAttachment = texture;
+            depthResource = &resource;
+        } else {
+            attachments.push_back(texture);
+        }
+    }
+    attachments.push_back(depthAttachment);
+
+    for (const CachedFramebuffer& cached : m_framebufferCache) {
+        if (cached.attachments == attachments)
+            return cached.framebuffer;
+    }
+
+    CachedFramebuffer cached;
+    cached.attachments = attachments;
+    glGenFramebuffers(1, &cached.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+    std::vector<GLenum> drawBuffers;
+    for (size_t i = 0; i + 1 < attachments.size(); ++i) {
+        const GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, attachments[i], 0);
+        drawBuffers.push_back(attachment);
+    }
+    if (depthResource) {
+        const bool hasStencil = depthResource->desc.internalFormat == GL_DEPTH24_STENCIL8 || depthResource->desc.internalFormat == GL_DEPTH32F_STENCIL8;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthAttachment, 0);
+    }
+    if (drawBuffers.empty())
+        glDrawBuffer(GL_NONE);
+    else
+        glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+    m_framebufferCache.push_back(cached);
+    return cached.framebuffer;
+}
+
+void FrameGraph::execute()
+{
+    CPU_PROFILE_ZONE("FrameGraph::execute");
+    readbackTimings();
+
+    QueryFrame& queryFrame = m_queryFrames[m_queryFrame];
+    if (queryFrame.queries.size() < m_executionOrder.size()) {
+        const size_t numExisting = queryFrame.queries.size();
+        queryFrame.queries.resize(m_executionOrder.size());
+        glGenQueries(static_cast<GLsizei>(m_executionOrder.size() - numExisting), queryFrame.queries.data() + numExisting);
+        queryFrame.sampleQueries.resize(m_executionOrder.size());
+        glGenQueries(static_cast<GLsizei>(m_executionOrder.size() - numExisting), queryFrame.sampleQueries.data() + numExisting);
+    }
+    queryFrame.passNames.clear();
+
+    const PassContext context { *this };
+    for (size_t i = 0; i < m_executionOrder.size(); ++i) {
+        Pass& pass = m_passes[m_executionOrder[i]];
+        const auto cpuStart = std::chrono::steady_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queryFrame.queries[i]);
+        glBeginQuery(GL_SAMPLES_PASSED, queryFrame.sampleQueries[i]);
+        queryFrame.passNames.push_back(pass.name);
+
+        if (!pass.writes.empty()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer(pass));
+            const glm::ivec2 size = m_resources[pass.writes.front()].desc.size;
+            glViewport(0, 0, size.x, size.y);
+        }
+
+        // Clear the targets that are written for the first time this frame. Clears respect the write masks.
+        if (!pass.clears.empty()) {
+            glDepthMask(GL_TRUE);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+        GLint colorAttachment = 0;
+        for (FrameGraphResource write : pass.writes) {
+            const Resource& resource = m_resources[write];
+            const bool clear = std::find(std::begin(pass.clears), std::end(pass.clears), write) != std::end(pass.clears);
+            if (resource.imported) {
+                if (clear && resource.importedClearMask) {
+                    glClearColor(resource.clearValue.r, resource.clearValue.g, resource.clearValue.b, resource.clearValue.a);
+                    glClear(resource.importedClearMask);
+                }
+            } else if (resource.desc.isDepth()) {
+                if (clear)
+                    glClearBufferfv(GL_DEPTH, 0, glm::value_ptr(resource.clearValue));
+            } else {
+                if (clear)
+                    glClearBufferfv(GL_COLOR, colorAttachment, glm::value_ptr(resource.clearValue));
+                colorAttachment++;
+            }
+        }
+
+        if (m_profiler)
+            m_profiler->pushZone(pass.name);
+        pass.execute(context);
+        if (m_profiler)
+            m_profiler->popZone();
+
+        glEndQuery(GL_SAMPLES_PASSED);
+        glEndQuery(GL_TIME_ELAPSED);
+        const auto cpuEnd = std::chrono::steady_clock::now();
+        FrameGraphPassTiming& timing = m_smoothedTimings[pass.name];
+        const float cpuMilliseconds = std::chrono::duration<float, std::milli>(cpuEnd - cpuStart).count();
+        timing.cpuMilliseconds += (cpuMilliseconds - timing.cpuMilliseconds) * TIMING_SMOOTHING;
+    }
+    queryFrame.pending = true;
+    m_queryFrame = (m_queryFrame + 1) % NUM_QUERY_FRAMES;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Read the GPU timings and sample counts of the oldest frame in the ring. If the GPU has not finished that frame yet,
+// its results are dropped instead of waiting for them (its queries are reused by the frame that is about to execute).
+void FrameGraph::readbackTimings()
+{
+    QueryFrame& queryFrame = m_queryFrames[m_queryFrame];
+    if (!queryFrame.pending)
+        return;
+    queryFrame.pending = false;
+    if (queryFrame.passNames.empty())
+        return;
+
+    const size_t last = queryFrame.passNames.size() - 1;
+    GLint timeAvailable = GL_FALSE, samplesAvailable = GL_FALSE;
+    glGetQueryObjectiv(queryFrame.queries[last], GL_QUERY_RESULT_AVAILABLE, &timeAvailable);
+    glGetQueryObjectiv(queryFrame.sampleQueries[last], GL_QUERY_RESULT_AVAILABLE, &samplesAvailable);
+    if (!timeAvailable || !samplesAvailable)
+        return;
+
+    for (size_t i = 0; i < queryFrame.passNames.size(); ++i) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queryFrame.queries[i], GL_QUERY_RESULT, &nanoseconds);
+        FrameGraphPassTiming& timing = m_smoothedTimings[queryFrame.passNames[i]];
+        const float gpuMilliseconds = static_cast<float>(nanoseconds) * 1e-6f;
+        timing.gpuMilliseconds += (gpuMilliseconds - timing.gpuMilliseconds) * TIMING_SMOOTHING;
+
+        GLuint64 samplesPassed = 0;
+        glGetQueryObjectui64v(queryFrame.sampleQueries[i], GL_QUERY_RESULT, &samplesPassed);
+        timing.samplesPassed = samplesPassed;
+    }
+}
+
+void FrameGraph::setProfiler(GpuProfiler* profiler)
+{
+    m_profiler = profiler;
+}
+
+std::span<const FrameGraphPassTiming> FrameGraph::timings() const
+{
+    return m_timings;
+}
+
+size_t FrameGraph::numPooledTextures() const
+{
+    return m_texturePool.size();
+}
+
+size_t FrameGraph::numTransientTargets() const
+{
+    return static_cast<size_t>(std::count_if(std::begin(m_resources), std::end(m_resources), [](const Resource& resource) {
+        return !resource.imported && resource.pooledTexture >= 0;
+    }));
+}
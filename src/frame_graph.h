@@ -0,0 +1,182 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class GpuProfiler;
+
+// Handle to a render target that was declared on a FrameGraph.
+using FrameGraphResource = uint32_t;
+
+// Description of a transient render target. Targets with equal descriptions can share a texture.
+struct RenderTargetDesc {
+    glm::ivec2 size { 0 };
+    GLenum internalFormat { GL_RGBA8 };
+
+    [[nodiscard]] bool isDepth() const;
+    [[nodiscard]] constexpr bool operator==(const RenderTargetDesc&) const noexcept = default;
+};
+
+// Timings of a single pass, averaged over the last few frames.
+struct FrameGraphPassTiming {
+    std::string name;
+    bool culled { false };
+    float cpuMilliseconds { 0.0f };
+    float gpuMilliseconds { 0.0f };
+    // Samples that passed the depth test (GL_SAMPLES_PASSED), i.e. the number of shaded fragments.
+    uint64_t samplesPassed { 0 };
+};
+
+// Frame graph that is rebuilt every frame:
+//  1. Declare render targets (createRenderTarget / importFramebuffer).
+//  2. Add passes that declare which targets they read (sample) and write (render to).
+//  3. compile() culls passes whose output is never used, orders the remaining passes so that every target
+//     is accessed in the order the passes were added, and assigns transient targets with non-overlapping
+//     lifetimes to the same texture.
+//  4. execute() binds a framebuffer with the written targets, clears targets on their first write and
+//     runs the passes.
+// The GL textures and framebuffers are kept in a pool between frames.
+class FrameGraph {
+public:
+    class PassBuilder {
+    public:
+        // Sample the target in this pass (it must have been written by an earlier pass).
+        FrameGraphResource read(FrameGraphResource resource);
+        // Render to the target in this pass (as color or depth attachment depending on its format).
+        FrameGraphResource write(FrameGraphResource resource);
+        // Never cull this pass, even if nothing reads what it writes.
+        void setSideEffect();
+
+    private:
+        friend class FrameGraph;
+        PassBuilder(FrameGraph& graph, uint32_t pass);
+
+        FrameGraph& m_graph;
+        uint32_t m_pass;
+    };
+
+    class PassContext {
+    public:
+        // Texture that backs the given target during this pass.
+        [[nodiscard]] GLuint texture(FrameGraphResource resource) const;
+        [[nodiscard]] glm::ivec2 size(FrameGraphResource resource) const;
+
+    private:
+        friend class FrameGraph;
+        explicit PassContext(const FrameGraph& graph);
+
+        const FrameGraph& m_graph;
+    };
+
+    using SetupFunction = std::function<void(PassBuilder&)>;
+    using ExecuteFunction = std::function<void(const PassContext&)>;
+
+public:
+    FrameGraph() = default;
+    FrameGraph(const FrameGraph&) = delete;
+    ~FrameGraph();
+
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // Forget all passes and resources of the previous frame (pooled GPU memory is kept).
+    void reset();
+
+    // Transient render target; only exists during the frame and may share memory with other targets.
+    // It is cleared to clearValue before its first write (depth targets clear to clearValue.x, so pass 1 for the far plane).
+    FrameGraphResource createRenderTarget(std::string_view name, const RenderTargetDesc& desc, const glm::vec4& clearValue = glm::vec4(0.0f));
+    // Render target owned by someone else (e.g. the window framebuffer). Passes that write it are never culled.
+    // Writing to an imported framebuffer writes all of its attachments; it is cleared on its first write if clearMask != 0.
+    FrameGraphResource importFramebuffer(std::string_view name, GLuint framebuffer, const glm::ivec2& size, GLbitfield clearMask = 0, const glm::vec4& clearColor = glm::vec4(0.0f));
+
+    void addPass(std::string_view name, const SetupFunction& setup, ExecuteFunction execute);
+
+    void compile();
+    void execute();
+
+    // Record a GPU profiler zone around every executed pass (nullptr to disable).
+    void setProfiler(GpuProfiler* profiler);
+
+    // Per pass CPU and GPU timings and shaded samples, in the order the passes were added.
+    [[nodiscard]] std::span<const FrameGraphPassTiming> timings() const;
+    // Number of pooled textures that back the transient targets.
+    [[nodiscard]] size_t numPooledTextures() const;
+    // Number of transient targets that were declared in the last compiled frame.
+    [[nodiscard]] size_t numTransientTargets() const;
+
+private:
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        glm::vec4 clearValue { 0.0f };
+        bool imported { false };
+        GLuint importedFramebuffer { 0 };
+        GLbitfield importedClearMask { 0 };
+
+        // Filled in by compile().
+        uint32_t refCount { 0 };
+        uint32_t firstUse { 0 };
+        uint32_t lastUse { 0 };
+        int32_t pooledTexture { -1 };
+    };
+    struct Pass {
+        std::string name;
+        ExecuteFunction execute;
+        std::vector<FrameGraphResource> reads;
+        std::vector<FrameGraphResource> writes;
+        bool sideEffect { false };
+
+        // Filled in by compile().
+        uint32_t refCount { 0 };
+        bool culled { false };
+        std::vector<FrameGraphResource> clears;
+    };
+    struct PooledTexture {
+        RenderTargetDesc desc;
+        GLuint texture { 0 };
+        int64_t busyUntil { -1 }; // Last (ordered) pass index that uses it in the current frame.
+        uint32_t unusedFrames { 0 };
+    };
+    struct CachedFramebuffer {
+        std::vector<GLuint> attachments;
+        GLuint framebuffer { 0 };
+    };
+
+    void cullPasses();
+    void orderPasses();
+    void allocateTextures();
+    GLuint getFramebuffer(const Pass& pass);
+    void readbackTimings();
+
+private:
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<uint32_t> m_executionOrder;
+
+    std::vector<PooledTexture> m_texturePool;
+    std::vector<CachedFramebuffer> m_framebufferCache;
+
+    // GPU timer queries are read back a few frames later so the CPU never waits for the GPU.
+    static constexpr size_t NUM_QUERY_FRAMES = 3;
+    struct QueryFrame {
+        std::vector<std::string> passNames;
+        std::vector<GLuint> queries;
+        std::vector<GLuint> sampleQueries;
+        bool pending { false };
+    };
+    std::array<QueryFrame, NUM_QUERY_FRAMES> m_queryFrames;
+    size_t m_queryFrame { 0 };
+    std::unordered_map<std::string, FrameGraphPassTiming> m_smoothedTimings;
+    std::vector<FrameGraphPassTiming> m_timings;
+    GpuProfiler* m_profiler { nullptr };
+};
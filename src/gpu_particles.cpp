@@ -0,0 +1,114 @@
+#include "gpu_particles.h"
+#include "particles.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <vector>
+
+// Interleaved floats per particle: position, velocity and life.
+static constexpr GLsizei PARTICLE_FLOATS = 7;
+
+GPUParticleSystem::GPUParticleSystem(size_t capacity)
+    : m_capacity(capacity)
+{
+    glGenBuffers(2, m_buffers.data());
+    glGenVertexArrays(2, m_updateVertexArrays.data());
+    glGenVertexArrays(2, m_renderVertexArrays.data());
+
+    constexpr GLsizei stride = PARTICLE_FLOATS * sizeof(GLfloat);
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_capacity * stride), nullptr, GL_DYNAMIC_COPY);
+
+        glBindVertexArray(m_updateVertexArrays[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));
+
+        // particle_vert.glsl reads the position components and the life as separate floats.
+        glBindVertexArray(m_renderVertexArrays[i]);
+        const std::array<size_t, 4> offsets { 0, 1, 2, 6 };
+        for (GLuint attribute = 0; attribute < offsets.size(); ++attribute) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribPointer(attribute, 1, GL_FLOAT, GL_FALSE, stride, (void*)(offsets[attribute] * sizeof(GLfloat)));
+        }
+    }
+    glBindVertexArray(0);
+    reset();
+}
+
+GPUParticleSystem::~GPUParticleSystem()
+{
+    glDeleteVertexArrays(2, m_renderVertexArrays.data());
+    glDeleteVertexArrays(2, m_updateVertexArrays.data());
+    glDeleteBuffers(2, m_buffers.data());
+}
+
+size_t GPUParticleSystem::capacity() const
+{
+    return m_capacity;
+}
+
+void GPUParticleSystem::update(const Shader& updateShader, std::span<const Emitter> emitters, float deltaTime)
+{
+    if (m_capacity == 0)
+        return;
+
+    // Assign the next slots of the ring to the emitters.
+    std::array<glm::vec3, MAX_EMITTERS> positions {};
+    std::array<GLint, MAX_EMITTERS> firstSlots {}, counts {};
+    const size_t numEmitters = std::min(emitters.size(), size_t(MAX_EMITTERS));
+    for (size_t i = 0; i < numEmitters; ++i) {
+        const size_t count = std::min(size_t(std::max(emitters[i].count, 0)), m_capacity);
+        positions[i] = emitters[i].position;
+        firstSlots[i] = static_cast<GLint>(m_nextEmitSlot);
+        counts[i] = static_cast<GLint>(count);
+        m_nextEmitSlot = (m_nextEmitSlot + count) % m_capacity;
+    }
+
+    updateShader.bind();
+    glUniform1i(updateShader.getUniformLocation("numEmitters"), static_cast<GLint>(numEmitters));
+    glUniform3fv(updateShader.getUniformLocation("emitterPositions"), MAX_EMITTERS, glm::value_ptr(positions[0]));
+    glUniform1iv(updateShader.getUniformLocation("emitterFirstSlots"), MAX_EMITTERS, firstSlots.data());
+    glUniform1iv(updateShader.getUniformLocation("emitterCounts"), MAX_EMITTERS, counts.data());
+    glUniform1i(updateShader.getUniformLocation("capacity"), static_cast<GLint>(m_capacity));
+    glUniform1ui(updateShader.getUniformLocation("seed"), m_numUpdates++);
+    glUniform1f(updateShader.getUniformLocation("deltaTime"), deltaTime);
+    glUniform1f(updateShader.getUniformLocation("gravity"), ParticleSystem::GRAVITY);
+    glUniform1f(updateShader.getUniformLocation("lifetime"), ParticleSystem::LIFETIME);
+
+    // Read the latest state and capture the new one in the other buffer; nothing is rasterized.
+    const size_t next = 1 - m_current;
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_updateVertexArrays[m_current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffers[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_capacity));
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    m_current = next;
+}
+
+void GPUParticleSystem::reset()
+{
+    // All zero: every slot is dead.
+    const std::vector<GLfloat> zeros(m_capacity * PARTICLE_FLOATS, 0.0f);
+    for (GLuint buffer : m_buffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(zeros.size() * sizeof(GLfloat)), zeros.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_nextEmitSlot = 0;
+}
+
+GLuint GPUParticleSystem::renderVertexArray() const
+{
+    return m_renderVertexArrays[m_current];
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <framework/shader.h>
+#include <array>
+#include <cstdint>
+#include <span>
+
+// Particle simulation on the GPU with transform feedback (OpenGL 4.1, no compute shaders). The particles live in two
+// vertex buffers that are used alternately as input and output of gpu_particles_update_vert.glsl, which emits,
+// applies gravity and ages them like ParticleSystem. Rendering reads the last output buffer, so the particles never
+// return to the CPU.
+//
+// Every particle has a fixed slot. Emitters respawn the next slots of a ring each update; since all particles live
+// equally long, a slot is only reused after its particle died unless more than capacity particles are alive.
+class GPUParticleSystem {
+public:
+    // Size of the emitter arrays in gpu_particles_update_vert.glsl.
+    static constexpr int MAX_EMITTERS = 8;
+
+    struct Emitter {
+        glm::vec3 position;
+        int count;
+    };
+
+    explicit GPUParticleSystem(size_t capacity);
+    GPUParticleSystem(const GPUParticleSystem&) = delete;
+    ~GPUParticleSystem();
+
+    GPUParticleSystem& operator=(const GPUParticleSystem&) = delete;
+
+    [[nodiscard]] size_t capacity() const;
+
+    // Emit the particles of (at most MAX_EMITTERS) emitters and simulate deltaTime seconds with the update shader,
+    // which must capture outPosition, outVelocity and outLife (see ShaderBuilder::setTransformFeedbackVaryings()).
+    void update(const Shader& updateShader, std::span<const Emitter> emitters, float deltaTime);
+    // Kill all particles.
+    void reset();
+
+    // Vertex array with the attributes of particle_vert.glsl (x, y, z and life) of all capacity() slots of the latest
+    // state; that shader culls the dead slots.
+    [[nodiscard]] GLuint renderVertexArray() const;
+
+private:
+    size_t m_capacity;
+    // Particles are stored interleaved as position (xyz), velocity (xyz) and life.
+    std::array<GLuint, 2> m_buffers {};
+    // Inputs of the update shader and of the particle shader, reading from the buffer with the same index.
+    std::array<GLuint, 2> m_updateVertexArrays {};
+    std::array<GLuint, 2> m_renderVertexArrays {};
+    // Buffer that holds the latest state.
+    size_t m_current { 0 };
+    size_t m_nextEmitSlot { 0 };
+    uint32_t m_numUpdates { 0 };
+};
@@ -0,0 +1,222 @@
+#include "gpu_profiler.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <imgui/imgui.h>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <numeric>
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, std::string_view name)
+    : m_profiler(profiler)
+{
+    m_profiler.pushZone(name);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+    m_profiler.popZone();
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (QueryFrame& frame : m_queryFrames) {
+        if (!frame.queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    }
+}
+
+void GpuProfiler::beginFrame()
+{
+    // Read back the pending frames from oldest to newest; timestamps complete in order, so once a frame is not
+    // finished the newer ones are not either.
+    for (size_t i = 0; i < NUM_QUERY_FRAMES; ++i) {
+        QueryFrame& frame = m_queryFrames[(m_queryFrame + i) % NUM_QUERY_FRAMES];
+        if (frame.pending && !tryReadback(frame))
+            break;
+    }
+
+    QueryFrame& frame = m_queryFrames[m_queryFrame];
+    if (frame.pending) {
+        frame.pending = false;
+        m_numDroppedFrames++;
+    }
+    frame.numQueries = 0;
+    frame.zones.clear();
+    m_openZones.clear();
+    m_recording = enabled;
+}
+
+void GpuProfiler::endFrame()
+{
+    if (!m_recording)
+        return;
+    while (!m_openZones.empty())
+        popZone();
+
+    m_queryFrames[m_queryFrame].pending = !m_queryFrames[m_queryFrame].zones.empty();
+    m_queryFrame = (m_queryFrame + 1) % NUM_QUERY_FRAMES;
+    m_recording = false;
+}
+
+void GpuProfiler::pushZone(std::string_view name)
+{
+    if (!m_recording)
+        return;
+
+    QueryFrame& frame = m_queryFrames[m_queryFrame];
+    RecordedZone zone;
+    zone.path = m_openZones.empty() ? std::string(name) : frame.zones[m_openZones.back()].path + "/" + std::string(name);
+    zone.depth = static_cast<int>(m_openZones.size());
+    zone.beginQuery = recordTimestamp();
+    m_openZones.push_back(frame.zones.size());
+    frame.zones.push_back(std::move(zone));
+}
+
+void GpuProfiler::popZone()
+{
+    if (!m_recording || m_openZones.empty())
+        return;
+
+    QueryFrame& frame = m_queryFrames[m_queryFrame];
+    frame.zones[m_openZones.back()].endQuery = recordTimestamp();
+    m_openZones.pop_back();
+}
+
+void GpuProfiler::finish()
+{
+    glFinish();
+    for (size_t i = 0; i < NUM_QUERY_FRAMES; ++i) {
+        QueryFrame& frame = m_queryFrames[(m_queryFrame + i) % NUM_QUERY_FRAMES];
+        if (frame.pending)
+            tryReadback(frame);
+    }
+}
+
+void GpuProfiler::clearHistory()
+{
+    m_histories.clear();
+}
+
+uint32_t GpuProfiler::recordTimestamp()
+{
+    QueryFrame& frame = m_queryFrames[m_queryFrame];
+    if (frame.numQueries == frame.queries.size()) {
+        const size_t numExisting = frame.queries.size();
+        frame.queries.resize(std::max<size_t>(2 * numExisting, 32));
+        glGenQueries(static_cast<GLsizei>(frame.queries.size() - numExisting), frame.queries.data() + numExisting);
+    }
+    glQueryCounter(frame.queries[frame.numQueries], GL_TIMESTAMP);
+    return frame.numQueries++;
+}
+
+bool GpuProfiler::tryReadback(QueryFrame& frame)
+{
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+    frame.pending = false;
+
+    std::vector<GLuint64> timestamps(frame.numQueries);
+    for (uint32_t i = 0; i < frame.numQueries; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+
+    const GLuint64 frameStart = timestamps[frame.zones.front().beginQuery];
+    std::vector<float> sorted;
+    m_zones.clear();
+    for (const RecordedZone& recorded : frame.zones) {
+        ZoneTiming& zone = m_zones.emplace_back();
+        zone.path = recorded.path;
+        zone.name = recorded.path.substr(recorded.path.find_last_of('/') + 1);
+        zone.depth = recorded.depth;
+        zone.startMilliseconds = float(timestamps[recorded.beginQuery] - frameStart) * 1e-6f;
+        zone.milliseconds = float(timestamps[recorded.endQuery] - timestamps[recorded.beginQuery]) * 1e-6f;
+
+        History& history = m_histories[recorded.path];
+        history.milliseconds[history.next] = zone.milliseconds;
+        history.next = (history.next + 1) % HISTORY_LENGTH;
+        history.count = std::min(history.count + 1, HISTORY_LENGTH);
+
+        sorted.assign(std::begin(history.milliseconds), std::begin(history.milliseconds) + history.count);
+        const auto p99 = std::begin(sorted) + std::ptrdiff_t(std::ceil(0.99 * double(sorted.size()))) - 1;
+        std::nth_element(std::begin(sorted), p99, std::end(sorted));
+        zone.p99Milliseconds = *p99;
+        zone.minMilliseconds = *std::min_element(std::begin(sorted), std::end(sorted));
+        zone.avgMilliseconds = std::accumulate(std::begin(sorted), std::end(sorted), 0.0f) / float(sorted.size());
+    }
+    if (m_frameTimeLog)
+        m_frameTimeLog->push_back(m_zones.front().milliseconds);
+    return true;
+}
+
+std::span<const GpuProfiler::ZoneTiming> GpuProfiler::zones() const
+{
+    return m_zones;
+}
+
+uint64_t GpuProfiler::numDroppedFrames() const
+{
+    return m_numDroppedFrames;
+}
+
+void GpuProfiler::setFrameTimeLog(std::vector<float>* log)
+{
+    m_frameTimeLog = log;
+}
+
+void GpuProfiler::drawFlameBar() const
+{
+    float frameMilliseconds = 0.0f;
+    int maxDepth = 0;
+    for (const ZoneTiming& zone : m_zones) {
+        frameMilliseconds = std::max(frameMilliseconds, zone.startMilliseconds + zone.milliseconds);
+        maxDepth = std::max(maxDepth, zone.depth);
+    }
+
+    const float rowHeight = ImGui::GetFrameHeight();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const ImVec2 size { std::max(ImGui::GetContentRegionAvail().x, 100.0f), rowHeight * float(maxDepth + 1) };
+    ImGui::InvisibleButton("flameBar", size);
+    if (frameMilliseconds <= 0.0f)
+        return;
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 mouse = ImGui::GetIO().MousePos;
+    const float scale = size.x / frameMilliseconds;
+    for (const ZoneTiming& zone : m_zones) {
+        const ImVec2 min { origin.x + zone.startMilliseconds * scale, origin.y + float(zone.depth) * rowHeight };
+        const ImVec2 max { std::max(min.x + 1.0f, min.x + zone.milliseconds * scale), min.y + rowHeight - 1.0f };
+
+        // Stable color per zone so the bars are easy to follow between frames.
+        const float hue = float(std::hash<std::string> {}(zone.path) % 360) / 360.0f;
+        float r, g, b;
+        ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.8f, r, g, b);
+        drawList->AddRectFilled(min, max, ImGui::GetColorU32(ImVec4(r, g, b, 1.0f)));
+        drawList->PushClipRect(min, max, true);
+        drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32_BLACK, zone.name.c_str());
+        drawList->PopClipRect();
+
+        if (ImGui::IsItemHovered() && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+            ImGui::SetTooltip("%s\nlast %.3f ms\nmin %.3f ms  avg %.3f ms  p99 %.3f ms", zone.path.c_str(),
+                double(zone.milliseconds), double(zone.minMilliseconds), double(zone.avgMilliseconds), double(zone.p99Milliseconds));
+        }
+    }
+}
+
+bool GpuProfiler::writeCsv(const std::filesystem::path& filePath) const
+{
+    std::ofstream file { filePath };
+    if (!file)
+        return false;
+
+    file << "zone,depth,start_ms,last_ms,min_ms,avg_ms,p99_ms\n";
+    for (const ZoneTiming& zone : m_zones) {
+        file << zone.path << ',' << zone.depth << ',' << zone.startMilliseconds << ',' << zone.milliseconds << ','
+             << zone.minMilliseconds << ',' << zone.avgMilliseconds << ',' << zone.p99Milliseconds << '\n';
+    }
+    return bool(file);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <framework/opengl_includes.h>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Scoped GPU profiler. Every zone records a GL_TIMESTAMP query at its start and end, so zones can be nested
+// (unlike GL_TIME_ELAPSED queries, of which only one can be active). The queries of a frame are read back a few
+// frames later, and only once the GPU has finished them, so the CPU never waits for the GPU. Frames whose queries
+// are still pending when their slot in the ring is needed again are dropped.
+//
+// Durations are kept per zone path (e.g. "frame/shadowCascade0/dynamic") over the last HISTORY_LENGTH frames and
+// summarized as min/avg/p99.
+class GpuProfiler {
+public:
+    static constexpr size_t NUM_QUERY_FRAMES = 4;
+    static constexpr size_t HISTORY_LENGTH = 240;
+
+    // Zone of the most recent frame that was read back, with statistics over the recent frames.
+    struct ZoneTiming {
+        std::string name;
+        std::string path;
+        int depth { 0 };
+        float startMilliseconds { 0.0f }; // Relative to the start of the first zone of the frame.
+        float milliseconds { 0.0f };
+        float minMilliseconds { 0.0f };
+        float avgMilliseconds { 0.0f };
+        float p99Milliseconds { 0.0f };
+    };
+
+    // Pushes a zone on construction and pops it on destruction.
+    class Scope {
+    public:
+        Scope(GpuProfiler& profiler, std::string_view name);
+        Scope(const Scope&) = delete;
+        ~Scope();
+
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        GpuProfiler& m_profiler;
+    };
+
+public:
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler&) = delete;
+    ~GpuProfiler();
+
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Read back the finished frames and start recording a new one.
+    void beginFrame();
+    void endFrame();
+
+    void pushZone(std::string_view name);
+    void popZone();
+    // Wait for the GPU and read back all pending frames.
+    void finish();
+    // Forget the frames that were read back so far (the min/avg/p99 only cover the frames after this call).
+    void clearHistory();
+
+    // Zones of the last frame that was read back, in the order in which they were started (parents before children).
+    [[nodiscard]] std::span<const ZoneTiming> zones() const;
+    // Number of frames that were dropped because their queries were not finished in time.
+    [[nodiscard]] uint64_t numDroppedFrames() const;
+    // Append the duration of the root zone of every frame that is read back to log (zones() only holds the last
+    // frame). Pass nullptr to stop logging.
+    void setFrameTimeLog(std::vector<float>* log);
+
+    // Horizontal flame bar of the last frame (one row per nesting level) with the statistics as tooltips.
+    void drawFlameBar() const;
+    // Write the statistics of all zones of the last frame as comma separated values.
+    bool writeCsv(const std::filesystem::path& filePath) const;
+
+    // Zones are ignored while the profiler is disabled.
+    bool enabled { true };
+
+private:
+    struct RecordedZone {
+        std::string path;
+        int depth { 0 };
+        uint32_t beginQuery { 0 };
+        uint32_t endQuery { 0 };
+    };
+    struct QueryFrame {
+        std::vector<GLuint> queries;
+        uint32_t numQueries { 0 };
+        std::vector<RecordedZone> zones;
+        bool pending { false };
+    };
+    struct History {
+        std::array<float, HISTORY_LENGTH> milliseconds {};
+        size_t count { 0 };
+        size_t next { 0 };
+    };
+
+    uint32_t recordTimestamp();
+    bool tryReadback(QueryFrame& frame);
+
+private:
+    std::array<QueryFrame, NUM_QUERY_FRAMES> m_queryFrames;
+    size_t m_queryFrame { 0 };
+    bool m_recording { false };
+    // Indices into the zones of the current frame of the zones that are open.
+    std::vector<size_t> m_openZones;
+
+    std::unordered_map<std::string, History> m_histories;
+    std::vector<ZoneTiming> m_zones;
+    uint64_t m_numDroppedFrames { 0 };
+    std::vector<float>* m_frameTimeLog { nullptr };
+};
@@ -0,0 +1,267 @@
+#include "light_clusters.h"
+#include <framework/cpu_profiler.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/job_system.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define LIGHT_CLUSTERS_SSE 1
+#endif
+
+// Below this many lights the assignment is cheaper than scheduling jobs.
+static constexpr size_t MIN_LIGHTS_FOR_JOBS = 64;
+
+static void createBufferTexture(GLuint& buffer, GLuint& texture, GLenum internalFormat)
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Replace the contents of a buffer texture (orphaning the old storage). Empty buffers keep a few bytes so the
+// texture stays complete.
+template <typename T>
+static void uploadBufferTexture(GLuint buffer, std::span<const T> data)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    const GLsizeiptr size = static_cast<GLsizeiptr>(data.size_bytes());
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, GLsizeiptr(16)), nullptr, GL_STREAM_DRAW);
+    if (size > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::LightClusters()
+{
+    createBufferTexture(m_lightBuffer, m_lightTexture, GL_RGBA32F);
+    createBufferTexture(m_clusterBuffer, m_clusterTexture, GL_RG32UI);
+    createBufferTexture(m_indexBuffer, m_indexTexture, GL_R32UI);
+    m_sliceBounds.resize(GRID_Z);
+    m_clusterRanges.resize(NUM_CLUSTERS, glm::uvec2(0));
+}
+
+LightClusters::~LightClusters()
+{
+    const GLuint textures[] = { m_lightTexture, m_clusterTexture, m_indexTexture };
+    const GLuint buffers[] = { m_lightBuffer, m_clusterBuffer, m_indexBuffer };
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::update(std::span<const ClusteredPointLight> lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float zNear, float zFar, JobSystem* jobSystem)
+{
+    CPU_PROFILE_ZONE("LightClusters::update");
+    const auto start = std::chrono::steady_clock::now();
+
+    if (projectionMatrix != m_boundsProjection || zNear != m_zNear || zFar != m_zFar)
+        computeClusterBounds(projectionMatrix, zNear, zFar);
+    m_viewMatrix = viewMatrix;
+
+    m_viewLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i)
+        m_viewLights[i] = { glm::vec3(viewMatrix * glm::vec4(lights[i].position, 1.0f)), lights[i].radius };
+
+    // Every depth slice writes only to its own clusters and index list, so slices can be processed in any order.
+    const auto assignSlices = [&](size_t beginSlice, size_t endSlice) {
+        CPU_PROFILE_ZONE("assignSlices");
+        for (size_t slice = beginSlice; slice < endSlice; ++slice)
+            assignSlice(slice);
+    };
+    if (jobSystem && lights.size() >= MIN_LIGHTS_FOR_JOBS)
+        jobSystem->parallelFor(0, GRID_Z, 1, assignSlices);
+    else
+        assignSlices(0, GRID_Z);
+
+    // Merge the per slice index lists.
+    m_lightIndices.clear();
+    m_maxLightsPerCluster = 0;
+    for (size_t slice = 0; slice < GRID_Z; ++slice) {
+        const uint32_t base = static_cast<uint32_t>(m_lightIndices.size());
+        for (size_t cluster = slice * CLUSTERS_PER_SLICE; cluster < (slice + 1) * CLUSTERS_PER_SLICE; ++cluster) {
+            m_clusterRanges[cluster].x += base;
+            m_maxLightsPerCluster = std::max(m_maxLightsPerCluster, size_t(m_clusterRanges[cluster].y));
+        }
+        m_lightIndices.insert(std::end(m_lightIndices), std::begin(m_sliceIndices[slice]), std::end(m_sliceIndices[slice]));
+    }
+    m_assignMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    upload(lights);
+}
+
+// The clusters of a depth slice are bounded by the four view rays through the corners of their screen tile, cut off at
+// the near and far depth of the slice. Slices are distributed exponentially so clusters are roughly cube shaped.
+void LightClusters::computeClusterBounds(const glm::mat4& projectionMatrix, float zNear, float zFar)
+{
+    m_boundsProjection = projectionMatrix;
+    m_zNear = zNear;
+    m_zFar = zFar;
+    const float logDepthRange = std::log(zFar / zNear);
+    m_depthScale = float(GRID_Z) / logDepthRange;
+    m_depthBias = float(GRID_Z) * std::log(zNear) / logDepthRange;
+
+    // Direction of the view ray through a point in normalized device coordinates, scaled to a depth of 1.
+    const glm::mat4 inverseProjection = glm::inverse(projectionMatrix);
+    const auto viewRay = [&](float x, float y) {
+        const glm::vec4 nearPoint = inverseProjection * glm::vec4(x, y, -1.0f, 1.0f);
+        const glm::vec3 point = glm::vec3(nearPoint) / nearPoint.w;
+        return point / -point.z;
+    };
+
+    for (size_t slice = 0; slice < GRID_Z; ++slice) {
+        SliceBounds& bounds = m_sliceBounds[slice];
+        bounds.nearDepth = zNear * std::pow(zFar / zNear, float(slice) / float(GRID_Z));
+        bounds.farDepth = zNear * std::pow(zFar / zNear, float(slice + 1) / float(GRID_Z));
+
+        for (size_t y = 0; y < GRID_Y; ++y) {
+            for (size_t x = 0; x < GRID_X; ++x) {
+                const float x0 = -1.0f + 2.0f * float(x) / float(GRID_X), x1 = -1.0f + 2.0f * float(x + 1) / float(GRID_X);
+                const float y0 = -1.0f + 2.0f * float(y) / float(GRID_Y), y1 = -1.0f + 2.0f * float(y + 1) / float(GRID_Y);
+                const glm::vec3 rays[] = { viewRay(x0, y0), viewRay(x1, y0), viewRay(x0, y1), viewRay(x1, y1) };
+
+                glm::vec3 boxMin { std::numeric_limits<float>::max() }, boxMax { std::numeric_limits<float>::lowest() };
+                for (const glm::vec3& ray : rays) {
+                    for (float depth : { bounds.nearDepth, bounds.farDepth }) {
+                        boxMin = glm::min(boxMin, ray * depth);
+                        boxMax = glm::max(boxMax, ray * depth);
+                    }
+                }
+
+                const size_t cluster = y * GRID_X + x;
+                bounds.minX[cluster] = boxMin.x;
+                bounds.minY[cluster] = boxMin.y;
+                bounds.minZ[cluster] = boxMin.z;
+                bounds.maxX[cluster] = boxMax.x;
+                bounds.maxY[cluster] = boxMax.y;
+                bounds.maxZ[cluster] = boxMax.z;
+            }
+        }
+    }
+}
+
+void LightClusters::assignSlice(size_t slice)
+{
+    const SliceBounds& bounds = m_sliceBounds[slice];
+    std::vector<glm::uvec2>& hits = m_sliceHits[slice];
+    hits.clear();
+
+    std::array<uint32_t, CLUSTERS_PER_SLICE> counts {};
+    for (uint32_t light = 0; light < m_viewLights.size(); ++light) {
+        const ViewLight& viewLight = m_viewLights[light];
+        const float depth = -viewLight.center.z;
+        if (depth + viewLight.radius < bounds.nearDepth || depth - viewLight.radius > bounds.farDepth)
+            continue;
+
+        // Sphere/box test: squared distance from the sphere center to the closest point of the box.
+#ifdef LIGHT_CLUSTERS_SSE
+        const __m128 centerX = _mm_set1_ps(viewLight.center.x);
+        const __m128 centerY = _mm_set1_ps(viewLight.center.y);
+        const __m128 centerZ = _mm_set1_ps(viewLight.center.z);
+        const __m128 radius2 = _mm_set1_ps(viewLight.radius * viewLight.radius);
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t cluster = 0; cluster < CLUSTERS_PER_SLICE; cluster += 4) {
+            const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(&bounds.minX[cluster]), centerX), _mm_sub_ps(centerX, _mm_load_ps(&bounds.maxX[cluster]))), zero);
+            const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(&bounds.minY[cluster]), centerY), _mm_sub_ps(centerY, _mm_load_ps(&bounds.maxY[cluster]))), zero);
+            const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(&bounds.minZ[cluster]), centerZ), _mm_sub_ps(centerZ, _mm_load_ps(&bounds.maxZ[cluster]))), zero);
+            const __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+            while (mask) {
+                const size_t clusterInSlice = cluster + static_cast<size_t>(std::countr_zero(static_cast<unsigned>(mask)));
+                mask &= mask - 1;
+                hits.emplace_back(static_cast<uint32_t>(clusterInSlice), light);
+                counts[clusterInSlice]++;
+            }
+        }
+#else
+        for (size_t cluster = 0; cluster < CLUSTERS_PER_SLICE; ++cluster) {
+            const float dx = std::max({ bounds.minX[cluster] - viewLight.center.x, viewLight.center.x - bounds.maxX[cluster], 0.0f });
+            const float dy = std::max({ bounds.minY[cluster] - viewLight.center.y, viewLight.center.y - bounds.maxY[cluster], 0.0f });
+            const float dz = std::max({ bounds.minZ[cluster] - viewLight.center.z, viewLight.center.z - bounds.maxZ[cluster], 0.0f });
+            if (dx * dx + dy * dy + dz * dz <= viewLight.radius * viewLight.radius) {
+                hits.emplace_back(static_cast<uint32_t>(cluster), light);
+                counts[cluster]++;
+            }
+        }
+#endif
+    }
+
+    // Counting sort of the hits by cluster.
+    glm::uvec2* ranges = &m_clusterRanges[slice * CLUSTERS_PER_SLICE];
+    uint32_t offset = 0;
+    for (size_t cluster = 0; cluster < CLUSTERS_PER_SLICE; ++cluster) {
+        ranges[cluster] = glm::uvec2(offset, 0);
+        offset += counts[cluster];
+    }
+    std::vector<uint32_t>& indices = m_sliceIndices[slice];
+    indices.resize(hits.size());
+    for (const glm::uvec2& hit : hits) {
+        glm::uvec2& range = ranges[hit.x];
+        indices[range.x + range.y++] = hit.y;
+    }
+}
+
+void LightClusters::upload(std::span<const ClusteredPointLight> lights)
+{
+    m_lightData.resize(2 * lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        m_lightData[2 * i + 0] = glm::vec4(lights[i].position, lights[i].radius);
+        m_lightData[2 * i + 1] = glm::vec4(lights[i].color, float(lights[i].shadowIndex));
+    }
+    uploadBufferTexture<glm::vec4>(m_lightBuffer, m_lightData);
+    uploadBufferTexture<glm::uvec2>(m_clusterBuffer, m_clusterRanges);
+    uploadBufferTexture<uint32_t>(m_indexBuffer, m_lightIndices);
+}
+
+void LightClusters::bind(const Shader& shader, const glm::ivec2& viewportSize) const
+{
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_BUFFER, m_clusterTexture);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_BUFFER, m_indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(shader.getUniformLocation("clusterLightData"), 7);
+    glUniform1i(shader.getUniformLocation("clusterData"), 8);
+    glUniform1i(shader.getUniformLocation("clusterLightIndices"), 9);
+    glUniformMatrix4fv(shader.getUniformLocation("clusterViewMatrix"), 1, GL_FALSE, glm::value_ptr(m_viewMatrix));
+    glUniform3i(shader.getUniformLocation("clusterGridSize"), GLint(GRID_X), GLint(GRID_Y), GLint(GRID_Z));
+    glUniform2f(shader.getUniformLocation("clusterTileScale"), float(GRID_X) / float(viewportSize.x), float(GRID_Y) / float(viewportSize.y));
+    glUniform2f(shader.getUniformLocation("clusterDepthScaleBias"), m_depthScale, m_depthBias);
+}
+
+size_t LightClusters::numLights() const
+{
+    return m_viewLights.size();
+}
+
+size_t LightClusters::numLightIndices() const
+{
+    return m_lightIndices.size();
+}
+
+size_t LightClusters::maxLightsPerCluster() const
+{
+    return m_maxLightsPerCluster;
+}
+
+float LightClusters::assignMilliseconds() const
+{
+    return m_assignMilliseconds;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <framework/shader.h>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// Point light with a finite range; it has no effect beyond its radius.
+struct ClusteredPointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    // Identifies the light across frames, so that the PointShadowAtlas can keep its shadow maps when lights before it
+    // in the list are added or removed.
+    uint32_t id { 0 };
+    // Index of the light's shadow maps in the PointShadowAtlas, or -1 if it has none.
+    int shadowIndex { -1 };
+};
+
+// Clustered forward lighting (Olsson et al.): the view frustum is divided into a grid of screen tiles and exponential
+// depth slices. Every frame the lights are assigned to the clusters they overlap on the CPU (SSE sphere/box tests, one
+// depth slice per job of the job system). The result is uploaded to three buffer textures that are read by
+// shaders/clustered_lights_frag.glsl:
+//  - light data: two RGBA32F texels per light (position + radius, color + shadow index),
+//  - cluster data: one RG32UI texel per cluster (offset into the index list, number of lights),
+//  - light indices: one R32UI texel per (cluster, light) pair.
+class LightClusters {
+public:
+    static constexpr size_t GRID_X = 16;
+    static constexpr size_t GRID_Y = 16;
+    static constexpr size_t GRID_Z = 24;
+    static constexpr size_t NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+    static constexpr size_t CLUSTERS_PER_SLICE = GRID_X * GRID_Y;
+
+    LightClusters();
+    LightClusters(const LightClusters&) = delete;
+    ~LightClusters();
+
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Assign the lights to the clusters of the given camera and upload the result to the GPU. The depth slices are
+    // split over the job system if there are enough lights.
+    void update(std::span<const ClusteredPointLight> lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float zNear, float zFar, JobSystem* jobSystem = nullptr);
+    // Bind the cluster buffers to texture units 7, 8 and 9 and set the uniforms of clustered_lights_frag.glsl.
+    void bind(const Shader& shader, const glm::ivec2& viewportSize) const;
+
+    [[nodiscard]] size_t numLights() const;
+    [[nodiscard]] size_t numLightIndices() const;
+    [[nodiscard]] size_t maxLightsPerCluster() const;
+    // CPU time of the last light assignment (excluding the upload).
+    [[nodiscard]] float assignMilliseconds() const;
+
+private:
+    // View space bounding boxes of the clusters of one depth slice, stored as structure of arrays for SIMD.
+    struct SliceBounds {
+        alignas(16) std::array<float, CLUSTERS_PER_SLICE> minX, minY, minZ;
+        alignas(16) std::array<float, CLUSTERS_PER_SLICE> maxX, maxY, maxZ;
+        float nearDepth, farDepth;
+    };
+    // Light in view space.
+    struct ViewLight {
+        glm::vec3 center;
+        float radius;
+    };
+
+    void computeClusterBounds(const glm::mat4& projectionMatrix, float zNear, float zFar);
+    void assignSlice(size_t slice);
+    void upload(std::span<const ClusteredPointLight> lights);
+
+private:
+    std::vector<SliceBounds> m_sliceBounds;
+    glm::mat4 m_boundsProjection { 0.0f };
+    float m_zNear { 0.0f }, m_zFar { 0.0f };
+    float m_depthScale { 0.0f }, m_depthBias { 0.0f };
+
+    std::vector<ViewLight> m_viewLights;
+    // Per cluster (offset, count); the offset is relative to the slice until all slices are merged.
+    std::vector<glm::uvec2> m_clusterRanges;
+    std::array<std::vector<uint32_t>, GRID_Z> m_sliceIndices;
+    std::array<std::vector<glm::uvec2>, GRID_Z> m_sliceHits; // (cluster within the slice, light) pairs.
+    std::vector<uint32_t> m_lightIndices;
+    std::vector<glm::vec4> m_lightData;
+
+    size_t m_maxLightsPerCluster { 0 };
+    float m_assignMilliseconds { 0.0f };
+    glm::mat4 m_viewMatrix { 1.0f };
+
+    GLuint m_lightBuffer { 0 }, m_lightTexture { 0 };
+    GLuint m_clusterBuffer { 0 }, m_clusterTexture { 0 };
+    GLuint m_indexBuffer { 0 }, m_indexTexture { 0 };
+};
@@ -1,8 +1,11 @@
 #include "mesh.h"
+#include "draw_stats.h"
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
+#include <glm/gtc/matrix_inverse.hpp>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -67,6 +70,32 @@ GPUMesh::GPUMesh(const Mesh& cpuMesh)
     glVertexAttribDivisor(2, 0);
     glVertexAttribDivisor(3, 0);
 
+    // Separate position-only stream for depth-only passes; it shares the index buffer but only fetches 12 bytes per vertex.
+    std::vector<glm::vec3> positions(cpuMesh.vertices.size());
+    std::transform(std::begin(cpuMesh.vertices), std::end(cpuMesh.vertices), std::begin(positions), [](const Vertex& vertex) { return vertex.position; });
+
+    // Bounding sphere around the center of the bounding box (not minimal, but good enough for culling).
+    if (!positions.empty()) {
+        glm::vec3 boxMin = positions.front(), boxMax = positions.front();
+        for (const glm::vec3& position : positions) {
+            boxMin = glm::min(boxMin, position);
+            boxMax = glm::max(boxMax, position);
+        }
+        m_boundingSphereCenter = 0.5f * (boxMin + boxMax);
+        for (const glm::vec3& position : positions)
+            m_boundingSphereRadius = std::max(m_boundingSphereRadius, glm::distance(m_boundingSphereCenter, position));
+    }
+
+    glGenVertexArrays(1, &m_positionVao);
+    glBindVertexArray(m_positionVao);
+    glGenBuffers(1, &m_positionVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(positions.size() * sizeof(glm::vec3)), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+    glBindVertexArray(0);
+
     // Each triangle has 3 vertices.
     m_numIndices = static_cast<GLsizei>(3 * cpuMesh.triangles.size());
 }
@@ -88,13 +117,20 @@ GPUMesh& GPUMesh::operator=(GPUMesh&& other)
 }
 
 std::vector<GPUMesh> GPUMesh::loadMeshGPU(std::filesystem::path filePath, bool normalize) {
+    return upload(loadMeshCPU(std::move(filePath), normalize));
+}
+
+std::vector<Mesh> GPUMesh::loadMeshCPU(std::filesystem::path filePath, bool normalize, JobSystem* jobSystem) {
     if (!std::filesystem::exists(filePath))
         throw MeshLoadingException(fmt::format("File {} does not exist", filePath.string().c_str()));
 
+    return loadMesh(filePath, { .normalizeVertexPositions = normalize, .jobSystem = jobSystem });
+}
+
+std::vector<GPUMesh> GPUMesh::upload(std::span<const Mesh> cpuMeshes) {
     // Generate GPU-side meshes for all sub-meshes
-    std::vector<Mesh> subMeshes = loadMesh(filePath, { .normalizeVertexPositions = normalize });
     std::vector<GPUMesh> gpuMeshes;
-    for (const Mesh& mesh : subMeshes) { gpuMeshes.emplace_back(mesh); }
+    for (const Mesh& mesh : cpuMeshes) { gpuMeshes.emplace_back(mesh); }
 
     return gpuMeshes;
 }
@@ -104,6 +140,16 @@ bool GPUMesh::hasTextureCoords() const
     return m_hasTextureCoords;
 }
 
+glm::vec3 GPUMesh::boundingSphereCenter() const
+{
+    return m_boundingSphereCenter;
+}
+
+float GPUMesh::boundingSphereRadius() const
+{
+    return m_boundingSphereRadius;
+}
+
 void GPUMesh::draw(const Shader& drawingShader)
 {
     // Bind material data uniform (we assume that the uniform buffer objects is always called 'Material')
@@ -113,6 +159,54 @@ void GPUMesh::draw(const Shader& drawingShader)
     // Draw the mesh's triangles
     glBindVertexArray(m_vao);
     glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, nullptr);
+    countDrawCall(static_cast<uint64_t>(m_numIndices / 3));
+}
+
+void GPUMesh::drawInstanced(const Shader& drawingShader, std::span<const glm::mat4> modelMatrices)
+{
+    if (modelMatrices.empty())
+        return;
+
+    glBindVertexArray(m_vao);
+    if (m_instanceVbo == INVALID) {
+        // Per-instance attributes: model matrix (locations 4-7) and normal matrix (locations 8-10).
+        // Matrices are passed as one vec4/vec3 attribute per column.
+        glGenBuffers(1, &m_instanceVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+        for (GLuint column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(4 + column);
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(4 + column, 1);
+        }
+        for (GLuint column = 0; column < 3; ++column) {
+            glEnableVertexAttribArray(8 + column);
+            glVertexAttribPointer(8 + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, normalModelMatrix) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(8 + column, 1);
+        }
+    }
+
+    m_instanceData.resize(modelMatrices.size());
+    for (size_t i = 0; i < modelMatrices.size(); ++i) {
+        m_instanceData[i].modelMatrix = modelMatrices[i];
+        m_instanceData[i].normalModelMatrix = glm::inverseTranspose(glm::mat3(modelMatrices[i]));
+    }
+
+    // Orphan the previous buffer storage so we never wait for draws that still read it.
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    m_instanceCapacity = std::max(m_instanceCapacity, m_instanceData.size());
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_instanceCapacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(m_instanceData.size() * sizeof(InstanceData)), m_instanceData.data());
+
+    drawingShader.bindUniformBlock("Material", 0, m_uboMaterial);
+    glDrawElementsInstanced(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(modelMatrices.size()));
+    countDrawCall(static_cast<uint64_t>(m_numIndices / 3), modelMatrices.size());
+}
+
+void GPUMesh::drawPositionsOnly()
+{
+    glBindVertexArray(m_positionVao);
+    glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, nullptr);
+    countDrawCall(static_cast<uint64_t>(m_numIndices / 3));
 }
 
 // Update the GPU material UBO with new material values (replaces buffer data)
@@ -131,17 +225,28 @@ void GPUMesh::moveInto(GPUMesh&& other)
     freeGpuMemory();
     m_numIndices = other.m_numIndices;
     m_hasTextureCoords = other.m_hasTextureCoords;
+    m_boundingSphereCenter = other.m_boundingSphereCenter;
+    m_boundingSphereRadius = other.m_boundingSphereRadius;
     m_ibo = other.m_ibo;
     m_vbo = other.m_vbo;
     m_vao = other.m_vao;
+    m_positionVbo = other.m_positionVbo;
+    m_positionVao = other.m_positionVao;
     m_uboMaterial = other.m_uboMaterial;
+    m_instanceVbo = other.m_instanceVbo;
+    m_instanceCapacity = other.m_instanceCapacity;
+    m_instanceData = std::move(other.m_instanceData);
 
     other.m_numIndices = 0;
     other.m_hasTextureCoords = other.m_hasTextureCoords;
     other.m_ibo = INVALID;
     other.m_vbo = INVALID;
     other.m_vao = INVALID;
+    other.m_positionVbo = INVALID;
+    other.m_positionVao = INVALID;
     other.m_uboMaterial = INVALID;
+    other.m_instanceVbo = INVALID;
+    other.m_instanceCapacity = 0;
 }
 
 void GPUMesh::freeGpuMemory()
@@ -152,6 +257,12 @@ void GPUMesh::freeGpuMemory()
         glDeleteBuffers(1, &m_vbo);
     if (m_ibo != INVALID)
         glDeleteBuffers(1, &m_ibo);
+    if (m_positionVao != INVALID)
+        glDeleteVertexArrays(1, &m_positionVao);
+    if (m_positionVbo != INVALID)
+        glDeleteBuffers(1, &m_positionVbo);
     if (m_uboMaterial != INVALID)
         glDeleteBuffers(1, &m_uboMaterial);
+    if (m_instanceVbo != INVALID)
+        glDeleteBuffers(1, &m_instanceVbo);
 }
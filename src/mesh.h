@@ -4,11 +4,14 @@
 #include <framework/mesh.h>
 #include <framework/shader.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 
 #include <exception>
 #include <filesystem>
+#include <span>
 #include <framework/opengl_includes.h>
 
 struct MeshLoadingException : public std::runtime_error {
@@ -37,15 +40,27 @@ public:
     // Generate a number of GPU meshes from a particular model file.
     // Multiple meshes may be generated if there are multiple sub-meshes in the file
     static std::vector<GPUMesh> loadMeshGPU(std::filesystem::path filePath, bool normalize = false);
+    // The two halves of loadMeshGPU(): parsing the file does not need OpenGL and may run on any thread (and compute
+    // the tangents of the sub-meshes on the job system), the upload has to run on the OpenGL thread.
+    static std::vector<Mesh> loadMeshCPU(std::filesystem::path filePath, bool normalize = false, JobSystem* jobSystem = nullptr);
+    static std::vector<GPUMesh> upload(std::span<const Mesh> cpuMeshes);
 
     // Cannot copy a GPU mesh because it would require reference counting of GPU resources.
     GPUMesh& operator=(const GPUMesh&) = delete;
     GPUMesh& operator=(GPUMesh&&);
 
     bool hasTextureCoords() const;
+    // Bounding sphere of the vertex positions in model space.
+    glm::vec3 boundingSphereCenter() const;
+    float boundingSphereRadius() const;
 
     // Bind VAO and call glDrawElements.
     void draw(const Shader& drawingShader);
+    // Draw one instance of the mesh per model matrix with a single glDrawElementsInstanced call.
+    // The model and normal matrices are streamed into an instance buffer (vertex attributes 4-7 and 8-10).
+    void drawInstanced(const Shader& drawingShader, std::span<const glm::mat4> modelMatrices);
+    // Draw only the vertex positions (location = 0) from a tightly packed stream, for depth-only passes.
+    void drawPositionsOnly();
 
     // Update the GPU material buffer with new values
     void updateMaterialBuffer(const GPUMaterial &gpuMaterial);
@@ -57,10 +72,22 @@ private:
 private:
     static constexpr GLuint INVALID = 0xFFFFFFFF;
 
+    struct InstanceData {
+        glm::mat4 modelMatrix;
+        glm::mat3 normalModelMatrix;
+    };
+
     GLsizei m_numIndices { 0 };
     bool m_hasTextureCoords { false };
+    glm::vec3 m_boundingSphereCenter { 0.0f };
+    float m_boundingSphereRadius { 0.0f };
     GLuint m_ibo { INVALID };
     GLuint m_vbo { INVALID };
     GLuint m_vao { INVALID };
+    GLuint m_positionVbo { INVALID };
+    GLuint m_positionVao { INVALID };
     GLuint m_uboMaterial { INVALID };
+    GLuint m_instanceVbo { INVALID };
+    size_t m_instanceCapacity { 0 };
+    std::vector<InstanceData> m_instanceData;
 };
@@ -0,0 +1,196 @@
+#include "ocean.h"
+#include "particles.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/packing.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/job_system.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+static constexpr float GRAVITY = 9.81f;
+// Waves that run against the wind keep this fraction of their energy.
+static constexpr float OPPOSING_WAVE_DAMPING = 0.07f;
+// Fixed point iterations that invert the horizontal displacement when sampling.
+static constexpr int DISPLACEMENT_ITERATIONS = 3;
+// Rows per job for the spectrum and the texel conversion.
+static constexpr size_t ROW_GRAIN_SIZE = 16;
+
+Ocean::Ocean(const OceanSettings& settings)
+    : m_settings(settings)
+    , m_resolution(size_t(settings.resolution))
+    , m_fft(size_t(settings.resolution))
+{
+    const size_t n = m_resolution;
+    const size_t numWaves = n * n;
+    m_waveX.resize(numWaves);
+    m_waveZ.resize(numWaves);
+    m_inverseWaveLength.resize(numWaves);
+    m_omega.resize(numWaves);
+    m_amplitude.resize(numWaves);
+    m_oppositeAmplitude.resize(numWaves);
+    for (auto& grid : m_grids)
+        grid.assign(numWaves, {});
+
+    // Phillips spectrum: P(k) = exp(-1 / (k L)^2) / k^4 * |k^ . w^|^2 with L = V^2 / g. Waves shorter than a texel
+    // are suppressed by exp(-k^2 l^2), since the heightfield cannot represent them.
+    const float pi = std::numbers::pi_v<float>;
+    const float largestWave = settings.windSpeed * settings.windSpeed / GRAVITY;
+    const float texelSize = settings.patchSize / float(n);
+    const float windAngle = settings.windDirection * pi / 180.0f;
+    const float windX = std::cos(windAngle), windZ = std::sin(windAngle);
+    Xoshiro128Plus random { settings.seed };
+    double variance = 0.0;
+    for (size_t row = 0; row < n; ++row) {
+        for (size_t column = 0; column < n; ++column) {
+            const size_t i = row * n + column;
+            // Frequencies above the Nyquist frequency are the negative ones.
+            const float waveX = 2.0f * pi * (float(column) - (column < n / 2 ? 0.0f : float(n))) / settings.patchSize;
+            const float waveZ = 2.0f * pi * (float(row) - (row < n / 2 ? 0.0f : float(n))) / settings.patchSize;
+            const float length = std::sqrt(waveX * waveX + waveZ * waveZ);
+            m_waveX[i] = waveX;
+            m_waveZ[i] = waveZ;
+            m_inverseWaveLength[i] = length > 0.0f ? 1.0f / length : 0.0f;
+            m_omega[i] = std::sqrt(GRAVITY * length);
+
+            // Two normally distributed numbers (Box-Muller).
+            const float radius = std::sqrt(-2.0f * std::log(1.0f - random.nextFloat()));
+            const float angle = 2.0f * pi * random.nextFloat();
+            // The constant term and the Nyquist frequencies (which have no opposite wave) stay zero.
+            if (length == 0.0f || row == n / 2 || column == n / 2)
+                continue;
+            const float alignment = (waveX * windX + waveZ * windZ) / length;
+            float spectrum = std::exp(-1.0f / (length * length * largestWave * largestWave)) / (length * length * length * length) * alignment * alignment;
+            spectrum *= std::exp(-length * length * texelSize * texelSize);
+            if (alignment < 0.0f)
+                spectrum *= OPPOSING_WAVE_DAMPING;
+            m_amplitude[i] = std::complex<float>(radius * std::cos(angle), radius * std::sin(angle)) * std::sqrt(spectrum * 0.5f);
+            variance += 2.0 * double(std::norm(m_amplitude[i]));
+        }
+    }
+
+    // Scale to the requested root mean square height; the variance of the height over space and time is the sum of
+    // |h0(k)|^2 + |h0(-k)|^2.
+    const float scale = variance > 0.0 ? settings.waveHeight / float(std::sqrt(variance)) : 0.0f;
+    for (auto& amplitude : m_amplitude)
+        amplitude *= scale;
+    for (size_t row = 0; row < n; ++row) {
+        for (size_t column = 0; column < n; ++column)
+            m_oppositeAmplitude[row * n + column] = std::conj(m_amplitude[((n - row) % n) * n + (n - column) % n]);
+    }
+}
+
+const OceanSettings& Ocean::settings() const
+{
+    return m_settings;
+}
+
+void Ocean::update(float time, JobSystem* jobSystem)
+{
+    if (jobSystem)
+        jobSystem->parallelFor(0, m_resolution, ROW_GRAIN_SIZE, [&](size_t begin, size_t end) { computeSpectra(begin, end, time); });
+    else
+        computeSpectra(0, m_resolution, time);
+    for (auto& grid : m_grids)
+        m_fft.inverse2D(grid, jobSystem);
+}
+
+void Ocean::computeSpectra(size_t beginRow, size_t endRow, float time)
+{
+    // Written out on real and imaginary parts like FFT::transform(). Two fields A and B (whose spectra are Hermitian,
+    // as the fields are real) are packed as A + iB.
+    const float choppiness = m_settings.choppiness;
+    for (size_t index = beginRow * m_resolution; index < endRow * m_resolution; ++index) {
+        // h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t), whose time derivative is i w times the difference.
+        const float omega = m_omega[index];
+        const float cosine = std::cos(omega * time), sine = std::sin(omega * time);
+        const std::complex<float> amplitude = m_amplitude[index], opposite = m_oppositeAmplitude[index];
+        const float forwardReal = amplitude.real() * cosine - amplitude.imag() * sine;
+        const float forwardImaginary = amplitude.real() * sine + amplitude.imag() * cosine;
+        const float backwardReal = opposite.real() * cosine + opposite.imag() * sine;
+        const float backwardImaginary = opposite.imag() * cosine - opposite.real() * sine;
+        const float hr = forwardReal + backwardReal, hi = forwardImaginary + backwardImaginary;
+        const float dr = forwardReal - backwardReal, di = forwardImaginary - backwardImaginary;
+        // Height + i * (i w (forward - backward)).
+        m_grids[HeightVelocity][index] = { hr - omega * dr, hi - omega * di };
+
+        // The displacement is -i k/|k| h (times the choppiness) and a derivative along x multiplies by i kx.
+        const float kx = m_waveX[index], kz = m_waveZ[index];
+        const float scale = choppiness * m_inverseWaveLength[index];
+        m_grids[DisplacementXZ][index] = { scale * (kx * hi + kz * hr), scale * (kz * hi - kx * hr) };
+        m_grids[SlopeXZ][index] = { -kx * hi - kz * hr, kx * hr - kz * hi };
+        m_grids[DisplacementDerivativesXXZZ][index] = { scale * (kx * kx * hr - kz * kz * hi), scale * (kx * kx * hi + kz * kz * hr) };
+        m_grids[DisplacementDerivativeXZ][index] = { scale * kx * kz * hr, scale * kx * kz * hi };
+    }
+}
+
+std::complex<float> Ocean::interpolate(Grid grid, float u, float v) const
+{
+    const float floorU = std::floor(u), floorV = std::floor(v);
+    const float fractionU = u - floorU, fractionV = v - floorV;
+    // The resolution is a power of two, so the wrap around is a mask (which also works for negative coordinates).
+    const size_t mask = m_resolution - 1;
+    const size_t column0 = size_t(int64_t(floorU)) & mask, column1 = (column0 + 1) & mask;
+    const size_t row0 = size_t(int64_t(floorV)) & mask, row1 = (row0 + 1) & mask;
+    const std::vector<std::complex<float>>& values = m_grids[grid];
+    const std::complex<float> top = values[row0 * m_resolution + column0] * (1.0f - fractionU) + values[row0 * m_resolution + column1] * fractionU;
+    const std::complex<float> bottom = values[row1 * m_resolution + column0] * (1.0f - fractionU) + values[row1 * m_resolution + column1] * fractionU;
+    return top * (1.0f - fractionV) + bottom * fractionV;
+}
+
+void Ocean::sample(std::span<const float> x, std::span<const float> z, const WaterSurfaceSamples& samples) const
+{
+    assert(z.size() == x.size());
+    const float texelsPerMeter = float(m_resolution) / m_settings.patchSize;
+    for (size_t point = 0; point < x.size(); ++point) {
+        // Find the undisplaced position that the displacement moves to the query point.
+        const float u = x[point] * texelsPerMeter, v = z[point] * texelsPerMeter;
+        float sourceU = u, sourceV = v;
+        for (int iteration = 0; iteration < DISPLACEMENT_ITERATIONS; ++iteration) {
+            const std::complex<float> displacement = interpolate(DisplacementXZ, sourceU, sourceV);
+            sourceU = u - displacement.real() * texelsPerMeter;
+            sourceV = v - displacement.imag() * texelsPerMeter;
+        }
+
+        const std::complex<float> heightVelocity = interpolate(HeightVelocity, sourceU, sourceV);
+        if (!samples.height.empty())
+            samples.height[point] = heightVelocity.real();
+        if (!samples.velocity.empty())
+            samples.velocity[point] = heightVelocity.imag();
+        if (!samples.normalX.empty()) {
+            const std::complex<float> slope = interpolate(SlopeXZ, sourceU, sourceV);
+            const float inverseLength = 1.0f / std::sqrt(slope.real() * slope.real() + 1.0f + slope.imag() * slope.imag());
+            samples.normalX[point] = -slope.real() * inverseLength;
+            samples.normalY[point] = inverseLength;
+            samples.normalZ[point] = -slope.imag() * inverseLength;
+        }
+    }
+}
+
+void Ocean::writeTexels(OceanTexels& texels, JobSystem* jobSystem) const
+{
+    const size_t numTexels = m_resolution * m_resolution;
+    texels.resolution = m_settings.resolution;
+    texels.patchSize = m_settings.patchSize;
+    texels.displacement.resize(numTexels);
+    texels.slopes.resize(numTexels);
+    const auto convert = [&](size_t beginRow, size_t endRow) {
+        for (size_t i = beginRow * m_resolution; i < endRow * m_resolution; ++i) {
+            const std::complex<float> heightVelocity = m_grids[HeightVelocity][i];
+            const std::complex<float> displacement = m_grids[DisplacementXZ][i];
+            const std::complex<float> slope = m_grids[SlopeXZ][i];
+            const std::complex<float> derivatives = m_grids[DisplacementDerivativesXXZZ][i];
+            const float derivativeXZ = m_grids[DisplacementDerivativeXZ][i].real();
+            const float jacobian = (1.0f + derivatives.real()) * (1.0f + derivatives.imag()) - derivativeXZ * derivativeXZ;
+            texels.displacement[i] = glm::packHalf4x16(glm::vec4(displacement.real(), heightVelocity.real(), displacement.imag(), 0.0f));
+            texels.slopes[i] = glm::packHalf4x16(glm::vec4(slope.real(), slope.imag(), jacobian, 0.0f));
+        }
+    };
+    if (jobSystem)
+        jobSystem->parallelFor(0, m_resolution, ROW_GRAIN_SIZE, convert);
+    else
+        convert(0, m_resolution);
+}
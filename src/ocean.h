@@ -0,0 +1,91 @@
+#pragma once
+#include "water.h"
+#include <framework/fft.h>
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+struct OceanSettings {
+    // Texels along each side of the heightfield; a power of two.
+    int resolution { 256 };
+    // World space size (m) of the square patch that the heightfield tiles.
+    float patchSize { 8.0f };
+    // Root mean square of the height (m); the spectrum is scaled to it.
+    float waveHeight { 0.03f };
+    // The longest waves are about windSpeed^2 / g long.
+    float windSpeed { 3.0f };
+    // Direction that the wind blows to, in degrees around the y axis (0 is +x).
+    float windDirection { 30.0f };
+    // Scale of the horizontal displacement, which sharpens the crests; 0 only moves the surface vertically.
+    float choppiness { 1.0f };
+    uint64_t seed { 1 };
+
+    bool operator==(const OceanSettings&) const = default;
+};
+
+// Half float RGBA texels of the ocean heightfield, ready to be uploaded by OceanTextures.
+struct OceanTexels {
+    int resolution { 0 };
+    float patchSize { 0.0f };
+    // Displacement along x, y (the height) and z; alpha is unused.
+    std::vector<uint64_t> displacement;
+    // Slopes of the height along x and z and the Jacobian determinant of the horizontal displacement, which drops
+    // below 1 where the surface is squeezed together (that is where the foam is); alpha is unused.
+    std::vector<uint64_t> slopes;
+};
+
+// Statistical ocean surface of Tessendorf ("Simulating Ocean Water"). The initial amplitudes are drawn from a Phillips
+// spectrum once; every update() advances their phases to the given time with the deep water dispersion relation and
+// transforms the spectra of the height and its time derivative, the choppy horizontal displacement, the slopes and
+// the derivatives of the displacement (for the Jacobian) to the heightfield with five inverse 2D FFTs. Every FFT
+// transforms two real fields at once, as the real and imaginary part of one complex field.
+//
+// The heightfield is in world space units and tiles the x/z plane with a period of the patch size.
+class Ocean {
+public:
+    explicit Ocean(const OceanSettings& settings = {});
+
+    [[nodiscard]] const OceanSettings& settings() const;
+
+    // Compute the heightfield at time (s); the spectrum and the FFTs are split over the job system.
+    void update(float time, JobSystem* jobSystem = nullptr);
+
+    // Bilinearly sample the heightfield at the world space x/z of the query points. The horizontal displacement is
+    // inverted by fixed point iteration, so the height is that of the displaced surface point above the query point.
+    // Heights are relative to the undisplaced plane, and normals and velocities are those of a horizontal plane.
+    void sample(std::span<const float> x, std::span<const float> z, const WaterSurfaceSamples& samples) const;
+
+    // Convert the heightfield to half floats (split over the job system), reusing the memory of texels.
+    void writeTexels(OceanTexels& texels, JobSystem* jobSystem = nullptr) const;
+
+private:
+    // Field pairs that are transformed together: (real part, imaginary part).
+    enum Grid {
+        HeightVelocity,
+        DisplacementXZ,
+        SlopeXZ,
+        DisplacementDerivativesXXZZ,
+        DisplacementDerivativeXZ,
+        NumGrids
+    };
+
+    void computeSpectra(size_t beginRow, size_t endRow, float time);
+    // Bilinear interpolation of a grid at texel coordinates (which wrap around).
+    [[nodiscard]] std::complex<float> interpolate(Grid grid, float u, float v) const;
+
+private:
+    OceanSettings m_settings;
+    size_t m_resolution;
+    FFT m_fft;
+
+    // Per wave vector: its components, the inverse of its length (0 for the constant term), the angular frequency,
+    // the initial amplitude h0(k) and conj(h0(-k)).
+    std::vector<float> m_waveX, m_waveZ, m_inverseWaveLength, m_omega;
+    std::vector<std::complex<float>> m_amplitude, m_oppositeAmplitude;
+
+    std::array<std::vector<std::complex<float>>, NumGrids> m_grids;
+};
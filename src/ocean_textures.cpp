@@ -0,0 +1,106 @@
+#include "ocean_textures.h"
+#include "ocean.h"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+// Longest wait for a pixel buffer to become free (ns).
+static constexpr GLuint64 FENCE_TIMEOUT = 1'000'000'000;
+
+OceanTextures::OceanTextures(int resolution)
+    : m_resolution(resolution)
+{
+    const GLsizeiptr textureBytes = GLsizeiptr(resolution) * resolution * GLsizeiptr(sizeof(uint64_t));
+    glGenBuffers(GLsizei(RING_SIZE), m_buffers.data());
+    for (GLuint buffer : m_buffers) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, 2 * textureBytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for (GLuint* texture : { &m_displacementTexture, &m_slopeTexture }) {
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D, *texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, resolution, resolution, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+OceanTextures::~OceanTextures()
+{
+    for (GLsync fence : m_fences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    glDeleteTextures(1, &m_slopeTexture);
+    glDeleteTextures(1, &m_displacementTexture);
+    glDeleteBuffers(GLsizei(RING_SIZE), m_buffers.data());
+}
+
+int OceanTextures::resolution() const
+{
+    return m_resolution;
+}
+
+float OceanTextures::patchSize() const
+{
+    return m_patchSize;
+}
+
+bool OceanTextures::hasData() const
+{
+    return m_hasData;
+}
+
+void OceanTextures::upload(const OceanTexels& texels)
+{
+    assert(texels.resolution == m_resolution);
+    const size_t textureBytes = texels.displacement.size() * sizeof(uint64_t);
+    GLsync& fence = m_fences[m_nextBuffer];
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // The fence guarantees that the buffer is no longer read, so mapping it does not have to synchronize.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[m_nextBuffer]);
+    auto* mapped = static_cast<std::byte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(2 * textureBytes),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (mapped) {
+        std::memcpy(mapped, texels.displacement.data(), textureBytes);
+        std::memcpy(mapped + textureBytes, texels.slopes.data(), textureBytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // With a pixel unpack buffer bound, the data pointer is an offset into it.
+        glBindTexture(GL_TEXTURE_2D, m_displacementTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_resolution, m_resolution, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, m_slopeTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_resolution, m_resolution, GL_RGBA, GL_HALF_FLOAT, reinterpret_cast<const void*>(textureBytes));
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_patchSize = texels.patchSize;
+        m_hasData = true;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_nextBuffer = (m_nextBuffer + 1) % RING_SIZE;
+}
+
+void OceanTextures::bind(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0 + DISPLACEMENT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_displacementTexture);
+    glActiveTexture(GL_TEXTURE0 + SLOPE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_slopeTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(shader.getUniformLocation("oceanDisplacement"), DISPLACEMENT_TEXTURE_UNIT);
+    glUniform1i(shader.getUniformLocation("oceanSlopes"), SLOPE_TEXTURE_UNIT);
+    glUniform1f(shader.getUniformLocation("oceanPatchSize"), m_patchSize);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <framework/opengl_includes.h>
+#include <framework/shader.h>
+#include <array>
+#include <cstddef>
+
+struct OceanTexels;
+
+// The heightfield of an Ocean on the GPU: two mipmapped RGBA16F textures with the layout of OceanTexels that repeat
+// over the water. Uploads go through a ring of pixel unpack buffers: the texels are copied into the next buffer and
+// the textures are filled from it, so the driver can copy asynchronously while the CPU continues. A fence per buffer
+// makes the CPU wait (rarely, with three buffers) before it overwrites a buffer whose copy is still pending.
+class OceanTextures {
+public:
+    static constexpr size_t RING_SIZE = 3;
+    // Texture units of the displacement (read by water_vert.glsl) and the slopes (read by water_frag.glsl).
+    static constexpr GLint DISPLACEMENT_TEXTURE_UNIT = 13;
+    static constexpr GLint SLOPE_TEXTURE_UNIT = 14;
+
+    explicit OceanTextures(int resolution);
+    OceanTextures(const OceanTextures&) = delete;
+    ~OceanTextures();
+
+    OceanTextures& operator=(const OceanTextures&) = delete;
+
+    [[nodiscard]] int resolution() const;
+    // Patch size of the texels of the last upload.
+    [[nodiscard]] float patchSize() const;
+    // Whether the textures were uploaded at least once.
+    [[nodiscard]] bool hasData() const;
+
+    // Upload texels, which must have resolution() texels along each side.
+    void upload(const OceanTexels& texels);
+    // Bind the textures to their units and set the sampler and patch size uniforms of the water shaders.
+    void bind(const Shader& shader) const;
+
+private:
+    int m_resolution;
+    float m_patchSize { 1.0f };
+    bool m_hasData { false };
+    GLuint m_displacementTexture { 0 };
+    GLuint m_slopeTexture { 0 };
+    std::array<GLuint, RING_SIZE> m_buffers {};
+    std::array<GLsync, RING_SIZE> m_fences {};
+    size_t m_nextBuffer { 0 };
+};
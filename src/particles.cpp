@@ -0,0 +1,242 @@
+#include "particles.h"
+#include <framework/job_system.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PARTICLES_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+Xoshiro128Plus::Xoshiro128Plus(uint64_t seed)
+{
+    // Expand the seed with splitmix64, as recommended by the authors; this never yields the all-zero state.
+    for (int i = 0; i < 4; i += 2) {
+        seed += 0x9E3779B97F4A7C15ull;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        m_state[i] = static_cast<uint32_t>(z);
+        m_state[i + 1] = static_cast<uint32_t>(z >> 32);
+    }
+}
+
+uint32_t Xoshiro128Plus::next()
+{
+    const uint32_t result = m_state[0] + m_state[3];
+    const uint32_t t = m_state[1] << 9;
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = std::rotl(m_state[3], 11);
+    return result;
+}
+
+float Xoshiro128Plus::nextFloat()
+{
+    // The upper bits are the most random ones of xoshiro128+.
+    return static_cast<float>(next() >> 8) * 0x1.0p-24f;
+}
+
+ParticleSystem::ParticleSystem(size_t capacity, uint64_t seed)
+    : m_positionX(capacity)
+    , m_positionY(capacity)
+    , m_positionZ(capacity)
+    , m_velocityX(capacity)
+    , m_velocityY(capacity)
+    , m_velocityZ(capacity)
+    , m_life(capacity)
+    , m_random(seed)
+{
+}
+
+size_t ParticleSystem::capacity() const
+{
+    return m_life.size();
+}
+
+size_t ParticleSystem::size() const
+{
+    return m_size;
+}
+
+void ParticleSystem::emit(const glm::vec3& position, size_t count)
+{
+    count = std::min(count, capacity() - m_size);
+    for (size_t i = m_size; i < m_size + count; ++i) {
+        m_positionX[i] = position.x;
+        m_positionY[i] = position.y;
+        m_positionZ[i] = position.z;
+        m_velocityX[i] = (m_random.nextFloat() * 2.0f - 1.0f) * 0.5f;
+        m_velocityY[i] = m_random.nextFloat();
+        m_velocityZ[i] = (m_random.nextFloat() * 2.0f - 1.0f) * 0.5f;
+        m_life[i] = LIFETIME;
+    }
+    m_size += count;
+}
+
+void ParticleSystem::update(float deltaTime, JobSystem* jobSystem, size_t grainSize)
+{
+    size_t numDied = 0;
+    if (jobSystem) {
+        std::atomic<size_t> numDiedInJobs { 0 };
+        jobSystem->parallelFor(0, m_size, grainSize, [&](size_t begin, size_t end) {
+            numDiedInJobs += simulate(begin, end, deltaTime);
+        });
+        numDied = numDiedInJobs;
+    } else {
+        numDied = simulate(0, m_size, deltaTime);
+    }
+    if (numDied > 0)
+        removeDead();
+}
+
+size_t ParticleSystem::simulate(size_t begin, size_t end, float deltaTime)
+{
+    float* positionX = m_positionX.data();
+    float* positionY = m_positionY.data();
+    float* positionZ = m_positionZ.data();
+    const float* velocityX = m_velocityX.data();
+    float* velocityY = m_velocityY.data();
+    const float* velocityZ = m_velocityZ.data();
+    float* life = m_life.data();
+    const float gravity = GRAVITY * deltaTime;
+
+    size_t numDied = 0;
+    size_t i = begin;
+#if defined(PARTICLES_AVX)
+    const __m256 dt = _mm256_set1_ps(deltaTime);
+    const __m256 dv = _mm256_set1_ps(gravity);
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= end; i += 8) {
+        const __m256 newLife = _mm256_sub_ps(_mm256_loadu_ps(life + i), dt);
+        const __m256 vy = _mm256_loadu_ps(velocityY + i);
+        _mm256_storeu_ps(life + i, newLife);
+        _mm256_storeu_ps(positionX + i, _mm256_add_ps(_mm256_loadu_ps(positionX + i), _mm256_mul_ps(_mm256_loadu_ps(velocityX + i), dt)));
+        _mm256_storeu_ps(positionY + i, _mm256_add_ps(_mm256_loadu_ps(positionY + i), _mm256_mul_ps(vy, dt)));
+        _mm256_storeu_ps(positionZ + i, _mm256_add_ps(_mm256_loadu_ps(positionZ + i), _mm256_mul_ps(_mm256_loadu_ps(velocityZ + i), dt)));
+        _mm256_storeu_ps(velocityY + i, _mm256_sub_ps(vy, dv));
+        numDied += static_cast<size_t>(std::popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(newLife, zero, _CMP_LE_OQ)))));
+    }
+#elif defined(PARTICLES_SSE)
+    const __m128 dt = _mm_set1_ps(deltaTime);
+    const __m128 dv = _mm_set1_ps(gravity);
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        const __m128 newLife = _mm_sub_ps(_mm_loadu_ps(life + i), dt);
+        const __m128 vy = _mm_loadu_ps(velocityY + i);
+        _mm_storeu_ps(life + i, newLife);
+        _mm_storeu_ps(positionX + i, _mm_add_ps(_mm_loadu_ps(positionX + i), _mm_mul_ps(_mm_loadu_ps(velocityX + i), dt)));
+        _mm_storeu_ps(positionY + i, _mm_add_ps(_mm_loadu_ps(positionY + i), _mm_mul_ps(vy, dt)));
+        _mm_storeu_ps(positionZ + i, _mm_add_ps(_mm_loadu_ps(positionZ + i), _mm_mul_ps(_mm_loadu_ps(velocityZ + i), dt)));
+        _mm_storeu_ps(velocityY + i, _mm_sub_ps(vy, dv));
+        numDied += static_cast<size_t>(std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(newLife, zero)))));
+    }
+#endif
+    for (; i < end; ++i) {
+        life[i] -= deltaTime;
+        positionX[i] += velocityX[i] * deltaTime;
+        positionY[i] += velocityY[i] * deltaTime;
+        positionZ[i] += velocityZ[i] * deltaTime;
+        velocityY[i] -= gravity;
+        if (life[i] <= 0.0f)
+            numDied++;
+    }
+    return numDied;
+}
+
+void ParticleSystem::removeDead()
+{
+    size_t i = 0;
+    while (i < m_size) {
+        if (m_life[i] > 0.0f) {
+            ++i;
+            continue;
+        }
+        // Swap-remove: the moved particle is checked in the next iteration.
+        const size_t last = --m_size;
+        m_positionX[i] = m_positionX[last];
+        m_positionY[i] = m_positionY[last];
+        m_positionZ[i] = m_positionZ[last];
+        m_velocityX[i] = m_velocityX[last];
+        m_velocityY[i] = m_velocityY[last];
+        m_velocityZ[i] = m_velocityZ[last];
+        m_life[i] = m_life[last];
+    }
+}
+
+void ParticleSystem::clear()
+{
+    m_size = 0;
+}
+
+void ParticleSystem::writeVertices(ParticleVertices& vertices) const
+{
+    const auto size = static_cast<std::ptrdiff_t>(m_size);
+    vertices.positionX.assign(m_positionX.begin(), m_positionX.begin() + size);
+    vertices.positionY.assign(m_positionY.begin(), m_positionY.begin() + size);
+    vertices.positionZ.assign(m_positionZ.begin(), m_positionZ.begin() + size);
+    vertices.life.assign(m_life.begin(), m_life.begin() + size);
+}
+
+std::span<const uint32_t> ParticleDepthSorter::sort(const ParticleVertices& vertices, const glm::mat4& viewMatrix, JobSystem* jobSystem)
+{
+    const size_t numParticles = vertices.size();
+    // View space z of a point is negative in front of the camera, so ascending z is back to front.
+    const glm::vec4 viewZ { viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2], viewMatrix[3][2] };
+    m_keys.resize(numParticles);
+    const auto computeKeys = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            m_keys[i] = floatToRadixKey(viewZ.x * vertices.positionX[i] + viewZ.y * vertices.positionY[i] + viewZ.z * vertices.positionZ[i] + viewZ.w);
+    };
+    if (jobSystem)
+        jobSystem->parallelFor(0, numParticles, 16384, computeKeys);
+    else
+        computeKeys(0, numParticles);
+
+    // Keep the previous order of the particles that still exist and append the new ones. Slots that were reused by
+    // ParticleSystem::removeDead() are simply out of place and get repaired like any other movement.
+    std::erase_if(m_order, [&](uint32_t index) { return index >= numParticles; });
+    for (size_t i = m_order.size(); i < numParticles; ++i)
+        m_order.push_back(static_cast<uint32_t>(i));
+
+    // A nearly sorted order takes about one move per particle that changed places; beyond that the radix sort wins.
+    m_lastSortWasIncremental = repairOrder(numParticles / 8 + 64);
+    if (!m_lastSortWasIncremental) {
+        m_sortedKeys = m_keys;
+        for (size_t i = 0; i < numParticles; ++i)
+            m_order[i] = static_cast<uint32_t>(i);
+        m_radixSorter.sort(m_sortedKeys, m_order, jobSystem);
+    }
+    return m_order;
+}
+
+bool ParticleDepthSorter::lastSortWasIncremental() const
+{
+    return m_lastSortWasIncremental;
+}
+
+bool ParticleDepthSorter::repairOrder(size_t maxMoves)
+{
+    size_t numMoves = 0;
+    for (size_t i = 1; i < m_order.size(); ++i) {
+        const uint32_t index = m_order[i];
+        const uint32_t key = m_keys[index];
+        size_t j = i;
+        for (; j > 0 && m_keys[m_order[j - 1]] > key; --j) {
+            m_order[j] = m_order[j - 1];
+            if (++numMoves > maxMoves) {
+                m_order[j - 1] = index; // Leave a valid permutation behind.
+                return false;
+            }
+        }
+        m_order[j] = index;
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/radix_sort.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// xoshiro128+ (Blackman and Vigna): a small and fast generator for floats. Each simulation owns its own, so the
+// particles are deterministic and no state is shared between threads.
+class Xoshiro128Plus {
+public:
+    explicit Xoshiro128Plus(uint64_t seed);
+
+    uint32_t next();
+    // Uniformly distributed in [0, 1).
+    float nextFloat();
+
+private:
+    uint32_t m_state[4];
+};
+
+// Render data of the live particles with one array per vertex attribute, which is the layout of the particle vertex
+// buffer (so it is uploaded with four copies).
+struct ParticleVertices {
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> life;
+
+    [[nodiscard]] size_t size() const { return life.size(); }
+};
+
+// Water droplets that are sprayed up by the snake, stored as structure of arrays for SIMD. The live particles are
+// always [0, size()): emitting appends a particle and dead particles are removed by moving the last live particle
+// into their slot, so neither has to search for a free slot.
+class ParticleSystem {
+public:
+    // Downward acceleration (scaled down gravity) and lifetime in seconds of the droplets.
+    static constexpr float GRAVITY = 9.81f * 0.1f;
+    static constexpr float LIFETIME = 1.0f;
+
+    explicit ParticleSystem(size_t capacity, uint64_t seed = 1);
+
+    [[nodiscard]] size_t capacity() const;
+    [[nodiscard]] size_t size() const;
+
+    // Spawn count particles at position with a random upward velocity. Particles that do not fit are dropped.
+    void emit(const glm::vec3& position, size_t count = 1);
+    // Age and move the particles of the whole system, split over the job system (if given), and remove the dead ones.
+    void update(float deltaTime, JobSystem* jobSystem = nullptr, size_t grainSize = 4096);
+    // Age and move the particles [begin, end); returns how many of them died. Disjoint ranges may be simulated in
+    // parallel. The dead particles stay in place until removeDead().
+    size_t simulate(size_t begin, size_t end, float deltaTime);
+    void removeDead();
+    // Remove all particles.
+    void clear();
+
+    // Copy the live particles into vertices, reusing its memory.
+    void writeVertices(ParticleVertices& vertices) const;
+
+private:
+    std::vector<float> m_positionX, m_positionY, m_positionZ;
+    std::vector<float> m_velocityX, m_velocityY, m_velocityZ;
+    // Seconds left to live; a particle with life <= 0 is dead.
+    std::vector<float> m_life;
+    size_t m_size { 0 };
+    Xoshiro128Plus m_random;
+};
+
+// Back-to-front draw order of the particles for alpha blending, as indices into ParticleVertices (the particle data is
+// never moved). Sorting starts from the order of the previous call, because the camera and the particles move little
+// between frames: an insertion sort repairs a nearly sorted order in linear time, and only when that takes too many
+// moves are the view depths radix sorted from scratch.
+class ParticleDepthSorter {
+public:
+    // Indices of the particles from far to near; valid until the next call.
+    std::span<const uint32_t> sort(const ParticleVertices& vertices, const glm::mat4& viewMatrix, JobSystem* jobSystem = nullptr);
+    // Whether the last sort() only had to repair the previous order.
+    [[nodiscard]] bool lastSortWasIncremental() const;
+
+private:
+    // Insertion sort of m_order by key; gives up (returns false) after maxMoves moves.
+    bool repairOrder(size_t maxMoves);
+
+private:
+    // Sortable view depth key of every particle; ascending keys are back to front.
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_sortedKeys;
+    RadixSorter m_radixSorter;
+    bool m_lastSortWasIncremental { false };
+};
@@ -0,0 +1,349 @@
+#include "point_shadow_atlas.h"
+#include <framework/cpu_profiler.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/trigonometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Near plane of the cube map faces; the far plane is the light radius.
+static constexpr float FACE_NEAR_PLANE = 0.05f;
+
+// Every tile size has its own vertical strip of the atlas.
+static constexpr std::array<int, PointShadowAtlas::NUM_SIZE_CLASSES> REGION_X { 0, 2048, 3072, 3584 };
+static constexpr std::array<int, PointShadowAtlas::NUM_SIZE_CLASSES> REGION_WIDTH { 2048, 1024, 512, 512 };
+// Minimum screen influence for each tile size.
+static constexpr std::array<float, PointShadowAtlas::NUM_SIZE_CLASSES> INFLUENCE_THRESHOLDS { 0.5f, 0.2f, 0.08f, 0.0f };
+
+// Orientation of the cube map faces (+X, -X, +Y, -Y, +Z, -Z), the same as in clustered_lights_frag.glsl.
+static const std::array<glm::vec3, 6> FACE_FORWARD { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+static const std::array<glm::vec3, 6> FACE_UP { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+
+PointShadowAtlas::PointShadowAtlas()
+{
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, ATLAS_SIZE, ATLAS_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &m_dataBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_dataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    glGenTextures(1, &m_dataTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_dataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_dataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    for (size_t sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; ++sizeClass) {
+        const int numTiles = (REGION_WIDTH[sizeClass] / TILE_SIZES[sizeClass]) * (ATLAS_SIZE / TILE_SIZES[sizeClass]);
+        // Reversed so that tiles are handed out from the start of the region.
+        for (int tile = numTiles - 1; tile >= 0; --tile)
+            m_freeTiles[sizeClass].push_back(tile);
+    }
+}
+
+PointShadowAtlas::~PointShadowAtlas()
+{
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteTextures(1, &m_texture);
+    glDeleteTextures(1, &m_dataTexture);
+    glDeleteBuffers(1, &m_dataBuffer);
+}
+
+void PointShadowAtlas::update(std::span<ClusteredPointLight> lights, const glm::mat4& cameraViewProjection, const glm::vec3& cameraPosition, std::span<const DynamicCaster> dynamicCasters)
+{
+    CPU_PROFILE_ZONE("PointShadowAtlas::update");
+    // Look up the states by id: the index of a light changes when a light before it is added, removed or selected as
+    // the active light. Lights that are gone release their tiles.
+    m_updateIndex++;
+    m_lights.clear();
+    for (const ClusteredPointLight& light : lights) {
+        LightState& state = m_lightStates[light.id];
+        state.lastUpdate = m_updateIndex;
+        m_lights.push_back(&state);
+    }
+    for (auto iter = std::begin(m_lightStates); iter != std::end(m_lightStates);) {
+        if (iter->second.lastUpdate == m_updateIndex) {
+            ++iter;
+        } else {
+            freeTiles(iter->second);
+            iter = m_lightStates.erase(iter);
+        }
+    }
+
+    // Frustum planes (Gribb & Hartmann), normalized so that distances are in world units.
+    std::array<glm::vec4, 6> frustumPlanes;
+    const glm::mat4 m = glm::transpose(cameraViewProjection);
+    for (int i = 0; i < 3; ++i) {
+        frustumPlanes[size_t(2 * i + 0)] = m[3] + m[i];
+        frustumPlanes[size_t(2 * i + 1)] = m[3] - m[i];
+    }
+    for (glm::vec4& plane : frustumPlanes)
+        plane /= glm::length(glm::vec3(plane));
+
+    for (size_t i = 0; i < lights.size(); ++i) {
+        LightState& state = *m_lights[i];
+        state.influence = settings.enabled ? computeInfluence(lights[i], frustumPlanes, cameraPosition) : 0.0f;
+        // The far plane of the faces is the radius, so depths that were rendered with another radius cannot be used.
+        if (state.radius != lights[i].radius)
+            state.valid.fill(false);
+        if (state.position != lights[i].position || state.radius != lights[i].radius) {
+            state.position = lights[i].position;
+            state.radius = lights[i].radius;
+            state.dirty.fill(true);
+        }
+    }
+
+    // Faces that saw a dynamic caster at its previous or current position have to be rendered again.
+    const bool castersChanged = dynamicCasters.size() != m_previousCasters.size();
+    for (size_t c = 0; c < dynamicCasters.size(); ++c) {
+        const DynamicCaster& caster = dynamicCasters[c];
+        const bool moved = castersChanged || caster.center != m_previousCasters[c].center || caster.radius != m_previousCasters[c].radius;
+        if (!moved)
+            continue;
+        for (LightState* state : m_lights) {
+            if (state->sizeClass < 0)
+                continue;
+            markDirtyFaces(*state, caster);
+            if (!castersChanged)
+                markDirtyFaces(*state, m_previousCasters[c]);
+        }
+    }
+    m_previousCasters.assign(std::begin(dynamicCasters), std::end(dynamicCasters));
+
+    // The lights with the largest influence get shadows; release the tiles of the others and of lights that
+    // need a different tile size, before handing out tiles in order of influence.
+    std::vector<size_t> order(m_lights.size());
+    std::iota(std::begin(order), std::end(order), size_t(0));
+    std::sort(std::begin(order), std::end(order), [&](size_t lhs, size_t rhs) { return m_lights[lhs]->influence > m_lights[rhs]->influence; });
+    const auto isCandidate = [&](size_t rank) {
+        return rank < size_t(std::max(settings.maxShadowedLights, 0)) && m_lights[order[rank]]->influence > 0.0f;
+    };
+    for (size_t rank = 0; rank < order.size(); ++rank) {
+        LightState& state = *m_lights[order[rank]];
+        if (state.sizeClass >= 0 && (!isCandidate(rank) || desiredSizeClass(state) != state.sizeClass))
+            freeTiles(state);
+    }
+    for (size_t rank = 0; rank < order.size() && isCandidate(rank); ++rank) {
+        LightState& state = *m_lights[order[rank]];
+        if (state.sizeClass >= 0)
+            continue;
+        for (int sizeClass = desiredSizeClass(state); sizeClass < NUM_SIZE_CLASSES; ++sizeClass) {
+            if (allocateTiles(state, sizeClass))
+                break;
+        }
+    }
+
+    // Schedule dirty faces: first those of lights that are not shadowed yet, then by influence.
+    struct DirtyFace {
+        size_t light;
+        size_t face;
+        float priority;
+    };
+    std::vector<DirtyFace> dirtyFaces;
+    for (size_t i = 0; i < m_lights.size(); ++i) {
+        const LightState& state = *m_lights[i];
+        if (state.sizeClass < 0)
+            continue;
+        const bool complete = std::all_of(std::begin(state.valid), std::end(state.valid), [](bool valid) { return valid; });
+        for (size_t face = 0; face < 6; ++face) {
+            if (state.dirty[face])
+                dirtyFaces.push_back({ i, face, state.influence + (complete ? 0.0f : 1000.0f) });
+        }
+    }
+    std::stable_sort(std::begin(dirtyFaces), std::end(dirtyFaces), [](const DirtyFace& lhs, const DirtyFace& rhs) { return lhs.priority > rhs.priority; });
+
+    m_facesToRender.clear();
+    const size_t numFaces = std::min(dirtyFaces.size(), size_t(std::max(settings.faceBudget, 0)));
+    for (size_t i = 0; i < numFaces; ++i) {
+        LightState& state = *m_lights[dirtyFaces[i].light];
+        const size_t face = dirtyFaces[i].face;
+        const glm::mat4 view = glm::lookAt(state.position, state.position + FACE_FORWARD[face], FACE_UP[face]);
+        const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, FACE_NEAR_PLANE, state.radius);
+        m_facesToRender.push_back({ tileViewport(state.sizeClass, state.tiles[face]), projection * view });
+        state.dirty[face] = false;
+        state.valid[face] = true;
+    }
+    m_numDirtyFaces = static_cast<int>(dirtyFaces.size() - numFaces);
+
+    // Upload the tiles of the lights whose faces have all been rendered (the scheduled ones are rendered this frame):
+    // seven texels per light, one per face (tile offset and size in uv) and (near, far).
+    m_shadowData.clear();
+    m_numShadowedLights = 0;
+    for (size_t i = 0; i < m_lights.size(); ++i) {
+        const LightState& state = *m_lights[i];
+        const bool complete = state.sizeClass >= 0 && std::all_of(std::begin(state.valid), std::end(state.valid), [](bool valid) { return valid; });
+        if (!complete) {
+            lights[i].shadowIndex = -1;
+            continue;
+        }
+        lights[i].shadowIndex = m_numShadowedLights++;
+        for (size_t face = 0; face < 6; ++face) {
+            const glm::ivec4 viewport = tileViewport(state.sizeClass, state.tiles[face]);
+            m_shadowData.push_back(glm::vec4(glm::vec3(viewport.x, viewport.y, viewport.z) / float(ATLAS_SIZE), 0.0f));
+        }
+        m_shadowData.push_back(glm::vec4(FACE_NEAR_PLANE, state.radius, 0.0f, 0.0f));
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, m_dataBuffer);
+    const GLsizeiptr size = static_cast<GLsizeiptr>(m_shadowData.size() * sizeof(glm::vec4));
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, GLsizeiptr(16)), nullptr, GL_STREAM_DRAW);
+    if (size > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, m_shadowData.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Approximate fraction of the screen that the light affects: 0 if its sphere is outside of the view frustum.
+float PointShadowAtlas::computeInfluence(const ClusteredPointLight& light, const std::array<glm::vec4, 6>& frustumPlanes, const glm::vec3& cameraPosition)
+{
+    for (const glm::vec4& plane : frustumPlanes) {
+        if (glm::dot(glm::vec3(plane), light.position) + plane.w < -light.radius)
+            return 0.0f;
+    }
+    const float distance = glm::distance(cameraPosition, light.position);
+    return light.radius / std::max(distance, light.radius);
+}
+
+// Tile size for the influence of the light, with some hysteresis so lights on a threshold do not keep switching
+// (which would throw away their shadow maps every time).
+int PointShadowAtlas::desiredSizeClass(const LightState& state) const
+{
+    int desired = 0;
+    while (desired < NUM_SIZE_CLASSES - 1 && state.influence < INFLUENCE_THRESHOLDS[size_t(desired)])
+        desired++;
+
+    const int current = state.sizeClass;
+    if (current >= 0 && desired < current && state.influence < INFLUENCE_THRESHOLDS[size_t(current - 1)] * 1.25f)
+        return current;
+    if (current >= 0 && desired > current && state.influence > INFLUENCE_THRESHOLDS[size_t(current)] * 0.8f)
+        return current;
+    return desired;
+}
+
+bool PointShadowAtlas::allocateTiles(LightState& state, int sizeClass)
+{
+    std::vector<int>& freeTiles = m_freeTiles[size_t(sizeClass)];
+    if (freeTiles.size() < 6)
+        return false;
+    for (size_t face = 0; face < 6; ++face) {
+        state.tiles[face] = freeTiles.back();
+        freeTiles.pop_back();
+    }
+    state.sizeClass = sizeClass;
+    state.dirty.fill(true);
+    state.valid.fill(false);
+    return true;
+}
+
+void PointShadowAtlas::freeTiles(LightState& state)
+{
+    if (state.sizeClass < 0)
+        return;
+    for (int tile : state.tiles)
+        m_freeTiles[size_t(state.sizeClass)].push_back(tile);
+    state.sizeClass = -1;
+    state.valid.fill(false);
+}
+
+glm::ivec4 PointShadowAtlas::tileViewport(int sizeClass, int tile) const
+{
+    const int tileSize = TILE_SIZES[size_t(sizeClass)];
+    const int columns = REGION_WIDTH[size_t(sizeClass)] / tileSize;
+    return glm::ivec4(REGION_X[size_t(sizeClass)] + (tile % columns) * tileSize, (tile / columns) * tileSize, tileSize, tileSize);
+}
+
+// Mark the faces of the light whose 90 degree frustum intersects the bounding sphere of the caster.
+void PointShadowAtlas::markDirtyFaces(LightState& state, const DynamicCaster& caster)
+{
+    const glm::vec3 offset = caster.center - state.position;
+    if (glm::length(offset) > state.radius + caster.radius)
+        return;
+
+    for (size_t face = 0; face < 6; ++face) {
+        const int axis = int(face / 2);
+        const float forward = glm::dot(offset, FACE_FORWARD[face]);
+        if (forward < -caster.radius)
+            continue;
+        // The side planes of the face frustum are at 45 degrees: forward >= |side| (up to the sphere radius).
+        bool inside = true;
+        for (int side = 0; side < 3; ++side) {
+            if (side != axis && forward - std::abs(offset[side]) < -caster.radius * glm::root_two<float>())
+                inside = false;
+        }
+        if (inside)
+            state.dirty[face] = true;
+    }
+}
+
+std::span<const PointShadowAtlas::FaceRender> PointShadowAtlas::facesToRender() const
+{
+    return m_facesToRender;
+}
+
+void PointShadowAtlas::beginRender() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+}
+
+void PointShadowAtlas::beginFace(const FaceRender& face) const
+{
+    glViewport(face.viewport.x, face.viewport.y, face.viewport.z, face.viewport.w);
+    glScissor(face.viewport.x, face.viewport.y, face.viewport.z, face.viewport.w);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void PointShadowAtlas::endRender() const
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+GLuint PointShadowAtlas::framebuffer() const
+{
+    return m_framebuffer;
+}
+
+void PointShadowAtlas::bind(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE11);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glActiveTexture(GL_TEXTURE12);
+    glBindTexture(GL_TEXTURE_BUFFER, m_dataTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(shader.getUniformLocation("pointShadowAtlas"), 11);
+    glUniform1i(shader.getUniformLocation("pointShadowData"), 12);
+}
+
+int PointShadowAtlas::numShadowedLights() const
+{
+    return m_numShadowedLights;
+}
+
+int PointShadowAtlas::numDirtyFaces() const
+{
+    return m_numDirtyFaces;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "light_clusters.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <framework/shader.h>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Omnidirectional shadows for the clustered point lights. The six cube map faces of every shadowed light are
+// rendered into square tiles of one shared depth texture (the atlas):
+//  - Lights that cover more of the screen get larger tiles. The atlas is divided into one region per tile size, and
+//    every region is a fixed grid of tiles, so a light keeps its tiles (and their contents) while its size is stable.
+//  - A face is only re-rendered when its light moved or a dynamic caster moved inside the face's frustum.
+//  - At most faceBudget faces are rendered per frame; the remaining dirty faces are rendered in later frames.
+//    Lights whose faces have not all been rendered yet are not shadowed.
+class PointShadowAtlas {
+public:
+    static constexpr int ATLAS_SIZE = 4096;
+    static constexpr int NUM_SIZE_CLASSES = 4;
+    static constexpr std::array<int, NUM_SIZE_CLASSES> TILE_SIZES { 512, 256, 128, 64 };
+
+    struct Settings {
+        bool enabled { true };
+        int faceBudget { 12 };
+        int maxShadowedLights { 32 };
+    };
+    // Bounding sphere of geometry that may move between frames.
+    struct DynamicCaster {
+        glm::vec3 center;
+        float radius;
+    };
+    struct FaceRender {
+        glm::ivec4 viewport;
+        glm::mat4 viewProjection;
+    };
+
+    PointShadowAtlas();
+    PointShadowAtlas(const PointShadowAtlas&) = delete;
+    ~PointShadowAtlas();
+
+    PointShadowAtlas& operator=(const PointShadowAtlas&) = delete;
+
+    // Assign atlas tiles to the lights, find the faces that have to be rendered this frame and set the shadowIndex
+    // of every light (-1 if it is not shadowed). Lights are recognized by their id; the tiles of lights that are no
+    // longer in the list are released.
+    void update(std::span<ClusteredPointLight> lights, const glm::mat4& cameraViewProjection, const glm::vec3& cameraPosition, std::span<const DynamicCaster> dynamicCasters);
+
+    // Faces that were scheduled by update(); render them between beginRender() and endRender().
+    [[nodiscard]] std::span<const FaceRender> facesToRender() const;
+    void beginRender() const;
+    // Restricts rendering to the tile of the face and clears it.
+    void beginFace(const FaceRender& face) const;
+    void endRender() const;
+    [[nodiscard]] GLuint framebuffer() const;
+
+    // Bind the atlas and the per light tile data to texture units 11 and 12 (see clustered_lights_frag.glsl).
+    void bind(const Shader& shader) const;
+
+    [[nodiscard]] int numShadowedLights() const;
+    [[nodiscard]] int numDirtyFaces() const;
+
+    Settings settings;
+
+private:
+    struct LightState {
+        glm::vec3 position { 0.0f };
+        float radius { 0.0f };
+        float influence { 0.0f };
+        int sizeClass { -1 };
+        std::array<int, 6> tiles {};
+        std::array<bool, 6> dirty {};
+        std::array<bool, 6> valid {};
+        uint64_t lastUpdate { 0 };
+    };
+
+    static float computeInfluence(const ClusteredPointLight& light, const std::array<glm::vec4, 6>& frustumPlanes, const glm::vec3& cameraPosition);
+    int desiredSizeClass(const LightState& state) const;
+    bool allocateTiles(LightState& state, int sizeClass);
+    void freeTiles(LightState& state);
+    glm::ivec4 tileViewport(int sizeClass, int tile) const;
+    void markDirtyFaces(LightState& state, const DynamicCaster& caster);
+
+private:
+    std::unordered_map<uint32_t, LightState> m_lightStates;
+    // States of the lights of the last update, in their order.
+    std::vector<LightState*> m_lights;
+    uint64_t m_updateIndex { 0 };
+    std::array<std::vector<int>, NUM_SIZE_CLASSES> m_freeTiles;
+    std::vector<DynamicCaster> m_previousCasters;
+    std::vector<FaceRender> m_facesToRender;
+    std::vector<glm::vec4> m_shadowData;
+    int m_numShadowedLights { 0 };
+    int m_numDirtyFaces { 0 };
+
+    GLuint m_texture { 0 };
+    GLuint m_framebuffer { 0 };
+    GLuint m_dataBuffer { 0 };
+    GLuint m_dataTexture { 0 };
+};
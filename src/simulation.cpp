@@ -0,0 +1,182 @@
+#include "simulation.h"
+#include <framework/cpu_profiler.h>
+#include <framework/job_system.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/matrix_transform.hpp>
+DISABLE_WARNINGS_POP()
+#include <cmath>
+
+Simulation::Simulation(std::vector<CubicBezier> snakePath, size_t maxParticles, JobSystem* jobSystem)
+    : m_jobSystem(jobSystem)
+    , m_snakePath(std::move(snakePath))
+    , m_particles(maxParticles)
+    , m_fluid(maxParticles)
+{
+    // Initialise Snake
+    const int segmentCount = 6;
+    const float segmentLength = 0.3f;
+    auto head = std::make_unique<SnakeSegment>();
+    head->localPosition = glm::vec3(0.0f);
+    SnakeSegment* prev = head.get();
+    m_snakeSegments.push_back(prev);
+
+    for (int i = 1; i < segmentCount; ++i) {
+        auto seg = std::make_unique<SnakeSegment>();
+        seg->localPosition = glm::vec3(0.0f, 0.0f, segmentLength);
+        prev->child = std::move(seg);
+        prev = prev->child.get();
+        m_snakeSegments.push_back(prev);
+    }
+
+    m_snakeRoot = std::move(head);
+    collectSnakeTransforms(m_snakeTransforms);
+    m_previousSnakeTransforms = m_snakeTransforms;
+}
+
+void Simulation::step(const SimulationSettings& settings, float stepSeconds)
+{
+    CPU_PROFILE_ZONE("simulationStep");
+    m_step++;
+    m_stepSeconds = stepSeconds;
+
+    m_previousTimeOfDay = m_timeOfDay;
+    m_timeOfDay += stepSeconds * settings.dayNightSpeed; // speed of day/night cycle
+
+    m_waterSurface.update(settings.waterModelMatrix, settings.waves);
+    m_fftOcean = settings.fftOcean;
+    if (m_fftOcean) {
+        CPU_PROFILE_ZONE("updateOcean");
+        if (!m_ocean || m_ocean->settings() != settings.ocean)
+            m_ocean.emplace(settings.ocean);
+        m_ocean->update(float(m_time), m_jobSystem);
+        m_waterSurface.setOcean(&*m_ocean);
+    } else {
+        m_waterSurface.setOcean(nullptr);
+    }
+    updateSnakeMotion(settings, stepSeconds);
+    updateSnake(settings, stepSeconds);
+    {
+        CPU_PROFILE_ZONE("updateParticles");
+        m_sphParticles = settings.simulateParticles && settings.sphParticles;
+        if (m_sphParticles) {
+            m_particles.clear();
+            m_fluid.emit(m_snakePosition);
+            m_fluid.update(stepSeconds, m_waterSurface, float(m_time), m_jobSystem, SPH_GRAIN_SIZE);
+        } else if (settings.simulateParticles) {
+            m_fluid.clear();
+            m_particles.emit(m_snakePosition);
+            m_particles.update(stepSeconds, m_jobSystem, PARTICLE_GRAIN_SIZE);
+        } else {
+            m_particles.clear();
+            m_fluid.clear();
+        }
+    }
+    m_time += double(stepSeconds);
+
+    std::swap(m_previousSnakeTransforms, m_snakeTransforms);
+    collectSnakeTransforms(m_snakeTransforms);
+}
+
+void Simulation::writeSnapshot(SimulationSnapshot& snapshot) const
+{
+    CPU_PROFILE_ZONE("writeSnapshot");
+    snapshot.step = m_step;
+    snapshot.stepSeconds = m_stepSeconds;
+    snapshot.time = m_time;
+    snapshot.snakeTransforms = m_snakeTransforms;
+    snapshot.previousSnakeTransforms = m_previousSnakeTransforms;
+    snapshot.timeOfDay = m_timeOfDay;
+    snapshot.previousTimeOfDay = m_previousTimeOfDay;
+    if (m_sphParticles)
+        m_fluid.writeVertices(snapshot.particles);
+    else
+        m_particles.writeVertices(snapshot.particles);
+    if (m_fftOcean) {
+        m_ocean->writeTexels(snapshot.ocean, m_jobSystem);
+    } else {
+        snapshot.ocean.resolution = 0;
+        snapshot.ocean.displacement.clear();
+        snapshot.ocean.slopes.clear();
+    }
+}
+
+void Simulation::updateSnake(const SimulationSettings& settings, float dt)
+{ // For updating the slithering motion of the snake
+    CPU_PROFILE_ZONE("updateSnake");
+    if (m_snakeSegments.empty() || settings.snakePaused)
+        return;
+
+    m_snakeTime += dt;
+
+    for (size_t i = 0; i < m_snakeSegments.size(); ++i) {
+        float phase = m_snakeTime * settings.snakeWaveSpeed - static_cast<float>(i) * settings.snakeWavelength;
+        float angle = std::sin(phase) * settings.snakeWaveAmplitude;
+
+        m_snakeSegments[i]->localRotation = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0, 1, 0));
+    }
+}
+
+void Simulation::collectSnakeTransforms(std::vector<glm::mat4>& transforms) const
+{
+    transforms.clear();
+    if (!m_snakeRoot)
+        return;
+
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), m_snakePosition) * m_snakeRotation;
+    for (const SnakeSegment* segment = m_snakeRoot.get(); segment; segment = segment->child.get()) {
+        model = model * glm::translate(glm::mat4(1.0f), segment->localPosition) * segment->localRotation;
+        transforms.push_back(model);
+    }
+}
+
+void Simulation::updateSnakeMotion(const SimulationSettings& settings, float deltaTime)
+{
+    CPU_PROFILE_ZONE("updateSnakeMotion");
+    if (m_snakePath.empty())
+        return;
+
+    if (settings.moveAtConstantSpeed) {
+        auto& curve = m_snakePath[m_snakeCurve];
+        float dLenDt = glm::length(curve.derivative(m_snakeT));
+        m_snakeT += (settings.snakeSpeed / dLenDt) * deltaTime;
+    } else { // else move at constant t
+        m_snakeT += 0.2f * deltaTime;
+    }
+
+    if (m_snakeT > 1.0f) {
+        m_snakeT = 0.0f;
+        m_snakeCurve = (m_snakeCurve + 1) % m_snakePath.size();
+    }
+
+    // evaluate next position on the bezier curve
+    glm::vec3 newPos = m_snakePath[m_snakeCurve].evaluate(m_snakeT);
+
+    // This block is for the direction of the snake
+    float nextT = m_snakeT + 0.01f;
+    if (nextT > 1.0f)
+        nextT = 1.0f;
+    glm::vec3 nextPos = m_snakePath[m_snakeCurve].evaluate(nextT);
+
+    if (settings.snakeClampedToWaterheight) {
+        // Clamp the snake's y (and that of the next position) to the water surface, with one query for both
+        const float x[] { newPos.x, nextPos.x }, y[] { newPos.y, nextPos.y }, z[] { newPos.z, nextPos.z };
+        float height[2];
+        m_waterSurface.evaluate(float(m_time), x, y, z, { .height = height });
+        newPos.y = height[0];
+        nextPos.y = height[1];
+    }
+    glm::vec3 direction = glm::normalize(newPos - nextPos);
+
+    // Build rotation so the snake faces along the path
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+    glm::vec3 right = glm::normalize(glm::cross(up, direction));
+    glm::vec3 correctedUp = glm::normalize(glm::cross(direction, right));
+
+    m_snakeRotation = glm::mat4(1.0f);
+    m_snakeRotation[0] = glm::vec4(right, 0.0f);
+    m_snakeRotation[1] = glm::vec4(correctedUp, 0.0f);
+    m_snakeRotation[2] = glm::vec4(direction, 0.0f);
+
+    m_snakePosition = newPos;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "bezier.h"
+#include "ocean.h"
+#include "particles.h"
+#include "sph.h"
+#include "water.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/trigonometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+class JobSystem;
+
+// Parameters of the simulation that are edited in the user interface.
+struct SimulationSettings {
+    float snakeSpeed { 1.0f };
+    float snakeWaveSpeed { 3.0f };
+    float snakeWaveAmplitude { glm::radians(20.0f) };
+    float snakeWavelength { 0.6f };
+    bool snakePaused { false };
+    bool snakeClampedToWaterheight { false };
+    bool moveAtConstantSpeed { true };
+
+    // Off while the particles are simulated on the GPU instead (see GPUParticleSystem).
+    bool simulateParticles { true };
+    // Simulate them as an SPH fluid (see SPHFluid) instead of as independent ballistic points.
+    bool sphParticles { false };
+
+    float dayNightSpeed { 0.05f };
+    WaveParameters waves;
+    glm::mat4 waterModelMatrix { 1.0f };
+    // Use the heightfield of an FFT ocean (see Ocean) as the water surface instead of the sum of sines.
+    bool fftOcean { false };
+    OceanSettings ocean;
+};
+
+// Everything the renderer needs of one simulation step. It holds the state before and after the step so that the
+// renderer can interpolate between them.
+struct SimulationSnapshot {
+    uint64_t step { 0 };
+    float stepSeconds { 0.0f };
+    // Simulation time after the step.
+    double time { 0.0 };
+    // cpuProfilerTimestamp() at which the step was published.
+    int64_t publishTimestamp { 0 };
+
+    std::vector<glm::mat4> snakeTransforms;
+    std::vector<glm::mat4> previousSnakeTransforms;
+    float timeOfDay { 0.0f };
+    float previousTimeOfDay { 0.0f };
+    ParticleVertices particles;
+    // Heightfield of the FFT ocean at the start of the step; empty when the sum of sines is used.
+    OceanTexels ocean;
+};
+
+// The snake following its Bezier path, the particles it emits and the day/night cycle. It is not thread-safe; it is
+// owned and stepped by the SimulationThread. The particle update is split over the job system (if given).
+class Simulation {
+public:
+    Simulation(std::vector<CubicBezier> snakePath, size_t maxParticles, JobSystem* jobSystem = nullptr);
+
+    void step(const SimulationSettings& settings, float stepSeconds);
+    // Write the state after the last step (and before it) into snapshot, reusing its memory.
+    void writeSnapshot(SimulationSnapshot& snapshot) const;
+
+private:
+    struct SnakeSegment {
+        glm::vec3 localPosition;
+        glm::mat4 localRotation = glm::mat4(1.0f);
+        std::unique_ptr<SnakeSegment> child = nullptr;
+    };
+
+    void updateSnakeMotion(const SimulationSettings& settings, float deltaTime);
+    void updateSnake(const SimulationSettings& settings, float dt);
+    // Walk the segment chain and accumulate the world transform of every segment.
+    void collectSnakeTransforms(std::vector<glm::mat4>& transforms) const;
+
+private:
+    // Number of particles per job.
+    static constexpr size_t PARTICLE_GRAIN_SIZE = 4096;
+    static constexpr size_t SPH_GRAIN_SIZE = 2048;
+
+    JobSystem* m_jobSystem;
+    uint64_t m_step { 0 };
+    float m_stepSeconds { 0.0f };
+    double m_time { 0.0 };
+    WaterSurface m_waterSurface;
+    // Created when it is first enabled and recreated when its settings change.
+    std::optional<Ocean> m_ocean;
+    bool m_fftOcean { false };
+
+    std::vector<CubicBezier> m_snakePath;
+    std::unique_ptr<SnakeSegment> m_snakeRoot;
+    std::vector<SnakeSegment*> m_snakeSegments;
+    float m_snakeTime = 0.0f;
+    glm::vec3 m_snakePosition = glm::vec3(0.0f);
+    glm::mat4 m_snakeRotation = glm::mat4(1.0f);
+    float m_snakeT = 0.0f;
+    size_t m_snakeCurve = 2;
+    std::vector<glm::mat4> m_snakeTransforms;
+    std::vector<glm::mat4> m_previousSnakeTransforms;
+
+    ParticleSystem m_particles;
+    SPHFluid m_fluid;
+    // Whether the last step simulated m_fluid instead of m_particles.
+    bool m_sphParticles { false };
+
+    float m_timeOfDay { 0.0f };
+    float m_previousTimeOfDay { 0.0f };
+};
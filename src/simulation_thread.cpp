@@ -0,0 +1,126 @@
+#include "simulation_thread.h"
+#include <framework/cpu_profiler.h>
+#include <chrono>
+
+SimulationThread::SimulationThread(Simulation simulation, const SimulationSettings& settings, double stepSeconds, Mode mode)
+    : m_simulation(std::move(simulation))
+    , m_mode(mode)
+    , m_settings(settings)
+    , m_timestep(stepSeconds)
+{
+    // The initial state is available before the first step.
+    m_simulation.writeSnapshot(m_snapshots.back());
+    m_snapshots.back().publishTimestamp = cpuProfilerTimestamp();
+    m_snapshots.publish();
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void SimulationThread::setSettings(const SimulationSettings& settings)
+{
+    std::lock_guard lock { m_mutex };
+    m_settings = settings;
+}
+
+void SimulationThread::setStepSeconds(double stepSeconds)
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_timestep.setStepSeconds(stepSeconds);
+    }
+    // Wake the RealTime loop so that it does not sleep for the old step length.
+    m_condition.notify_all();
+}
+
+void SimulationThread::setMaxStepsPerFrame(int maxStepsPerFrame)
+{
+    std::lock_guard lock { m_mutex };
+    m_timestep.maxStepsPerFrame = maxStepsPerFrame;
+}
+
+double SimulationThread::stepSeconds() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_timestep.stepSeconds();
+}
+
+int SimulationThread::maxStepsPerFrame() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_timestep.maxStepsPerFrame;
+}
+
+double SimulationThread::droppedSeconds() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_timestep.droppedSeconds();
+}
+
+const SimulationSnapshot& SimulationThread::acquire()
+{
+    if (m_mode == Mode::LockStep) {
+        std::unique_lock lock { m_mutex };
+        m_condition.wait(lock, [this] { return m_completedSteps == m_requestedSteps; });
+        m_snapshots.update();
+        m_requestedSteps++;
+        lock.unlock();
+        m_condition.notify_all();
+    } else {
+        m_snapshots.update();
+    }
+    return m_snapshots.front();
+}
+
+void SimulationThread::run()
+{
+    cpuProfilerSetThreadName("Simulation");
+    auto lastTime = std::chrono::steady_clock::now();
+    std::unique_lock lock { m_mutex };
+    while (!m_stop) {
+        int numSteps = 0;
+        if (m_mode == Mode::LockStep) {
+            m_condition.wait(lock, [this] { return m_stop || m_completedSteps < m_requestedSteps; });
+            if (m_stop)
+                break;
+            numSteps = 1;
+        } else {
+            // Sleep until the next step is due (or the settings change the step length).
+            const float waitStepSeconds = m_timestep.stepSeconds();
+            const auto nextStep = lastTime + std::chrono::duration<double>(waitStepSeconds * (1.0f - m_timestep.alpha()));
+            m_condition.wait_until(lock, nextStep, [&] { return m_stop || m_timestep.stepSeconds() != waitStepSeconds; });
+            if (m_stop)
+                break;
+            const auto now = std::chrono::steady_clock::now();
+            numSteps = m_timestep.advance(std::chrono::duration<double>(now - lastTime).count());
+            lastTime = now;
+        }
+        if (numSteps == 0)
+            continue;
+
+        // Step without holding the lock so that the render thread can update the settings meanwhile.
+        const SimulationSettings settings = m_settings;
+        const float stepSeconds = m_timestep.stepSeconds();
+        lock.unlock();
+        for (int i = 0; i < numSteps; ++i)
+            m_simulation.step(settings, stepSeconds);
+        SimulationSnapshot& snapshot = m_snapshots.back();
+        m_simulation.writeSnapshot(snapshot);
+        snapshot.publishTimestamp = cpuProfilerTimestamp();
+        m_snapshots.publish();
+        lock.lock();
+
+        if (m_mode == Mode::LockStep) {
+            m_completedSteps++;
+            m_condition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "fixed_timestep.h"
+#include "simulation.h"
+#include "triple_buffer.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Runs a Simulation on its own thread and hands the results to the render thread through a triple buffer of
+// snapshots, so that the next simulation step overlaps with rendering the current one.
+//
+// In RealTime mode the thread steps the simulation with a FixedTimestep clock, driven by the wall clock, and
+// publishes one snapshot after taking all the steps that are due. In LockStep mode (used by the benchmark) it takes
+// exactly one step for every call to acquire(), which makes the results independent of thread timing.
+class SimulationThread {
+public:
+    enum class Mode {
+        RealTime,
+        LockStep
+    };
+
+    SimulationThread(Simulation simulation, const SimulationSettings& settings, double stepSeconds, Mode mode);
+    SimulationThread(const SimulationThread&) = delete;
+    ~SimulationThread();
+
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Settings for the following steps.
+    void setSettings(const SimulationSettings& settings);
+    void setStepSeconds(double stepSeconds);
+    void setMaxStepsPerFrame(int maxStepsPerFrame);
+    [[nodiscard]] double stepSeconds() const;
+    [[nodiscard]] int maxStepsPerFrame() const;
+    // Simulation time that was dropped by the step limit.
+    [[nodiscard]] double droppedSeconds() const;
+
+    // Latest published snapshot; it stays valid until the next call. In LockStep mode this waits for the step that
+    // was requested by the previous call and requests the next one.
+    const SimulationSnapshot& acquire();
+
+private:
+    void run();
+
+private:
+    Simulation m_simulation;
+    const Mode m_mode;
+    TripleBuffer<SimulationSnapshot> m_snapshots;
+
+    // Protects the members below.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    SimulationSettings m_settings;
+    FixedTimestep m_timestep;
+    bool m_stop { false };
+    // LockStep mode: number of steps requested by the render thread and taken by the simulation thread.
+    uint64_t m_requestedSteps { 0 };
+    uint64_t m_completedSteps { 0 };
+
+    std::thread m_thread;
+};
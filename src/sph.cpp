@@ -0,0 +1,268 @@
+#include "sph.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/job_system.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+
+SPHFluid::SPHFluid(size_t capacity, const SPHSettings& settings, uint64_t seed)
+    : m_settings(settings)
+    , m_positionX(capacity)
+    , m_positionY(capacity)
+    , m_positionZ(capacity)
+    , m_velocityX(capacity)
+    , m_velocityY(capacity)
+    , m_velocityZ(capacity)
+    , m_life(capacity)
+    , m_density(capacity)
+    , m_pressure(capacity)
+    , m_accelerationX(capacity)
+    , m_accelerationY(capacity)
+    , m_accelerationZ(capacity)
+    , m_surfaceHeight(capacity)
+    , m_surfaceVelocity(capacity)
+    , m_hash(settings.smoothingRadius)
+    , m_random(seed)
+{
+    const float h = settings.smoothingRadius;
+    const float pi = std::numbers::pi_v<float>;
+    m_particleMass = settings.restDensity * std::pow(h * 0.5f, 3.0f);
+    m_poly6Scale = 315.0f / (64.0f * pi * std::pow(h, 9.0f));
+    m_spikyGradientScale = 45.0f / (pi * std::pow(h, 6.0f));
+    m_viscosityLaplacianScale = 45.0f / (pi * std::pow(h, 6.0f));
+}
+
+size_t SPHFluid::capacity() const
+{
+    return m_life.size();
+}
+
+size_t SPHFluid::size() const
+{
+    return m_size;
+}
+
+const SPHSettings& SPHFluid::settings() const
+{
+    return m_settings;
+}
+
+void SPHFluid::emit(const glm::vec3& position, size_t count, float spread, float velocityScale)
+{
+    count = std::min(count, capacity() - m_size);
+    for (size_t i = m_size; i < m_size + count; ++i) {
+        m_positionX[i] = position.x + (m_random.nextFloat() * 2.0f - 1.0f) * spread;
+        m_positionY[i] = position.y + (m_random.nextFloat() * 2.0f - 1.0f) * spread;
+        m_positionZ[i] = position.z + (m_random.nextFloat() * 2.0f - 1.0f) * spread;
+        m_velocityX[i] = (m_random.nextFloat() * 2.0f - 1.0f) * 0.5f * velocityScale;
+        m_velocityY[i] = m_random.nextFloat() * velocityScale;
+        m_velocityZ[i] = (m_random.nextFloat() * 2.0f - 1.0f) * 0.5f * velocityScale;
+        m_life[i] = m_settings.lifetime;
+    }
+    m_size += count;
+}
+
+void SPHFluid::update(float deltaTime, const WaterSurface& water, float waterTime, JobSystem* jobSystem, size_t grainSize)
+{
+    const int numSubsteps = std::max(static_cast<int>(std::ceil(deltaTime / m_settings.maxTimeStep)), 1);
+    const float substepTime = deltaTime / static_cast<float>(numSubsteps);
+    const auto forEachRange = [&](auto&& function) {
+        if (jobSystem)
+            jobSystem->parallelFor(0, m_size, grainSize, function);
+        else
+            function(size_t(0), m_size);
+    };
+
+    for (int substep = 0; substep < numSubsteps && m_size > 0; ++substep) {
+        sortIntoCells(jobSystem);
+        std::atomic<size_t> numNeighbours { 0 };
+        forEachRange([&](size_t begin, size_t end) { numNeighbours += computeDensities(begin, end); });
+        m_averageNeighbours = static_cast<float>(numNeighbours) / static_cast<float>(m_size);
+        forEachRange([&](size_t begin, size_t end) { computeAccelerations(begin, end); });
+        std::atomic<size_t> numDied { 0 };
+        const float time = waterTime + static_cast<float>(substep) * substepTime;
+        forEachRange([&](size_t begin, size_t end) {
+            numDied += integrate(begin, end, substepTime, water, time);
+        });
+        if (numDied > 0)
+            removeDead();
+    }
+}
+
+void SPHFluid::clear()
+{
+    m_size = 0;
+}
+
+float SPHFluid::averageNeighbours() const
+{
+    return m_averageNeighbours;
+}
+
+void SPHFluid::writeVertices(ParticleVertices& vertices) const
+{
+    const auto size = static_cast<std::ptrdiff_t>(m_size);
+    vertices.positionX.assign(m_positionX.begin(), m_positionX.begin() + size);
+    vertices.positionY.assign(m_positionY.begin(), m_positionY.begin() + size);
+    vertices.positionZ.assign(m_positionZ.begin(), m_positionZ.begin() + size);
+    vertices.life.assign(m_life.begin(), m_life.begin() + size);
+}
+
+void SPHFluid::sortIntoCells(JobSystem* jobSystem)
+{
+    m_hash.build(std::span(m_positionX).first(m_size), std::span(m_positionY).first(m_size), std::span(m_positionZ).first(m_size), jobSystem);
+
+    // Move the particles into bucket order, so that every bucket is a contiguous range of particles.
+    const std::span<const uint32_t> order = m_hash.order();
+    m_reordered.resize(m_size);
+    for (std::vector<float>* attribute : { &m_positionX, &m_positionY, &m_positionZ, &m_velocityX, &m_velocityY, &m_velocityZ, &m_life }) {
+        const float* source = attribute->data();
+        const auto gather = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                m_reordered[i] = source[order[i]];
+        };
+        if (jobSystem)
+            jobSystem->parallelFor(0, m_size, 65536, gather);
+        else
+            gather(0, m_size);
+        std::copy_n(m_reordered.data(), m_size, attribute->data());
+    }
+}
+
+template <typename F>
+void SPHFluid::forEachParticle(size_t begin, size_t end, F&& function) const
+{
+    glm::ivec3 cachedCell { 0 };
+    SpatialHash::NeighbourRanges ranges {};
+    bool hasCachedCell = false;
+    for (size_t i = begin; i < end; ++i) {
+        const glm::ivec3 cell = m_hash.cell(glm::vec3(m_positionX[i], m_positionY[i], m_positionZ[i]));
+        if (!hasCachedCell || cell != cachedCell) {
+            ranges = m_hash.neighbourRanges(cell);
+            cachedCell = cell;
+            hasCachedCell = true;
+        }
+        function(i, ranges);
+    }
+}
+
+size_t SPHFluid::computeDensities(size_t begin, size_t end)
+{
+    const float h2 = m_settings.smoothingRadius * m_settings.smoothingRadius;
+    size_t numNeighbours = 0;
+    forEachParticle(begin, end, [&](size_t i, const SpatialHash::NeighbourRanges& ranges) {
+        const float x = m_positionX[i], y = m_positionY[i], z = m_positionZ[i];
+        float sum = 0.0f;
+        for (size_t range = 0; range < ranges.size; ++range) {
+            for (uint32_t j = ranges.begins[range]; j < ranges.ends[range]; ++j) {
+                const float dx = x - m_positionX[j], dy = y - m_positionY[j], dz = z - m_positionZ[j];
+                const float r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 < h2) {
+                    const float w = h2 - r2;
+                    sum += w * w * w;
+                    numNeighbours++;
+                }
+            }
+        }
+        // Poly6 kernel.
+        m_density[i] = m_particleMass * m_poly6Scale * sum;
+        m_pressure[i] = std::max(m_settings.stiffness * (m_density[i] - m_settings.restDensity), 0.0f);
+    });
+    return numNeighbours;
+}
+
+void SPHFluid::computeAccelerations(size_t begin, size_t end)
+{
+    const float h = m_settings.smoothingRadius;
+    const float h2 = h * h;
+    forEachParticle(begin, end, [&](size_t i, const SpatialHash::NeighbourRanges& ranges) {
+        const float x = m_positionX[i], y = m_positionY[i], z = m_positionZ[i];
+        const float vx = m_velocityX[i], vy = m_velocityY[i], vz = m_velocityZ[i];
+        const float pressure = m_pressure[i];
+        float ax = 0.0f, ay = 0.0f, az = 0.0f;
+        for (size_t range = 0; range < ranges.size; ++range) {
+            for (uint32_t j = ranges.begins[range]; j < ranges.ends[range]; ++j) {
+                const float dx = x - m_positionX[j], dy = y - m_positionY[j], dz = z - m_positionZ[j];
+                const float r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 >= h2 || j == i)
+                    continue;
+                const float r = std::sqrt(r2);
+                const float inverseDensity = 1.0f / m_density[j];
+                // Spiky kernel gradient for the (symmetrized) pressure; coincident particles have no direction.
+                if (r > 1e-6f) {
+                    const float q = h - r;
+                    const float scale = (pressure + m_pressure[j]) * 0.5f * inverseDensity * m_spikyGradientScale * q * q / r;
+                    ax += scale * dx;
+                    ay += scale * dy;
+                    az += scale * dz;
+                }
+                // Viscosity kernel Laplacian, which pulls the velocities of neighbours together.
+                const float viscosity = m_settings.viscosity * inverseDensity * m_viscosityLaplacianScale * (h - r);
+                ax += viscosity * (m_velocityX[j] - vx);
+                ay += viscosity * (m_velocityY[j] - vy);
+                az += viscosity * (m_velocityZ[j] - vz);
+            }
+        }
+        const float scale = m_particleMass / m_density[i];
+        m_accelerationX[i] = ax * scale;
+        m_accelerationY[i] = ay * scale - m_settings.gravity;
+        m_accelerationZ[i] = az * scale;
+    });
+}
+
+size_t SPHFluid::integrate(size_t begin, size_t end, float deltaTime, const WaterSurface& water, float waterTime)
+{
+    size_t numDied = 0;
+    for (size_t i = begin; i < end; ++i) {
+        m_velocityX[i] += m_accelerationX[i] * deltaTime;
+        m_velocityY[i] += m_accelerationY[i] * deltaTime;
+        m_velocityZ[i] += m_accelerationZ[i] * deltaTime;
+        m_positionX[i] += m_velocityX[i] * deltaTime;
+        m_positionY[i] += m_velocityY[i] * deltaTime;
+        m_positionZ[i] += m_velocityZ[i] * deltaTime;
+        m_life[i] -= deltaTime;
+        if (m_life[i] <= 0.0f)
+            numDied++;
+    }
+
+    const size_t count = end - begin;
+    water.evaluate(waterTime, std::span(m_positionX).subspan(begin, count), std::span(m_positionY).subspan(begin, count), std::span(m_positionZ).subspan(begin, count),
+        { .height = std::span(m_surfaceHeight).subspan(begin, count), .velocity = std::span(m_surfaceVelocity).subspan(begin, count) });
+    for (size_t i = begin; i < end; ++i) {
+        if (m_positionY[i] >= m_surfaceHeight[i])
+            continue;
+        // The waves are low, so the surface normal is taken to point straight up; the bounce is relative to the
+        // moving surface.
+        m_positionY[i] = m_surfaceHeight[i];
+        const float relativeVelocity = m_velocityY[i] - m_surfaceVelocity[i];
+        if (relativeVelocity < 0.0f)
+            m_velocityY[i] = m_surfaceVelocity[i] - relativeVelocity * m_settings.restitution;
+        m_velocityX[i] *= 1.0f - m_settings.friction;
+        m_velocityZ[i] *= 1.0f - m_settings.friction;
+    }
+    return numDied;
+}
+
+void SPHFluid::removeDead()
+{
+    size_t i = 0;
+    while (i < m_size) {
+        if (m_life[i] > 0.0f) {
+            ++i;
+            continue;
+        }
+        // Swap-remove: the moved particle is checked in the next iteration. The order is restored by the next sort.
+        const size_t last = --m_size;
+        m_positionX[i] = m_positionX[last];
+        m_positionY[i] = m_positionY[last];
+        m_positionZ[i] = m_positionZ[last];
+        m_velocityX[i] = m_velocityX[last];
+        m_velocityY[i] = m_velocityY[last];
+        m_velocityZ[i] = m_velocityZ[last];
+        m_life[i] = m_life[last];
+    }
+}
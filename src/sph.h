@@ -0,0 +1,96 @@
+#pragma once
+#include "particles.h"
+#include "water.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/spatial_hash.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct SPHSettings {
+    // Radius of the smoothing kernels; particles further apart do not interact. Also the cell size of the hash.
+    float smoothingRadius { 0.1f };
+    // Density of water at rest (kg/m^3). The particle mass is chosen so that particles at half the smoothing radius
+    // apart have this density.
+    float restDensity { 1000.0f };
+    // Pressure per unit of density above the rest density (m^2/s^2); only compression is resisted, so that the
+    // splash breaks up instead of clumping.
+    float stiffness { 10.0f };
+    float viscosity { 0.5f };
+    float gravity { ParticleSystem::GRAVITY };
+    float lifetime { ParticleSystem::LIFETIME };
+    // Fraction of the normal velocity that is kept when bouncing off the water surface and of the tangential
+    // velocity that is lost.
+    float restitution { 0.2f };
+    float friction { 0.1f };
+    // Longer steps are split into substeps of at most this length to keep the pressure forces stable.
+    float maxTimeStep { 1.0f / 120.0f };
+};
+
+// Smoothed particle hydrodynamics (Müller et al., "Particle-Based Fluid Simulation for Interactive Applications") for
+// the water that the snake splashes up. Every substep the particles are counting sorted into a SpatialHash and their
+// structure of arrays is reordered to match, so each neighbour query reads the particles of a few contiguous cell
+// ranges. The density, force and integration passes are split over the job system, and the particles collide with the
+// water surface, which is evaluated for a whole range of particles at once.
+class SPHFluid {
+public:
+    explicit SPHFluid(size_t capacity, const SPHSettings& settings = {}, uint64_t seed = 1);
+
+    [[nodiscard]] size_t capacity() const;
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] const SPHSettings& settings() const;
+
+    // Spawn count particles with the random upward velocity of ParticleSystem::emit() times velocityScale, uniformly
+    // spread over a cube with a half size of spread around position. Particles that do not fit are dropped.
+    void emit(const glm::vec3& position, size_t count = 1, float spread = 0.0f, float velocityScale = 1.0f);
+    // Simulate deltaTime seconds, starting at waterTime of the water surface, and remove the particles that died.
+    void update(float deltaTime, const WaterSurface& water, float waterTime, JobSystem* jobSystem = nullptr, size_t grainSize = 2048);
+    // Remove all particles.
+    void clear();
+
+    // Average number of neighbours within the smoothing radius (including the particle itself) in the last substep.
+    [[nodiscard]] float averageNeighbours() const;
+
+    // Copy the live particles into vertices, reusing its memory.
+    void writeVertices(ParticleVertices& vertices) const;
+
+private:
+    void sortIntoCells(JobSystem* jobSystem);
+    // Returns the number of neighbours of the particles.
+    size_t computeDensities(size_t begin, size_t end);
+    void computeAccelerations(size_t begin, size_t end);
+    // Returns the number of particles that died.
+    size_t integrate(size_t begin, size_t end, float deltaTime, const WaterSurface& water, float waterTime);
+    void removeDead();
+
+    // Call function(i, ranges) for the particles [begin, end) with the ranges of the cells around them, which hold
+    // their neighbour candidates. Consecutive particles of the same cell share the lookup.
+    template <typename F>
+    void forEachParticle(size_t begin, size_t end, F&& function) const;
+
+private:
+    SPHSettings m_settings;
+    float m_particleMass;
+    // Kernel constants, see computeDensities() and computeAccelerations().
+    float m_poly6Scale, m_spikyGradientScale, m_viscosityLaplacianScale;
+
+    std::vector<float> m_positionX, m_positionY, m_positionZ;
+    std::vector<float> m_velocityX, m_velocityY, m_velocityZ;
+    std::vector<float> m_life;
+    std::vector<float> m_density, m_pressure;
+    std::vector<float> m_accelerationX, m_accelerationY, m_accelerationZ;
+    // Height and vertical velocity of the water surface below the particles.
+    std::vector<float> m_surfaceHeight, m_surfaceVelocity;
+    size_t m_size { 0 };
+
+    SpatialHash m_hash;
+    // Scratch array for reordering the particle attributes.
+    std::vector<float> m_reordered;
+    float m_averageNeighbours { 0.0f };
+    Xoshiro128Plus m_random;
+};
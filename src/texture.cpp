@@ -8,11 +8,14 @@ DISABLE_WARNINGS_POP()
 #include <iostream>
 
 Texture::Texture(std::filesystem::path filePath)
-{
     // Load image from disk to CPU memory.
     // Image class is defined in <framework/image.h>
-    Image cpuTexture { filePath };
+    : Texture(Image { filePath })
+{
+}
 
+Texture::Texture(const Image& cpuTexture)
+{
     // Create a texture on the GPU and bind it for parameter setting
     glGenTextures(1, &m_texture);
     glBindTexture(GL_TEXTURE_2D, m_texture);
@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer for a single writer and a single reader thread. The writer fills back() and publishes it;
+// the reader picks up the most recently published value with update() and reads it through front(). Neither side
+// ever waits for the other, and values that were published while the reader was busy are skipped.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer: the slot that is being written.
+    T& back() { return m_slots[m_back]; }
+    // Writer: make back() the latest value and continue with a different slot.
+    void publish()
+    {
+        m_back = m_middle.exchange(uint8_t(m_back | FRESH_BIT), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader: switch to the latest published value; returns false if nothing new was published since the last call.
+    bool update()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH_BIT))
+            return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    // Reader: the value that is being read.
+    const T& front() const { return m_slots[m_front]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    std::array<T, 3> m_slots;
+    uint8_t m_back { 0 };
+    std::atomic<uint8_t> m_middle { 1 };
+    uint8_t m_front { 2 };
+};
@@ -0,0 +1,275 @@
+#include "water.h"
+#include "ocean.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/matrix.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WATER_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define WATER_SSE 1
+#endif
+
+// sinf()/cosf() of Cephes: the argument is reduced to [-pi/4, pi/4] by subtracting a multiple of pi/2 (in three parts, so
+// that the product with the multiple is exact), and the quadrant then picks and negates the two polynomials.
+static constexpr float TWO_OVER_PI = 0.636619772f;
+static constexpr float HALF_PI_1 = 1.5703125f;
+static constexpr float HALF_PI_2 = 4.837512969970703125e-4f;
+static constexpr float HALF_PI_3 = 7.54978995489188216e-8f;
+static constexpr float SIN_1 = -1.6666654611e-1f, SIN_2 = 8.3321608736e-3f, SIN_3 = -1.9515295891e-4f;
+static constexpr float COS_1 = 4.166664568298827e-2f, COS_2 = -1.388731625493765e-3f, COS_3 = 2.443315711809948e-5f;
+
+namespace {
+// Lane types of WaterSurface::evaluateLanes(), which is written once for all of them.
+struct Lanes1 {
+    static constexpr size_t WIDTH = 1;
+    float v;
+
+    explicit Lanes1(float value)
+        : v(value)
+    {
+    }
+    static Lanes1 load(const float* p) { return Lanes1(*p); }
+    void store(float* p) const { *p = v; }
+    friend Lanes1 operator+(Lanes1 a, Lanes1 b) { return Lanes1(a.v + b.v); }
+    friend Lanes1 operator-(Lanes1 a, Lanes1 b) { return Lanes1(a.v - b.v); }
+    friend Lanes1 operator*(Lanes1 a, Lanes1 b) { return Lanes1(a.v * b.v); }
+    friend Lanes1 operator/(Lanes1 a, Lanes1 b) { return Lanes1(a.v / b.v); }
+    friend Lanes1 sqrt(Lanes1 a) { return Lanes1(std::sqrt(a.v)); }
+    friend void sinCos(Lanes1 x, Lanes1& sine, Lanes1& cosine)
+    {
+        const float multiple = std::nearbyint(x.v * TWO_OVER_PI);
+        const int quadrant = static_cast<int>(multiple);
+        const float r = ((x.v - multiple * HALF_PI_1) - multiple * HALF_PI_2) - multiple * HALF_PI_3;
+        const float r2 = r * r;
+        const float s = r + r * r2 * (SIN_1 + r2 * (SIN_2 + r2 * SIN_3));
+        const float c = 1.0f - 0.5f * r2 + r2 * r2 * (COS_1 + r2 * (COS_2 + r2 * COS_3));
+        sine.v = (quadrant & 1) ? c : s;
+        cosine.v = (quadrant & 1) ? s : c;
+        if (quadrant & 2)
+            sine.v = -sine.v;
+        if ((quadrant + 1) & 2)
+            cosine.v = -cosine.v;
+    }
+};
+
+#if defined(WATER_SSE)
+struct Lanes4 {
+    static constexpr size_t WIDTH = 4;
+    __m128 v;
+
+    explicit Lanes4(float value)
+        : v(_mm_set1_ps(value))
+    {
+    }
+    explicit Lanes4(__m128 value)
+        : v(value)
+    {
+    }
+    static Lanes4 load(const float* p) { return Lanes4(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    friend Lanes4 operator+(Lanes4 a, Lanes4 b) { return Lanes4(_mm_add_ps(a.v, b.v)); }
+    friend Lanes4 operator-(Lanes4 a, Lanes4 b) { return Lanes4(_mm_sub_ps(a.v, b.v)); }
+    friend Lanes4 operator*(Lanes4 a, Lanes4 b) { return Lanes4(_mm_mul_ps(a.v, b.v)); }
+    friend Lanes4 operator/(Lanes4 a, Lanes4 b) { return Lanes4(_mm_div_ps(a.v, b.v)); }
+    friend Lanes4 sqrt(Lanes4 a) { return Lanes4(_mm_sqrt_ps(a.v)); }
+    friend void sinCos(Lanes4 x, Lanes4& sine, Lanes4& cosine)
+    {
+        const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x.v, _mm_set1_ps(TWO_OVER_PI)));
+        const __m128 multiple = _mm_cvtepi32_ps(quadrant);
+        __m128 r = _mm_sub_ps(x.v, _mm_mul_ps(multiple, _mm_set1_ps(HALF_PI_1)));
+        r = _mm_sub_ps(r, _mm_mul_ps(multiple, _mm_set1_ps(HALF_PI_2)));
+        r = _mm_sub_ps(r, _mm_mul_ps(multiple, _mm_set1_ps(HALF_PI_3)));
+        const __m128 r2 = _mm_mul_ps(r, r);
+        __m128 s = _mm_add_ps(_mm_set1_ps(SIN_2), _mm_mul_ps(r2, _mm_set1_ps(SIN_3)));
+        s = _mm_add_ps(_mm_set1_ps(SIN_1), _mm_mul_ps(r2, s));
+        s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+        __m128 c = _mm_add_ps(_mm_set1_ps(COS_2), _mm_mul_ps(r2, _mm_set1_ps(COS_3)));
+        c = _mm_add_ps(_mm_set1_ps(COS_1), _mm_mul_ps(r2, c));
+        c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), c));
+
+        const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+        const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        const __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+        const __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+        sine.v = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sineSign);
+        cosine.v = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cosineSign);
+    }
+};
+#endif
+
+#if defined(WATER_AVX2)
+struct Lanes8 {
+    static constexpr size_t WIDTH = 8;
+    __m256 v;
+
+    explicit Lanes8(float value)
+        : v(_mm256_set1_ps(value))
+    {
+    }
+    explicit Lanes8(__m256 value)
+        : v(value)
+    {
+    }
+    static Lanes8 load(const float* p) { return Lanes8(_mm256_loadu_ps(p)); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    friend Lanes8 operator+(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_add_ps(a.v, b.v)); }
+    friend Lanes8 operator-(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_sub_ps(a.v, b.v)); }
+    friend Lanes8 operator*(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_mul_ps(a.v, b.v)); }
+    friend Lanes8 operator/(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_div_ps(a.v, b.v)); }
+    friend Lanes8 sqrt(Lanes8 a) { return Lanes8(_mm256_sqrt_ps(a.v)); }
+    friend void sinCos(Lanes8 x, Lanes8& sine, Lanes8& cosine)
+    {
+        const __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x.v, _mm256_set1_ps(TWO_OVER_PI)));
+        const __m256 multiple = _mm256_cvtepi32_ps(quadrant);
+        __m256 r = _mm256_sub_ps(x.v, _mm256_mul_ps(multiple, _mm256_set1_ps(HALF_PI_1)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(multiple, _mm256_set1_ps(HALF_PI_2)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(multiple, _mm256_set1_ps(HALF_PI_3)));
+        const __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 s = _mm256_add_ps(_mm256_set1_ps(SIN_2), _mm256_mul_ps(r2, _mm256_set1_ps(SIN_3)));
+        s = _mm256_add_ps(_mm256_set1_ps(SIN_1), _mm256_mul_ps(r2, s));
+        s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+        __m256 c = _mm256_add_ps(_mm256_set1_ps(COS_2), _mm256_mul_ps(r2, _mm256_set1_ps(COS_3)));
+        c = _mm256_add_ps(_mm256_set1_ps(COS_1), _mm256_mul_ps(r2, c));
+        c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), c));
+
+        const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+        const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+        const __m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+        const __m256 cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+        sine.v = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sineSign);
+        cosine.v = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosineSign);
+    }
+};
+#endif
+}
+
+WaterSurface::WaterSurface(const glm::mat4& modelMatrix, const WaveParameters& waves)
+{
+    computeTables(modelMatrix, waves);
+}
+
+void WaterSurface::update(const glm::mat4& modelMatrix, const WaveParameters& waves)
+{
+    if (modelMatrix != m_modelMatrix || waves != m_waves)
+        computeTables(modelMatrix, waves);
+}
+
+void WaterSurface::setOcean(const Ocean* ocean)
+{
+    m_ocean = ocean;
+}
+
+void WaterSurface::computeTables(const glm::mat4& modelMatrix, const WaveParameters& waves)
+{
+    m_modelMatrix = modelMatrix;
+    m_inverseModelMatrix = glm::inverse(modelMatrix);
+    m_normalMatrix = glm::inverse(glm::transpose(glm::mat3(modelMatrix)));
+    m_waves = waves;
+
+    // Same waves as in the water shader (including its value of pi).
+    m_numWaves = std::clamp(waves.numWaves, 0, MAX_WAVES);
+    float angle = 0.1f;
+    float amplitude = waves.amplitude;
+    float frequency = waves.omega;
+    for (int i = 0; i < m_numWaves; ++i) {
+        m_waveX[size_t(i)] = std::cos(angle) * frequency;
+        m_waveZ[size_t(i)] = std::sin(angle) * frequency;
+        m_amplitude[size_t(i)] = amplitude;
+        angle += 0.73f * 3.14159f;
+        amplitude *= 0.75f;
+        frequency *= 1.5f;
+    }
+}
+
+template <typename Lanes>
+size_t WaterSurface::evaluateLanes(size_t begin, size_t end, float time, const float* x, const float* y, const float* z, const WaterSurfaceSamples& samples) const
+{
+    const glm::mat4& inverse = m_inverseModelMatrix;
+    const glm::mat4& model = m_modelMatrix;
+    const glm::mat3& normal = m_normalMatrix;
+    const Lanes phase(time * m_waves.phi);
+    const Lanes zero(0.0f);
+
+    size_t i = begin;
+    for (; i + Lanes::WIDTH <= end; i += Lanes::WIDTH) {
+        const Lanes pointX = Lanes::load(x + i), pointY = Lanes::load(y + i), pointZ = Lanes::load(z + i);
+        const Lanes modelX = pointX * Lanes(inverse[0][0]) + pointY * Lanes(inverse[1][0]) + pointZ * Lanes(inverse[2][0]) + Lanes(inverse[3][0]);
+        const Lanes modelZ = pointX * Lanes(inverse[0][2]) + pointY * Lanes(inverse[1][2]) + pointZ * Lanes(inverse[2][2]) + Lanes(inverse[3][2]);
+
+        // Height, its model space x/z derivatives and the sum of the amplitude times the cosine for its time derivative.
+        Lanes height = zero, slopeX = zero, slopeZ = zero, rate = zero;
+        for (size_t wave = 0; wave < size_t(m_numWaves); ++wave) {
+            const Lanes waveX(m_waveX[wave]), waveZ(m_waveZ[wave]), amplitude(m_amplitude[wave]);
+            Lanes sine = zero, cosine = zero;
+            sinCos(modelX * waveX + modelZ * waveZ + phase, sine, cosine);
+            height = height + amplitude * sine;
+            const Lanes slope = amplitude * cosine;
+            slopeX = slopeX + slope * waveX;
+            slopeZ = slopeZ + slope * waveZ;
+            rate = rate + slope;
+        }
+
+        if (!samples.height.empty())
+            (modelX * Lanes(model[0][1]) + height * Lanes(model[1][1]) + modelZ * Lanes(model[2][1]) + Lanes(model[3][1])).store(samples.height.data() + i);
+        if (!samples.normalX.empty()) {
+            // The model space normal is (-slopeX, 1, -slopeZ).
+            const Lanes normalX = Lanes(normal[1][0]) - slopeX * Lanes(normal[0][0]) - slopeZ * Lanes(normal[2][0]);
+            const Lanes normalY = Lanes(normal[1][1]) - slopeX * Lanes(normal[0][1]) - slopeZ * Lanes(normal[2][1]);
+            const Lanes normalZ = Lanes(normal[1][2]) - slopeX * Lanes(normal[0][2]) - slopeZ * Lanes(normal[2][2]);
+            const Lanes length = sqrt(normalX * normalX + normalY * normalY + normalZ * normalZ);
+            (normalX / length).store(samples.normalX.data() + i);
+            (normalY / length).store(samples.normalY.data() + i);
+            (normalZ / length).store(samples.normalZ.data() + i);
+        }
+        if (!samples.velocity.empty())
+            (rate * Lanes(m_waves.phi * model[1][1])).store(samples.velocity.data() + i);
+    }
+    return i;
+}
+
+void WaterSurface::evaluate(float time, std::span<const float> x, std::span<const float> y, std::span<const float> z, const WaterSurfaceSamples& samples) const
+{
+    const size_t numPoints = x.size();
+    assert(y.size() == numPoints && z.size() == numPoints);
+    assert(samples.height.empty() || samples.height.size() == numPoints);
+    assert(samples.normalX.empty() || (samples.normalX.size() == numPoints && samples.normalY.size() == numPoints && samples.normalZ.size() == numPoints));
+    assert(samples.velocity.empty() || samples.velocity.size() == numPoints);
+
+    if (m_ocean) {
+        m_ocean->sample(x, z, samples);
+        if (samples.height.empty())
+            return;
+        // Add the height of the water plane below the points.
+        const glm::mat4& inverse = m_inverseModelMatrix;
+        const glm::mat4& model = m_modelMatrix;
+        for (size_t i = 0; i < numPoints; ++i) {
+            const float modelX = inverse[0][0] * x[i] + inverse[1][0] * y[i] + inverse[2][0] * z[i] + inverse[3][0];
+            const float modelZ = inverse[0][2] * x[i] + inverse[1][2] * y[i] + inverse[2][2] * z[i] + inverse[3][2];
+            samples.height[i] += model[0][1] * modelX + model[2][1] * modelZ + model[3][1];
+        }
+        return;
+    }
+
+    size_t i = 0;
+#if defined(WATER_AVX2)
+    i = evaluateLanes<Lanes8>(i, numPoints, time, x.data(), y.data(), z.data(), samples);
+#endif
+#if defined(WATER_SSE)
+    i = evaluateLanes<Lanes4>(i, numPoints, time, x.data(), y.data(), z.data(), samples);
+#endif
+    evaluateLanes<Lanes1>(i, numPoints, time, x.data(), y.data(), z.data(), samples);
+}
+
+float WaterSurface::height(const glm::vec3& worldPosition, float time) const
+{
+    float result = 0.0f;
+    evaluate(time, std::span(&worldPosition.x, 1), std::span(&worldPosition.y, 1), std::span(&worldPosition.z, 1), { .height = std::span(&result, 1) });
+    return result;
+}
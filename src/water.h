@@ -0,0 +1,72 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <span>
+
+class Ocean;
+
+// Sum-of-sines wave parameters of the water surface (uniforms of water_vert.glsl).
+struct WaveParameters {
+    int numWaves { 10 };
+    float omega { 3.0f };
+    float phi { 1.0f };
+    float amplitude { 0.008f };
+
+    bool operator==(const WaveParameters&) const = default;
+};
+
+// Outputs of WaterSurface::evaluate(), one element per query point and all in world space. Empty spans are skipped.
+struct WaterSurfaceSamples {
+    std::span<float> height;
+    std::span<float> normalX, normalY, normalZ;
+    // Vertical velocity of the surface.
+    std::span<float> velocity;
+};
+
+// The water surface of water_vert.glsl for the CPU side of the simulation. The inverse transform and the per-wave
+// direction, frequency and amplitude tables are computed once in update(), and evaluate() sums the waves for whole
+// arrays of query points at once, four or eight points per instruction with a polynomial sine and cosine. When an
+// Ocean is set, its heightfield (the one that the water shader draws in that mode) is sampled instead.
+class WaterSurface {
+public:
+    // More waves than this are ignored (the user interface allows at most 10).
+    static constexpr int MAX_WAVES = 10;
+
+    explicit WaterSurface(const glm::mat4& modelMatrix = glm::mat4(1.0f), const WaveParameters& waves = {});
+
+    // Change the transform of the water plane and its waves; does nothing if neither changed.
+    void update(const glm::mat4& modelMatrix, const WaveParameters& waves);
+    // Sample the heightfield of ocean (which must stay alive while it is set) on top of the water plane instead of
+    // the sum of sines, or go back to the sum of sines with nullptr.
+    void setOcean(const Ocean* ocean);
+
+    // Evaluate the surface at time below the world space query points; height is the world space y of the surface at
+    // the x/z of the point (which is moved vertically in water model space). With an Ocean, the heightfield of its
+    // last update is sampled regardless of time.
+    void evaluate(float time, std::span<const float> x, std::span<const float> y, std::span<const float> z, const WaterSurfaceSamples& samples) const;
+    // Height of a single point; use evaluate() for many.
+    [[nodiscard]] float height(const glm::vec3& worldPosition, float time) const;
+
+private:
+    void computeTables(const glm::mat4& modelMatrix, const WaveParameters& waves);
+    // Evaluate the points [begin, end) in groups of Lanes::WIDTH; returns the first point that is left.
+    template <typename Lanes>
+    size_t evaluateLanes(size_t begin, size_t end, float time, const float* x, const float* y, const float* z, const WaterSurfaceSamples& samples) const;
+
+private:
+    glm::mat4 m_modelMatrix;
+    glm::mat4 m_inverseModelMatrix;
+    glm::mat3 m_normalMatrix;
+    WaveParameters m_waves;
+
+    // Per wave: the wave vector (direction times frequency) in model space and the amplitude.
+    int m_numWaves { 0 };
+    std::array<float, MAX_WAVES> m_waveX {}, m_waveZ {}, m_amplitude {};
+    const Ocean* m_ocean { nullptr };
+};